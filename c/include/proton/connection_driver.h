@@ -180,6 +180,18 @@ PN_EXTERN bool pn_connection_driver_read_closed(pn_connection_driver_t *);
  */
 PN_EXTERN void pn_connection_driver_write_done(pn_connection_driver_t *, size_t n);
 
+/**
+ * **Unsettled API** - Get the write buffer as up to n segments to be
+ * written in order, for example with writev(), so that large message
+ * payloads need not be copied. See pn_transport_segments().
+ *
+ * Call pn_connection_driver_write_done() with the number of bytes
+ * written from the start of the first segment.
+ *
+ * @return the number of segments filled, 0 means there is nothing to write.
+ */
+PN_EXTERN size_t pn_connection_driver_write_segments(pn_connection_driver_t *, pn_bytes_t *segments, size_t n);
+
 /**
  * Close the write side. Call when IO can no longer be written to.
  */
@@ -167,6 +167,31 @@ PN_EXTERN bool pn_delivery_settled(pn_delivery_t *delivery);
  */
 PN_EXTERN size_t pn_delivery_pending(pn_delivery_t *delivery);
 
+/**
+ * **Unsettled API** - Get a read-only view of the pending message data for a
+ * delivery.
+ *
+ * This gives access to the same data that pn_link_recv() would copy out,
+ * without copying it. The view is contiguous and its size is
+ * pn_delivery_pending(). It is valid until the delivery data is next
+ * modified, i.e. by pn_link_recv(), pn_link_advance(), pn_delivery_settle() or
+ * further input being given to the transport.
+ *
+ * The view is onto the delivery's own copy of the data, or with
+ * pn_link_set_input_view() onto the transport's input buffer.
+ *
+ * Data in the view is not consumed, and still counts towards
+ * pn_session_incoming_bytes(); use pn_link_advance() or
+ * pn_delivery_settle() to discard it once a complete message has been
+ * decoded.
+ *
+ * An aborted delivery has an empty view.
+ *
+ * @param[in] delivery a delivery object
+ * @return the pending message data
+ */
+PN_EXTERN pn_bytes_t pn_delivery_bytes_view(pn_delivery_t *delivery);
+
 /**
  * Check if a delivery only has partial message data.
  *
@@ -677,6 +677,36 @@ PN_EXTERN void pn_link_set_max_message_size(pn_link_t *link, uint64_t size);
  */
 PN_EXTERN uint64_t pn_link_remote_max_message_size(pn_link_t *link);
 
+/**
+ * **Unsettled API** - Let deliveries on a receiver be read in place from
+ * the transport's input buffer.
+ *
+ * The data of a delivery that arrives in a single transfer frame, without
+ * any security layer decoding it, is then not copied into the delivery.
+ * pn_delivery_bytes_view() points into the input buffer instead, until
+ * pn_link_advance() or pn_delivery_settle(). While such a delivery is
+ * pending the transport doesn't reuse or move that part of its input
+ * buffer. When it needs the space, in pn_transport_capacity(), it copies
+ * the data into the delivery first, so an earlier view is no longer
+ * valid.
+ *
+ * This suits an application that decodes each delivery as it arrives and
+ * then advances the link. It is off by default.
+ *
+ * @param[in] receiver a receiving link object
+ * @param[in] view true to read deliveries in place
+ */
+PN_EXTERN void pn_link_set_input_view(pn_link_t *receiver, bool view);
+
+/**
+ * **Unsettled API** - Check if deliveries on a receiver are read in place.
+ * See pn_link_set_input_view().
+ *
+ * @param[in] receiver a receiving link object
+ * @return true if deliveries are read in place from the input buffer
+ */
+PN_EXTERN bool pn_link_get_input_view(pn_link_t *receiver);
+
 /**
  * @}
  */
@@ -722,6 +722,26 @@ PN_EXTERN pn_data_t *pn_message_body(pn_message_t *msg);
  */
 PN_EXTERN int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size);
 
+/**
+ * **Unsettled API**: Decode message content lazily.
+ *
+ * Like pn_message_decode(), but the bytes are copied into the message
+ * and only indexed by section. Each section (header, delivery
+ * annotations, message annotations, properties, application properties
+ * and body) is decoded the first time one of its fields is accessed.
+ * Sections that are never accessed are copied as they are when the
+ * message is encoded again.
+ *
+ * Errors in a section are only found when it is decoded, and are then
+ * reported by pn_message_error().
+ *
+ * @param[in] msg a message object
+ * @param[in] bytes the start of the encoded AMQP data
+ * @param[in] size the size of the encoded AMQP data
+ * @return zero on success or an error code on failure
+ */
+PN_EXTERN int pn_message_decode_lazy(pn_message_t *msg, const char *bytes, size_t size);
+
 /**
  * Encode a message as AMQP formatted binary data.
  *
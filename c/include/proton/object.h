@@ -223,6 +223,16 @@ PN_EXTERN int pn_object_refcount(void *object);
 PN_EXTERN void pn_object_decref(void *object);
 PN_EXTERN void pn_object_free(void *object);
 
+/* Objects created with pn_object_new() (the default newinst for PN_CLASS
+   and PN_CLASSDEF classes) come from per-thread caches of freed objects.
+   A class can supply its own newinst and free to allocate some other way.
+
+   A thread's cache is released when the thread exits;
+   pn_object_cache_flush() releases the objects the calling thread has
+   cached before then.
+*/
+PN_EXTERN void pn_object_cache_flush(void);
+
 PN_EXTERN void *pn_incref(void *object);
 PN_EXTERN int pn_decref(void *object);
 PN_EXTERN int pn_refcount(void *object);
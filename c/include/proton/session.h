@@ -216,11 +216,40 @@ PN_EXTERN size_t pn_session_get_incoming_capacity(pn_session_t *session);
  * max frame size. As such, capacity and max frame size should be chosen so
  * as to ensure the frame window isn't unduly small and limiting performance.
  *
+ * The window is refreshed before it is used up, once what is left of it
+ * falls to the low water mark, see ::pn_session_set_incoming_low_water().
+ * Changing the capacity of an open session takes effect at the next refresh.
+ *
  * @param[in] session the session object
  * @param[in] capacity the incoming capacity for the session in bytes
  */
 PN_EXTERN void pn_session_set_incoming_capacity(pn_session_t *session, size_t capacity);
 
+/**
+ * Get the incoming low water mark of the session measured in bytes.
+ *
+ * @param[in] session the session object
+ * @return the low water mark in bytes, 0 for the default of half the
+ * incoming capacity
+ */
+PN_EXTERN size_t pn_session_get_incoming_low_water(pn_session_t *session);
+
+/**
+ * Set the incoming low water mark for a session object.
+ *
+ * When the incoming capacity is set, the session refreshes the incoming
+ * window it grants the peer once what is left of the window, in bytes of
+ * max frame size, falls to the low water mark and the application has
+ * consumed enough buffered data to raise it back above the mark. A higher
+ * mark keeps more of the window in flight while refreshing more often.
+ * The window is always refreshed when it is exhausted.
+ *
+ * @param[in] session the session object
+ * @param[in] low_water the low water mark in bytes, 0 for the default of
+ * half the incoming capacity
+ */
+PN_EXTERN void pn_session_set_incoming_low_water(pn_session_t *session, size_t low_water);
+
 /**
  * Get the outgoing window for a session object.
  *
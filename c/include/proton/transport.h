@@ -457,6 +457,57 @@ PN_EXTERN pn_millis_t pn_transport_get_idle_timeout(pn_transport_t *transport);
  */
 PN_EXTERN void pn_transport_set_idle_timeout(pn_transport_t *transport, pn_millis_t timeout);
 
+/**
+ * Get the maximum number of separate delivery-id ranges a session collects
+ * before it sends their dispositions.
+ *
+ * @param[in] transport a transport object
+ * @return the maximum number of pending disposition ranges per session
+ */
+PN_EXTERN size_t pn_transport_get_max_disposition_ranges(pn_transport_t *transport);
+
+/**
+ * Set the maximum number of separate delivery-id ranges a session collects
+ * before it sends their dispositions.
+ *
+ * Settlements and outcomes that can be batched are collected per session
+ * in any order and sent as one DISPOSITION frame per range of consecutive
+ * delivery-ids. When a new range would exceed this limit the pending
+ * ranges are sent first. The default is 16.
+ *
+ * @param[in] transport a transport object
+ * @param[in] ranges the maximum number of pending disposition ranges per session
+ */
+PN_EXTERN void pn_transport_set_max_disposition_ranges(pn_transport_t *transport, size_t ranges);
+
+/**
+ * Get the disposition delay for a transport.
+ *
+ * @param[in] transport a transport object
+ * @return the disposition delay, zero if dispositions are not delayed
+ */
+PN_EXTERN pn_millis_t pn_transport_get_disposition_delay(pn_transport_t *transport);
+
+/**
+ * Set the disposition delay for a transport.
+ *
+ * By default dispositions collected while processing are sent when the
+ * transport next produces output. With a non-zero delay they are held
+ * back for up to about delay milliseconds so that more can be combined,
+ * counted from the time passed to the latest pn_transport_tick(), or
+ * from the next one if the transport has not been ticked yet.
+ * Dispositions are always sent when their session or connection closes.
+ *
+ * Held dispositions are only sent from pn_transport_tick(), so a
+ * transport that holds some must be ticked again by the deadline it
+ * returns, even if there is no other input. Tick the transport after it
+ * produces output to learn that deadline; the proactor does this.
+ *
+ * @param[in] transport a transport object
+ * @param[in] delay the disposition delay in milliseconds
+ */
+PN_EXTERN void pn_transport_set_disposition_delay(pn_transport_t *transport, pn_millis_t delay);
+
 /**
  * Get the idle timeout for a transport's remote peer.
  *
@@ -625,6 +676,28 @@ PN_EXTERN ssize_t pn_transport_peek(pn_transport_t *transport, char *dst, size_t
  */
 PN_EXTERN void pn_transport_pop(pn_transport_t *transport, size_t size);
 
+/**
+ * **Unsettled API** - Get the pending output as a list of segments to be
+ * written in order, for example with writev().
+ *
+ * Frame headers and performatives are in the transport's own buffer,
+ * while large transfer payloads are returned in place from the sender's
+ * buffer without being copied. This only applies when the output is not
+ * transformed by an SSL or SASL security layer, otherwise all the
+ * pending output is returned as one segment as by
+ * ::pn_transport_pending and ::pn_transport_head.
+ *
+ * Remove the written output with ::pn_transport_pop, which invalidates
+ * the segments.
+ *
+ * @param[in] transport the transport
+ * @param[out] segments filled with up to n segments of output
+ * @param[in] n the capacity of segments
+ * @return the number of segments filled, which may be fewer than there
+ * are pending if it is n, or an error code if < 0 as for ::pn_transport_pending
+ */
+PN_EXTERN ssize_t pn_transport_segments(pn_transport_t *transport, pn_bytes_t *segments, size_t n);
+
 /**
  * **Deprecated** - Use the @ref connection_driver API.
  *
@@ -26,34 +26,46 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <assert.h>
 
 #include "buffer.h"
 #include "util.h"
 
+// Buffers whose requested capacity fits are stored in the buffer itself
+// (e.g. delivery tags), they spill to the heap when they need to grow.
+#define PNI_BUFFER_INLINE (32)
+
 struct pn_buffer_t {
   size_t capacity;
   size_t start;
   size_t size;
-  char *bytes;
+  char *bytes;        // Points to inline_bytes until the buffer outgrows it
+  char inline_bytes[PNI_BUFFER_INLINE];
 };
 
+static inline bool pni_buffer_inline(pn_buffer_t *buf)
+{
+  return buf->bytes == buf->inline_bytes;
+}
+
 pn_buffer_t *pn_buffer(size_t capacity)
 {
   pn_buffer_t *buf = (pn_buffer_t *) malloc(sizeof(pn_buffer_t));
   if (buf != NULL) {
-    buf->capacity = capacity;
     buf->start = 0;
     buf->size = 0;
-    if (capacity > 0) {
+    if (capacity <= PNI_BUFFER_INLINE) {
+        buf->capacity = PNI_BUFFER_INLINE;
+        buf->bytes = buf->inline_bytes;
+    }
+    else {
+        buf->capacity = capacity;
         buf->bytes = (char *)malloc(capacity);
         if (buf->bytes == NULL) {
             free(buf);
             buf = NULL;
         }
     }
-    else {
-        buf->bytes = NULL;
-    }
   }
   return buf;
 }
@@ -61,7 +73,7 @@ pn_buffer_t *pn_buffer(size_t capacity)
 void pn_buffer_free(pn_buffer_t *buf)
 {
   if (buf) {
-    free(buf->bytes);
+    if (!pni_buffer_inline(buf)) free(buf->bytes);
     free(buf);
   }
 }
@@ -141,20 +153,28 @@ int pn_buffer_ensure(pn_buffer_t *buf, size_t size)
   size_t old_head = pni_buffer_head(buf);
   bool wrapped = pni_buffer_wrapped(buf);
 
-  while (pn_buffer_available(buf) < size) {
-    buf->capacity = 2*(buf->capacity ? buf->capacity : 16);
+  size_t capacity = old_capacity;
+  while (capacity - buf->size < size) {
+    capacity = 2*(capacity ? capacity : 16);
   }
 
-  if (buf->capacity != old_capacity) {
-    char* new_bytes = (char *)realloc(buf->bytes, buf->capacity);
-    if (new_bytes) {
-      buf->bytes = new_bytes;
+  if (capacity != old_capacity) {
+    char* new_bytes;
+    if (pni_buffer_inline(buf)) {
+      new_bytes = (char *)malloc(capacity);
+      if (new_bytes) memcpy(new_bytes, buf->inline_bytes, old_capacity);
+    } else {
+      new_bytes = (char *)realloc(buf->bytes, capacity);
+    }
+    // Leave the buffer as it was, so callers see no more space than it has
+    if (!new_bytes) return PN_OUT_OF_MEMORY;
 
-      if (wrapped) {
-          size_t n = old_capacity - old_head;
-          memmove(buf->bytes + buf->capacity - n, buf->bytes + old_head, n);
-          buf->start = buf->capacity - n;
-      }
+    buf->bytes = new_bytes;
+    buf->capacity = capacity;
+    if (wrapped) {
+        size_t n = old_capacity - old_head;
+        memmove(buf->bytes + buf->capacity - n, buf->bytes + old_head, n);
+        buf->start = buf->capacity - n;
     }
   }
 
@@ -202,6 +222,25 @@ int pn_buffer_prepend(pn_buffer_t *buf, const char *bytes, size_t size)
   return 0;
 }
 
+pn_rwbytes_t pn_buffer_reserve(pn_buffer_t *buf, size_t size)
+{
+  if (pn_buffer_ensure(buf, size)) {
+    pn_rwbytes_t r = {0, NULL};
+    return r;
+  }
+  if (pni_buffer_tail_space(buf) < size) {
+    pn_buffer_defrag(buf);
+  }
+  pn_rwbytes_t r = {pni_buffer_tail_space(buf), buf->bytes + pni_buffer_tail(buf)};
+  return r;
+}
+
+void pn_buffer_extend(pn_buffer_t *buf, size_t size)
+{
+  assert(size <= pni_buffer_tail_space(buf));
+  buf->size += size;
+}
+
 static size_t pni_buffer_index(pn_buffer_t *buf, size_t index)
 {
   size_t result = buf->start + index;
@@ -209,6 +248,14 @@ static size_t pni_buffer_index(pn_buffer_t *buf, size_t index)
   return result;
 }
 
+pn_bytes_t pn_buffer_chunk(pn_buffer_t *buf, size_t offset, size_t size)
+{
+  if (offset >= buf->size) return pn_bytes(0, NULL);
+  size_t start = pni_buffer_index(buf, offset);
+  size = pn_min(size, buf->size - offset);
+  return pn_bytes(pn_min(size, buf->capacity - start), buf->bytes + start);
+}
+
 size_t pn_buffer_get(pn_buffer_t *buf, size_t offset, size_t size, char *dst)
 {
   size = pn_min(size, buf->size);
@@ -40,7 +40,14 @@ size_t pn_buffer_available(pn_buffer_t *buf);
 int pn_buffer_ensure(pn_buffer_t *buf, size_t size);
 int pn_buffer_append(pn_buffer_t *buf, const char *bytes, size_t size);
 int pn_buffer_prepend(pn_buffer_t *buf, const char *bytes, size_t size);
+/* Contiguous space for at least size bytes after the buffer contents,
+   to be filled and then added with pn_buffer_extend() */
+pn_rwbytes_t pn_buffer_reserve(pn_buffer_t *buf, size_t size);
+void pn_buffer_extend(pn_buffer_t *buf, size_t size);
 size_t pn_buffer_get(pn_buffer_t *buf, size_t offset, size_t size, char *dst);
+/* The contiguous bytes at offset, at most size of them, left in place.
+   Fewer than size are returned where the contents wrap around. */
+pn_bytes_t pn_buffer_chunk(pn_buffer_t *buf, size_t offset, size_t size);
 int pn_buffer_trim(pn_buffer_t *buf, size_t left, size_t right);
 void pn_buffer_clear(pn_buffer_t *buf);
 int pn_buffer_defrag(pn_buffer_t *buf);
@@ -85,7 +85,12 @@ static void pn_data_finalize(void *object)
 {
   pn_data_t *data = (pn_data_t *) object;
   free(data->nodes);
-  pn_buffer_free(data->buf);
+  pni_data_chunk_t *chunk = data->chunks;
+  while (chunk) {
+    pni_data_chunk_t *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
   pn_free(data->str);
   pn_error_free(data->error);
   pn_free(data->decoder);
@@ -371,7 +376,10 @@ pn_data_t *pn_data(size_t capacity)
   data->capacity = capacity;
   data->size = 0;
   data->nodes = capacity ? (pni_node_t *) malloc(capacity * sizeof(pni_node_t)) : NULL;
-  data->buf = pn_buffer(64);
+  data->chunks = NULL;
+  data->chunk = NULL;
+  data->encoded_size = -1;
+  data->generation = 0;
   data->parent = 0;
   data->current = 0;
   data->base_parent = 0;
@@ -411,7 +419,9 @@ void pn_data_clear(pn_data_t *data)
     data->current = 0;
     data->base_parent = 0;
     data->base_current = 0;
-    pn_buffer_clear(data->buf);
+    data->chunk = data->chunks;
+    if (data->chunk) data->chunk->used = 0;
+    pni_data_modified(data);
   }
 }
 
@@ -429,14 +439,45 @@ static int pni_data_grow(pn_data_t *data)
   return 0;
 }
 
-static ssize_t pni_data_intern(pn_data_t *data, const char *start, size_t size)
+#define PNI_DATA_CHUNK_MIN ((size_t)256)
+#define PNI_DATA_CHUNK_MAX ((size_t)64*1024)
+
+static inline char *pni_data_chunk_bytes(pni_data_chunk_t *chunk)
 {
-  size_t offset = pn_buffer_size(data->buf);
-  int err = pn_buffer_append(data->buf, start, size);
-  if (err) return err;
-  err = pn_buffer_append(data->buf, "\0", 1);
-  if (err) return err;
-  return offset;
+  return (char *) (chunk + 1);
+}
+
+// Reserve size bytes of interned storage, moving on to the next chunk (or
+// adding one after the current chunk) when the current one is full.
+static char *pni_data_reserve(pn_data_t *data, size_t size)
+{
+  pni_data_chunk_t *chunk = data->chunk;
+  if (chunk && chunk->capacity - chunk->used >= size) {
+    char *bytes = pni_data_chunk_bytes(chunk) + chunk->used;
+    chunk->used += size;
+    return bytes;
+  }
+
+  pni_data_chunk_t *next = chunk ? chunk->next : NULL;
+  if (!next || next->capacity < size) {
+    size_t capacity = chunk ? chunk->capacity * 2 : PNI_DATA_CHUNK_MIN;
+    if (capacity > PNI_DATA_CHUNK_MAX) capacity = PNI_DATA_CHUNK_MAX;
+    if (capacity < size) capacity = size;
+    pni_data_chunk_t *added = (pni_data_chunk_t *) malloc(sizeof(pni_data_chunk_t) + capacity);
+    if (!added) return NULL;
+    added->capacity = capacity;
+    added->next = next;
+    if (chunk) {
+      chunk->next = added;
+    } else {
+      data->chunks = added;
+    }
+    next = added;
+  }
+
+  next->used = size;
+  data->chunk = next;
+  return pni_data_chunk_bytes(next);
 }
 
 static pn_bytes_t *pni_data_bytes(pn_data_t *data, pni_node_t *node)
@@ -450,34 +491,15 @@ static pn_bytes_t *pni_data_bytes(pn_data_t *data, pni_node_t *node)
   }
 }
 
-static void pni_data_rebase(pn_data_t *data, char *base)
-{
-  for (unsigned i = 0; i < data->size; i++) {
-    pni_node_t *node = &data->nodes[i];
-    if (node->data) {
-      pn_bytes_t *bytes = pni_data_bytes(data, node);
-      bytes->start = base + node->data_offset;
-    }
-  }
-}
-
 static int pni_data_intern_node(pn_data_t *data, pni_node_t *node)
 {
   pn_bytes_t *bytes = pni_data_bytes(data, node);
   if (!bytes) return 0;
-  size_t oldcap = pn_buffer_capacity(data->buf);
-  ssize_t offset = pni_data_intern(data, bytes->start, bytes->size);
-  if (offset < 0) return offset;
-  node->data = true;
-  node->data_offset = offset;
-  node->data_size = bytes->size;
-  pn_rwbytes_t buf = pn_buffer_memory(data->buf);
-  bytes->start = buf.start + offset;
-
-  if (pn_buffer_capacity(data->buf) != oldcap) {
-    pni_data_rebase(data, buf.start);
-  }
-
+  char *start = pni_data_reserve(data, bytes->size + 1);
+  if (!start) return PN_OUT_OF_MEMORY;
+  if (bytes->size) memcpy(start, bytes->start, bytes->size);
+  start[bytes->size] = '\0';
+  bytes->start = start;
   return 0;
 }
 
@@ -654,6 +676,7 @@ int pn_data_vfill(pn_data_t *data, const char *fmt, va_list ap)
         pni_node_t *parent = pn_data_node(data, data->parent);
         if (parent->atom.type == PN_ARRAY) {
           parent->type = (pn_type_t) va_arg(ap, int);
+          pni_data_modified(data);
         } else {
           return pn_error_format(data->error, PN_ERR, "naked type");
         }
@@ -1462,6 +1485,7 @@ void pn_data_dump(pn_data_t *data)
 
 static pni_node_t *pni_data_add(pn_data_t *data)
 {
+  pni_data_modified(data);
   pni_node_t *current = pni_data_current(data);
   pni_node_t *parent = pn_data_node(data, data->parent);
   pni_node_t *node;
@@ -1512,10 +1536,7 @@ static pni_node_t *pni_data_add(pn_data_t *data)
 
   node->down = 0;
   node->children = 0;
-  node->data = false;
   node->described = false;
-  node->data_offset = 0;
-  node->data_size = 0;
   data->current = pni_data_id(data, node);
   return node;
 }
@@ -1565,6 +1586,7 @@ void pni_data_set_array_type(pn_data_t *data, pn_type_t type)
 {
   pni_node_t *array = pni_data_current(data);
   if (array) array->type = type;
+  pni_data_modified(data);
 }
 
 int pn_data_put_described(pn_data_t *data)
@@ -125,6 +125,11 @@ void pn_connection_driver_write_done(pn_connection_driver_t *d, size_t n) {
   pn_transport_pop(d->transport, n);
 }
 
+size_t pn_connection_driver_write_segments(pn_connection_driver_t *d, pn_bytes_t *segments, size_t n) {
+  ssize_t count = pn_transport_segments(d->transport, segments, n);
+  return (count > 0) ? (size_t)count : 0;
+}
+
 bool pn_connection_driver_write_closed(pn_connection_driver_t *d) {
   return pn_transport_head_closed(d->transport);
 }
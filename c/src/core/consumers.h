@@ -0,0 +1,391 @@
+#ifndef PROTON_CONSUMERS_H
+#define PROTON_CONSUMERS_H 1
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Consumers read AMQP encoded values directly from a byte buffer, without
+ * first decoding into a pn_data_t tree.  They are the counterpart of the
+ * emitters and are used for the performatives on the transport hot path.
+ *
+ * Every consumer returns false if the value at the current position is not
+ * of a type it handles (or runs past the end of the buffer). The caller then
+ * falls back to the general pn_data_t decoder, so consumers only need to
+ * cover the encodings that are actually seen for these performatives.
+ *
+ * The elements of a list are read with a consumer over the list contents
+ * returned by pni_consumer_enter_list().  Elements past the end of the list
+ * read as absent, like trailing nulls that have been omitted.
+ */
+
+#include "encodings.h"
+
+#include <proton/types.h>
+
+typedef struct pni_consumer_t {
+  const uint8_t *input_start;
+  size_t size;
+  size_t position;
+  uint32_t count;       /* elements remaining, for a list consumer */
+} pni_consumer_t;
+
+static inline pni_consumer_t pni_consumer(pn_bytes_t input)
+{
+  pni_consumer_t consumer = {(const uint8_t *)input.start, input.size, 0, UINT32_MAX};
+  return consumer;
+}
+
+/* The bytes that have not been consumed yet */
+static inline pn_bytes_t pni_consumer_remaining(pni_consumer_t *consumer)
+{
+  return pn_bytes(consumer->size - consumer->position, (const char *)consumer->input_start + consumer->position);
+}
+
+static inline bool pni_consumer_readf8(pni_consumer_t *consumer, uint8_t *result)
+{
+  if (consumer->position+1 > consumer->size) return false;
+  *result = consumer->input_start[consumer->position];
+  consumer->position++;
+  return true;
+}
+
+static inline bool pni_consumer_readf32(pni_consumer_t *consumer, uint32_t *result)
+{
+  if (consumer->position+4 > consumer->size) return false;
+  const uint8_t *p = consumer->input_start + consumer->position;
+  *result = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+  consumer->position += 4;
+  return true;
+}
+
+static inline bool pni_consumer_readf64(pni_consumer_t *consumer, uint64_t *result)
+{
+  uint32_t hi, lo;
+  if (!pni_consumer_readf32(consumer, &hi) || !pni_consumer_readf32(consumer, &lo)) return false;
+  *result = (uint64_t)hi << 32 | lo;
+  return true;
+}
+
+static inline bool pni_consumer_skip(pni_consumer_t *consumer, size_t size)
+{
+  if (consumer->position+size > consumer->size) return false;
+  consumer->position += size;
+  return true;
+}
+
+/* Read the type constructor of the next list element, false at the end of the list */
+static inline bool pni_consumer_next(pni_consumer_t *consumer, uint8_t *type)
+{
+  if (consumer->count == 0 || consumer->position == consumer->size) return false;
+  if (!pni_consumer_readf8(consumer, type)) return false;
+  consumer->count--;
+  return true;
+}
+
+/* Skip over a complete value of the given type whose constructor has been read */
+static inline bool pni_consumer_skip_value(pni_consumer_t *consumer, uint8_t type)
+{
+  uint8_t size8;
+  uint32_t size32;
+  switch (type & 0xF0) {
+  case 0x00:
+    // Described: a descriptor and then a value
+    if (!pni_consumer_readf8(consumer, &type) || !pni_consumer_skip_value(consumer, type)) return false;
+    return pni_consumer_readf8(consumer, &type) && pni_consumer_skip_value(consumer, type);
+  case 0x40: return true;
+  case 0x50: return pni_consumer_skip(consumer, 1);
+  case 0x60: return pni_consumer_skip(consumer, 2);
+  case 0x70: return pni_consumer_skip(consumer, 4);
+  case 0x80: return pni_consumer_skip(consumer, 8);
+  case 0x90: return pni_consumer_skip(consumer, 16);
+  case 0xA0:
+  case 0xC0:
+  case 0xE0:
+    return pni_consumer_readf8(consumer, &size8) && pni_consumer_skip(consumer, size8);
+  case 0xB0:
+  case 0xD0:
+  case 0xF0:
+    return pni_consumer_readf32(consumer, &size32) && pni_consumer_skip(consumer, size32);
+  default:
+    return false;
+  }
+}
+
+/* Skip the next list element if there is one */
+static inline bool pni_consume_anything(pni_consumer_t *consumer)
+{
+  uint8_t type;
+  if (!pni_consumer_next(consumer, &type)) return true;
+  return pni_consumer_skip_value(consumer, type);
+}
+
+/* Read a bool, as the "o" scan format: null or absent reads as false */
+static inline bool pni_consume_bool(pni_consumer_t *consumer, bool *present, bool *value)
+{
+  uint8_t type;
+  *present = false;
+  *value = false;
+  if (!pni_consumer_next(consumer, &type)) return true;
+  switch (type) {
+  case PNE_NULL: return true;
+  case PNE_TRUE: *value = true; break;
+  case PNE_FALSE: *value = false; break;
+  case PNE_BOOLEAN: {
+    uint8_t b;
+    if (!pni_consumer_readf8(consumer, &b)) return false;
+    *value = b;
+    break;
+  }
+  default: return false;
+  }
+  *present = true;
+  return true;
+}
+
+/* Read a uint, as the "?I" scan format: null or absent reads as 0 and not present */
+static inline bool pni_consume_uint(pni_consumer_t *consumer, bool *present, uint32_t *value)
+{
+  uint8_t type;
+  *present = false;
+  *value = 0;
+  if (!pni_consumer_next(consumer, &type)) return true;
+  switch (type) {
+  case PNE_NULL: return true;
+  case PNE_UINT0: *value = 0; break;
+  case PNE_SMALLUINT: {
+    uint8_t v;
+    if (!pni_consumer_readf8(consumer, &v)) return false;
+    *value = v;
+    break;
+  }
+  case PNE_UINT:
+    if (!pni_consumer_readf32(consumer, value)) return false;
+    break;
+  default: return false;
+  }
+  *present = true;
+  return true;
+}
+
+static inline bool pni_consume_ulong(pni_consumer_t *consumer, bool *present, uint64_t *value)
+{
+  uint8_t type;
+  *present = false;
+  *value = 0;
+  if (!pni_consumer_next(consumer, &type)) return true;
+  switch (type) {
+  case PNE_NULL: return true;
+  case PNE_ULONG0: *value = 0; break;
+  case PNE_SMALLULONG: {
+    uint8_t v;
+    if (!pni_consumer_readf8(consumer, &v)) return false;
+    *value = v;
+    break;
+  }
+  case PNE_ULONG:
+    if (!pni_consumer_readf64(consumer, value)) return false;
+    break;
+  default: return false;
+  }
+  *present = true;
+  return true;
+}
+
+/* Read binary, as the "z" scan format: null or absent reads as empty and not present */
+static inline bool pni_consume_binary(pni_consumer_t *consumer, bool *present, pn_bytes_t *value)
+{
+  uint8_t type;
+  *present = false;
+  *value = pn_bytes(0, NULL);
+  if (!pni_consumer_next(consumer, &type)) return true;
+  uint32_t size;
+  switch (type) {
+  case PNE_NULL: return true;
+  case PNE_VBIN8: {
+    uint8_t size8;
+    if (!pni_consumer_readf8(consumer, &size8)) return false;
+    size = size8;
+    break;
+  }
+  case PNE_VBIN32:
+    if (!pni_consumer_readf32(consumer, &size)) return false;
+    break;
+  default: return false;
+  }
+  if (consumer->position+size > consumer->size) return false;
+  *value = pn_bytes(size, (const char *)consumer->input_start + consumer->position);
+  consumer->position += size;
+  *present = true;
+  return true;
+}
+
+/* Read a list, returning a consumer for its elements in list */
+static inline bool pni_consume_list(pni_consumer_t *consumer, pni_consumer_t *list)
+{
+  uint8_t type;
+  if (!pni_consumer_next(consumer, &type)) return false;
+  uint32_t size, count;
+  switch (type) {
+  case PNE_LIST0:
+    size = 0;
+    count = 0;
+    break;
+  case PNE_LIST8: {
+    uint8_t size8, count8;
+    if (!pni_consumer_readf8(consumer, &size8) || size8 < 1) return false;
+    if (!pni_consumer_readf8(consumer, &count8)) return false;
+    size = size8 - 1;
+    count = count8;
+    break;
+  }
+  case PNE_LIST32:
+    if (!pni_consumer_readf32(consumer, &size) || size < 4) return false;
+    if (!pni_consumer_readf32(consumer, &count)) return false;
+    size -= 4;
+    break;
+  default: return false;
+  }
+  if (consumer->position+size > consumer->size) return false;
+  pni_consumer_t contents = {consumer->input_start + consumer->position, size, 0, count};
+  *list = contents;
+  consumer->position += size;
+  return true;
+}
+
+/* Read a described value with a numeric descriptor, leaving the consumer at the value */
+static inline bool pni_consume_descriptor(pni_consumer_t *consumer, uint64_t *code)
+{
+  uint8_t type;
+  bool present;
+  if (!pni_consumer_next(consumer, &type) || type != PNE_DESCRIPTOR) return false;
+  // The described value counts as a single element
+  consumer->count++;
+  if (!pni_consume_ulong(consumer, &present, code) || !present) return false;
+  consumer->count++;
+  return true;
+}
+
+/*
+ * Read an optional described list that must be empty, as for outcomes like
+ * accepted or released that have no fields: null or absent reads as not present.
+ */
+static inline bool pni_consume_described_list0(pni_consumer_t *consumer, bool *present, uint64_t *code)
+{
+  *present = false;
+  *code = 0;
+  if (consumer->count == 0 || consumer->position == consumer->size) return true;
+  if (consumer->input_start[consumer->position] == PNE_NULL) {
+    return pni_consume_anything(consumer);
+  }
+  pni_consumer_t fields;
+  if (!pni_consume_descriptor(consumer, code) || !pni_consume_list(consumer, &fields)) return false;
+  if (fields.count != 0 || fields.size != 0) return false;
+  *present = true;
+  return true;
+}
+
+/*
+ * The fields of the performatives read on the transport hot path.  Each
+ * reader must give the same values as the pn_data_scan() format noted, on
+ * any encoding of the field list: list0, list8 or list32 with fields that
+ * are null or absent.
+ */
+
+typedef struct pni_transfer_t {
+  uint32_t handle;
+  bool id_present;
+  pn_sequence_t id;
+  pn_bytes_t tag;
+  bool settled_set, settled;
+  bool more;
+  bool has_type;
+  uint64_t type;
+  bool resume, aborted, batchable;
+} pni_transfer_t;
+
+typedef struct pni_flow_t {
+  bool inext_init;
+  pn_sequence_t inext;
+  uint32_t iwin;
+  pn_sequence_t onext;
+  uint32_t owin;
+  bool handle_init;
+  uint32_t handle;
+  bool dcount_init;
+  pn_sequence_t delivery_count;
+  uint32_t link_credit;
+  bool drain;
+} pni_flow_t;
+
+typedef struct pni_disposition_t {
+  bool role;
+  pn_sequence_t first, last;
+  bool last_init;
+  bool settled;
+  bool type_init;
+  uint64_t type;
+} pni_disposition_t;
+
+/* "D.[I?Iz.?oo.D?LCooo]", only the descriptor of a delivery state is read */
+static inline bool pni_consume_transfer_fields(pni_consumer_t *fields, pni_transfer_t *t)
+{
+  bool present;
+  return pni_consume_uint(fields, &present, &t->handle) &&
+         pni_consume_uint(fields, &t->id_present, &t->id) &&
+         pni_consume_binary(fields, &present, &t->tag) &&
+         pni_consume_anything(fields) &&
+         pni_consume_bool(fields, &t->settled_set, &t->settled) &&
+         pni_consume_bool(fields, &present, &t->more) &&
+         pni_consume_anything(fields) &&
+         pni_consume_described_list0(fields, &t->has_type, &t->type) &&
+         pni_consume_bool(fields, &present, &t->resume) &&
+         pni_consume_bool(fields, &present, &t->aborted) &&
+         pni_consume_bool(fields, &present, &t->batchable);
+}
+
+/* "D.[?IIII?I?II.o]" */
+static inline bool pni_consume_flow_fields(pni_consumer_t *fields, pni_flow_t *f)
+{
+  bool present;
+  return pni_consume_uint(fields, &f->inext_init, &f->inext) &&
+         pni_consume_uint(fields, &present, &f->iwin) &&
+         pni_consume_uint(fields, &present, &f->onext) &&
+         pni_consume_uint(fields, &present, &f->owin) &&
+         pni_consume_uint(fields, &f->handle_init, &f->handle) &&
+         pni_consume_uint(fields, &f->dcount_init, &f->delivery_count) &&
+         pni_consume_uint(fields, &present, &f->link_credit) &&
+         pni_consume_anything(fields) &&
+         pni_consume_bool(fields, &present, &f->drain);
+}
+
+/* "D.[oI?IoD?LC]", only outcomes without fields are read */
+static inline bool pni_consume_disposition_fields(pni_consumer_t *fields, pni_disposition_t *d)
+{
+  bool present;
+  return pni_consume_bool(fields, &present, &d->role) &&
+         pni_consume_uint(fields, &present, &d->first) &&
+         pni_consume_uint(fields, &d->last_init, &d->last) &&
+         pni_consume_bool(fields, &present, &d->settled) &&
+         pni_consume_described_list0(fields, &d->type_init, &d->type);
+}
+
+#endif /* consumers.h */
@@ -31,9 +31,9 @@ typedef uint16_t pni_nid_t;
 #define PNI_NID_MAX ((pni_nid_t)-1)
 
 typedef struct {
-  char *start;
-  size_t data_offset;
-  size_t data_size;
+  // set by the encoder's sizing pass for lists, maps and arrays
+  size_t size;
+  pni_nid_t count;
   pn_atom_t atom;
   pn_type_t type;
   pni_nid_t next;
@@ -43,17 +43,28 @@ typedef struct {
   pni_nid_t children;
   // for arrays
   bool described;
-  bool data;
   bool small;
 } pni_node_t;
 
+// Interned bytes live in a chain of chunks that never move, so nodes can
+// point straight into them. Clearing the data rewinds to the first chunk
+// and keeps the chain for reuse.
+typedef struct pni_data_chunk_t {
+  struct pni_data_chunk_t *next;
+  size_t capacity;
+  size_t used;
+} pni_data_chunk_t;
+
 struct pn_data_t {
   pni_node_t *nodes;
-  pn_buffer_t *buf;
+  pni_data_chunk_t *chunks;
+  pni_data_chunk_t *chunk;
   pn_decoder_t *decoder;
   pn_encoder_t *encoder;
   pn_error_t *error;
   pn_string_t *str;
+  ssize_t encoded_size; // cached by the encoder, -1 when the data has changed
+  unsigned generation;  // incremented whenever the data changes
   pni_nid_t capacity;
   pni_nid_t size;
   pni_nid_t parent;
@@ -62,11 +73,27 @@ struct pn_data_t {
   pni_nid_t base_current;
 };
 
+static inline void pni_data_modified(pn_data_t *data)
+{
+  data->encoded_size = -1;
+  data->generation++;
+}
+
 static inline pni_node_t * pn_data_node(pn_data_t *data, pni_nid_t nd) 
 {
   return nd ? (data->nodes + nd - 1) : NULL;
 }
 
+// Bytes of node and chunk storage the data keeps when it is cleared
+static inline size_t pni_data_retained(pn_data_t *data)
+{
+  size_t size = data->capacity * sizeof(pni_node_t);
+  for (pni_data_chunk_t *chunk = data->chunks; chunk; chunk = chunk->next) {
+    size += chunk->capacity;
+  }
+  return size;
+}
+
 int pni_data_traverse(pn_data_t *data,
                       int (*enter)(void *ctx, pn_data_t *data, pni_node_t *node),
                       int (*exit)(void *ctx, pn_data_t *data, pni_node_t *node),
@@ -22,6 +22,7 @@
  *
  */
 
+#include "consumers.h"
 #include "dispatcher.h"
 
 #define AMQP_FRAME_TYPE (0)
@@ -39,6 +40,13 @@ int pn_do_detach(pn_transport_t *transport, uint8_t frame_type, uint16_t channel
 int pn_do_end(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload);
 int pn_do_close(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload);
 
+/* AMQP actions reading their fields directly from the encoded performative list,
+   these return false without acting if the fields need the general decoder */
+typedef bool (pn_consumer_action_t)(pn_transport_t *transport, uint16_t channel, pni_consumer_t *fields, const pn_bytes_t *payload, int *err);
+bool pn_consume_transfer(pn_transport_t *transport, uint16_t channel, pni_consumer_t *fields, const pn_bytes_t *payload, int *err);
+bool pn_consume_flow(pn_transport_t *transport, uint16_t channel, pni_consumer_t *fields, const pn_bytes_t *payload, int *err);
+bool pn_consume_disposition(pn_transport_t *transport, uint16_t channel, pni_consumer_t *fields, const pn_bytes_t *payload, int *err);
+
 /* SASL actions */
 int pn_do_init(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload);
 int pn_do_mechanisms(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload);
@@ -74,6 +74,27 @@ static inline int pni_dispatch_action(pn_transport_t* transport, uint64_t lcode,
   return action(transport, frame_type, channel, args, payload);
 }
 
+// Dispatch the frequent performatives without building a pn_data_t for them,
+// returns false if the frame has to go through the general decoder instead
+static inline bool pni_dispatch_consumed(pn_transport_t *transport, pn_frame_t frame, int *err)
+{
+  pn_consumer_action_t *action;
+  pni_consumer_t consumer = pni_consumer(pn_bytes(frame.size, frame.payload));
+  uint64_t lcode;
+  pni_consumer_t fields;
+  if (!pni_consume_descriptor(&consumer, &lcode)) return false;
+  switch (lcode) {
+  case FLOW:            action = pn_consume_flow; break;
+  case TRANSFER:        action = pn_consume_transfer; break;
+  case DISPOSITION:     action = pn_consume_disposition; break;
+  default:              return false;
+  }
+  if (!pni_consume_list(&consumer, &fields)) return false;
+  pn_bytes_t payload = pni_consumer_remaining(&consumer);
+  if (!payload.size) payload.start = NULL;
+  return action(transport, frame.channel, &fields, &payload, err);
+}
+
 static int pni_dispatch_frame(pn_transport_t * transport, pn_data_t *args, pn_frame_t frame)
 {
   if (frame.size == 0) { // ignore null frames
@@ -82,6 +103,12 @@ static int pni_dispatch_frame(pn_transport_t * transport, pn_data_t *args, pn_fr
     return 0;
   }
 
+  // Frame tracing needs the decoded performative
+  if (frame.type == AMQP_FRAME_TYPE && !(transport->trace & PN_TRACE_FRM)) {
+    int err;
+    if (pni_dispatch_consumed(transport, frame, &err)) return err;
+  }
+
   ssize_t dsize = pn_data_decode(args, frame.payload, frame.size);
   if (dsize < 0) {
     pn_string_format(transport->scratch,
@@ -149,8 +176,6 @@ ssize_t pn_dispatcher_input(pn_transport_t *transport, const char *bytes, size_t
 
 ssize_t pn_dispatcher_output(pn_transport_t *transport, char *bytes, size_t size)
 {
-    int n = pn_buffer_get(transport->output_buffer, 0, size, bytes);
-    pn_buffer_trim(transport->output_buffer, n, 0);
-    // XXX: need to check for errors
-    return n;
+    // Transfer payloads left in the sender's buffer are copied in order
+    return pni_output_take(transport, bytes, size);
 }
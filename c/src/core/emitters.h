@@ -0,0 +1,312 @@
+#ifndef PROTON_EMITTERS_H
+#define PROTON_EMITTERS_H 1
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * Emitters write AMQP encoded values directly into a byte buffer, without
+ * first building a pn_data_t tree.  They are used for the performatives on
+ * the transport hot path where the shape of the value is fixed.
+ *
+ * Like the pn_data_t encoder, writes past the end of the buffer are skipped
+ * but the position is still advanced, so after emitting a complete value
+ * pni_emitter_overflow() tells the caller to grow the buffer and try again,
+ * and the position tells it by how much.
+ *
+ * Compound values are emitted between pni_emit_list_begin() and
+ * pni_emit_list_end() using a pni_compound_t to keep the element count.
+ * Trailing nulls in a described list are omitted, and the smallest of
+ * list0/list8/list32 is chosen when the list is closed.
+ */
+
+#include "encodings.h"
+#include "protocol.h"
+
+#include <proton/types.h>
+
+#include <string.h>
+
+typedef struct pni_emitter_t {
+  char *output_start;
+  size_t size;
+  size_t position;
+} pni_emitter_t;
+
+typedef struct pni_compound_t {
+  size_t start;         /* position of the list constructor */
+  uint32_t count;       /* elements written, not counting pending nulls */
+  uint32_t null_count;  /* nulls not yet written in case they are trailing */
+} pni_compound_t;
+
+/* Space reserved for a list8 header: constructor, size, count */
+#define PNI_LIST8_HEADER_SIZE (3)
+/* Extra space needed if the list turns out to need a list32 header */
+#define PNI_LIST32_EXTRA_SIZE (6)
+
+static inline pni_emitter_t pni_emitter(pn_rwbytes_t output)
+{
+  pni_emitter_t emitter = {output.start, output.size, 0};
+  return emitter;
+}
+
+static inline bool pni_emitter_overflow(pni_emitter_t *emitter)
+{
+  return emitter->position > emitter->size;
+}
+
+static inline pn_bytes_t pni_emitter_bytes(pni_emitter_t *emitter)
+{
+  return pn_bytes(emitter->position, emitter->output_start);
+}
+
+static inline void pni_emitter_writef8(pni_emitter_t *emitter, uint8_t value)
+{
+  if (emitter->position+1 <= emitter->size) {
+    emitter->output_start[emitter->position] = value;
+  }
+  emitter->position++;
+}
+
+static inline void pni_emitter_writef32(pni_emitter_t *emitter, uint32_t value)
+{
+  if (emitter->position+4 <= emitter->size) {
+    char *p = emitter->output_start + emitter->position;
+    p[0] = 0xFF & (value >> 24);
+    p[1] = 0xFF & (value >> 16);
+    p[2] = 0xFF & (value >>  8);
+    p[3] = 0xFF & (value      );
+  }
+  emitter->position += 4;
+}
+
+static inline void pni_emitter_writev8(pni_emitter_t *emitter, pn_bytes_t value)
+{
+  pni_emitter_writef8(emitter, value.size);
+  if (emitter->position+value.size <= emitter->size) {
+    memcpy(emitter->output_start+emitter->position, value.start, value.size);
+  }
+  emitter->position += value.size;
+}
+
+static inline void pni_emitter_writev32(pni_emitter_t *emitter, pn_bytes_t value)
+{
+  pni_emitter_writef32(emitter, value.size);
+  if (emitter->position+value.size <= emitter->size) {
+    memcpy(emitter->output_start+emitter->position, value.start, value.size);
+  }
+  emitter->position += value.size;
+}
+
+/* Write any nulls held back by the compound, called before a non-null element */
+static inline void pni_emit_pending_nulls(pni_emitter_t *emitter, pni_compound_t *compound)
+{
+  for (uint32_t i = 0; i < compound->null_count; i++) {
+    pni_emitter_writef8(emitter, PNE_NULL);
+  }
+  compound->count += compound->null_count;
+  compound->null_count = 0;
+}
+
+/* Start a new element of a compound, the caller then writes its encoding */
+static inline void pni_emit_element(pni_emitter_t *emitter, pni_compound_t *compound)
+{
+  pni_emit_pending_nulls(emitter, compound);
+  compound->count++;
+}
+
+/* Emit a descriptor for a described type with a numeric descriptor */
+static inline void pni_emit_descriptor(pni_emitter_t *emitter, uint64_t code)
+{
+  pni_emitter_writef8(emitter, PNE_DESCRIPTOR);
+  if (code < 256) {
+    pni_emitter_writef8(emitter, PNE_SMALLULONG);
+    pni_emitter_writef8(emitter, code);
+  } else {
+    pni_emitter_writef8(emitter, PNE_ULONG);
+    pni_emitter_writef32(emitter, code >> 32);
+    pni_emitter_writef32(emitter, code);
+  }
+}
+
+static inline void pni_emit_null(pni_emitter_t *emitter, pni_compound_t *compound)
+{
+  compound->null_count++;
+}
+
+static inline void pni_emit_bool(pni_emitter_t *emitter, pni_compound_t *compound, bool value)
+{
+  pni_emit_element(emitter, compound);
+  pni_emitter_writef8(emitter, value ? PNE_TRUE : PNE_FALSE);
+}
+
+/* Like the pn_data_t encoder, 0 is written as a smalluint rather than uint0 */
+static inline void pni_emit_uint(pni_emitter_t *emitter, pni_compound_t *compound, uint32_t value)
+{
+  pni_emit_element(emitter, compound);
+  if (value < 256) {
+    pni_emitter_writef8(emitter, PNE_SMALLUINT);
+    pni_emitter_writef8(emitter, value);
+  } else {
+    pni_emitter_writef8(emitter, PNE_UINT);
+    pni_emitter_writef32(emitter, value);
+  }
+}
+
+/* Emit value if present, otherwise null: like the "?o" and "?I" fill formats */
+static inline void pni_emit_bool_or_null(pni_emitter_t *emitter, pni_compound_t *compound, bool present, bool value)
+{
+  if (present) pni_emit_bool(emitter, compound, value);
+  else pni_emit_null(emitter, compound);
+}
+
+static inline void pni_emit_uint_or_null(pni_emitter_t *emitter, pni_compound_t *compound, bool present, uint32_t value)
+{
+  if (present) pni_emit_uint(emitter, compound, value);
+  else pni_emit_null(emitter, compound);
+}
+
+/* Emit binary, or null if value.start is NULL */
+static inline void pni_emit_binaryornull(pni_emitter_t *emitter, pni_compound_t *compound, pn_bytes_t value)
+{
+  if (!value.start) {
+    pni_emit_null(emitter, compound);
+    return;
+  }
+  pni_emit_element(emitter, compound);
+  if (value.size < 256) {
+    pni_emitter_writef8(emitter, PNE_VBIN8);
+    pni_emitter_writev8(emitter, value);
+  } else {
+    pni_emitter_writef8(emitter, PNE_VBIN32);
+    pni_emitter_writev32(emitter, value);
+  }
+}
+
+/* Emit a described empty list, e.g. an outcome that has no fields */
+static inline void pni_emit_described_list0(pni_emitter_t *emitter, pni_compound_t *compound, uint64_t code)
+{
+  pni_emit_element(emitter, compound);
+  pni_emit_descriptor(emitter, code);
+  pni_emitter_writef8(emitter, PNE_LIST0);
+}
+
+/* Begin a list, space is reserved for a list8 header and patched by pni_emit_list_end() */
+static inline pni_compound_t pni_emit_list_begin(pni_emitter_t *emitter)
+{
+  pni_compound_t compound = {emitter->position, 0, 0};
+  emitter->position += PNI_LIST8_HEADER_SIZE;
+  return compound;
+}
+
+/* Finish a list, discarding trailing nulls and using the smallest encoding */
+static inline void pni_emit_list_end(pni_emitter_t *emitter, pni_compound_t *compound)
+{
+  size_t start = compound->start;
+  size_t content = emitter->position - (start + PNI_LIST8_HEADER_SIZE);
+  compound->null_count = 0;
+
+  if (compound->count == 0) {
+    emitter->position = start;
+    pni_emitter_writef8(emitter, PNE_LIST0);
+  } else if (content + 1 < 256 && compound->count < 256) {
+    emitter->position = start;
+    pni_emitter_writef8(emitter, PNE_LIST8);
+    pni_emitter_writef8(emitter, content + 1);
+    pni_emitter_writef8(emitter, compound->count);
+    emitter->position += content;
+  } else {
+    // Rare for performatives: move the content up to make room for a list32 header
+    size_t end = start + PNI_LIST8_HEADER_SIZE + PNI_LIST32_EXTRA_SIZE + content;
+    if (end <= emitter->size) {
+      memmove(emitter->output_start + start + PNI_LIST8_HEADER_SIZE + PNI_LIST32_EXTRA_SIZE,
+              emitter->output_start + start + PNI_LIST8_HEADER_SIZE,
+              content);
+    }
+    emitter->position = start;
+    pni_emitter_writef8(emitter, PNE_LIST32);
+    pni_emitter_writef32(emitter, content + 4);
+    pni_emitter_writef32(emitter, compound->count);
+    emitter->position = end;
+  }
+}
+
+/*
+ * The performatives emitted on the transport hot path.  Each must encode to
+ * the same bytes as pn_post_frame() with the pn_data_fill() format noted.
+ */
+
+/* "DL[IIzI?o?on?DLC?o?o?o]" without a delivery state */
+static inline void pni_emit_transfer(pni_emitter_t *emitter, uint32_t handle, pn_sequence_t id,
+                                     pn_bytes_t tag, uint32_t message_format, bool settled,
+                                     bool more, bool resume, bool aborted, bool batchable)
+{
+  pni_emit_descriptor(emitter, TRANSFER);
+  pni_compound_t list = pni_emit_list_begin(emitter);
+  pni_emit_uint(emitter, &list, handle);
+  pni_emit_uint(emitter, &list, id);
+  pni_emit_binaryornull(emitter, &list, tag);
+  pni_emit_uint(emitter, &list, message_format);
+  pni_emit_bool_or_null(emitter, &list, settled, settled);
+  pni_emit_bool_or_null(emitter, &list, more, more);
+  pni_emit_null(emitter, &list);  // rcv-settle-mode
+  pni_emit_null(emitter, &list);  // state
+  pni_emit_bool_or_null(emitter, &list, resume, resume);
+  pni_emit_bool_or_null(emitter, &list, aborted, aborted);
+  pni_emit_bool_or_null(emitter, &list, batchable, batchable);
+  pni_emit_list_end(emitter, &list);
+}
+
+/* "DL[?IIII?I?I?In?o]", the link fields are only present if linkq */
+static inline void pni_emit_flow(pni_emitter_t *emitter, bool inext_init, pn_sequence_t inext,
+                                 uint32_t iwin, pn_sequence_t onext, uint32_t owin, bool linkq,
+                                 uint32_t handle, pn_sequence_t delivery_count, uint32_t link_credit,
+                                 bool drain)
+{
+  pni_emit_descriptor(emitter, FLOW);
+  pni_compound_t list = pni_emit_list_begin(emitter);
+  pni_emit_uint_or_null(emitter, &list, inext_init, inext);
+  pni_emit_uint(emitter, &list, iwin);
+  pni_emit_uint(emitter, &list, onext);
+  pni_emit_uint(emitter, &list, owin);
+  pni_emit_uint_or_null(emitter, &list, linkq, handle);
+  pni_emit_uint_or_null(emitter, &list, linkq, delivery_count);
+  pni_emit_uint_or_null(emitter, &list, linkq, link_credit);
+  pni_emit_null(emitter, &list);  // available
+  pni_emit_bool_or_null(emitter, &list, linkq, drain);
+  pni_emit_list_end(emitter, &list);
+}
+
+/* "DL[oI?I?o?DL[]]", last is omitted if it is first and code 0 means no state */
+static inline void pni_emit_disposition(pni_emitter_t *emitter, bool role, pn_sequence_t first,
+                                        pn_sequence_t last, bool settled, uint64_t code)
+{
+  pni_emit_descriptor(emitter, DISPOSITION);
+  pni_compound_t list = pni_emit_list_begin(emitter);
+  pni_emit_bool(emitter, &list, role);
+  pni_emit_uint(emitter, &list, first);
+  pni_emit_uint_or_null(emitter, &list, last!=first, last);
+  pni_emit_bool_or_null(emitter, &list, settled, settled);
+  if (code) pni_emit_described_list0(emitter, &list, code);
+  pni_emit_list_end(emitter, &list);
+}
+
+#endif /* emitters.h */
@@ -35,6 +35,7 @@ struct pn_encoder_t {
   pn_error_t *error;
   size_t size;
   unsigned null_count;
+  bool sizing;
 };
 
 static void pn_encoder_initialize(void *obj)
@@ -45,6 +46,7 @@ static void pn_encoder_initialize(void *obj)
   encoder->error = pn_error();
   encoder->size = 0;
   encoder->null_count = 0;
+  encoder->sizing = false;
 }
 
 static void pn_encoder_finalize(void *obj) {
@@ -147,6 +149,17 @@ static uint8_t pn_node2code(pn_encoder_t *encoder, pni_node_t *node)
     } else {
       return PNE_VBIN32;
     }
+  // Compound encodings are chosen by the sizing pass
+  case PN_LIST:
+    if (encoder->sizing || !node->small) {
+      return PNE_LIST32;
+    } else {
+      return node->count ? PNE_LIST8 : PNE_LIST0;
+    }
+  case PN_MAP:
+    return (encoder->sizing || !node->small) ? PNE_MAP32 : PNE_MAP8;
+  case PN_ARRAY:
+    return (encoder->sizing || !node->small) ? PNE_ARRAY32 : PNE_ARRAY8;
   default:
     return pn_type2code(encoder, node->atom.type);
   }
@@ -320,42 +333,64 @@ static int pni_encoder_enter(void *ctx, pn_data_t *data, pni_node_t *node)
   case PNE_STR32_UTF8: pn_encoder_writev32(encoder, &atom->u.as_bytes); return 0;
   case PNE_SYM8: pn_encoder_writev8(encoder, &atom->u.as_bytes); return 0;
   case PNE_SYM32: pn_encoder_writev32(encoder, &atom->u.as_bytes); return 0;
-  case PNE_ARRAY32:
-    node->start = encoder->position;
-    node->small = false;
-    // we'll backfill the size on exit
-    encoder->position += 4;
-    pn_encoder_writef32(encoder, node->described ? node->children - 1 : node->children);
-    if (node->described)
+  case PNE_LIST0: return 0;
+  case PNE_ARRAY8:
+  case PNE_LIST8:
+  case PNE_MAP8:
+    pn_encoder_writef8(encoder, node->size + 1);
+    pn_encoder_writef8(encoder, node->count);
+    if (code == PNE_ARRAY8 && node->described)
       pn_encoder_writef8(encoder, 0);
     return 0;
+  case PNE_ARRAY32:
   case PNE_LIST32:
   case PNE_MAP32:
-    node->start = encoder->position;
-    node->small = false;
-    // we'll backfill the size later
-    encoder->position += 4;
-    pn_encoder_writef32(encoder, node->children);
+    if (encoder->sizing) {
+      // skip the size and count, the content is measured from here on exit
+      encoder->position += 8;
+      node->size = encoder->position - encoder->output;
+    } else {
+      pn_encoder_writef32(encoder, node->size + 4);
+      pn_encoder_writef32(encoder, node->count);
+    }
+    if (code == PNE_ARRAY32 && node->described)
+      pn_encoder_writef8(encoder, 0);
     return 0;
   default:
     return pn_error_format(data->error, PN_ERR, "unrecognized encoding: %u", code);
   }
 }
 
-#include <stdio.h>
+/* Record the size and count of a list, map or array and pick its smallest
+   encoding, now that its content has been sized. Array elements must all
+   use the 32 bit encoding named by the array's constructor.
+*/
+static void pni_encoder_size_compound(pn_encoder_t *encoder, pn_data_t *data, pni_node_t *node)
+{
+  pni_node_t *parent = pn_data_node(data, node->parent);
+  size_t content = (encoder->position - encoder->output) - node->size;
+  node->size = content;
+  if (node->atom.type == PN_ARRAY) {
+    node->count = node->described ? node->children - 1 : node->children;
+  } else {
+    // Trailing nulls of a described list are not encoded
+    node->count = node->children - encoder->null_count;
+  }
+  node->small = false;
+
+  if (pn_is_in_array(data, parent, node)) return;
+  if (node->atom.type == PN_LIST && node->count == 0) {
+    node->small = true;
+    encoder->position -= 8;     // list0 has no size or count
+  } else if (content + 1 < 256 && node->count < 256) {
+    node->small = true;
+    encoder->position -= 6;     // 1 byte size and count instead of 4
+  }
+}
 
 static int pni_encoder_exit(void *ctx, pn_data_t *data, pni_node_t *node)
 {
   pn_encoder_t *encoder = (pn_encoder_t *) ctx;
-  char *pos;
-
-  // Special case 0 length list
-  if (node->atom.type==PN_LIST && node->children-encoder->null_count==0) {
-    encoder->position = node->start-1; // position of list opcode
-    pn_encoder_writef8(encoder, PNE_LIST0);
-    encoder->null_count = 0;
-    return 0;
-  }
 
   switch (node->atom.type) {
   case PN_ARRAY:
@@ -365,26 +400,7 @@ static int pni_encoder_exit(void *ctx, pn_data_t *data, pni_node_t *node)
   // Fallthrough
   case PN_LIST:
   case PN_MAP:
-    pos = encoder->position;
-    encoder->position = node->start;
-    if (node->small) {
-      // backfill size
-      size_t size = pos - node->start - 1;
-      pn_encoder_writef8(encoder, size);
-      // Adjust count
-      if (encoder->null_count) {
-        pn_encoder_writef8(encoder, node->children-encoder->null_count);
-      }
-    } else {
-      // backfill size
-      size_t size = pos - node->start - 4;
-      pn_encoder_writef32(encoder, size);
-      // Adjust count
-      if (encoder->null_count) {
-        pn_encoder_writef32(encoder, node->children-encoder->null_count);
-      }
-    }
-    encoder->position = pos;
+    if (encoder->sizing) pni_encoder_size_compound(encoder, data, node);
     encoder->null_count = 0;
     return 0;
   default:
@@ -394,30 +410,44 @@ static int pni_encoder_exit(void *ctx, pn_data_t *data, pni_node_t *node)
 
 ssize_t pn_encoder_encode(pn_encoder_t *encoder, pn_data_t *src, char *dst, size_t size)
 {
+  // Size first so every header is written once, in its smallest form
+  ssize_t encoded = pn_encoder_size(encoder, src);
+  if (encoded < 0) return encoded;
+  if ((size_t)encoded > size) {
+      pn_error_format(pn_data_error(src), PN_OVERFLOW, "not enough space to encode");
+      return PN_OVERFLOW;
+  }
+
   encoder->output = dst;
   encoder->position = dst;
   encoder->size = size;
+  encoder->null_count = 0;
 
   int err = pni_data_traverse(src, pni_encoder_enter, pni_encoder_exit, encoder);
   if (err) return err;
-  size_t encoded = encoder->position - encoder->output;
-  if (encoded > size) {
-      pn_error_format(pn_data_error(src), PN_OVERFLOW, "not enough space to encode");
-      return PN_OVERFLOW;
-  }
-  return (ssize_t)encoded;
+  return encoded;
 }
 
+/* The sizing pass leaves each compound node's size, count and encoding in
+   place for pn_encoder_encode() and the result is cached on the data until
+   it is next modified, so asking for the size before encoding is cheap.
+*/
 ssize_t pn_encoder_size(pn_encoder_t *encoder, pn_data_t *src)
 {
+  if (src->encoded_size >= 0) return src->encoded_size;
+
   encoder->output = 0;
   encoder->position = 0;
   encoder->size = 0;
+  encoder->null_count = 0;
+  encoder->sizing = true;
 
   pn_handle_t save = pn_data_point(src);
   int err = pni_data_traverse(src, pni_encoder_enter, pni_encoder_exit, encoder);
   pn_data_restore(src, save);
+  encoder->sizing = false;
 
   if (err) return err;
-  return encoder->position - encoder->output;
+  src->encoded_size = encoder->position - encoder->output;
+  return src->encoded_size;
 }
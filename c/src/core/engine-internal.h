@@ -63,9 +63,28 @@ typedef struct {
   bool init;
 } pn_delivery_state_t;
 
+/* Unsettled deliveries of a session, by delivery-id.
+ *
+ * Delivery-ids are assigned in sequence, so the map is a circular array of
+ * the ids from lwm (the oldest unsettled delivery) up to next. Slot of id is
+ * (head + id - lwm) & (capacity - 1), settled deliveries leave NULL slots.
+ *
+ * The capacity follows the span next - lwm, up to PNI_DELIVERY_MAP_MAX
+ * slots. When the span would pass that, because an old delivery is left
+ * unsettled while later ones settle, the oldest deliveries move to the
+ * stragglers hash and lwm moves past them, so one unsettled delivery
+ * doesn't keep a slot for every id after it.
+ */
+#define PNI_DELIVERY_MAP_MAX 4096
+
 typedef struct {
+  pn_delivery_t **slots;
+  size_t capacity;              /* 0 or a power of 2 */
+  size_t head;                  /* Slot of lwm */
+  size_t size;                  /* Deliveries in the slots */
+  pn_sequence_t lwm;
   pn_sequence_t next;
-  pn_hash_t *deliveries;
+  pn_hash_t *stragglers;        /* Deliveries before lwm, NULL until needed */
 } pn_delivery_map_t;
 
 typedef struct {
@@ -91,11 +110,16 @@ typedef struct {
   pn_hash_t *local_handles;
   pn_hash_t *remote_handles;
 
+  // Batchable dispositions waiting to be sent, they all have the same
+  // disp_code, disp_settled and disp_type. See pni_post_disp()
   uint64_t disp_code;
   bool disp_settled;
   bool disp_type;
-  pn_sequence_t disp_first;
-  pn_sequence_t disp_last;
+  pn_sequence_t *disp_ranges;   /* Sorted, disjoint first/last pairs */
+  size_t disp_range_count;
+  size_t disp_range_capacity;
+  pn_timestamp_t disp_deadline; /* Send by, if delayed. 0 till known */
+  bool disp_due;                /* Delay is over */
   bool disp;
 } pn_session_state_t;
 
@@ -123,6 +147,17 @@ typedef uint8_t pn_io_layer_flags_t;
 typedef struct pni_sasl_t pni_sasl_t;
 typedef struct pni_ssl_t pni_ssl_t;
 
+/* A transfer payload written from the sender's own buffer rather than
+   copied into the transport's output_buffer */
+typedef struct {
+  size_t before;        /* output_buffer bytes written ahead of the slice */
+  pn_bytes_t bytes;
+  pn_buffer_t *owner;   /* released once the slice has been written */
+} pni_output_slice_t;
+
+#define PNI_OUTPUT_SLICE_MIN (1024)  /* smaller payloads are copied */
+#define PNI_OUTPUT_SPARE_MAX (16)    /* written payload buffers kept for reuse */
+
 struct pn_transport_t {
   pn_tracer_t tracer;
   pni_sasl_t *sasl;
@@ -156,6 +191,12 @@ struct pn_transport_t {
   pn_timestamp_t keepalive_deadline;
   uint64_t last_bytes_output;
 
+  /* disposition batching */
+#define PN_DEFAULT_DISP_MAX_RANGES (16)
+  size_t disp_max_ranges;
+  pn_millis_t disp_delay;
+  pn_timestamp_t last_tick;     /* now at the latest pn_transport_tick() */
+
   pn_hash_t *local_channels;
   pn_hash_t *remote_channels;
 
@@ -168,6 +209,16 @@ struct pn_transport_t {
 
   // Temporary - ??
   pn_buffer_t *output_buffer;
+  /* payload slices interleaved with output_buffer, head to tail */
+  pni_output_slice_t *slices;
+  size_t slices_head;
+  size_t slices_tail;
+  size_t slices_capacity;
+  size_t slices_before;         /* sum of 'before' of the queued slices */
+  size_t slices_size;           /* sum of the slice sizes */
+  /* written payload buffers kept to swap into deliveries */
+  pn_buffer_t *spare_payloads[PNI_OUTPUT_SPARE_MAX];
+  size_t spare_count;
 
   /* statistics */
   uint64_t bytes_input;
@@ -177,14 +228,21 @@ struct pn_transport_t {
 
   /* output buffered for send */
   #define PN_TRANSPORT_INITIAL_BUFFER_SIZE (16*1024)
+  /* pending bytes start at output_start, consumed bytes are only moved out
+     of the way once at least as many have been consumed as remain pending */
   size_t output_size;
+  size_t output_start;
   size_t output_pending;
   char *output_buf;
 
-  /* input from peer */
+  /* input from peer, kept the same way as the output */
   size_t input_size;
+  size_t input_start;
   size_t input_pending;
   char *input_buf;
+  /* receiver deliveries with data still in input_buf, which must not move */
+  pn_delivery_t *pinned_head;
+  pn_delivery_t *pinned_tail;
 
   pn_record_t *context;
 
@@ -258,6 +316,7 @@ struct pn_session_t {
   pn_list_t *freed;
   pn_record_t *context;
   size_t incoming_capacity;
+  size_t incoming_low_water;
   pn_sequence_t incoming_bytes;
   pn_sequence_t outgoing_bytes;
   pn_sequence_t incoming_deliveries;
@@ -308,6 +367,7 @@ struct pn_link_t {
   bool drain_flag_mode; // receiver only
   bool drain;
   bool detached;
+  bool input_view; // receiver only
 };
 
 struct pn_disposition_t {
@@ -333,8 +393,11 @@ struct pn_delivery_t {
   pn_delivery_t *work_prev;
   pn_delivery_t *tpwork_next;
   pn_delivery_t *tpwork_prev;
+  pn_delivery_t *pinned_next;
+  pn_delivery_t *pinned_prev;
   pn_delivery_state_t state;
   pn_buffer_t *bytes;
+  pn_bytes_t view; // data in the transport input buffer instead of bytes
   pn_record_t *context;
   bool updated;
   bool settled; // tracks whether we're in the unsettled list or not
@@ -361,6 +424,8 @@ void pn_condition_tini(pn_condition_t *condition);
 void pn_modified(pn_connection_t *connection, pn_endpoint_t *endpoint, bool emit);
 void pn_real_settle(pn_delivery_t *delivery);  // will free delivery if link is freed
 void pn_clear_tpwork(pn_delivery_t *delivery);
+void pni_delivery_pin(pn_transport_t *transport, pn_delivery_t *delivery, pn_bytes_t view);
+void pni_delivery_unpin(pn_delivery_t *delivery, bool keep);
 void pn_work_update(pn_connection_t *connection, pn_delivery_t *delivery);
 void pn_clear_modified(pn_connection_t *connection, pn_endpoint_t *endpoint);
 void pn_connection_bound(pn_connection_t *conn);
@@ -372,8 +437,22 @@ void pn_link_unbound(pn_link_t* link);
 void pn_ep_incref(pn_endpoint_t *endpoint);
 void pn_ep_decref(pn_endpoint_t *endpoint);
 
+/* Send bytes on the current delivery of a sender by filling space in the
+   delivery's own buffer, rather than copying them in with pn_link_send() */
+pn_rwbytes_t pni_link_send_reserve(pn_link_t *sender, size_t n);
+ssize_t pni_link_send_commit(pn_link_t *sender, size_t n);
+
+/* True if the session's incoming window should be refreshed with a flow */
+bool pni_session_refresh_incoming_window(pn_session_t *ssn);
+
 int pn_post_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, const char *fmt, ...);
 
+/* Frame output waiting to be produced, in output_buffer and slices */
+size_t pni_output_size(pn_transport_t *transport);
+/* Copy up to size bytes of frame output to dst, or discard them if dst
+   is NULL, returning the number taken */
+size_t pni_output_take(pn_transport_t *transport, char *dst, size_t size);
+
 typedef enum {IN, OUT} pn_dir_t;
 
 void pn_do_trace(pn_transport_t *transport, uint16_t ch, pn_dir_t dir,
@@ -950,6 +950,7 @@ static void pn_session_finalize(void *object)
   pni_endpoint_tini(endpoint);
   pn_delivery_map_free(&session->state.incoming);
   pn_delivery_map_free(&session->state.outgoing);
+  free(session->state.disp_ranges);
   pn_free(session->state.local_handles);
   pn_free(session->state.remote_handles);
   pni_remove_session(session->connection, session);
@@ -989,6 +990,7 @@ pn_session_t *pn_session(pn_connection_t *conn)
   ssn->freed = pn_list(PN_WEAKREF, 0);
   ssn->context = pn_record();
   ssn->incoming_capacity = 0;
+  ssn->incoming_low_water = 0;
   ssn->incoming_bytes = 0;
   ssn->outgoing_bytes = 0;
   ssn->incoming_deliveries = 0;
@@ -1042,8 +1044,27 @@ size_t pn_session_get_incoming_capacity(pn_session_t *ssn)
 void pn_session_set_incoming_capacity(pn_session_t *ssn, size_t capacity)
 {
   assert(ssn);
-  // XXX: should this trigger a flow?
   ssn->incoming_capacity = capacity;
+  // Let the receivers announce the new window if it is time to refresh it
+  size_t nlinks = pn_list_size(ssn->links);
+  for (size_t i = 0; i < nlinks; i++) {
+    pn_link_t *link = (pn_link_t *) pn_list_get(ssn->links, i);
+    if (link->endpoint.type == RECEIVER) {
+      pn_modified(ssn->connection, &link->endpoint, true);
+    }
+  }
+}
+
+size_t pn_session_get_incoming_low_water(pn_session_t *ssn)
+{
+  assert(ssn);
+  return ssn->incoming_low_water;
+}
+
+void pn_session_set_incoming_low_water(pn_session_t *ssn, size_t low_water)
+{
+  assert(ssn);
+  ssn->incoming_low_water = low_water;
 }
 
 size_t pn_session_get_outgoing_window(pn_session_t *ssn)
@@ -1178,6 +1199,7 @@ pn_link_t *pn_link_new(int type, pn_session_t *session, const char *name)
   link->remote_snd_settle_mode = PN_SND_MIXED;
   link->remote_rcv_settle_mode = PN_RCV_FIRST;
   link->detached = false;
+  link->input_view = false;
 
   // begin transport state
   link->state.local_handle = -1;
@@ -1447,6 +1469,7 @@ static void pn_delivery_finalize(void *object)
     referenced = delivery->referenced;
 
     pn_clear_tpwork(delivery);
+    pni_delivery_unpin(delivery, false);
     LL_REMOVE(link, unsettled, delivery);
     pn_delivery_map_del(pn_link_is_sender(link)
                         ? &link->session->state.outgoing
@@ -1561,6 +1584,9 @@ pn_delivery_t *pn_delivery(pn_link_t *link, pn_delivery_tag_t tag)
   delivery->tpwork_prev = NULL;
   delivery->tpwork = false;
   pn_buffer_clear(delivery->bytes);
+  delivery->view = pn_bytes(0, NULL);
+  delivery->pinned_next = NULL;
+  delivery->pinned_prev = NULL;
   delivery->done = false;
   delivery->aborted = false;
   pn_record_clear(delivery->context);
@@ -1772,10 +1798,11 @@ static void pni_advance_receiver(pn_link_t *link)
   link->session->incoming_deliveries--;
 
   pn_delivery_t *current = link->current;
-  link->session->incoming_bytes -= pn_buffer_size(current->bytes);
+  link->session->incoming_bytes -= pn_buffer_size(current->bytes) + current->view.size;
   pn_buffer_clear(current->bytes);
+  pni_delivery_unpin(current, false);
 
-  if (!link->session->state.incoming_window) {
+  if (pni_session_refresh_incoming_window(link->session)) {
     pni_add_tpwork(current);
   }
 
@@ -1895,6 +1922,27 @@ ssize_t pn_link_send(pn_link_t *sender, const char *bytes, size_t n)
   return n;
 }
 
+pn_rwbytes_t pni_link_send_reserve(pn_link_t *sender, size_t n)
+{
+  pn_delivery_t *current = pn_link_current(sender);
+  if (!current) {
+    pn_rwbytes_t r = {0, NULL};
+    return r;
+  }
+  return pn_buffer_reserve(current->bytes, n);
+}
+
+ssize_t pni_link_send_commit(pn_link_t *sender, size_t n)
+{
+  pn_delivery_t *current = pn_link_current(sender);
+  if (!current) return PN_EOS;
+  if (!n) return 0;
+  pn_buffer_extend(current->bytes, n);
+  sender->session->outgoing_bytes += n;
+  pni_add_tpwork(current);
+  return n;
+}
+
 int pn_link_drained(pn_link_t *link)
 {
   assert(link);
@@ -1921,11 +1969,12 @@ ssize_t pn_link_recv(pn_link_t *receiver, char *bytes, size_t n)
   pn_delivery_t *delivery = receiver->current;
   if (!delivery) return PN_STATE_ERR;
   if (delivery->aborted) return PN_ABORTED;
+  pni_delivery_unpin(delivery, true);
   size_t size = pn_buffer_get(delivery->bytes, 0, n, bytes);
   pn_buffer_trim(delivery->bytes, size, 0);
   if (size) {
     receiver->session->incoming_bytes -= size;
-    if (!receiver->session->state.incoming_window) {
+    if (pni_session_refresh_incoming_window(receiver->session)) {
       pni_add_tpwork(delivery);
     }
     return size;
@@ -1982,6 +2031,18 @@ void pn_link_set_max_message_size(pn_link_t *link, uint64_t size)
   link->max_message_size = size;
 }
 
+void pn_link_set_input_view(pn_link_t *receiver, bool view)
+{
+  assert(receiver);
+  receiver->input_view = view;
+}
+
+bool pn_link_get_input_view(pn_link_t *receiver)
+{
+  assert(receiver);
+  return receiver->input_view;
+}
+
 uint64_t pn_link_remote_max_message_size(pn_link_t *link)
 {
   return link->remote_max_message_size;
@@ -2065,7 +2126,35 @@ size_t pn_delivery_pending(pn_delivery_t *delivery)
      the PN_ABORTED error return code.
   */
   if (delivery->aborted) return 1;
-  return pn_buffer_size(delivery->bytes);
+  return pn_buffer_size(delivery->bytes) + delivery->view.size;
+}
+
+pn_bytes_t pn_delivery_bytes_view(pn_delivery_t *delivery)
+{
+  if (delivery->aborted) return pn_bytes(0, NULL);
+  if (delivery->view.size) return delivery->view;
+  return pn_buffer_bytes(delivery->bytes);
+}
+
+// The transport keeps the pinned part of its input buffer in place
+void pni_delivery_pin(pn_transport_t *transport, pn_delivery_t *delivery, pn_bytes_t view)
+{
+  assert(!delivery->view.size && !pn_buffer_size(delivery->bytes));
+  delivery->view = view;
+  LL_ADD(transport, pinned, delivery);
+}
+
+// Release a delivery's view, copying its data into the delivery first if keep
+void pni_delivery_unpin(pn_delivery_t *delivery, bool keep)
+{
+  if (!delivery->view.size) return;
+  pn_transport_t *transport = delivery->link->session->connection->transport;
+  assert(transport);
+  if (keep) pn_buffer_append(delivery->bytes, delivery->view.start, delivery->view.size);
+  delivery->view = pn_bytes(0, NULL);
+  LL_REMOVE(transport, pinned, delivery);
+  delivery->pinned_next = NULL;
+  delivery->pinned_prev = NULL;
 }
 
 bool pn_delivery_partial(pn_delivery_t *delivery)
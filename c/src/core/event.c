@@ -24,29 +24,47 @@
 #include <proton/reactor.h>
 #include <assert.h>
 
+/*
+  Events are recycled by the collector that created them: when the last
+  reference to an event is released it goes back on the collector's free
+  list, ready for the next pn_collector_put(). Every event a collector creates is also on its
+  list of owned events, so when the collector is finalized it can free the
+  recycled events and detach any that are still referenced elsewhere (for
+  example by a language binding), which then free themselves.
+*/
+
 struct pn_collector_t {
-  pn_list_t *pool;
   pn_event_t *head;
   pn_event_t *tail;
   pn_event_t *prev;         /* event returned by previous call to pn_collector_next() */
+  pn_event_t *free_events;  /* recycled events, linked by next */
+  pn_event_t *events;       /* all events owned by this collector, linked by owned_next */
   bool freed;
 };
 
 struct pn_event_t {
-  pn_list_t *pool;
+  pn_collector_t *collector;  // NULL once the owning collector is finalized
   const pn_class_t *clazz;
-  void *context;    // depends on clazz
-  pn_record_t *attachments;
+  void *context;    // depends on clazz, NULL while recycled
+  pn_record_t *attachments;   // created on first use
   pn_event_t *next;
+  pn_event_t *owned_next;
   pn_event_type_t type;
 };
 
+static void pni_event_destroy(pn_event_t *event)
+{
+  pn_decref(event->attachments);
+  pn_object_free(event);
+}
+
 static void pn_collector_initialize(pn_collector_t *collector)
 {
-  collector->pool = pn_list(PN_OBJECT, 0);
   collector->head = NULL;
   collector->tail = NULL;
   collector->prev = NULL;
+  collector->free_events = NULL;
+  collector->events = NULL;
   collector->freed = false;
 }
 
@@ -62,13 +80,27 @@ void pn_collector_drain(pn_collector_t *collector)
 static void pn_collector_shrink(pn_collector_t *collector)
 {
   assert(collector);
-  pn_list_clear(collector->pool);
+  pn_event_t **owned = &collector->events;
+  while (*owned) {
+    pn_event_t *event = *owned;
+    if (!event->context) {
+      *owned = event->owned_next;
+      pni_event_destroy(event);
+    } else {
+      owned = &event->owned_next;
+    }
+  }
+  collector->free_events = NULL;
 }
 
 static void pn_collector_finalize(pn_collector_t *collector)
 {
   pn_collector_drain(collector);
-  pn_decref(collector->pool);
+  pn_collector_shrink(collector);
+  for (pn_event_t *event = collector->events; event; event = event->owned_next) {
+    event->collector = NULL;
+  }
+  collector->events = NULL;
 }
 
 static int pn_collector_inspect(pn_collector_t *collector, pn_string_t *dst)
@@ -119,7 +151,7 @@ void pn_collector_release(pn_collector_t *collector)
   }
 }
 
-pn_event_t *pn_event(void);
+static pn_event_t *pni_event(pn_collector_t *collector);
 
 pn_event_t *pn_collector_put(pn_collector_t *collector,
                              const pn_class_t *clazz, void *context,
@@ -142,15 +174,16 @@ pn_event_t *pn_collector_put(pn_collector_t *collector,
 
   clazz = clazz->reify(context);
 
-  pn_event_t *event = (pn_event_t *) pn_list_pop(collector->pool);
-
-  if (!event) {
-    event = pn_event();
+  pn_event_t *event = collector->free_events;
+  if (event) {
+    collector->free_events = event->next;
+    event->next = NULL;
+    pn_object_incref(event);
+  } else {
+    event = pni_event(collector);
+    if (!event) return NULL;
   }
 
-  event->pool = collector->pool;
-  pn_incref(event->pool);
-
   if (tail) {
     tail->next = event;
     collector->tail = event;
@@ -210,41 +243,33 @@ bool pn_collector_more(pn_collector_t *collector)
   return collector->head && collector->head->next;
 }
 
-static void pn_event_initialize(pn_event_t *event)
-{
-  event->pool = NULL;
-  event->type = PN_EVENT_NONE;
-  event->clazz = NULL;
-  event->context = NULL;
-  event->next = NULL;
-  event->attachments = pn_record();
-}
-
-static void pn_event_finalize(pn_event_t *event) {
-  // decref before adding to the free list
+static void pn_event_finalize(void *object) {
+  pn_event_t *event = (pn_event_t *) object;
   if (event->clazz && event->context) {
     pn_class_decref(event->clazz, event->context);
   }
+}
 
-  pn_list_t *pool = event->pool;
-
-  if (pool && pn_refcount(pool) > 1) {
-    event->pool = NULL;
+static void pn_event_free(void *object) {
+  pn_event_t *event = (pn_event_t *) object;
+  pn_collector_t *collector = event->collector;
+  if (collector) {
     event->type = PN_EVENT_NONE;
     event->clazz = NULL;
     event->context = NULL;
-    event->next = NULL;
-    pn_record_clear(event->attachments);
-    pn_list_add(pool, event);
+    if (event->attachments) {
+      pn_record_clear(event->attachments);
+    }
+    event->next = collector->free_events;
+    collector->free_events = event;
   } else {
-    pn_decref(event->attachments);
+    pni_event_destroy(event);
   }
-
-  pn_decref(pool);
 }
 
-static int pn_event_inspect(pn_event_t *event, pn_string_t *dst)
+static int pn_event_inspect(void *object, pn_string_t *dst)
 {
+  pn_event_t *event = (pn_event_t *) object;
   assert(event);
   assert(dst);
   const char *name = pn_event_type_name(event->type);
@@ -265,14 +290,24 @@ static int pn_event_inspect(pn_event_t *event, pn_string_t *dst)
   return pn_string_addf(dst, ")");
 }
 
+#define pn_event_new pn_object_new
+#define pn_event_initialize NULL
+#define pn_event_incref pn_object_incref
+#define pn_event_decref pn_object_decref
+#define pn_event_refcount pn_object_refcount
+#define pn_event_reify pn_object_reify
 #define pn_event_hashcode NULL
 #define pn_event_compare NULL
 
-PN_CLASSDEF(pn_event)
-
-pn_event_t *pn_event(void)
+static pn_event_t *pni_event(pn_collector_t *collector)
 {
-  return pn_event_new();
+  static const pn_class_t clazz = PN_METACLASS(pn_event);
+  pn_event_t *event = (pn_event_t *) pn_class_new(&clazz, sizeof(pn_event_t));
+  if (!event) return NULL;
+  event->collector = collector;
+  event->owned_next = collector->events;
+  collector->events = event;
+  return event;
 }
 
 pn_event_type_t pn_event_type(pn_event_t *event)
@@ -295,6 +330,9 @@ void *pn_event_context(pn_event_t *event)
 pn_record_t *pn_event_attachments(pn_event_t *event)
 {
   assert(event);
+  if (!event->attachments) {
+    event->attachments = pn_record();
+  }
   return event->attachments;
 }
 
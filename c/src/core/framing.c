@@ -85,8 +85,20 @@ ssize_t pn_read_frame(pn_frame_t *frame, const char *bytes, size_t available, ui
 
 size_t pn_write_frame(pn_buffer_t* buffer, pn_frame_t frame)
 {
-  size_t size = AMQP_HEADER_SIZE + frame.ex_size + frame.size;
-  if (size <= pn_buffer_available(buffer))
+  return pn_write_frame_body(buffer, frame, pn_bytes(0, NULL));
+}
+
+size_t pn_write_frame_body(pn_buffer_t* buffer, pn_frame_t frame, pn_bytes_t body)
+{
+  size_t size = pn_write_frame_head(buffer, frame, body.size);
+  if (size) pn_buffer_append(buffer, body.start, body.size);
+  return size;
+}
+
+size_t pn_write_frame_head(pn_buffer_t* buffer, pn_frame_t frame, size_t body_size)
+{
+  size_t size = AMQP_HEADER_SIZE + frame.ex_size + frame.size + body_size;
+  if (size - body_size <= pn_buffer_available(buffer))
   {
     // Prepare header
     char bytes[8];
@@ -43,5 +43,12 @@ typedef struct {
 
 ssize_t pn_read_frame(pn_frame_t *frame, const char *bytes, size_t available, uint32_t max);
 size_t pn_write_frame(pn_buffer_t* buffer, pn_frame_t frame);
+// As pn_write_frame but the frame content is frame.payload followed by body.
+// Allows a transfer payload to be written straight from the delivery without
+// first copying it next to the encoded performative.
+size_t pn_write_frame_body(pn_buffer_t* buffer, pn_frame_t frame, pn_bytes_t body);
+// As pn_write_frame_body but only writes the header and frame.payload, the
+// body_size bytes of body must be written after them separately.
+size_t pn_write_frame_head(pn_buffer_t* buffer, pn_frame_t frame, size_t body_size);
 
 #endif /* framing.h */
@@ -28,12 +28,57 @@ extern "C" {
 
 /** @cond INTERNAL */
 
+/** Sections of an encoded message, in the order they are encoded */
+typedef enum {
+  PNI_SECTION_HEADER,
+  PNI_SECTION_DELIVERY_ANNOTATIONS,
+  PNI_SECTION_MESSAGE_ANNOTATIONS,
+  PNI_SECTION_PROPERTIES,
+  PNI_SECTION_APPLICATION_PROPERTIES,
+  PNI_SECTION_BODY,
+  PNI_SECTION_COUNT
+} pni_section_t;
+
+#define PNI_SECTION_BIT(section) (1u << (section))
+#define PNI_SECTIONS_ALL (PNI_SECTION_BIT(PNI_SECTION_COUNT) - 1)
+
 /** Construct a message with extra storage */
 PN_EXTERN pn_message_t * pni_message_with_extra(size_t extra);
 
 /** Pointer to extra space allocated by pn_message_with_extra(). */
 PN_EXTERN void* pni_message_get_extra(pn_message_t *msg);
 
+/** Decode any of sections (PNI_SECTION_BIT()s) that pn_message_decode_lazy()
+ * left undecoded. The pn_message_t accessors do this too, but cannot report
+ * a malformed section.
+ * @return an error code if any of sections is malformed, now or when it was
+ * decoded before.
+ */
+PN_EXTERN int pni_message_check_sections(pn_message_t *msg, unsigned sections);
+
+/** Prepare msg for encoding and return its exact encoded size (or an error
+ * code). Must be followed by pni_message_encode_prepared().
+ */
+PN_EXTERN ssize_t pni_message_encoded_size(pn_message_t *msg);
+
+/** Encode the message prepared by pni_message_encoded_size().
+ * @return the encoded length, PN_OVERFLOW if size is too small, or an error code.
+ */
+PN_EXTERN ssize_t pni_message_encode_prepared(pn_message_t *msg, char *bytes, size_t size);
+
+/** Encode msg straight into the current delivery of the sender link,
+ * without an intermediate buffer. Does not advance the link.
+ * @return the encoded length or an error code.
+ */
+PN_EXTERN ssize_t pni_message_send_direct(pn_message_t *msg, pn_link_t *sender);
+
+/** For a message that is reused to receive: if the copy of the encoded
+ * message it keeps for lazy decoding has grown past the 64KiB a pooled
+ * message may keep, clear the message and free the copy.
+ * @return true if the message was cleared.
+ */
+PN_EXTERN bool pni_message_trim(pn_message_t *msg);
+
 /** @endcond */
 
 #ifdef __cplusplus
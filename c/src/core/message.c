@@ -19,8 +19,12 @@
  *
  */
 
+#include "platform/platform.h"
 #include "platform/platform_fmt.h"
 
+#include "consumers.h"
+#include "data.h"
+#include "engine-internal.h"
 #include "max_align.h"
 #include "message-internal.h"
 #include "protocol.h"
@@ -37,6 +41,11 @@
 
 // message
 
+typedef struct {
+  size_t offset;
+  size_t size;
+} pni_section_span_t;
+
 struct pn_message_t {
   pn_timestamp_t expiry_time;
   pn_timestamp_t creation_time;
@@ -59,6 +68,22 @@ struct pn_message_t {
 
   pn_error_t *error;
 
+  // Copy of the bytes the message was decoded from and where each section
+  // is in it. Sections in lazy have not been decoded yet, sections in clean
+  // have not been changed since and are encoded by copying their bytes.
+  // generations holds the pn_data_t generations of each section as decoded.
+  // Sections in malformed failed to decode when they were loaded.
+  char *encoded;
+  size_t encoded_capacity;
+  pni_section_span_t spans[PNI_SECTION_COUNT];
+  unsigned generations[PNI_SECTION_COUNT];
+  unsigned lazy;
+  unsigned clean;
+  unsigned malformed;
+
+  size_t alloc_size;            // for reuse from the message pool
+  pn_message_t *pool_next;
+
   pn_sequence_t group_sequence;
   pn_millis_t ttl;
   uint32_t delivery_count;
@@ -89,11 +114,28 @@ void pn_message_finalize(void *obj)
   pn_data_free(msg->properties);
   pn_data_free(msg->body);
   pn_error_free(msg->error);
+  free(msg->encoded);
+}
+
+static int pni_message_load_sections(pn_message_t *msg, unsigned sections);
+
+// Decode any of the sections that are still lazy
+static inline void pni_message_load(pn_message_t *msg, unsigned sections)
+{
+  if (msg->lazy & sections) pni_message_load_sections(msg, sections);
+}
+
+// Decode sections that are about to be changed, they must now be re-encoded
+static inline void pni_message_touch(pn_message_t *msg, unsigned sections)
+{
+  pni_message_load(msg, sections);
+  msg->clean &= ~sections;
 }
 
 int pn_message_inspect(void *obj, pn_string_t *dst)
 {
   pn_message_t *msg = (pn_message_t *) obj;
+  pni_message_load(msg, PNI_SECTIONS_ALL);
   int err = pn_string_addf(dst, "Message{");
   if (err) return err;
 
@@ -305,10 +347,93 @@ int pn_message_inspect(void *obj, pn_string_t *dst)
 #define pn_message_hashcode NULL
 #define pn_message_compare NULL
 
+/*
+  Messages freed with pn_message_free() are cleared and kept in a small
+  per-thread pool, with all the strings and data they own, so a thread
+  that keeps creating and freeing messages stops allocating. Only messages
+  of one allocation size (with or without extra storage) are pooled at a
+  time, and not those that have grown to hold a large message. The pool is
+  released when the thread exits.
+*/
+#define PNI_MESSAGE_POOL_MAX 32
+#define PNI_MESSAGE_POOL_RETAINED (64*1024)
+
+typedef struct {
+  pn_message_t *head;
+  size_t size;
+  int count;
+  bool hooked;                  // Released when the thread exits
+  bool exiting;                 // Released, stop pooling
+} pni_message_pool_t;
+
+static PNI_THREAD_LOCAL pni_message_pool_t pni_message_pool;
+
+static void pni_message_pool_exit(void)
+{
+  pni_message_pool_t *pool = &pni_message_pool;
+  pool->exiting = true;
+  while (pool->head) {
+    pn_message_t *msg = pool->head;
+    pool->head = msg->pool_next;
+    pn_free(msg);
+  }
+  pool->count = 0;
+}
+
+// Bytes a cleared message keeps for reuse, leaving out the short strings
+static size_t pni_message_retained(pn_message_t *msg)
+{
+  return msg->encoded_capacity +
+    pni_data_retained(msg->id) + pni_data_retained(msg->correlation_id) +
+    pni_data_retained(msg->data) + pni_data_retained(msg->instructions) +
+    pni_data_retained(msg->annotations) + pni_data_retained(msg->properties) +
+    pni_data_retained(msg->body);
+}
+
+static pn_message_t *pni_message_pool_get(size_t size)
+{
+  pni_message_pool_t *pool = &pni_message_pool;
+  pn_message_t *msg = pool->head;
+  if (!msg || pool->size != size) return NULL;
+  pool->head = msg->pool_next;
+  pool->count--;
+  msg->pool_next = NULL;
+  return msg;
+}
+
+static bool pni_message_pool_put(pn_message_t *msg)
+{
+  pni_message_pool_t *pool = &pni_message_pool;
+  if (!pool->hooked && !pool->exiting) {
+    // Don't pool anything the thread could not release
+    pool->hooked = true;
+    pool->exiting = pni_thread_exit_hook(pni_message_pool_exit) != 0;
+  }
+  if (pool->exiting || pni_message_retained(msg) > PNI_MESSAGE_POOL_RETAINED) {
+    return false;
+  }
+  if (pool->count == 0) {
+    pool->size = msg->alloc_size;
+  } else if (pool->size != msg->alloc_size || pool->count >= PNI_MESSAGE_POOL_MAX) {
+    return false;
+  }
+  pn_message_clear(msg);
+  pn_error_clear(msg->error);
+  msg->pool_next = pool->head;
+  pool->head = msg;
+  pool->count++;
+  return true;
+}
+
 static pn_message_t *pni_message_new(size_t size)
 {
   static const pn_class_t clazz = PN_CLASS(pn_message);
-  pn_message_t *msg = (pn_message_t *) pn_class_new(&clazz, size);
+  pn_message_t *msg = pni_message_pool_get(size);
+  if (msg) return msg;
+
+  msg = (pn_message_t *) pn_class_new(&clazz, size);
+  msg->alloc_size = size;
+  msg->pool_next = NULL;
   msg->durable = false;
   msg->priority = HEADER_PRIORITY_DEFAULT;
   msg->ttl = 0;
@@ -336,6 +461,11 @@ static pn_message_t *pni_message_new(size_t size)
   msg->body = pn_data(16);
 
   msg->error = pn_error();
+  msg->encoded = NULL;
+  msg->encoded_capacity = 0;
+  msg->lazy = 0;
+  msg->clean = 0;
+  msg->malformed = 0;
   return msg;
 }
 
@@ -359,6 +489,8 @@ void *pni_message_get_extra(pn_message_t *m) {
 
 void pn_message_free(pn_message_t *msg)
 {
+  // Only pool a message nobody else holds a reference to
+  if (msg && pn_refcount(msg) == 1 && pni_message_pool_put(msg)) return;
   pn_free(msg);
 }
 
@@ -388,6 +520,9 @@ void pn_message_clear(pn_message_t *msg)
   pn_data_clear(msg->annotations);
   pn_data_clear(msg->properties);
   pn_data_clear(msg->body);
+  msg->lazy = 0;
+  msg->clean = 0;
+  msg->malformed = 0;
 }
 
 int pn_message_errno(pn_message_t *msg)
@@ -405,12 +540,14 @@ pn_error_t *pn_message_error(pn_message_t *msg)
 bool pn_message_is_inferred(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_BODY));
   return msg->inferred;
 }
 
 int pn_message_set_inferred(pn_message_t *msg, bool inferred)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_BODY));
   msg->inferred = inferred;
   return 0;
 }
@@ -418,11 +555,13 @@ int pn_message_set_inferred(pn_message_t *msg, bool inferred)
 bool pn_message_is_durable(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_HEADER));
   return msg->durable;
 }
 int pn_message_set_durable(pn_message_t *msg, bool durable)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_HEADER));
   msg->durable = durable;
   return 0;
 }
@@ -431,11 +570,13 @@ int pn_message_set_durable(pn_message_t *msg, bool durable)
 uint8_t pn_message_get_priority(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_HEADER));
   return msg->priority;
 }
 int pn_message_set_priority(pn_message_t *msg, uint8_t priority)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_HEADER));
   msg->priority = priority;
   return 0;
 }
@@ -443,11 +584,13 @@ int pn_message_set_priority(pn_message_t *msg, uint8_t priority)
 pn_millis_t pn_message_get_ttl(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_HEADER));
   return msg->ttl;
 }
 int pn_message_set_ttl(pn_message_t *msg, pn_millis_t ttl)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_HEADER));
   msg->ttl = ttl;
   return 0;
 }
@@ -455,11 +598,13 @@ int pn_message_set_ttl(pn_message_t *msg, pn_millis_t ttl)
 bool pn_message_is_first_acquirer(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_HEADER));
   return msg->first_acquirer;
 }
 int pn_message_set_first_acquirer(pn_message_t *msg, bool first)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_HEADER));
   msg->first_acquirer = first;
   return 0;
 }
@@ -467,11 +612,13 @@ int pn_message_set_first_acquirer(pn_message_t *msg, bool first)
 uint32_t pn_message_get_delivery_count(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_HEADER));
   return msg->delivery_count;
 }
 int pn_message_set_delivery_count(pn_message_t *msg, uint32_t count)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_HEADER));
   msg->delivery_count = count;
   return 0;
 }
@@ -479,16 +626,19 @@ int pn_message_set_delivery_count(pn_message_t *msg, uint32_t count)
 pn_data_t *pn_message_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return msg->id;
 }
 pn_atom_t pn_message_get_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_data_get_atom(msg->id);
 }
 int pn_message_set_id(pn_message_t *msg, pn_atom_t id)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   pn_data_rewind(msg->id);
   return pn_data_put_atom(msg->id, id);
 }
@@ -506,60 +656,71 @@ static int pn_string_set_bytes(pn_string_t *string, pn_bytes_t bytes)
 pn_bytes_t pn_message_get_user_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_string_get_bytes(msg->user_id);
 }
 int pn_message_set_user_id(pn_message_t *msg, pn_bytes_t user_id)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_string_set_bytes(msg->user_id, user_id);
 }
 
 const char *pn_message_get_address(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_string_get(msg->address);
 }
 int pn_message_set_address(pn_message_t *msg, const char *address)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_string_set(msg->address, address);
 }
 
 const char *pn_message_get_subject(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_string_get(msg->subject);
 }
 int pn_message_set_subject(pn_message_t *msg, const char *subject)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_string_set(msg->subject, subject);
 }
 
 const char *pn_message_get_reply_to(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_string_get(msg->reply_to);
 }
 int pn_message_set_reply_to(pn_message_t *msg, const char *reply_to)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_string_set(msg->reply_to, reply_to);
 }
 
 pn_data_t *pn_message_correlation_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return msg->correlation_id;
 }
 pn_atom_t pn_message_get_correlation_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_data_get_atom(msg->correlation_id);
 }
 int pn_message_set_correlation_id(pn_message_t *msg, pn_atom_t atom)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   pn_data_rewind(msg->correlation_id);
   return pn_data_put_atom(msg->correlation_id, atom);
 }
@@ -567,33 +728,39 @@ int pn_message_set_correlation_id(pn_message_t *msg, pn_atom_t atom)
 const char *pn_message_get_content_type(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_string_get(msg->content_type);
 }
 int pn_message_set_content_type(pn_message_t *msg, const char *type)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_string_set(msg->content_type, type);
 }
 
 const char *pn_message_get_content_encoding(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_string_get(msg->content_encoding);
 }
 int pn_message_set_content_encoding(pn_message_t *msg, const char *encoding)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_string_set(msg->content_encoding, encoding);
 }
 
 pn_timestamp_t pn_message_get_expiry_time(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return msg->expiry_time;
 }
 int pn_message_set_expiry_time(pn_message_t *msg, pn_timestamp_t time)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   msg->expiry_time = time;
   return 0;
 }
@@ -601,11 +768,13 @@ int pn_message_set_expiry_time(pn_message_t *msg, pn_timestamp_t time)
 pn_timestamp_t pn_message_get_creation_time(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return msg->creation_time;
 }
 int pn_message_set_creation_time(pn_message_t *msg, pn_timestamp_t time)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   msg->creation_time = time;
   return 0;
 }
@@ -613,22 +782,26 @@ int pn_message_set_creation_time(pn_message_t *msg, pn_timestamp_t time)
 const char *pn_message_get_group_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_string_get(msg->group_id);
 }
 int pn_message_set_group_id(pn_message_t *msg, const char *group_id)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_string_set(msg->group_id, group_id);
 }
 
 pn_sequence_t pn_message_get_group_sequence(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return msg->group_sequence;
 }
 int pn_message_set_group_sequence(pn_message_t *msg, pn_sequence_t n)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   msg->group_sequence = n;
   return 0;
 }
@@ -636,20 +809,19 @@ int pn_message_set_group_sequence(pn_message_t *msg, pn_sequence_t n)
 const char *pn_message_get_reply_to_group_id(pn_message_t *msg)
 {
   assert(msg);
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_string_get(msg->reply_to_group_id);
 }
 int pn_message_set_reply_to_group_id(pn_message_t *msg, const char *reply_to_group_id)
 {
   assert(msg);
+  pni_message_touch(msg, PNI_SECTION_BIT(PNI_SECTION_PROPERTIES));
   return pn_string_set(msg->reply_to_group_id, reply_to_group_id);
 }
 
-int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size)
+// Decode the sections in bytes into the message fields
+static int pni_message_decode_sections(pn_message_t *msg, const char *bytes, size_t size)
 {
-  assert(msg && bytes && size);
-
-  pn_message_clear(msg);
-
   while (size) {
     pn_data_clear(msg->data);
     ssize_t used = pn_data_decode(msg->data, bytes, size);
@@ -761,42 +933,247 @@ int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size)
   return 0;
 }
 
-int pn_message_encode(pn_message_t *msg, char *bytes, size_t *size)
+static unsigned pni_section_generation(pn_message_t *msg, int section)
 {
-  if (!msg || !bytes || !size || !*size) return PN_ARG_ERR;
-  pn_data_clear(msg->data);
-  pn_message_data(msg, msg->data);
-  size_t remaining = *size;
-  ssize_t encoded = pn_data_encode(msg->data, bytes, remaining);
-  if (encoded < 0) {
-    if (encoded == PN_OVERFLOW) {
-      return encoded;
+  switch (section) {
+  case PNI_SECTION_DELIVERY_ANNOTATIONS: return msg->instructions->generation;
+  case PNI_SECTION_MESSAGE_ANNOTATIONS: return msg->annotations->generation;
+  case PNI_SECTION_PROPERTIES: return msg->id->generation + msg->correlation_id->generation;
+  case PNI_SECTION_APPLICATION_PROPERTIES: return msg->properties->generation;
+  case PNI_SECTION_BODY: return msg->body->generation;
+  default: return 0;
+  }
+}
+
+static int pni_section_for_code(uint64_t code)
+{
+  switch (code) {
+  case HEADER: return PNI_SECTION_HEADER;
+  case DELIVERY_ANNOTATIONS: return PNI_SECTION_DELIVERY_ANNOTATIONS;
+  case MESSAGE_ANNOTATIONS: return PNI_SECTION_MESSAGE_ANNOTATIONS;
+  case PROPERTIES: return PNI_SECTION_PROPERTIES;
+  case APPLICATION_PROPERTIES: return PNI_SECTION_APPLICATION_PROPERTIES;
+  case DATA:
+  case AMQP_SEQUENCE:
+  case AMQP_VALUE: return PNI_SECTION_BODY;
+  default: return -1;
+  }
+}
+
+/*
+  Find where each section of msg->encoded starts and ends without decoding
+  them. Returns false if the sections are not all described by one of the
+  standard descriptor codes, or a kind of section appears in more than one
+  place, so that the message must be decoded eagerly.
+*/
+static bool pni_message_index(pn_message_t *msg, size_t size)
+{
+  pni_consumer_t consumer = pni_consumer(pn_bytes(size, msg->encoded));
+  memset(msg->spans, 0, sizeof(msg->spans));
+  unsigned found = 0;
+  while (consumer.position < consumer.size) {
+    size_t start = consumer.position;
+    uint64_t code;
+    uint8_t type;
+    if (!pni_consume_descriptor(&consumer, &code) ||
+        !pni_consumer_next(&consumer, &type) ||
+        !pni_consumer_skip_value(&consumer, type)) {
+      return false;
+    }
+    if (code == FOOTER) continue; // Not kept, as for pn_message_decode()
+
+    int section = pni_section_for_code(code);
+    if (section < 0 || section >= PNI_SECTION_COUNT) return false;
+    pni_section_span_t *span = &msg->spans[section];
+    if (found & PNI_SECTION_BIT(section)) {
+      // Repeated body sections are contiguous, anything else is unusual
+      if (span->offset + span->size != start) return false;
     } else {
-      return pn_error_format(msg->error, encoded, "data error: %s",
-                             pn_error_text(pn_data_error(msg->data)));
+      span->offset = start;
+      found |= PNI_SECTION_BIT(section);
+    }
+    span->size = consumer.position - span->offset;
+  }
+  msg->lazy = found;
+  msg->clean = found;
+  return true;
+}
+
+int pn_message_decode_lazy(pn_message_t *msg, const char *bytes, size_t size)
+{
+  assert(msg && bytes && size);
+
+  pn_message_clear(msg);
+  if (msg->encoded_capacity < size) {
+    char *encoded = (char *) realloc(msg->encoded, size);
+    if (!encoded) return pn_error_format(msg->error, PN_OUT_OF_MEMORY, "cannot copy message");
+    msg->encoded = encoded;
+    msg->encoded_capacity = size;
+  }
+  memcpy(msg->encoded, bytes, size);
+
+  if (pni_message_index(msg, size)) return 0;
+  return pni_message_decode_sections(msg, msg->encoded, size);
+}
+
+bool pni_message_trim(pn_message_t *msg)
+{
+  assert(msg);
+  if (msg->encoded_capacity <= PNI_MESSAGE_POOL_RETAINED) return false;
+  pn_message_clear(msg);
+  free(msg->encoded);
+  msg->encoded = NULL;
+  msg->encoded_capacity = 0;
+  return true;
+}
+
+int pn_message_decode(pn_message_t *msg, const char *bytes, size_t size)
+{
+  int err = pn_message_decode_lazy(msg, bytes, size);
+  if (err) return err;
+  return pni_message_load_sections(msg, PNI_SECTIONS_ALL);
+}
+
+// Errors are also left in pn_message_error() for accessors that cannot return them
+static int pni_message_load_sections(pn_message_t *msg, unsigned sections)
+{
+  int result = 0;
+  unsigned load = msg->lazy & sections;
+  msg->lazy &= ~load;
+  for (int i = 0; i < PNI_SECTION_COUNT; ++i) {
+    if (load & PNI_SECTION_BIT(i)) {
+      int err = pni_message_decode_sections(msg, msg->encoded + msg->spans[i].offset, msg->spans[i].size);
+      if (err) {
+        msg->malformed |= PNI_SECTION_BIT(i);
+        if (!result) result = err;
+      }
+      msg->generations[i] = pni_section_generation(msg, i);
+    }
+  }
+  return result;
+}
+
+int pni_message_check_sections(pn_message_t *msg, unsigned sections)
+{
+  assert(msg);
+  int err = pni_message_load_sections(msg, sections);
+  if (err) return err;
+  if (msg->malformed & sections) {
+    // Loaded before, the error may since have been replaced
+    err = pn_error_code(msg->error);
+    return err ? err : PN_ERR;
+  }
+  return 0;
+}
+
+// Sections that can still be copied as they were decoded
+static unsigned pni_message_clean(pn_message_t *msg)
+{
+  for (int i = 0; i < PNI_SECTION_COUNT; ++i) {
+    unsigned bit = PNI_SECTION_BIT(i);
+    if ((msg->clean & bit) && !(msg->lazy & bit) &&
+        msg->generations[i] != pni_section_generation(msg, i)) {
+      msg->clean &= ~bit;
     }
   }
-  bytes += encoded;
-  remaining -= encoded;
-  *size -= remaining;
+  return msg->clean;
+}
+
+static int pni_message_fill(pn_message_t *msg, pn_data_t *data, unsigned sections);
+
+static ssize_t pni_message_data_encode(pn_message_t *msg, char *bytes, size_t size)
+{
+  ssize_t encoded = pn_data_encode(msg->data, bytes, size);
+  if (encoded < 0 && encoded != PN_OVERFLOW) {
+    encoded = pn_error_format(msg->error, encoded, "data error: %s",
+                              pn_error_text(pn_data_error(msg->data)));
+  }
+  return encoded;
+}
+
+/*
+  Clean sections are copied from the decoded bytes as they are, the rest
+  are encoded from msg->data.
+*/
+ssize_t pni_message_encoded_size(pn_message_t *msg)
+{
+  unsigned clean = pni_message_clean(msg);
   pn_data_clear(msg->data);
+  int err = pni_message_fill(msg, msg->data, PNI_SECTIONS_ALL & ~clean);
+  if (err) return err;
+  ssize_t size = pn_data_encoded_size(msg->data);
+  if (size < 0) {
+    return pn_error_format(msg->error, size, "data error: %s",
+                           pn_error_text(pn_data_error(msg->data)));
+  }
+  for (int i = 0; i < PNI_SECTION_COUNT; ++i) {
+    if (clean & PNI_SECTION_BIT(i)) size += msg->spans[i].size;
+  }
+  return size;
+}
+
+ssize_t pni_message_encode_prepared(pn_message_t *msg, char *bytes, size_t size)
+{
+  unsigned clean = pni_message_clean(msg);
+  if (!clean) {
+    ssize_t encoded = pni_message_data_encode(msg, bytes, size);
+    pn_data_clear(msg->data);
+    return encoded;
+  }
+
+  // Interleave the copied sections with runs of encoded ones
+  size_t position = 0;
+  for (int i = 0; i < PNI_SECTION_COUNT; ) {
+    if (clean & PNI_SECTION_BIT(i)) {
+      pni_section_span_t *span = &msg->spans[i++];
+      if (span->size > size - position) return PN_OVERFLOW;
+      memcpy(bytes + position, msg->encoded + span->offset, span->size);
+      position += span->size;
+      continue;
+    }
+    unsigned run = 0;
+    for (; i < PNI_SECTION_COUNT && !(clean & PNI_SECTION_BIT(i)); ++i) {
+      run |= PNI_SECTION_BIT(i);
+    }
+    pn_data_clear(msg->data);
+    int err = pni_message_fill(msg, msg->data, run);
+    if (err) return err;
+    ssize_t encoded = pni_message_data_encode(msg, bytes + position, size - position);
+    if (encoded < 0) return encoded;
+    position += encoded;
+  }
+  pn_data_clear(msg->data);
+  return position;
+}
+
+int pn_message_encode(pn_message_t *msg, char *bytes, size_t *size)
+{
+  if (!msg || !bytes || !size || !*size) return PN_ARG_ERR;
+  ssize_t encoded = pni_message_encoded_size(msg);
+  if (encoded < 0) return encoded;
+  encoded = pni_message_encode_prepared(msg, bytes, *size);
+  if (encoded < 0) return encoded;
+  *size = encoded;
   return 0;
 }
 
-int pn_message_data(pn_message_t *msg, pn_data_t *data)
+// Append the given sections of msg to data
+static int pni_message_fill(pn_message_t *msg, pn_data_t *data, unsigned sections)
 {
-  pn_data_clear(data);
-  int err = pn_data_fill(data, "DL[?o?B?I?o?I]", HEADER,
-                         msg->durable, msg->durable,
-                         msg->priority!=HEADER_PRIORITY_DEFAULT, msg->priority,
-                         (bool)msg->ttl, msg->ttl,
-                         msg->first_acquirer, msg->first_acquirer,
-                         (bool)msg->delivery_count, msg->delivery_count);
-  if (err)
-    return pn_error_format(msg->error, err, "data error: %s",
-                           pn_error_text(pn_data_error(data)));
+  int err = 0;
+  if (sections & PNI_SECTION_BIT(PNI_SECTION_HEADER)) {
+    err = pn_data_fill(data, "DL[?o?B?I?o?I]", HEADER,
+                       msg->durable, msg->durable,
+                       msg->priority!=HEADER_PRIORITY_DEFAULT, msg->priority,
+                       (bool)msg->ttl, msg->ttl,
+                       msg->first_acquirer, msg->first_acquirer,
+                       (bool)msg->delivery_count, msg->delivery_count);
+    if (err)
+      return pn_error_format(msg->error, err, "data error: %s",
+                             pn_error_text(pn_data_error(data)));
+  }
 
-  if (pn_data_size(msg->instructions)) {
+  if ((sections & PNI_SECTION_BIT(PNI_SECTION_DELIVERY_ANNOTATIONS)) && pn_data_size(msg->instructions)) {
     pn_data_put_described(data);
     pn_data_enter(data);
     pn_data_put_ulong(data, DELIVERY_ANNOTATIONS);
@@ -808,7 +1185,7 @@ int pn_message_data(pn_message_t *msg, pn_data_t *data)
     pn_data_exit(data);
   }
 
-  if (pn_data_size(msg->annotations)) {
+  if ((sections & PNI_SECTION_BIT(PNI_SECTION_MESSAGE_ANNOTATIONS)) && pn_data_size(msg->annotations)) {
     pn_data_put_described(data);
     pn_data_enter(data);
     pn_data_put_ulong(data, MESSAGE_ANNOTATIONS);
@@ -820,30 +1197,32 @@ int pn_message_data(pn_message_t *msg, pn_data_t *data)
     pn_data_exit(data);
   }
 
-  err = pn_data_fill(data, "DL[CzSSSCss?t?tS?IS]", PROPERTIES,
-                     msg->id,
-                     pn_string_size(msg->user_id), pn_string_get(msg->user_id),
-                     pn_string_get(msg->address),
-                     pn_string_get(msg->subject),
-                     pn_string_get(msg->reply_to),
-                     msg->correlation_id,
-                     pn_string_get(msg->content_type),
-                     pn_string_get(msg->content_encoding),
-                     (bool)msg->expiry_time, msg->expiry_time,
-                     (bool)msg->creation_time, msg->creation_time,
-                     pn_string_get(msg->group_id),
-                     /*
-                      * As a heuristic, null out group_sequence if there is no group_id and
-                      * group_sequence is 0. In this case it is extremely unlikely we want
-                      * group semantics
-                      */
-                     (bool)pn_string_get(msg->group_id) || (bool)msg->group_sequence , msg->group_sequence,
-                     pn_string_get(msg->reply_to_group_id));
-  if (err)
-    return pn_error_format(msg->error, err, "data error: %s",
-                           pn_error_text(pn_data_error(data)));
+  if (sections & PNI_SECTION_BIT(PNI_SECTION_PROPERTIES)) {
+    err = pn_data_fill(data, "DL[CzSSSCss?t?tS?IS]", PROPERTIES,
+                       msg->id,
+                       pn_string_size(msg->user_id), pn_string_get(msg->user_id),
+                       pn_string_get(msg->address),
+                       pn_string_get(msg->subject),
+                       pn_string_get(msg->reply_to),
+                       msg->correlation_id,
+                       pn_string_get(msg->content_type),
+                       pn_string_get(msg->content_encoding),
+                       (bool)msg->expiry_time, msg->expiry_time,
+                       (bool)msg->creation_time, msg->creation_time,
+                       pn_string_get(msg->group_id),
+                       /*
+                        * As a heuristic, null out group_sequence if there is no group_id and
+                        * group_sequence is 0. In this case it is extremely unlikely we want
+                        * group semantics
+                        */
+                       (bool)pn_string_get(msg->group_id) || (bool)msg->group_sequence , msg->group_sequence,
+                       pn_string_get(msg->reply_to_group_id));
+    if (err)
+      return pn_error_format(msg->error, err, "data error: %s",
+                             pn_error_text(pn_data_error(data)));
+  }
 
-  if (pn_data_size(msg->properties)) {
+  if ((sections & PNI_SECTION_BIT(PNI_SECTION_APPLICATION_PROPERTIES)) && pn_data_size(msg->properties)) {
     pn_data_put_described(data);
     pn_data_enter(data);
     pn_data_put_ulong(data, APPLICATION_PROPERTIES);
@@ -855,7 +1234,7 @@ int pn_message_data(pn_message_t *msg, pn_data_t *data)
     pn_data_exit(data);
   }
 
-  if (pn_data_size(msg->body)) {
+  if ((sections & PNI_SECTION_BIT(PNI_SECTION_BODY)) && pn_data_size(msg->body)) {
     pn_data_rewind(msg->body);
     pn_data_next(msg->body);
     pn_type_t body_type = pn_data_type(msg->body);
@@ -883,55 +1262,81 @@ int pn_message_data(pn_message_t *msg, pn_data_t *data)
   return 0;
 }
 
+int pn_message_data(pn_message_t *msg, pn_data_t *data)
+{
+  pni_message_load(msg, PNI_SECTIONS_ALL);
+  pn_data_clear(data);
+  return pni_message_fill(msg, data, PNI_SECTIONS_ALL);
+}
+
 pn_data_t *pn_message_instructions(pn_message_t *msg)
 {
-  return msg ? msg->instructions : NULL;
+  if (!msg) return NULL;
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_DELIVERY_ANNOTATIONS));
+  return msg->instructions;
 }
 
 pn_data_t *pn_message_annotations(pn_message_t *msg)
 {
-  return msg ? msg->annotations : NULL;
+  if (!msg) return NULL;
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_MESSAGE_ANNOTATIONS));
+  return msg->annotations;
 }
 
 pn_data_t *pn_message_properties(pn_message_t *msg)
 {
-  return msg ? msg->properties : NULL;
+  if (!msg) return NULL;
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_APPLICATION_PROPERTIES));
+  return msg->properties;
 }
 
 pn_data_t *pn_message_body(pn_message_t *msg)
 {
-  return msg ? msg->body : NULL;
+  if (!msg) return NULL;
+  pni_message_load(msg, PNI_SECTION_BIT(PNI_SECTION_BODY));
+  return msg->body;
 }
 
 ssize_t pn_message_encode2(pn_message_t *msg, pn_rwbytes_t *buffer) {
   static const size_t initial_size = 256;
-  int err = 0;
-  size_t size = 0;
 
-  if (buffer->start == NULL) {
-    buffer->start = (char*)malloc(initial_size);
-    buffer->size = initial_size;
+  ssize_t size = pni_message_encoded_size(msg);
+  if (size < 0) return size;
+  if (buffer->start == NULL || buffer->size < (size_t)size) {
+    size_t capacity = (size_t)size > initial_size ? (size_t)size : initial_size;
+    char *start = (char*)realloc(buffer->start, capacity);
+    if (start == NULL) return PN_OUT_OF_MEMORY;
+    buffer->start = start;
+    buffer->size = capacity;
   }
-  if (buffer->start == NULL) return PN_OUT_OF_MEMORY;
-  size = buffer->size;
-  while ((err = pn_message_encode(msg, buffer->start, &size)) == PN_OVERFLOW) {
-    buffer->size *= 2;
-    buffer->start = (char*)realloc(buffer->start, buffer->size);
-    if (buffer->start == NULL) return PN_OUT_OF_MEMORY;
-    size = buffer->size;
+  return pni_message_encode_prepared(msg, buffer->start, buffer->size);
+}
+
+ssize_t pni_message_send_direct(pn_message_t *msg, pn_link_t *sender) {
+  ssize_t size = pni_message_encoded_size(msg);
+  if (size < 0) return size;
+  pn_rwbytes_t space = pni_link_send_reserve(sender, size);
+  if (!space.start) {
+    return pn_error_format(msg->error, pn_link_current(sender) ? PN_OUT_OF_MEMORY : PN_EOS,
+                           "cannot send message");
   }
-  return err == 0 ? (ssize_t)size : err;
+  ssize_t ret = pni_message_encode_prepared(msg, space.start, space.size);
+  if (ret >= 0) ret = pni_link_send_commit(sender, ret);
+  return ret;
 }
 
 ssize_t pn_message_send(pn_message_t *msg, pn_link_t *sender, pn_rwbytes_t *buffer) {
-  pn_rwbytes_t local_buf = { 0 };
-  if (!buffer) buffer = &local_buf;
+  if (!buffer) {
+    // Nothing to reuse, so encode straight into the delivery
+    ssize_t ret = pni_message_send_direct(msg, sender);
+    if (ret >= 0) ret = pn_link_advance(sender);
+    return ret;
+  }
   ssize_t ret = pn_message_encode2(msg, buffer);
   if (ret >= 0) {
     ret = pn_link_send(sender, buffer->start, ret);
     if (ret >= 0) ret = pn_link_advance(sender);
     if (ret < 0) pn_error_copy(pn_message_error(msg), pn_link_error(sender));
   }
-  if (local_buf.start) free(local_buf.start);
   return ret;
 }
@@ -19,8 +19,11 @@
  *
  */
 
+#include "platform/platform.h"
+
 #include <proton/object.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #define pn_object_initialize NULL
@@ -191,21 +194,65 @@ int pn_class_inspect(const pn_class_t *clazz, void *object, pn_string_t *dst)
 typedef struct {
   const pn_class_t *clazz;
   int refcount;
+  unsigned size_class;  // 1-based cache size class, 0 if not cacheable
 } pni_head_t;
 
+// Keep the object itself 8 byte aligned whatever the size of the head
+#define PNI_HEAD_SIZE ((sizeof(pni_head_t) + 7) & ~(size_t) 7)
+
 #define pni_head(PTR) \
-  (((pni_head_t *) (PTR)) - 1)
+  ((pni_head_t *) (((char *) (PTR)) - PNI_HEAD_SIZE))
+
+/*
+  Objects are allocated in size classes of PNI_CACHE_GRAIN bytes. Freed
+  objects of the smaller classes are kept on per-thread free lists and
+  handed out again by the next allocation of the same class on that thread,
+  so the engine's short lived objects (deliveries, events, strings, data)
+  stop going back to malloc. Each class keeps at most PNI_CACHE_DEPTH free
+  objects, anything beyond that, or too large to cache, uses calloc/free.
+*/
+#define PNI_CACHE_GRAIN 16
+#define PNI_CACHE_CLASSES 32    // Objects of up to 512 bytes with their head
+#define PNI_CACHE_DEPTH 64
+
+typedef struct pni_cached_t {
+  struct pni_cached_t *next;
+} pni_cached_t;
+
+typedef struct {
+  pni_cached_t *free[PNI_CACHE_CLASSES];
+  int count[PNI_CACHE_CLASSES];
+  bool hooked;                  // Released when the thread exits
+  bool exiting;                 // Released, stop caching
+} pni_object_cache_t;
+
+static PNI_THREAD_LOCAL pni_object_cache_t pni_object_cache;
 
 void *pn_object_new(const pn_class_t *clazz, size_t size)
 {
-  void *object = NULL;
-  pni_head_t *head = (pni_head_t *) calloc(1, sizeof(pni_head_t) + size);
-  if (head != NULL) {
-    object = head + 1;
-    head->clazz = clazz;
-    head->refcount = 1;
+  pni_object_cache_t *cache = &pni_object_cache;
+  size_t total = PNI_HEAD_SIZE + size;
+  unsigned size_class = (total + PNI_CACHE_GRAIN - 1) / PNI_CACHE_GRAIN;
+  pni_head_t *head;
+  if (size_class <= PNI_CACHE_CLASSES && cache->free[size_class - 1]) {
+    pni_cached_t *cached = cache->free[size_class - 1];
+    cache->free[size_class - 1] = cached->next;
+    cache->count[size_class - 1]--;
+    head = (pni_head_t *) cached;
+    memset(head, 0, size_class * PNI_CACHE_GRAIN);
+  } else {
+    if (size_class <= PNI_CACHE_CLASSES) {
+      total = size_class * PNI_CACHE_GRAIN;
+    } else {
+      size_class = 0;
+    }
+    head = (pni_head_t *) calloc(1, total);
+    if (head == NULL) return NULL;
   }
-  return object;
+  head->clazz = clazz;
+  head->refcount = 1;
+  head->size_class = size_class;
+  return ((char *) head) + PNI_HEAD_SIZE;
 }
 
 const pn_class_t *pn_object_reify(void *object)
@@ -237,10 +284,43 @@ void pn_object_decref(void *object)
   head->refcount--;
 }
 
+static void pni_object_cache_exit(void)
+{
+  pni_object_cache.exiting = true;
+  pn_object_cache_flush();
+}
+
 void pn_object_free(void *object)
 {
+  pni_object_cache_t *cache = &pni_object_cache;
   pni_head_t *head = pni_head(object);
-  free(head);
+  unsigned size_class = head->size_class;
+  if (!cache->hooked && !cache->exiting) {
+    // Don't cache anything the thread could not release
+    cache->hooked = true;
+    cache->exiting = pni_thread_exit_hook(pni_object_cache_exit) != 0;
+  }
+  if (size_class && !cache->exiting && cache->count[size_class - 1] < PNI_CACHE_DEPTH) {
+    pni_cached_t *cached = (pni_cached_t *) head;
+    cached->next = cache->free[size_class - 1];
+    cache->free[size_class - 1] = cached;
+    cache->count[size_class - 1]++;
+  } else {
+    free(head);
+  }
+}
+
+void pn_object_cache_flush(void)
+{
+  pni_object_cache_t *cache = &pni_object_cache;
+  for (int i = 0; i < PNI_CACHE_CLASSES; i++) {
+    while (cache->free[i]) {
+      pni_cached_t *cached = cache->free[i];
+      cache->free[i] = cached->next;
+      free(cached);
+    }
+    cache->count[i] = 0;
+  }
 }
 
 void *pn_incref(void *object)
@@ -31,16 +31,26 @@
 
 #define PNI_NULL_SIZE (-1)
 
+// Strings that fit (with their terminating NUL) are stored in the object
+// itself, only longer strings spill to a separate heap allocation.
+#define PNI_STRING_INLINE (32)
+
 struct pn_string_t {
-  char *bytes;
+  char *bytes;        // Points to inline_bytes until the string outgrows it
   ssize_t size;       // PNI_NULL_SIZE (-1) means null
   size_t capacity;
+  char inline_bytes[PNI_STRING_INLINE];
 };
 
+static inline bool pni_string_inline(pn_string_t *string)
+{
+  return string->bytes == string->inline_bytes;
+}
+
 static void pn_string_finalize(void *object)
 {
   pn_string_t *string = (pn_string_t *) object;
-  free(string->bytes);
+  if (!pni_string_inline(string)) free(string->bytes);
 }
 
 static uintptr_t pn_string_hashcode(void *object)
@@ -108,8 +118,13 @@ pn_string_t *pn_stringn(const char *bytes, size_t n)
 {
   static const pn_class_t clazz = PN_CLASS(pn_string);
   pn_string_t *string = (pn_string_t *) pn_class_new(&clazz, sizeof(pn_string_t));
-  string->capacity = n ? n * sizeof(char) : 16;
-  string->bytes = (char *) malloc(string->capacity);
+  if (n < PNI_STRING_INLINE) {
+    string->capacity = PNI_STRING_INLINE;
+    string->bytes = string->inline_bytes;
+  } else {
+    string->capacity = (n + 1) * sizeof(char);
+    string->bytes = (char *) malloc(string->capacity);
+  }
   pn_string_setn(string, bytes, n);
   return string;
 }
@@ -148,11 +163,18 @@ int pn_string_grow(pn_string_t *string, size_t capacity)
   }
 
   if (grow) {
-    char *growed = (char *) realloc(string->bytes, string->capacity);
-    if (growed) {
-      string->bytes = growed;
+    if (pni_string_inline(string)) {
+      char *spilled = (char *) malloc(string->capacity);
+      if (!spilled) return PN_ERR;
+      memcpy(spilled, string->inline_bytes, PNI_STRING_INLINE);
+      string->bytes = spilled;
     } else {
-      return PN_ERR;
+      char *growed = (char *) realloc(string->bytes, string->capacity);
+      if (growed) {
+        string->bytes = growed;
+      } else {
+        return PN_ERR;
+      }
     }
   }
 
@@ -27,6 +27,7 @@
 #include "ssl/ssl-internal.h"
 
 #include "autodetect.h"
+#include "emitters.h"
 #include "protocol.h"
 #include "dispatch_actions.h"
 #include "config.h"
@@ -73,24 +74,90 @@ static void pni_calculate_channel_max(pn_transport_t *transport) {
 
 void pn_delivery_map_init(pn_delivery_map_t *db, pn_sequence_t next)
 {
-  db->deliveries = pn_hash(PN_WEAKREF, 0, 0.75);
+  db->slots = NULL;
+  db->capacity = 0;
+  db->head = 0;
+  db->size = 0;
+  db->lwm = next;
   db->next = next;
+  db->stragglers = NULL;
 }
 
 void pn_delivery_map_free(pn_delivery_map_t *db)
 {
-  pn_free(db->deliveries);
+  free(db->slots);
+  pn_free(db->stragglers);
 }
 
-static inline uintptr_t pni_sequence_make_hash ( pn_sequence_t i )
+static inline pn_delivery_t **pni_delivery_map_slot(pn_delivery_map_t *db, pn_sequence_t id)
 {
-  return i & 0x00000000FFFFFFFFUL;
+  return &db->slots[(db->head + (pn_sequence_t)(id - db->lwm)) & (db->capacity - 1)];
 }
 
+static inline bool pni_delivery_map_has_slot(pn_delivery_map_t *db, pn_sequence_t id)
+{
+  // Unsigned arithmetic: ids below lwm wrap to large offsets
+  return (pn_sequence_t)(id - db->lwm) < (pn_sequence_t)(db->next - db->lwm);
+}
+
+static inline bool pni_delivery_map_has_stragglers(pn_delivery_map_t *db)
+{
+  return db->stragglers && pn_hash_size(db->stragglers);
+}
 
 static pn_delivery_t *pni_delivery_map_get(pn_delivery_map_t *db, pn_sequence_t id)
 {
-  return (pn_delivery_t *) pn_hash_get(db->deliveries, pni_sequence_make_hash(id) );
+  if (pni_delivery_map_has_slot(db, id)) return *pni_delivery_map_slot(db, id);
+  if (pni_delivery_map_has_stragglers(db)) return (pn_delivery_t *) pn_hash_get(db->stragglers, id);
+  return NULL;
+}
+
+// Advance lwm past settled deliveries
+static void pni_delivery_map_trim(pn_delivery_map_t *db)
+{
+  if (db->size == 0) {
+    db->lwm = db->next;
+    db->head = 0;
+  } else {
+    while (!db->slots[db->head]) {
+      db->head = (db->head + 1) & (db->capacity - 1);
+      db->lwm++;
+    }
+  }
+}
+
+// Move the oldest deliveries to the stragglers until there is a free slot
+static int pni_delivery_map_evict(pn_delivery_map_t *db)
+{
+  if (!db->stragglers) {
+    db->stragglers = pn_hash(PN_WEAKREF, 0, 0.75);
+    if (!db->stragglers) return PN_OUT_OF_MEMORY;
+  }
+  while ((size_t)(pn_sequence_t)(db->next - db->lwm) >= db->capacity) {
+    pn_delivery_t *delivery = db->slots[db->head];
+    if (pn_hash_put(db->stragglers, db->lwm, delivery)) return PN_OUT_OF_MEMORY;
+    db->slots[db->head] = NULL;
+    db->size--;
+    pni_delivery_map_trim(db);
+  }
+  return 0;
+}
+
+// Double the capacity, unwrapping the window to start at slot 0
+static int pni_delivery_map_grow(pn_delivery_map_t *db)
+{
+  size_t capacity = db->capacity ? db->capacity * 2 : 64;
+  pn_delivery_t **slots = (pn_delivery_t **) calloc(capacity, sizeof(pn_delivery_t *));
+  if (!slots) return PN_OUT_OF_MEMORY;
+  size_t span = (pn_sequence_t)(db->next - db->lwm);
+  for (size_t i = 0; i < span; ++i) {
+    slots[i] = db->slots[(db->head + i) & (db->capacity - 1)];
+  }
+  free(db->slots);
+  db->slots = slots;
+  db->capacity = capacity;
+  db->head = 0;
+  return 0;
 }
 
 static void pn_delivery_state_init(pn_delivery_state_t *ds, pn_delivery_t *delivery, pn_sequence_t id)
@@ -101,11 +168,22 @@ static void pn_delivery_state_init(pn_delivery_state_t *ds, pn_delivery_t *deliv
   ds->init = true;
 }
 
+// Returns NULL if the map cannot grow to hold the delivery
 static pn_delivery_state_t *pni_delivery_map_push(pn_delivery_map_t *db, pn_delivery_t *delivery)
 {
+  if (db->size == 0) {
+    // Nothing unsettled, restart the window at next (which may have been set directly)
+    db->lwm = db->next;
+    db->head = 0;
+  }
+  if ((size_t)(pn_sequence_t)(db->next - db->lwm) >= db->capacity) {
+    int err = db->capacity < PNI_DELIVERY_MAP_MAX ? pni_delivery_map_grow(db) : pni_delivery_map_evict(db);
+    if (err) return NULL;
+  }
   pn_delivery_state_t *ds = &delivery->state;
   pn_delivery_state_init(ds, delivery, db->next++);
-  pn_hash_put(db->deliveries, pni_sequence_make_hash(ds->id), delivery);
+  *pni_delivery_map_slot(db, ds->id) = delivery;
+  db->size++;
   return ds;
 }
 
@@ -115,21 +193,35 @@ void pn_delivery_map_del(pn_delivery_map_t *db, pn_delivery_t *delivery)
     delivery->state.init = false;
     delivery->state.sending = false;
     delivery->state.sent = false;
-    pn_hash_del(db->deliveries, pni_sequence_make_hash(delivery->state.id) );
+    pn_sequence_t id = delivery->state.id;
+    if (!pni_delivery_map_has_slot(db, id)) {
+      if (pni_delivery_map_has_stragglers(db) && pn_hash_get(db->stragglers, id) == delivery) {
+        pn_hash_del(db->stragglers, id);
+      }
+      return;
+    }
+    if (*pni_delivery_map_slot(db, id) != delivery) return;
+    *pni_delivery_map_slot(db, id) = NULL;
+    db->size--;
+    if (id == db->lwm) pni_delivery_map_trim(db);
   }
 }
 
 static void pni_delivery_map_clear(pn_delivery_map_t *dm)
 {
-  pn_hash_t *hash = dm->deliveries;
-  for (pn_handle_t entry = pn_hash_head(hash);
-       entry;
-       entry = pn_hash_next(hash, entry))
-  {
-    pn_delivery_t *dlv = (pn_delivery_t *) pn_hash_value(hash, entry);
-    pn_delivery_map_del(dm, dlv);
+  while (pni_delivery_map_has_stragglers(dm)) {
+    pn_handle_t entry = pn_hash_head(dm->stragglers);
+    pn_delivery_map_del(dm, (pn_delivery_t *) pn_hash_value(dm->stragglers, entry));
+  }
+  // Deleting advances lwm, so walk by id rather than by slot
+  pn_sequence_t end = dm->next;
+  for (pn_sequence_t id = dm->lwm; dm->size && id != end; ++id) {
+    pn_delivery_t *dlv = pni_delivery_map_get(dm, id);
+    if (dlv) pn_delivery_map_del(dm, dlv);
   }
   dm->next = 0;
+  dm->lwm = 0;
+  dm->head = 0;
 }
 
 static void pni_default_tracer(pn_transport_t *transport, const char *message)
@@ -467,6 +559,9 @@ static void pn_transport_initialize(void *object)
   transport->remote_idle_timeout = 0;
   transport->keepalive_deadline = 0;
   transport->last_bytes_output = 0;
+  transport->disp_max_ranges = PN_DEFAULT_DISP_MAX_RANGES;
+  transport->disp_delay = 0;
+  transport->last_tick = 0;
   transport->remote_offered_capabilities = pn_data(0);
   transport->remote_desired_capabilities = pn_data(0);
   transport->remote_properties = pn_data(0);
@@ -481,8 +576,19 @@ static void pn_transport_initialize(void *object)
   transport->bytes_input = 0;
   transport->bytes_output = 0;
 
+  transport->input_start = 0;
   transport->input_pending = 0;
+  transport->pinned_head = NULL;
+  transport->pinned_tail = NULL;
+  transport->output_start = 0;
   transport->output_pending = 0;
+  transport->slices = NULL;
+  transport->slices_head = 0;
+  transport->slices_tail = 0;
+  transport->slices_capacity = 0;
+  transport->slices_before = 0;
+  transport->slices_size = 0;
+  transport->spare_count = 0;
 
   transport->done_processing = false;
 
@@ -682,6 +788,13 @@ static void pn_transport_finalize(void *object)
   pn_buffer_free(transport->frame);
   pn_free(transport->context);
   pn_buffer_free(transport->output_buffer);
+  for (size_t i = transport->slices_head; i < transport->slices_tail; ++i) {
+    pn_buffer_free(transport->slices[i].owner);
+  }
+  free(transport->slices);
+  for (size_t i = 0; i < transport->spare_count; ++i) {
+    pn_buffer_free(transport->spare_payloads[i]);
+  }
 }
 
 static void pni_post_remote_open_events(pn_transport_t *transport, pn_connection_t *connection) {
@@ -766,11 +879,20 @@ void pni_transport_unbind_channels(pn_hash_t *channels)
   }
 }
 
+// Copy the data of deliveries read in place out of the input buffer
+static void pni_transport_unpin(pn_transport_t *transport)
+{
+  while (transport->pinned_head) {
+    pni_delivery_unpin(transport->pinned_head, true);
+  }
+}
+
 int pn_transport_unbind(pn_transport_t *transport)
 {
   assert(transport);
   if (!transport->connection) return 0;
 
+  pni_transport_unpin(transport);
 
   pn_connection_t *conn = transport->connection;
   transport->connection = NULL;
@@ -848,6 +970,8 @@ static pn_link_t *pni_handle_state(pn_session_t *ssn, uint32_t handle)
 bool pni_disposition_batchable(pn_disposition_t *disposition)
 {
   switch (disposition->type) {
+  case 0:                       /* Settled with no outcome */
+    return true;
   case PN_ACCEPTED:
     return true;
   case PN_RELEASED:
@@ -909,6 +1033,38 @@ void pn_do_trace(pn_transport_t *transport, uint16_t ch, pn_dir_t dir,
   }
 }
 
+// Write a frame containing an already encoded performative to the output buffer
+static int pni_post_encoded_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, pn_bytes_t performative)
+{
+  pn_frame_t frame = {AMQP_FRAME_TYPE};
+  frame.type = type;
+  frame.channel = ch;
+  frame.payload = performative.start;
+  frame.size = performative.size;
+  pn_buffer_ensure(transport->output_buffer, AMQP_HEADER_SIZE+frame.ex_size+frame.size);
+  pn_write_frame(transport->output_buffer, frame);
+  transport->output_frames_ct += 1;
+  if (transport->trace & PN_TRACE_RAW) {
+    pn_string_set(transport->scratch, "RAW: \"");
+    pn_buffer_quote(transport->output_buffer, transport->scratch, AMQP_HEADER_SIZE+frame.ex_size+frame.size);
+    pn_string_addf(transport->scratch, "\"");
+    pn_transport_log(transport, pn_string_get(transport->scratch));
+  }
+
+  return 0;
+}
+
+// Encode transport->output_args into the (cleared) frame buffer, sized up front
+static ssize_t pni_encode_performative(pn_transport_t *transport, pn_buffer_t *frame, pn_rwbytes_t *buf)
+{
+  ssize_t size = pn_data_encoded_size(transport->output_args);
+  if (size < 0) return size;
+  pn_buffer_clear(frame);
+  pn_buffer_ensure(frame, size);
+  *buf = pn_buffer_memory(frame);
+  return pn_data_encode(transport->output_args, buf->start, pn_buffer_available(frame));
+}
+
 int pn_post_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, const char *fmt, ...)
 {
   pn_buffer_t *frame_buf = transport->frame;
@@ -926,38 +1082,147 @@ int pn_post_frame(pn_transport_t *transport, uint8_t type, uint16_t ch, const ch
 
   pn_do_trace(transport, ch, OUT, transport->output_args, NULL, 0);
 
- encode_performatives:
-  pn_buffer_clear( frame_buf );
-  pn_rwbytes_t buf = pn_buffer_memory( frame_buf );
-  buf.size = pn_buffer_available( frame_buf );
-
-  ssize_t wr = pn_data_encode( transport->output_args, buf.start, buf.size );
+  pn_rwbytes_t buf;
+  ssize_t wr = pni_encode_performative(transport, frame_buf, &buf);
   if (wr < 0) {
-    if (wr == PN_OVERFLOW) {
-      pn_buffer_ensure( frame_buf, pn_buffer_available( frame_buf ) * 2 );
-      goto encode_performatives;
-    }
     pn_transport_logf(transport,
                       "error posting frame: %s", pn_code(wr));
     return PN_ERR;
   }
 
-  pn_frame_t frame = {AMQP_FRAME_TYPE};
-  frame.type = type;
-  frame.channel = ch;
-  frame.payload = buf.start;
-  frame.size = wr;
-  pn_buffer_ensure(transport->output_buffer, AMQP_HEADER_SIZE+frame.ex_size+frame.size);
-  pn_write_frame(transport->output_buffer, frame);
-  transport->output_frames_ct += 1;
-  if (transport->trace & PN_TRACE_RAW) {
-    pn_string_set(transport->scratch, "RAW: \"");
-    pn_buffer_quote(transport->output_buffer, transport->scratch, AMQP_HEADER_SIZE+frame.ex_size+frame.size);
-    pn_string_addf(transport->scratch, "\"");
-    pn_transport_log(transport, pn_string_get(transport->scratch));
+  return pni_post_encoded_frame(transport, type, ch, pn_bytes(wr, buf.start));
+}
+
+// Queue body to be written after the frame output buffered so far
+static bool pni_output_slice(pn_transport_t *transport, pn_bytes_t body)
+{
+  if (transport->slices_tail == transport->slices_capacity) {
+    if (transport->slices_head) {
+      size_t count = transport->slices_tail - transport->slices_head;
+      memmove(transport->slices, &transport->slices[transport->slices_head],
+              count * sizeof(pni_output_slice_t));
+      transport->slices_head = 0;
+      transport->slices_tail = count;
+    } else {
+      size_t capacity = transport->slices_capacity ? 2 * transport->slices_capacity : 8;
+      pni_output_slice_t *slices = (pni_output_slice_t *)
+        realloc(transport->slices, capacity * sizeof(pni_output_slice_t));
+      if (!slices) return false;
+      transport->slices = slices;
+      transport->slices_capacity = capacity;
+    }
   }
+  pni_output_slice_t *slice = &transport->slices[transport->slices_tail++];
+  slice->before = pn_buffer_size(transport->output_buffer) - transport->slices_before;
+  slice->bytes = body;
+  slice->owner = NULL;
+  transport->slices_before += slice->before;
+  transport->slices_size += body.size;
+  return true;
+}
 
-  return 0;
+// Keep written payload buffers, with their capacity, for later deliveries
+static void pni_output_release(pn_transport_t *transport, pn_buffer_t *owner)
+{
+  if (!owner) return;
+  if (transport->spare_count == PNI_OUTPUT_SPARE_MAX) {
+    pn_buffer_free(owner);
+  } else {
+    pn_buffer_clear(owner);
+    transport->spare_payloads[transport->spare_count++] = owner;
+  }
+}
+
+size_t pni_output_size(pn_transport_t *transport)
+{
+  return pn_buffer_size(transport->output_buffer) + transport->slices_size;
+}
+
+size_t pni_output_take(pn_transport_t *transport, char *dst, size_t size)
+{
+  size_t taken = 0;
+  while (taken < size) {
+    size_t n;
+    if (transport->slices_head == transport->slices_tail) {
+      n = pn_min(size - taken, pn_buffer_size(transport->output_buffer));
+      if (!n) break;
+      if (dst) pn_buffer_get(transport->output_buffer, 0, n, dst + taken);
+      pn_buffer_trim(transport->output_buffer, n, 0);
+    } else {
+      pni_output_slice_t *slice = &transport->slices[transport->slices_head];
+      if (slice->before) {
+        n = pn_min(size - taken, slice->before);
+        if (dst) pn_buffer_get(transport->output_buffer, 0, n, dst + taken);
+        pn_buffer_trim(transport->output_buffer, n, 0);
+        slice->before -= n;
+        transport->slices_before -= n;
+      } else {
+        n = pn_min(size - taken, slice->bytes.size);
+        if (dst) memcpy(dst + taken, slice->bytes.start, n);
+        slice->bytes.start += n;
+        slice->bytes.size -= n;
+        transport->slices_size -= n;
+        if (!slice->bytes.size) {
+          pni_output_release(transport, slice->owner);
+          if (++transport->slices_head == transport->slices_tail) {
+            transport->slices_head = transport->slices_tail = 0;
+          }
+        }
+      }
+    }
+    taken += n;
+  }
+  return taken;
+}
+
+// Add size bytes of output_buffer from offset to segments, in place
+static size_t pni_output_buffered(pn_transport_t *transport, size_t offset, size_t size,
+                                  pn_bytes_t *segments, size_t n)
+{
+  size_t count = 0;
+  while (size && count < n) {
+    pn_bytes_t chunk = pn_buffer_chunk(transport->output_buffer, offset, size);
+    segments[count++] = chunk;
+    offset += chunk.size;
+    size -= chunk.size;
+  }
+  return count;
+}
+
+// Fill segments with the frame output in order, without consuming it
+static size_t pni_output_segments(pn_transport_t *transport, pn_bytes_t *segments, size_t n)
+{
+  size_t count = 0;
+  size_t offset = 0;
+  for (size_t i = transport->slices_head; i < transport->slices_tail && count < n; ++i) {
+    pni_output_slice_t *slice = &transport->slices[i];
+    count += pni_output_buffered(transport, offset, slice->before, segments + count, n - count);
+    offset += slice->before;
+    if (count == n) break;
+    segments[count++] = slice->bytes;
+  }
+  size_t buffered = pn_buffer_size(transport->output_buffer);
+  if (offset < buffered) {
+    count += pni_output_buffered(transport, offset, buffered - offset, segments + count, n - count);
+  }
+  return count;
+}
+
+// Start emitting a performative into the (cleared) frame buffer
+static inline pni_emitter_t pni_frame_emitter(pn_buffer_t *frame)
+{
+  pn_buffer_clear(frame);
+  pn_rwbytes_t buf = pn_buffer_memory(frame);
+  buf.size = pn_buffer_available(frame);
+  return pni_emitter(buf);
+}
+
+// If the emitter overflowed, grow the frame buffer and return true to emit again
+static inline bool pni_frame_emitter_retry(pni_emitter_t *emitter, pn_buffer_t *frame)
+{
+  if (!pni_emitter_overflow(emitter)) return false;
+  pn_buffer_ensure(frame, emitter->position);
+  return true;
 }
 
 static int pni_post_amqp_transfer_frame(pn_transport_t *transport, uint16_t ch,
@@ -973,51 +1238,62 @@ static int pni_post_amqp_transfer_frame(pn_transport_t *transport, uint16_t ch,
                                         pn_data_t* state,
                                         bool resume,
                                         bool aborted,
-                                        bool batchable)
+                                        bool batchable,
+                                        pn_buffer_t *owner)
 {
   bool more_flag = more;
   unsigned framecount = 0;
   pn_buffer_t *frame = transport->frame;
+  // Emit the performative directly unless it carries a delivery state or
+  // needs to be traced, both of which need the pn_data_t form.
+  bool emit = !code && !(transport->trace & PN_TRACE_FRM);
+  pn_bytes_t emitted = pn_bytes(0, NULL);
 
   // create preformatives, assuming 'more' flag need not change
 
  compute_performatives:
-  pn_data_clear(transport->output_args);
-  int err = pn_data_fill(transport->output_args, "DL[IIzI?o?on?DLC?o?o?o]", TRANSFER,
-                         handle,
-                         id,
-                         tag->size, tag->start,
-                         message_format,
-                         settled, settled,
-                         more_flag, more_flag,
-                         (bool)code, code, state,
-                         resume, resume,
-                         aborted, aborted,
-                         batchable, batchable);
-  if (err) {
-    pn_transport_logf(transport,
-                      "error posting transfer frame: %s: %s", pn_code(err),
-                      pn_error_text(pn_data_error(transport->output_args)));
-    return PN_ERR;
+  if (emit) {
+    pni_emitter_t emitter;
+    do {
+      emitter = pni_frame_emitter(frame);
+      pni_emit_transfer(&emitter, handle, id, *tag, message_format,
+                        settled, more_flag, resume, aborted, batchable);
+    } while (pni_frame_emitter_retry(&emitter, frame));
+    emitted = pni_emitter_bytes(&emitter);
+  } else {
+    pn_data_clear(transport->output_args);
+    int err = pn_data_fill(transport->output_args, "DL[IIzI?o?on?DLC?o?o?o]", TRANSFER,
+                           handle,
+                           id,
+                           tag->size, tag->start,
+                           message_format,
+                           settled, settled,
+                           more_flag, more_flag,
+                           (bool)code, code, state,
+                           resume, resume,
+                           aborted, aborted,
+                           batchable, batchable);
+    if (err) {
+      pn_transport_logf(transport,
+                        "error posting transfer frame: %s: %s", pn_code(err),
+                        pn_error_text(pn_data_error(transport->output_args)));
+      return PN_ERR;
+    }
   }
 
   do { // send as many frames as possible without changing the 'more' flag...
 
-  encode_performatives:
-    pn_buffer_clear( frame );
-    pn_rwbytes_t buf = pn_buffer_memory( frame );
-    buf.size = pn_buffer_available( frame );
-
-    ssize_t wr = pn_data_encode(transport->output_args, buf.start, buf.size);
-    if (wr < 0) {
-      if (wr == PN_OVERFLOW) {
-        pn_buffer_ensure( frame, pn_buffer_available( frame ) * 2 );
-        goto encode_performatives;
+    pn_rwbytes_t buf;
+    if (emit) {
+      buf = pn_rwbytes(emitted.size, (char *) emitted.start);
+    } else {
+      ssize_t wr = pni_encode_performative(transport, frame, &buf);
+      if (wr < 0) {
+        pn_transport_logf(transport, "error posting frame: %s", pn_code(wr));
+        return PN_ERR;
       }
-      pn_transport_logf(transport, "error posting frame: %s", pn_code(wr));
-      return PN_ERR;
+      buf.size = wr;
     }
-    buf.size = wr;
 
     // check if we need to break up the outbound frame
     size_t available = payload->size;
@@ -1035,36 +1311,42 @@ static int pni_post_amqp_transfer_frame(pn_transport_t *transport, uint16_t ch,
       }
     }
 
-    if (pn_buffer_available( frame ) < (available + buf.size)) {
-      // not enough room for payload - try again...
-      pn_buffer_ensure( frame, available + buf.size );
-      goto encode_performatives;
-    }
-
     pn_do_trace(transport, ch, OUT, transport->output_args, payload->start, available);
 
-    memmove( buf.start + buf.size, payload->start, available);
+    // The payload is written directly after the performative in the output
+    // buffer, there is no need to assemble the whole frame in 'frame' first.
+    pn_bytes_t body = pn_bytes(available, payload->start);
     payload->start += available;
     payload->size -= available;
-    buf.size += available;
 
     pn_frame_t frame = {AMQP_FRAME_TYPE};
     frame.channel = ch;
     frame.payload = buf.start;
     frame.size = buf.size;
 
-    pn_buffer_ensure(transport->output_buffer, AMQP_HEADER_SIZE+frame.ex_size+frame.size);
-    pn_write_frame(transport->output_buffer, frame);
+    size_t frame_size = AMQP_HEADER_SIZE+frame.ex_size+frame.size+body.size;
+    if (owner) {
+      // The body stays in the owner's memory and is written from there
+      pn_buffer_ensure(transport->output_buffer, frame_size - body.size);
+      pn_write_frame_head(transport->output_buffer, frame, body.size);
+      if (!pni_output_slice(transport, body)) return PN_OUT_OF_MEMORY;
+    } else {
+      pn_buffer_ensure(transport->output_buffer, frame_size);
+      pn_write_frame_body(transport->output_buffer, frame, body);
+    }
     transport->output_frames_ct += 1;
     framecount++;
     if (transport->trace & PN_TRACE_RAW) {
       pn_string_set(transport->scratch, "RAW: \"");
-      pn_buffer_quote(transport->output_buffer, transport->scratch, AMQP_HEADER_SIZE+frame.ex_size+frame.size);
+      pn_buffer_quote(transport->output_buffer, transport->scratch, frame_size);
       pn_string_addf(transport->scratch, "\"");
       pn_transport_log(transport, pn_string_get(transport->scratch));
     }
   } while (payload->size > 0 && framecount < frame_limit);
 
+  if (owner) {
+    transport->slices[transport->slices_tail-1].owner = owner;
+  }
   return framecount;
 }
 
@@ -1463,23 +1745,19 @@ static void pn_full_settle(pn_delivery_map_t *db, pn_delivery_t *delivery)
   pn_decref(delivery);
 }
 
-int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+// Act on a TRANSFER, the delivery state (if has_type) is in transport->disp_data
+static int pni_do_transfer(pn_transport_t *transport, uint16_t channel, const pni_transfer_t *t, const pn_bytes_t *payload)
 {
   // XXX: multi transfer
-  uint32_t handle;
-  pn_bytes_t tag;
-  bool id_present;
-  pn_sequence_t id;
-  bool settled;
-  bool more;
-  bool has_type, settled_set;
-  bool resume, aborted, batchable;
-  uint64_t type;
-  pn_data_clear(transport->disp_data);
-  int err = pn_data_scan(args, "D.[I?Iz.?oo.D?LCooo]", &handle, &id_present, &id, &tag,
-                         &settled_set, &settled, &more, &has_type, &type, transport->disp_data,
-                         &resume, &aborted, &batchable);
-  if (err) return err;
+  uint32_t handle = t->handle;
+  pn_bytes_t tag = t->tag;
+  bool id_present = t->id_present;
+  pn_sequence_t id = t->id;
+  bool settled = t->settled;
+  bool more = t->more;
+  bool has_type = t->has_type, settled_set = t->settled_set;
+  bool aborted = t->aborted;
+  uint64_t type = t->type;
   pn_session_t *ssn = pni_channel_state(transport, channel);
   if (!ssn) {
     return pn_do_error(transport, "amqp:not-allowed", "no such channel: %u", channel);
@@ -1509,6 +1787,10 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
 
     delivery = pn_delivery(link, pn_dtag(tag.start, tag.size));
     pn_delivery_state_t *state = pni_delivery_map_push(incoming, delivery);
+    if (!state) {
+      return pn_do_error(transport, "amqp:resource-limit-exceeded",
+                         "no memory to track delivery-id %u", incoming->next);
+    }
     if (id_present && id != state->id) {
       return pn_do_error(transport, "amqp:session:invalid-field",
                          "sequencing error, expected delivery-id %u, got %u",
@@ -1524,7 +1806,14 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
     link->queued++;
   }
 
-  pn_buffer_append(delivery->bytes, payload->start, payload->size);
+  // A whole delivery in one frame, straight from the input buffer, can be read in place
+  if (link->input_view && !more && !aborted && payload->size && !pn_buffer_size(delivery->bytes) &&
+      payload->start >= transport->input_buf &&
+      payload->start + payload->size <= transport->input_buf + transport->input_size) {
+    pni_delivery_pin(transport, delivery, *payload);
+  } else {
+    pn_buffer_append(delivery->bytes, payload->start, payload->size);
+  }
   ssn->incoming_bytes += payload->size;
   delivery->done = !more;
 
@@ -1538,8 +1827,7 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
   ssn->state.incoming_transfer_count++;
   ssn->state.incoming_window--;
 
-  // XXX: need better policy for when to refresh window
-  if (!ssn->state.incoming_window && (int32_t) link->state.local_handle >= 0) {
+  if ((int32_t) link->state.local_handle >= 0 && pni_session_refresh_incoming_window(ssn)) {
     pni_post_flow(transport, ssn, link);
   }
 
@@ -1553,16 +1841,33 @@ int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t chann
   return 0;
 }
 
-int pn_do_flow(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+int pn_do_transfer(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
 {
-  pn_sequence_t onext, inext, delivery_count;
-  uint32_t iwin, owin, link_credit;
-  uint32_t handle;
-  bool inext_init, handle_init, dcount_init, drain;
-  int err = pn_data_scan(args, "D.[?IIII?I?II.o]", &inext_init, &inext, &iwin,
-                         &onext, &owin, &handle_init, &handle, &dcount_init,
-                         &delivery_count, &link_credit, &drain);
+  pni_transfer_t t;
+  pn_data_clear(transport->disp_data);
+  int err = pn_data_scan(args, "D.[I?Iz.?oo.D?LCooo]", &t.handle, &t.id_present, &t.id, &t.tag,
+                         &t.settled_set, &t.settled, &t.more, &t.has_type, &t.type, transport->disp_data,
+                         &t.resume, &t.aborted, &t.batchable);
   if (err) return err;
+  return pni_do_transfer(transport, channel, &t, payload);
+}
+
+bool pn_consume_transfer(pn_transport_t *transport, uint16_t channel, pni_consumer_t *fields, const pn_bytes_t *payload, int *err)
+{
+  pni_transfer_t t;
+  if (!pni_consume_transfer_fields(fields, &t)) return false;
+  // The delivery state is kept as data, leave that to the general decoder
+  if (t.has_type) return false;
+  *err = pni_do_transfer(transport, channel, &t, payload);
+  return true;
+}
+
+static int pni_do_flow(pn_transport_t *transport, uint16_t channel, const pni_flow_t *f)
+{
+  pn_sequence_t inext = f->inext, delivery_count = f->delivery_count;
+  uint32_t iwin = f->iwin, link_credit = f->link_credit;
+  uint32_t handle = f->handle;
+  bool inext_init = f->inext_init, handle_init = f->handle_init, dcount_init = f->dcount_init, drain = f->drain;
 
   pn_session_t *ssn = pni_channel_state(transport, channel);
   if (!ssn) {
@@ -1610,6 +1915,24 @@ int pn_do_flow(pn_transport_t *transport, uint8_t frame_type, uint16_t channel,
   return 0;
 }
 
+int pn_do_flow(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+{
+  pni_flow_t f;
+  int err = pn_data_scan(args, "D.[?IIII?I?II.o]", &f.inext_init, &f.inext, &f.iwin,
+                         &f.onext, &f.owin, &f.handle_init, &f.handle, &f.dcount_init,
+                         &f.delivery_count, &f.link_credit, &f.drain);
+  if (err) return err;
+  return pni_do_flow(transport, channel, &f);
+}
+
+bool pn_consume_flow(pn_transport_t *transport, uint16_t channel, pni_consumer_t *fields, const pn_bytes_t *payload, int *err)
+{
+  pni_flow_t f;
+  if (!pni_consume_flow_fields(fields, &f)) return false;
+  *err = pni_do_flow(transport, channel, &f);
+  return true;
+}
+
 #define SCAN_ERROR_DEFAULT ("D.[D.[sSC]")
 #define SCAN_ERROR_DETACH ("D.[..D.[sSC]")
 #define SCAN_ERROR_DISP ("[D.[sSC]")
@@ -1631,18 +1954,69 @@ static inline bool sequence_lte(pn_sequence_t a, pn_sequence_t b) {
   return b-a <= INT32_MAX;
 }
 
-int pn_do_disposition(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+static inline bool sequence_lt(pn_sequence_t a, pn_sequence_t b) {
+  return a != b && sequence_lte(a, b);
+}
+
+// Apply a DISPOSITION to one delivery, the delivery state (if type_init) is in transport->disp_data
+static int pni_delivery_disposition(pn_transport_t *transport, pn_delivery_t *delivery,
+                                    const pni_disposition_t *d, bool remote_data)
 {
-  bool role;
-  pn_sequence_t first, last;
-  uint64_t type = 0;
-  bool last_init, settled, type_init;
-  pn_data_clear(transport->disp_data);
-  int err = pn_data_scan(args, "D.[oI?IoD?LC]", &role, &first, &last_init,
-                         &last, &settled, &type_init, &type,
-                         transport->disp_data);
-  if (err) return err;
-  if (!last_init) last = first;
+  uint64_t type = d->type;
+  pn_disposition_t *remote = &delivery->remote;
+  if (d->type_init) remote->type = type;
+  if (remote_data) {
+    switch (type) {
+    case PN_RECEIVED:
+      pn_data_rewind(transport->disp_data);
+      pn_data_next(transport->disp_data);
+      pn_data_enter(transport->disp_data);
+      if (pn_data_next(transport->disp_data))
+        remote->section_number = pn_data_get_uint(transport->disp_data);
+      if (pn_data_next(transport->disp_data))
+        remote->section_offset = pn_data_get_ulong(transport->disp_data);
+      break;
+    case PN_ACCEPTED:
+      break;
+    case PN_REJECTED: {
+      int err = pn_scan_error(transport->disp_data, &remote->condition, SCAN_ERROR_DISP);
+      if (err) return err;
+      break;
+    }
+    case PN_RELEASED:
+      break;
+    case PN_MODIFIED:
+      pn_data_rewind(transport->disp_data);
+      pn_data_next(transport->disp_data);
+      pn_data_enter(transport->disp_data);
+      if (pn_data_next(transport->disp_data))
+        remote->failed = pn_data_get_bool(transport->disp_data);
+      if (pn_data_next(transport->disp_data))
+        remote->undeliverable = pn_data_get_bool(transport->disp_data);
+      pn_data_narrow(transport->disp_data);
+      pn_data_clear(remote->data);
+      pn_data_appendn(remote->annotations, transport->disp_data, 1);
+      pn_data_widen(transport->disp_data);
+      break;
+    default:
+      pn_data_copy(remote->data, transport->disp_data);
+      break;
+    }
+  }
+  remote->settled = d->settled;
+  delivery->updated = true;
+  pn_work_update(transport->connection, delivery);
+
+  pn_collector_put(transport->connection->collector, PN_OBJECT, delivery, PN_DELIVERY);
+  return 0;
+}
+
+// Act on a DISPOSITION, the delivery state (if type_init) is in transport->disp_data
+static int pni_do_disposition(pn_transport_t *transport, uint16_t channel, const pni_disposition_t *d)
+{
+  pn_sequence_t first = d->first, last = d->last;
+  int err;
+  if (!d->last_init) last = first;
 
   pn_session_t *ssn = pni_channel_state(transport, channel);
   if (!ssn) {
@@ -1650,7 +2024,7 @@ int pn_do_disposition(pn_transport_t *transport, uint8_t frame_type, uint16_t ch
   }
 
   pn_delivery_map_t *deliveries;
-  if (role) {
+  if (d->role) {
     deliveries = &ssn->state.outgoing;
   } else {
     deliveries = &ssn->state.incoming;
@@ -1660,64 +2034,62 @@ int pn_do_disposition(pn_transport_t *transport, uint8_t frame_type, uint16_t ch
   bool remote_data = (pn_data_next(transport->disp_data) &&
                       pn_data_get_list(transport->disp_data) > 0);
 
-  // Do some validation of received first and last values
-  // TODO: We should really also clamp the first value here, but we're not keeping track of the earliest
-  // unsettled delivery sequence no
-  last = sequence_lte(last, deliveries->next) ? last : deliveries->next;
-  first = sequence_lte(first, last) ? first : last;
-  for (pn_sequence_t id = first; sequence_lte(id, last); ++id) {
-    pn_delivery_t *delivery = pni_delivery_map_get(deliveries, id);
-    if (delivery) {
-      pn_disposition_t *remote = &delivery->remote;
-      if (type_init) remote->type = type;
-      if (remote_data) {
-        switch (type) {
-        case PN_RECEIVED:
-          pn_data_rewind(transport->disp_data);
-          pn_data_next(transport->disp_data);
-          pn_data_enter(transport->disp_data);
-          if (pn_data_next(transport->disp_data))
-            remote->section_number = pn_data_get_uint(transport->disp_data);
-          if (pn_data_next(transport->disp_data))
-            remote->section_offset = pn_data_get_ulong(transport->disp_data);
-          break;
-        case PN_ACCEPTED:
-          break;
-        case PN_REJECTED:
-          err = pn_scan_error(transport->disp_data, &remote->condition, SCAN_ERROR_DISP);
+  // Ids below lwm are settled or stragglers, look up whichever are fewer
+  if (pni_delivery_map_has_stragglers(deliveries) && sequence_lt(first, deliveries->lwm)) {
+    pn_hash_t *stragglers = deliveries->stragglers;
+    pn_sequence_t end = sequence_lt(last, deliveries->lwm) ? last : deliveries->lwm - 1;
+    if ((size_t)(pn_sequence_t)(end - first) < pn_hash_size(stragglers)) {
+      for (pn_sequence_t id = first; sequence_lte(id, end); ++id) {
+        pn_delivery_t *delivery = (pn_delivery_t *) pn_hash_get(stragglers, id);
+        if (delivery && (err = pni_delivery_disposition(transport, delivery, d, remote_data))) return err;
+      }
+    } else {
+      for (pn_handle_t entry = pn_hash_head(stragglers); entry; entry = pn_hash_next(stragglers, entry)) {
+        pn_sequence_t id = (pn_sequence_t) pn_hash_key(stragglers, entry);
+        if (sequence_lte(first, id) && sequence_lte(id, end)) {
+          err = pni_delivery_disposition(transport, (pn_delivery_t *) pn_hash_value(stragglers, entry), d, remote_data);
           if (err) return err;
-          break;
-        case PN_RELEASED:
-          break;
-        case PN_MODIFIED:
-          pn_data_rewind(transport->disp_data);
-          pn_data_next(transport->disp_data);
-          pn_data_enter(transport->disp_data);
-          if (pn_data_next(transport->disp_data))
-            remote->failed = pn_data_get_bool(transport->disp_data);
-          if (pn_data_next(transport->disp_data))
-            remote->undeliverable = pn_data_get_bool(transport->disp_data);
-          pn_data_narrow(transport->disp_data);
-          pn_data_clear(remote->data);
-          pn_data_appendn(remote->annotations, transport->disp_data, 1);
-          pn_data_widen(transport->disp_data);
-          break;
-        default:
-          pn_data_copy(remote->data, transport->disp_data);
-          break;
         }
       }
-      remote->settled = settled;
-      delivery->updated = true;
-      pn_work_update(transport->connection, delivery);
-
-      pn_collector_put(transport->connection->collector, PN_OBJECT, delivery, PN_DELIVERY);
     }
   }
 
+  // Do some validation of received first and last values, then walk the slots between them
+  if (deliveries->size == 0) return 0;
+  last = sequence_lt(last, deliveries->next) ? last : deliveries->next - 1;
+  first = sequence_lte(deliveries->lwm, first) ? first : deliveries->lwm;
+  if (!sequence_lte(first, last)) return 0;
+  size_t mask = deliveries->capacity - 1;
+  size_t slot = (deliveries->head + (pn_sequence_t)(first - deliveries->lwm)) & mask;
+  for (size_t n = (size_t)(pn_sequence_t)(last - first) + 1; n > 0; --n, slot = (slot + 1) & mask) {
+    pn_delivery_t *delivery = deliveries->slots[slot];
+    if (delivery && (err = pni_delivery_disposition(transport, delivery, d, remote_data))) return err;
+  }
+
   return 0;
 }
 
+int pn_do_disposition(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
+{
+  pni_disposition_t d = {0};
+  pn_data_clear(transport->disp_data);
+  int err = pn_data_scan(args, "D.[oI?IoD?LC]", &d.role, &d.first, &d.last_init,
+                         &d.last, &d.settled, &d.type_init, &d.type,
+                         transport->disp_data);
+  if (err) return err;
+  return pni_do_disposition(transport, channel, &d);
+}
+
+bool pn_consume_disposition(pn_transport_t *transport, uint16_t channel, pni_consumer_t *fields, const pn_bytes_t *payload, int *err)
+{
+  pni_disposition_t d;
+  if (!pni_consume_disposition_fields(fields, &d)) return false;
+  // Outcomes without fields carry no data
+  pn_data_clear(transport->disp_data);
+  *err = pni_do_disposition(transport, channel, &d);
+  return true;
+}
+
 int pn_do_detach(pn_transport_t *transport, uint8_t frame_type, uint16_t channel, pn_data_t *args, const pn_bytes_t *payload)
 {
   uint32_t handle;
@@ -1821,10 +2193,11 @@ static ssize_t transport_consume(pn_transport_t *transport)
     ssize_t n;
     n = transport->io_layers[0]->
       process_input( transport, 0,
-                     transport->input_buf + consumed,
+                     transport->input_buf + transport->input_start,
                      transport->input_pending );
     if (n > 0) {
       consumed += n;
+      transport->input_start += n;
       transport->input_pending -= n;
     } else if (n == 0) {
       break;
@@ -1832,13 +2205,15 @@ static ssize_t transport_consume(pn_transport_t *transport)
       assert(n == PN_EOS);
       if (transport->trace & (PN_TRACE_RAW | PN_TRACE_FRM))
         pn_transport_log(transport, "  <- EOS");
+      transport->input_start = 0;
       transport->input_pending = 0;  // XXX ???
       return n;
     }
   }
 
-  if (transport->input_pending && consumed) {
-    memmove( transport->input_buf,  &transport->input_buf[consumed], transport->input_pending );
+  // Unconsumed input is left in place, pn_transport_capacity() moves it
+  if (!transport->input_pending && !transport->pinned_head) {
+    transport->input_start = 0;
   }
 
   return consumed;
@@ -1916,6 +2291,25 @@ static size_t pni_session_incoming_window(pn_session_t *ssn)
   }
 }
 
+/* The window is refreshed when exhausted, and with session flow control once
+   the bytes it has left fall to the low water mark (half the capacity by
+   default) and the application has consumed enough to lift it back above
+   the mark. The sender keeps transferring while the flow is on its way,
+   and small frames do not cause a flow each. */
+bool pni_session_refresh_incoming_window(pn_session_t *ssn)
+{
+  pn_sequence_t window = ssn->state.incoming_window;
+  if (!window) return true;
+  pn_transport_t *t = ssn->connection->transport;
+  if (!t) return false;
+  size_t size = t->local_max_frame;
+  size_t capacity = ssn->incoming_capacity;
+  if (!size || capacity < size || ssn->incoming_bytes >= capacity) return false;
+  size_t low_water = ssn->incoming_low_water ? ssn->incoming_low_water : capacity / 2;
+  return (size_t)window * size <= low_water &&
+    (capacity - ssn->incoming_bytes) / size * size > low_water;
+}
+
 static int pni_map_local_channel(pn_session_t *ssn)
 {
   pn_transport_t *transport = ssn->connection->transport;
@@ -2067,6 +2461,21 @@ static int pni_post_flow(pn_transport_t *transport, pn_session_t *ssn, pn_link_t
   ssn->state.outgoing_window = pni_session_outgoing_window(ssn);
   bool linkq = (bool) link;
   pn_link_state_t *state = &link->state;
+  if (!(transport->trace & PN_TRACE_FRM)) {
+    pni_emitter_t emitter;
+    do {
+      emitter = pni_frame_emitter(transport->frame);
+      pni_emit_flow(&emitter, (int16_t) ssn->state.remote_channel >= 0, ssn->state.incoming_transfer_count,
+                    ssn->state.incoming_window,
+                    ssn->state.outgoing_transfer_count,
+                    ssn->state.outgoing_window,
+                    linkq, linkq ? state->local_handle : 0,
+                    linkq ? state->delivery_count : 0,
+                    linkq ? state->link_credit : 0,
+                    linkq ? link->drain : false);
+    } while (pni_frame_emitter_retry(&emitter, transport->frame));
+    return pni_post_encoded_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel, pni_emitter_bytes(&emitter));
+  }
   return pn_post_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel, "DL[?IIII?I?I?In?o]", FLOW,
                        (int16_t) ssn->state.remote_channel >= 0, ssn->state.incoming_transfer_count,
                        ssn->state.incoming_window,
@@ -2087,7 +2496,7 @@ static int pni_process_flow_receiver(pn_transport_t *transport, pn_endpoint_t *e
     pn_link_state_t *state = &rcv->state;
     if ((int16_t) ssn->state.local_channel >= 0 &&
         (int32_t) state->local_handle >= 0 &&
-        ((rcv->drain || state->link_credit != rcv->credit - rcv->queued) || !ssn->state.incoming_window)) {
+        ((rcv->drain || state->link_credit != rcv->credit - rcv->queued) || pni_session_refresh_incoming_window(ssn))) {
       state->link_credit = rcv->credit - rcv->queued;
       return pni_post_flow(transport, ssn, rcv);
     }
@@ -2098,26 +2507,86 @@ static int pni_process_flow_receiver(pn_transport_t *transport, pn_endpoint_t *e
 
 static int pni_flush_disp(pn_transport_t *transport, pn_session_t *ssn)
 {
-  uint64_t code = ssn->state.disp_code;
-  bool settled = ssn->state.disp_settled;
-  if (ssn->state.disp) {
-    int err = pn_post_frame(transport, AMQP_FRAME_TYPE, ssn->state.local_channel, "DL[oI?I?o?DL[]]", DISPOSITION,
-                            ssn->state.disp_type,
-                            ssn->state.disp_first,
-                            ssn->state.disp_last!=ssn->state.disp_first, ssn->state.disp_last,
+  pn_session_state_t *state = &ssn->state;
+  uint64_t code = state->disp_code;
+  bool settled = state->disp_settled;
+  if (state->disp) {
+    // One frame per range of delivery-ids
+    for (size_t i = 0; i < state->disp_range_count; ++i) {
+      pn_sequence_t first = state->disp_ranges[2*i];
+      pn_sequence_t last = state->disp_ranges[2*i+1];
+      int err;
+      if (!(transport->trace & PN_TRACE_FRM)) {
+        pni_emitter_t emitter;
+        do {
+          emitter = pni_frame_emitter(transport->frame);
+          pni_emit_disposition(&emitter, state->disp_type, first, last, settled, code);
+        } while (pni_frame_emitter_retry(&emitter, transport->frame));
+        err = pni_post_encoded_frame(transport, AMQP_FRAME_TYPE, state->local_channel, pni_emitter_bytes(&emitter));
+      } else {
+        err = pn_post_frame(transport, AMQP_FRAME_TYPE, state->local_channel, "DL[oI?I?o?DL[]]", DISPOSITION,
+                            state->disp_type,
+                            first,
+                            last!=first, last,
                             settled, settled,
                             (bool)code, code);
-    if (err) return err;
-    ssn->state.disp_type = 0;
-    ssn->state.disp_code = 0;
-    ssn->state.disp_settled = 0;
-    ssn->state.disp_first = 0;
-    ssn->state.disp_last = 0;
-    ssn->state.disp = false;
+      }
+      if (err) {
+        // Keep only the ranges that were not sent
+        state->disp_range_count -= i;
+        memmove(state->disp_ranges, state->disp_ranges + 2*i,
+                2*state->disp_range_count*sizeof(pn_sequence_t));
+        return err;
+      }
+    }
+    state->disp_type = 0;
+    state->disp_code = 0;
+    state->disp_settled = 0;
+    state->disp_range_count = 0;
+    state->disp_deadline = 0;
+    state->disp_due = false;
+    state->disp = false;
   }
   return 0;
 }
 
+// Add id to the pending disposition ranges, merging it with its neighbours.
+// Return false if id needs a new range and there are already max ranges.
+static bool pni_disp_add(pn_session_state_t *state, pn_sequence_t id, size_t max)
+{
+  pn_sequence_t *r = state->disp_ranges;
+  size_t n = state->disp_range_count;
+  // Dispositions mostly arrive in order, so search back from the last range
+  size_t i = n;
+  while (i > 0 && sequence_lt(id, r[2*(i-1)])) --i;
+  // Ranges before i start at or before id, ranges from i start after it
+  if (i > 0 && sequence_lte(id, r[2*(i-1)+1])) return true;
+  bool join_prev = i > 0 && r[2*(i-1)+1] + 1 == id;
+  bool join_next = i < n && id + 1 == r[2*i];
+  if (join_prev && join_next) {
+    r[2*(i-1)+1] = r[2*i+1];
+    memmove(&r[2*i], &r[2*(i+1)], 2*(n-i-1)*sizeof(pn_sequence_t));
+    --state->disp_range_count;
+  } else if (join_prev) {
+    r[2*(i-1)+1] = id;
+  } else if (join_next) {
+    r[2*i] = id;
+  } else {
+    if (n > 0 && n >= max) return false;
+    if (n == state->disp_range_capacity) {
+      size_t capacity = n ? 2*n : 4;
+      r = (pn_sequence_t *) realloc(r, 2*capacity*sizeof(pn_sequence_t));
+      if (!r) return false;
+      state->disp_ranges = r;
+      state->disp_range_capacity = capacity;
+    }
+    memmove(&r[2*(i+1)], &r[2*i], 2*(n-i)*sizeof(pn_sequence_t));
+    r[2*i] = r[2*i+1] = id;
+    ++state->disp_range_count;
+  }
+  return true;
+}
+
 static int pni_post_disp(pn_transport_t *transport, pn_delivery_t *delivery)
 {
   pn_link_t *link = delivery->link;
@@ -2143,31 +2612,30 @@ static int pni_post_disp(pn_transport_t *transport, pn_delivery_t *delivery)
       (bool)code, code, transport->disp_data);
   }
 
-  if (ssn_state->disp && code == ssn_state->disp_code &&
-      delivery->local.settled == ssn_state->disp_settled &&
-      ssn_state->disp_type == role) {
-    if (state->id == ssn_state->disp_first - 1) {
-      ssn_state->disp_first = state->id;
-      return 0;
-    } else if (state->id == ssn_state->disp_last + 1) {
-      ssn_state->disp_last = state->id;
+  // Collect ids with the same outcome till pni_process_flush_disp(), in any order
+  if (ssn_state->disp && (code != ssn_state->disp_code ||
+                          delivery->local.settled != ssn_state->disp_settled ||
+                          ssn_state->disp_type != role)) {
+    PN_RETURN_IF_ERROR(pni_flush_disp(transport, ssn));
+  }
+  for (int tries = 0; tries < 2; ++tries) {
+    if (!ssn_state->disp) {
+      ssn_state->disp_type = role;
+      ssn_state->disp_code = code;
+      ssn_state->disp_settled = delivery->local.settled;
+      ssn_state->disp = true;
+      // The delay runs from now, as far as the transport knows the time
+      if (transport->disp_delay && transport->last_tick) {
+        ssn_state->disp_deadline = transport->last_tick + transport->disp_delay;
+      }
+    }
+    if (pni_disp_add(ssn_state, state->id, transport->disp_max_ranges)) {
       return 0;
     }
+    // Too many ranges, send what we have and start again
+    PN_RETURN_IF_ERROR(pni_flush_disp(transport, ssn));
   }
-
-  if (ssn_state->disp) {
-    int err = pni_flush_disp(transport, ssn);
-    if (err) return err;
-  }
-
-  ssn_state->disp_type = role;
-  ssn_state->disp_code = code;
-  ssn_state->disp_settled = delivery->local.settled;
-  ssn_state->disp_first = state->id;
-  ssn_state->disp_last = state->id;
-  ssn_state->disp = true;
-
-  return 0;
+  return PN_OUT_OF_MEMORY;
 }
 
 static int pni_process_tpwork_sender(pn_transport_t *transport, pn_delivery_t *delivery, bool *settle)
@@ -2190,11 +2658,23 @@ static int pni_process_tpwork_sender(pn_transport_t *transport, pn_delivery_t *d
         ssn_state->remote_incoming_window > 0 && link_state->link_credit > 0) {
       if (!state->init) {
         state = pni_delivery_map_push(&ssn_state->outgoing, delivery);
+        if (!state) return PN_OUT_OF_MEMORY;
       }
 
       pn_bytes_t bytes = pn_buffer_bytes(delivery->bytes);
       size_t full_size = bytes.size;
       pn_bytes_t tag = pn_buffer_bytes(delivery->tag);
+      // Hand a large payload's buffer to the transport to write from, the
+      // delivery carries on with a spare one
+      pn_buffer_t *owner = NULL;
+      if (full_size >= PNI_OUTPUT_SLICE_MIN && !delivery->aborted &&
+          !(transport->trace & PN_TRACE_RAW)) {
+        pn_buffer_t *spare = transport->spare_count ?
+          transport->spare_payloads[--transport->spare_count] : pn_buffer(64);
+        if (!spare) return PN_OUT_OF_MEMORY;
+        owner = delivery->bytes;
+        delivery->bytes = spare;
+      }
       pn_data_clear(transport->disp_data);
       PN_RETURN_IF_ERROR(pni_disposition_encode(&delivery->local, transport->disp_data));
       int count = pni_post_amqp_transfer_frame(transport,
@@ -2209,7 +2689,8 @@ static int pni_process_tpwork_sender(pn_transport_t *transport, pn_delivery_t *d
                                                transport->disp_data,
                                                false, /* Resume */
                                                delivery->aborted,
-                                               false /* Batchable */
+                                               false, /* Batchable */
+                                               owner
       );
       if (count < 0) return count;
       state->sending = true;
@@ -2218,7 +2699,12 @@ static int pni_process_tpwork_sender(pn_transport_t *transport, pn_delivery_t *d
       ssn_state->remote_incoming_window -= count;
 
       int sent = full_size - bytes.size;
-      pn_buffer_trim(delivery->bytes, sent, 0);
+      if (owner) {
+        // Whatever did not fit in the window goes back to the delivery
+        pn_buffer_append(delivery->bytes, bytes.start, bytes.size);
+      } else {
+        pn_buffer_trim(delivery->bytes, sent, 0);
+      }
       link->session->outgoing_bytes -= sent;
       if (!pn_buffer_size(delivery->bytes) && delivery->done) {
         state->sent = true;
@@ -2254,8 +2740,7 @@ static int pni_process_tpwork_receiver(pn_transport_t *transport, pn_delivery_t
     if (err) return err;
   }
 
-  // XXX: need to centralize this policy and improve it
-  if (!ssn->state.incoming_window) {
+  if (pni_session_refresh_incoming_window(ssn)) {
     int err = pni_post_flow(transport, ssn, link);
     if (err) return err;
   }
@@ -2305,7 +2790,11 @@ static int pni_process_flush_disp(pn_transport_t *transport, pn_endpoint_t *endp
   if (endpoint->type == SESSION) {
     pn_session_t *session = (pn_session_t *) endpoint;
     pn_session_state_t *state = &session->state;
-    if ((int16_t) state->local_channel >= 0 && !transport->close_sent)
+    // Delayed dispositions wait for pn_transport_tick() unless the session is ending
+    bool hold = transport->disp_delay && !state->disp_due &&
+      !(session->endpoint.state & PN_LOCAL_CLOSED) &&
+      !(transport->connection->endpoint.state & PN_LOCAL_CLOSED);
+    if ((int16_t) state->local_channel >= 0 && !transport->close_sent && !hold)
     {
       int err = pni_flush_disp(transport, session);
       if (err) return err;
@@ -2590,6 +3079,7 @@ static ssize_t pn_input_read_amqp(pn_transport_t* transport, unsigned int layer,
 static pn_timestamp_t pn_tick_amqp(pn_transport_t* transport, unsigned int layer, pn_timestamp_t now)
 {
   pn_timestamp_t timeout = 0;
+  transport->last_tick = now;
 
   if (transport->local_idle_timeout) {
     if (transport->dead_remote_deadline == 0 ||
@@ -2615,7 +3105,7 @@ static pn_timestamp_t pn_tick_amqp(pn_transport_t* transport, unsigned int layer
       transport->last_bytes_output = transport->bytes_output;
     } else if (transport->keepalive_deadline <= now) {
       transport->keepalive_deadline = now + (pn_timestamp_t)(transport->remote_idle_timeout/2.0);
-      if (pn_buffer_size(transport->output_buffer) == 0) {    // no outbound data pending
+      if (pni_output_size(transport) == 0) {    // no outbound data pending
         // so send empty frame (and account for it!)
         pn_post_frame(transport, AMQP_FRAME_TYPE, 0, "");
         transport->last_bytes_output += pn_buffer_size(transport->output_buffer);
@@ -2624,6 +3114,24 @@ static pn_timestamp_t pn_tick_amqp(pn_transport_t* transport, unsigned int layer
     timeout = pn_timestamp_min( timeout, transport->keepalive_deadline );
   }
 
+  // Send delayed dispositions that are due
+  if (transport->disp_delay && transport->connection) {
+    pn_list_t *sessions = transport->connection->sessions;
+    for (size_t i = 0; i < pn_list_size(sessions); ++i) {
+      pn_session_t *ssn = (pn_session_t *) pn_list_get(sessions, i);
+      pn_session_state_t *state = &ssn->state;
+      if (!state->disp || state->disp_due) continue;
+      if (!state->disp_deadline) {
+        state->disp_deadline = now + transport->disp_delay;
+      } else if (state->disp_deadline <= now) {
+        state->disp_due = true;
+        pn_modified(transport->connection, &ssn->endpoint, false);
+        continue;
+      }
+      timeout = pn_timestamp_min(timeout, state->disp_deadline);
+    }
+  }
+
   return timeout;
 }
 
@@ -2647,7 +3155,7 @@ static ssize_t pn_output_write_amqp_header(pn_transport_t* transport, unsigned i
   return 8;
 }
 
-static ssize_t pn_output_write_amqp(pn_transport_t* transport, unsigned int layer, char* bytes, size_t available)
+static void pni_output_process(pn_transport_t* transport)
 {
   if (transport->connection && !transport->done_processing) {
     int err = pni_process(transport);
@@ -2656,17 +3164,33 @@ static ssize_t pn_output_write_amqp(pn_transport_t* transport, unsigned int laye
       transport->done_processing = true;
     }
   }
+}
+
+static ssize_t pn_output_write_amqp(pn_transport_t* transport, unsigned int layer, char* bytes, size_t available)
+{
+  pni_output_process(transport);
 
   // write out any buffered data _before_ returning PN_EOS, else we
   // could truncate an outgoing Close frame containing a useful error
   // status
-  if (!pn_buffer_size(transport->output_buffer) && transport->close_sent) {
+  if (!pni_output_size(transport) && transport->close_sent) {
     return PN_EOS;
   }
 
   return pn_dispatcher_output(transport, bytes, available);
 }
 
+// True if frame output goes out unchanged, with no SSL or SASL layer
+static bool pni_output_segmentable(pn_transport_t *transport)
+{
+  for (int layer = 0; layer < PN_IO_LAYER_CT; ++layer) {
+    const pn_io_layer_t *io_layer = transport->io_layers[layer];
+    if (io_layer == &amqp_layer) return true;
+    if (io_layer != &pni_passthru_layer) return false;
+  }
+  return false;
+}
+
 // Mark transport output as closed and send event
 static void pni_close_head(pn_transport_t *transport)
 {
@@ -2683,9 +3207,17 @@ static ssize_t transport_produce(pn_transport_t *transport)
 {
   if (transport->head_closed) return PN_EOS;
 
-  ssize_t space = transport->output_size - transport->output_pending;
+  // Reclaim the space of popped output once that copies no more than was
+  // popped. Until then a full buffer just waits for more output to be popped.
+  if (transport->output_start && transport->output_start >= transport->output_pending) {
+    memmove( transport->output_buf, &transport->output_buf[transport->output_start],
+             transport->output_pending );
+    transport->output_start = 0;
+  }
 
-  if (space <= 0) {     // can we expand the buffer?
+  ssize_t space = transport->output_size - transport->output_start - transport->output_pending;
+
+  if (space <= 0 && !transport->output_start) {     // can we expand the buffer?
     int more = 0;
     if (!transport->remote_max_frame)   // no limit, so double it
       more = transport->output_size;
@@ -2705,7 +3237,7 @@ static ssize_t transport_produce(pn_transport_t *transport)
     ssize_t n;
     n = transport->io_layers[0]->
       process_output( transport, 0,
-                      &transport->output_buf[transport->output_pending],
+                      &transport->output_buf[transport->output_start + transport->output_pending],
                       space );
     if (n > 0) {
       space -= n;
@@ -2865,6 +3397,26 @@ void pn_transport_set_idle_timeout(pn_transport_t *transport, pn_millis_t timeou
   transport->local_idle_timeout = timeout;
 }
 
+size_t pn_transport_get_max_disposition_ranges(pn_transport_t *transport)
+{
+  return transport->disp_max_ranges;
+}
+
+void pn_transport_set_max_disposition_ranges(pn_transport_t *transport, size_t ranges)
+{
+  transport->disp_max_ranges = ranges;
+}
+
+pn_millis_t pn_transport_get_disposition_delay(pn_transport_t *transport)
+{
+  return transport->disp_delay;
+}
+
+void pn_transport_set_disposition_delay(pn_transport_t *transport, pn_millis_t delay)
+{
+  transport->disp_delay = delay;
+}
+
 pn_millis_t pn_transport_get_remote_idle_timeout(pn_transport_t *transport)
 {
   return transport->remote_idle_timeout;
@@ -2900,7 +3452,25 @@ ssize_t pn_transport_capacity(pn_transport_t *transport)  /* <0 == done */
   if (transport->tail_closed) return PN_EOS;
   //if (pn_error_code(transport->error)) return pn_error_code(transport->error);
 
-  ssize_t capacity = transport->input_size - transport->input_pending;
+  // Pinned input stays in place while there is space after it
+  if (transport->pinned_head) {
+    if (transport->input_start + transport->input_pending < transport->input_size) {
+      return transport->input_size - transport->input_start - transport->input_pending;
+    }
+    pni_transport_unpin(transport);
+  }
+
+  // Move unconsumed input to the start of the buffer once that copies no
+  // more than has been consumed, or when there is no space left after it
+  if (transport->input_start &&
+      (transport->input_start >= transport->input_pending ||
+       transport->input_start + transport->input_pending >= transport->input_size)) {
+    memmove( transport->input_buf, &transport->input_buf[transport->input_start],
+             transport->input_pending );
+    transport->input_start = 0;
+  }
+
+  ssize_t capacity = transport->input_size - transport->input_start - transport->input_pending;
   if ( capacity<=0 ) {
     // can we expand the size of the input buffer?
     int more = 0;
@@ -2924,8 +3494,8 @@ ssize_t pn_transport_capacity(pn_transport_t *transport)  /* <0 == done */
 
 char *pn_transport_tail(pn_transport_t *transport)
 {
-  if (transport && transport->input_pending < transport->input_size) {
-    return &transport->input_buf[transport->input_pending];
+  if (transport && transport->input_start + transport->input_pending < transport->input_size) {
+    return &transport->input_buf[transport->input_start + transport->input_pending];
   }
   return NULL;
 }
@@ -2956,7 +3526,7 @@ ssize_t pn_transport_push(pn_transport_t *transport, const char *src, size_t siz
 int pn_transport_process(pn_transport_t *transport, size_t size)
 {
   assert(transport);
-  size = pn_min( size, (transport->input_size - transport->input_pending) );
+  size = pn_min( size, (transport->input_size - transport->input_start - transport->input_pending) );
   transport->input_pending += size;
   transport->bytes_input += size;
 
@@ -2988,7 +3558,7 @@ ssize_t pn_transport_pending(pn_transport_t *transport)      /* <0 == done */
 const char *pn_transport_head(pn_transport_t *transport)
 {
   if (transport && transport->output_pending) {
-    return transport->output_buf;
+    return &transport->output_buf[transport->output_start];
   }
   return NULL;
 }
@@ -3013,18 +3583,58 @@ ssize_t pn_transport_peek(pn_transport_t *transport, char *dst, size_t size)
   return size;
 }
 
+ssize_t pn_transport_segments(pn_transport_t *transport, pn_bytes_t *segments, size_t n)
+{
+  assert(transport);
+  if (!n) return 0;
+  if (!pni_output_segmentable(transport)) {
+    ssize_t pending = pn_transport_pending(transport);
+    if (pending <= 0) return pending;
+    segments[0] = pn_bytes(pending, pn_transport_head(transport));
+    return 1;
+  }
+  if (transport->head_closed) return PN_EOS;
+
+  // Output already produced for the copy-based API goes first
+  size_t count = 0;
+  if (transport->output_pending) {
+    segments[count++] = pn_bytes(transport->output_pending,
+                                 &transport->output_buf[transport->output_start]);
+  }
+  pni_output_process(transport);
+  count += pni_output_segments(transport, segments + count, n - count);
+  if (!count && transport->close_sent) {
+    if (transport->trace & (PN_TRACE_RAW | PN_TRACE_FRM)) {
+      pn_transport_log(transport, "  -> EOS");
+    }
+    pni_close_head(transport);
+    return PN_EOS;
+  }
+  return count;
+}
+
 void pn_transport_pop(pn_transport_t *transport, size_t size)
 {
   if (transport) {
-    assert( transport->output_pending >= size );
-    transport->output_pending -= size;
+    // Output produced into output_buf, then any taken by pn_transport_segments()
+    size_t popped = pn_min(size, transport->output_pending);
+    transport->output_pending -= popped;
     transport->bytes_output += size;
+    // Leave the remaining output in place, transport_produce() moves it
     if (transport->output_pending) {
-      memmove( transport->output_buf,  &transport->output_buf[size],
-               transport->output_pending );
+      transport->output_start += popped;
+    } else {
+      transport->output_start = 0;
+    }
+    if (size > popped) {
+      size_t taken = pni_output_take(transport, NULL, size - popped);
+      assert(taken == size - popped);
+      (void)taken;
     }
 
-    if (transport->output_pending==0 && pn_transport_pending(transport) < 0) {
+    // Check for the end of output without copying any that remains
+    pn_bytes_t segment;
+    if (transport->output_pending==0 && pn_transport_segments(transport, &segment, 1) < 0) {
       // TODO: It looks to me that this is a NOP as iff we ever get here
       // TODO: pni_close_head() will always have been already called before leaving pn_transport_pending()
       pni_close_head(transport);
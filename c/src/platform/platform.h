@@ -81,6 +81,24 @@ int pni_vsnprintf(char *buf, size_t count, const char *fmt, va_list ap);
 
 #endif
 
+/* Storage class for per-thread caches */
+#ifdef _MSC_VER
+#define PNI_THREAD_LOCAL __declspec(thread)
+#else
+#define PNI_THREAD_LOCAL __thread
+#endif
+
+/**
+ * Call hook when the calling thread exits, to release its per-thread
+ * caches. Registering the same hook again from the same thread does
+ * nothing. Hooks are not called for a thread that ends the process.
+ *
+ * @return 0, or non-zero if the platform cannot call the hook.
+ *
+ * @internal
+ */
+int pni_thread_exit_hook(void (*hook)(void));
+
 #if defined _MSC_VER || defined _OPENVMS
 #if !defined(va_copy)
 #define va_copy(d,s) ((d) = (s))
@@ -0,0 +1,121 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "platform.h"
+
+#include <stdbool.h>
+
+/* Hooks are kept per thread, one platform slot calls them all at exit */
+#define PNI_THREAD_EXIT_HOOKS 4
+
+typedef void (*pni_thread_exit_fn)(void);
+
+static PNI_THREAD_LOCAL pni_thread_exit_fn pni_thread_exit_hooks[PNI_THREAD_EXIT_HOOKS];
+static PNI_THREAD_LOCAL int pni_thread_exit_count;
+
+static void pni_thread_exit_run(void)
+{
+  // A hook may free objects that another hook would cache, so run them all
+  while (pni_thread_exit_count > 0) {
+    pni_thread_exit_hooks[--pni_thread_exit_count]();
+  }
+}
+
+/* Record hook for this thread, return true if the slot must be armed */
+static bool pni_thread_exit_add(pni_thread_exit_fn hook, int *err)
+{
+  *err = 0;
+  for (int i = 0; i < pni_thread_exit_count; ++i) {
+    if (pni_thread_exit_hooks[i] == hook) return false;
+  }
+  if (pni_thread_exit_count == PNI_THREAD_EXIT_HOOKS) {
+    *err = -1;
+    return false;
+  }
+  pni_thread_exit_hooks[pni_thread_exit_count++] = hook;
+  return pni_thread_exit_count == 1;
+}
+
+#if defined(USE_PTHREAD_THREAD_EXIT)
+#include <pthread.h>
+
+static pthread_key_t pni_thread_exit_key;
+static pthread_once_t pni_thread_exit_once = PTHREAD_ONCE_INIT;
+static int pni_thread_exit_key_err;
+
+static void pni_thread_exit_destructor(void *value)
+{
+  pni_thread_exit_run();
+}
+
+static void pni_thread_exit_init(void)
+{
+  pni_thread_exit_key_err = pthread_key_create(&pni_thread_exit_key, pni_thread_exit_destructor);
+}
+
+int pni_thread_exit_hook(void (*hook)(void))
+{
+  pthread_once(&pni_thread_exit_once, pni_thread_exit_init);
+  if (pni_thread_exit_key_err) return pni_thread_exit_key_err;
+  int err;
+  // The destructor only runs for a thread with a non-NULL value
+  if (pni_thread_exit_add(hook, &err)) {
+    err = pthread_setspecific(pni_thread_exit_key, &pni_thread_exit_count);
+  }
+  return err;
+}
+
+#elif defined(USE_FLS_THREAD_EXIT)
+#include <windows.h>
+
+static DWORD pni_thread_exit_index = FLS_OUT_OF_INDEXES;
+static INIT_ONCE pni_thread_exit_once = INIT_ONCE_STATIC_INIT;
+
+static VOID WINAPI pni_thread_exit_callback(PVOID value)
+{
+  pni_thread_exit_run();
+}
+
+static BOOL CALLBACK pni_thread_exit_init(PINIT_ONCE once, PVOID param, PVOID *context)
+{
+  pni_thread_exit_index = FlsAlloc(pni_thread_exit_callback);
+  return TRUE;
+}
+
+int pni_thread_exit_hook(void (*hook)(void))
+{
+  InitOnceExecuteOnce(&pni_thread_exit_once, pni_thread_exit_init, NULL, NULL);
+  if (pni_thread_exit_index == FLS_OUT_OF_INDEXES) return -1;
+  int err;
+  // The callback only runs for a fiber with a non-NULL value
+  if (pni_thread_exit_add(hook, &err)) {
+    if (!FlsSetValue(pni_thread_exit_index, &pni_thread_exit_count)) err = -1;
+  }
+  return err;
+}
+
+#else
+
+int pni_thread_exit_hook(void (*hook)(void))
+{
+  return -1;
+}
+
+#endif
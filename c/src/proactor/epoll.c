@@ -52,21 +52,19 @@
 #include <fcntl.h>
 #include <netinet/tcp.h>
 #include <sys/eventfd.h>
+#include <sys/uio.h>
 #include <limits.h>
 #include <time.h>
 
 #include "./netaddr-internal.h" /* Include after socket/inet headers */
 
-// TODO: replace timerfd per connection with global lightweight timer mechanism.
 // logging in general
 // SIGPIPE?
 // Can some of the mutexes be spinlocks (any benefit over adaptive pthread mutex)?
 //   Maybe futex is even better?
 // See other "TODO" in code.
 //
-// Consider case of large number of wakes: proactor_do_epoll() could start by
-// looking for pending wakes before a kernel call to epoll_wait(), or there
-// could be several eventfds with random assignment of wakeables.
+// The ready queue size and the batch size for epoll_wait() could be tuned.
 
 
 typedef char strerrorbuf[1024];      /* used for pstrerror message buffer */
@@ -119,9 +117,11 @@ typedef enum {
   PCONNECTION_IO,
   PCONNECTION_IO_2,
   PCONNECTION_TIMER,
+  PCONNECTION_TIMERS,
   LISTENER_IO,
   CHAINED_EPOLL,
-  PROACTOR_TIMER } epoll_type_t;
+  PROACTOR_TIMER,
+  READY_KICK } epoll_type_t;
 
 // Data to use with epoll.
 typedef struct epoll_extended_t {
@@ -172,16 +172,15 @@ typedef struct ptimer_t {
   bool shutting_down;
 } ptimer_t;
 
-static bool ptimer_init(ptimer_t *pt, struct psocket_t *ps) {
+static bool ptimer_init(ptimer_t *pt) {
   pt->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
   pmutex_init(&pt->mutex);
   pt->timer_active = false;
   pt->in_doubt = false;
   pt->shutting_down = false;
-  epoll_type_t type = ps ? PCONNECTION_TIMER : PROACTOR_TIMER;
-  pt->epoll_io.psocket = ps;
+  pt->epoll_io.psocket = NULL;
   pt->epoll_io.fd = pt->timerfd;
-  pt->epoll_io.type = type;
+  pt->epoll_io.type = PROACTOR_TIMER;
   pt->epoll_io.wanted = EPOLLIN;
   pt->epoll_io.polling = false;
   return (pt->timerfd >= 0);
@@ -240,23 +239,6 @@ static bool ptimer_callback(ptimer_t *pt) {
   return u_exp_count > 0;
 }
 
-// Return true if timerfd has and will have no pollable expiries in the current armed state
-static bool ptimer_shutdown(ptimer_t *pt, bool currently_armed) {
-  lock(&pt->mutex);
-  if (currently_armed) {
-    ptimer_set_lh(pt, 0);
-    pt->shutting_down = true;
-    if (pt->in_doubt)
-      // Force at least one callback.  If two, second cannot proceed with unarmed timerfd.
-      ptimer_set_lh(pt, 1);
-  }
-  else
-    pt->shutting_down = true;
-  bool rv = !pt->in_doubt;
-  unlock(&pt->mutex);
-  return rv;
-}
-
 static void ptimer_finalize(ptimer_t *pt) {
   if (pt->timerfd >= 0) close(pt->timerfd);
   pmutex_finalize(&pt->mutex);
@@ -269,6 +251,13 @@ pn_timestamp_t pn_i_now2(void)
   return ((pn_timestamp_t)now.tv_sec) * 1000 + (now.tv_nsec / 1000000);
 }
 
+static uint64_t monotonic_millis(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t)now.tv_sec) * 1000 + (now.tv_nsec / 1000000);
+}
+
 // ========================================================================
 // Proactor common code
 // ========================================================================
@@ -374,7 +363,7 @@ typedef struct pcontext_t {
   pcontext_type_t type;
   bool working;
   int wake_ops;             // unprocessed eventfd wake callback (convert to bool?)
-  struct pcontext_t *wake_next; // wake list, guarded by proactor eventfd_mutex
+  struct pcontext_t *wake_next; // wake list, see wake()
   bool closing;
   // Next 4 are protected by the proactor mutex
   struct pcontext_t* next;  /* Protected by proactor.mutex */
@@ -428,15 +417,32 @@ struct pn_proactor_t {
   bool shutting_down;
   // wake subsystem
   int eventfd;
-  pmutex eventfd_mutex;
-  bool wakes_in_progress;
-  pcontext_t *wake_list_first;
-  pcontext_t *wake_list_last;
+  pcontext_t *wake_stack;       /* pushed by wake() without a lock */
+  pcontext_t *wake_list_first;  /* only used by the thread in wake_pop_front() */
+  size_t wake_pending;          /* wakes pushed and not yet popped */
   // Interrupts have a dedicated eventfd because they must be async-signal safe.
   int interruptfd;
   // If the process runs out of file descriptors, disarm listening sockets temporarily and save them here.
   acceptor_t *overflow;
   pmutex overflow_mutex;
+  // ready queue: events harvested by epoll_wait() but not yet processed, see proactor_do_epoll()
+  pmutex ready_mutex;
+  struct epoll_event *ready_events;
+  size_t ready_capacity;
+  size_t ready_first;
+  size_t ready_count;
+  int epoll_waiters;            /* threads blocked in epoll_wait() */
+  bool ready_kicked;            /* readyfd written and not yet read */
+  int readyfd;
+  epoll_extended_t epoll_ready;
+  // connection timers: all connections share a single timerfd, see "connection timers" below
+  pmutex timers_mutex;
+  int timersfd;
+  epoll_extended_t epoll_timers;
+  struct pconnection_t **timers_heap;
+  size_t timers_count;
+  size_t timers_capacity;
+  uint64_t timers_deadline;     /* expiry set on timersfd, 0 if none */
 };
 
 static void rearm(pn_proactor_t *p, epoll_extended_t *ee);
@@ -444,13 +450,18 @@ static void rearm(pn_proactor_t *p, epoll_extended_t *ee);
 /*
  * Wake strategy with eventfd.
  *  - wakees can be in the list only once
- *  - wakers only write() if wakes_in_progress is false
- *  - wakees only read() if about to set wakes_in_progress to false
+ *  - wakers push onto wake_stack with a compare-and-swap, no lock is taken
+ *  - wakers only write() if they raise wake_pending from zero
+ *  - wakees only read() if about to pop the last pending wake
  * When multiple wakes are pending, the kernel cost is a single rearm().
  * Otherwise it is the trio of write/read/rearm.
- * Only the writes and reads need to be carefully ordered.
  *
- * Multiple eventfds could be used and shared amongst the pcontext_t's.
+ * epoll_wake is EPOLLONESHOT and only rearmed at the end of
+ * wake_pop_front(), so there is a single consumer at a time.  It takes
+ * the whole stack when its private FIFO list is empty, so wakes are
+ * still processed in order.  If a wake is pushed after the consumer
+ * has read() the eventfd its waker did not write(), so the consumer
+ * writes on its behalf.
  */
 
 // part1: call with ctx->owner lock held, return true if notify required by caller
@@ -460,19 +471,12 @@ static bool wake(pcontext_t *ctx) {
     if (!ctx->working) {
       ctx->wake_ops++;
       pn_proactor_t *p = ctx->proactor;
-      lock(&p->eventfd_mutex);
-      if (!p->wake_list_first) {
-        p->wake_list_first = p->wake_list_last = ctx;
-      } else {
-        p->wake_list_last->wake_next = ctx;
-        p->wake_list_last = ctx;
-      }
-      if (!p->wakes_in_progress) {
-        // force a wakeup via the eventfd
-        p->wakes_in_progress = true;
-        notify = true;
-      }
-      unlock(&p->eventfd_mutex);
+      pcontext_t *top = __atomic_load_n(&p->wake_stack, __ATOMIC_RELAXED);
+      do {
+        ctx->wake_next = top;
+      } while (!__atomic_compare_exchange_n(&p->wake_stack, &top, ctx, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+      // force a wakeup via the eventfd if no other wake is in progress
+      notify = __atomic_fetch_add(&p->wake_pending, 1, __ATOMIC_ACQ_REL) == 0;
     }
   }
   return notify;
@@ -487,27 +491,34 @@ static inline void wake_notify(pcontext_t *ctx) {
     EPOLL_FATAL("setting eventfd", errno);
 }
 
-// call with no locks
+// call with no locks, from the single thread that got the epoll_wake event
 static pcontext_t *wake_pop_front(pn_proactor_t *p) {
-  pcontext_t *ctx = NULL;
-  lock(&p->eventfd_mutex);
-  assert(p->wakes_in_progress);
-  if (p->wake_list_first) {
-    ctx = p->wake_list_first;
+  if (!p->wake_list_first) {
+    // Take all pushed wakes, reversing the stack into FIFO order
+    pcontext_t *stack = __atomic_exchange_n(&p->wake_stack, NULL, __ATOMIC_ACQUIRE);
+    while (stack) {
+      pcontext_t *next = stack->wake_next;
+      stack->wake_next = p->wake_list_first;
+      p->wake_list_first = stack;
+      stack = next;
+    }
+  }
+  pcontext_t *ctx = p->wake_list_first;
+  if (ctx) {
     p->wake_list_first = ctx->wake_next;
-    if (!p->wake_list_first) p->wake_list_last = NULL;
     ctx->wake_next = NULL;
 
-    if (!p->wake_list_first) {
-      /* Reset the eventfd until a future write.
-       * Can the read system call be made without holding the lock?
-       * Note that if the reads/writes happen out of order, the wake
-       * mechanism will hang. */
+    /* Reset the eventfd before giving up the last pending wake.
+     * If the reads/writes happen out of order, the wake mechanism will hang. */
+    bool reset = false;
+    if (__atomic_load_n(&p->wake_pending, __ATOMIC_ACQUIRE) == 1) {
       (void)read_uint64(p->eventfd);
-      p->wakes_in_progress = false;
+      reset = true;
+    }
+    if (__atomic_fetch_sub(&p->wake_pending, 1, __ATOMIC_ACQ_REL) > 1 && reset) {
+      wake_notify(&p->context);   // A wake arrived since the read()
     }
   }
-  unlock(&p->eventfd_mutex);
   rearm(p, &p->epoll_wake);
   return ctx;
 }
@@ -540,10 +551,15 @@ typedef struct pconnection_t {
   int wake_count;
   bool server;                /* accept, not connect */
   bool tick_pending;
-  bool timer_armed;
   bool queued_disconnect;     /* deferred from pn_proactor_disconnect() */
   pn_condition_t *disconnect_condition;
-  ptimer_t timer;  // TODO: review one timerfd per connection
+  // Protected by the proactor timers_mutex
+  bool timer_armed;           /* timer event queued and not yet processed */
+  bool timer_stopped;         /* no more timer events after close */
+  uint64_t timer_expire;      /* wanted expiry (monotonic millis), 0 if none */
+  uint64_t timer_key;         /* expiry that orders the timer heap */
+  size_t timer_index;         /* position in the timer heap or TIMER_NONE */
+  epoll_extended_t timer_event;
   // Following values only changed by (sole) working context:
   uint32_t current_arm;  // active epoll io events
   uint32_t current_arm_2;  // secondary active epoll io events
@@ -562,29 +578,22 @@ typedef struct pconnection_t {
   epoll_extended_t *rearm_target;    /* main or secondary epollfd */
 } pconnection_t;
 
-/* Protects read/update of pn_connnection_t pointer to it's pconnection_t
- *
- * Global because pn_connection_wake()/pn_connection_proactor() navigate from
- * the pn_connection_t before we know the proactor or driver. Critical sections
- * are small: only get/set of the pn_connection_t driver pointer.
+/* Read/update of pn_connnection_t pointer to it's pconnection_t
  *
- * TODO: replace mutex with atomic load/store
+ * pn_connection_wake()/pn_connection_proactor() navigate from the
+ * pn_connection_t before we know the proactor or driver, from any thread.
+ * The pointer is loaded and stored atomically so that cross-thread wakes
+ * do not all serialize on one global mutex.
  */
-static pthread_mutex_t driver_ptr_mutex = PTHREAD_MUTEX_INITIALIZER;
-
 static pconnection_t *get_pconnection(pn_connection_t* c) {
   if (!c) return NULL;
-  lock(&driver_ptr_mutex);
-  pn_connection_driver_t *d = *pn_connection_driver_ptr(c);
-  unlock(&driver_ptr_mutex);
+  pn_connection_driver_t *d = __atomic_load_n(pn_connection_driver_ptr(c), __ATOMIC_ACQUIRE);
   if (!d) return NULL;
   return (pconnection_t*)((char*)d-offsetof(pconnection_t, driver));
 }
 
 static void set_pconnection(pn_connection_t* c, pconnection_t *pc) {
-  lock(&driver_ptr_mutex);
-  *pn_connection_driver_ptr(c) = pc ? &pc->driver : NULL;
-  unlock(&driver_ptr_mutex);
+  __atomic_store_n(pn_connection_driver_ptr(c), pc ? &pc->driver : NULL, __ATOMIC_RELEASE);
 }
 
 /*
@@ -596,9 +605,14 @@ static void set_pconnection(pn_connection_t* c, pconnection_t *pc) {
  * traverse.
  */
 
+/* Most connections accepted from one listening socket per readiness event */
+#define ACCEPT_BATCH 16
+
 struct acceptor_t{
   psocket_t psocket;
-  int accepted_fd;
+  int accepted_fds[ACCEPT_BATCH]; /* accepted, waiting for pn_listener_accept2() */
+  size_t accepted_first;
+  size_t accepted_count;
   bool armed;
   bool overflowed;
   acceptor_t *next;              /* next listener list member */
@@ -739,6 +753,14 @@ static void rearm_2(pn_proactor_t *p, epoll_extended_t *ee) {
   }
 }
 
+// Take the oldest accepted fd from an acceptor. Called with listener context lock held.
+static int acceptor_pop_fd(acceptor_t *a) {
+  assert(a->accepted_count);
+  int fd = a->accepted_fds[a->accepted_first++];
+  if (--a->accepted_count == 0) a->accepted_first = 0;
+  return fd;
+}
+
 static void listener_list_append(acceptor_t **start, acceptor_t *item) {
   assert(item->next == NULL);
   if (*start) {
@@ -812,7 +834,154 @@ static int pclosefd(pn_proactor_t *p, int fd) {
 // pconnection
 // ========================================================================
 
+// ========================================================================
+// connection timers
+// ========================================================================
+
+/*
+ * Connection timers are kept in a binary heap ordered by expiry and share a
+ * single timerfd, set to the earliest expiry in the heap.
+ *
+ * pconnection_tick() mostly moves an expiry later, which only updates
+ * timer_expire: the connection keeps its place in the heap (timer_key) and
+ * is put back with the new expiry when it reaches the top.  So the common
+ * rearm costs no heap reordering and no timerfd_settime().
+ *
+ * An expired connection is handed to a thread as a PCONNECTION_TIMER event on
+ * the ready queue (see proactor_do_epoll()).  timer_armed is true from then
+ * until the event is processed, so the connection cannot be freed under it.
+ *
+ * Lock order: connection context mutex, then timers_mutex, then ready_mutex.
+ */
+
+#define TIMER_NONE (~(size_t)0)
+
+// call with timers_mutex held
+static inline bool timers_less(pconnection_t *a, pconnection_t *b) {
+  return a->timer_key < b->timer_key;
+}
+
+// call with timers_mutex held
+static void timers_place_lh(pn_proactor_t *p, size_t i, pconnection_t *pc) {
+  p->timers_heap[i] = pc;
+  pc->timer_index = i;
+}
+
+// call with timers_mutex held
+static void timers_up_lh(pn_proactor_t *p, size_t i) {
+  pconnection_t *pc = p->timers_heap[i];
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (!timers_less(pc, p->timers_heap[parent])) break;
+    timers_place_lh(p, i, p->timers_heap[parent]);
+    i = parent;
+  }
+  timers_place_lh(p, i, pc);
+}
+
+// call with timers_mutex held
+static void timers_down_lh(pn_proactor_t *p, size_t i) {
+  pconnection_t *pc = p->timers_heap[i];
+  while (true) {
+    size_t child = 2 * i + 1;
+    if (child >= p->timers_count) break;
+    if (child + 1 < p->timers_count && timers_less(p->timers_heap[child + 1], p->timers_heap[child]))
+      child++;
+    if (!timers_less(p->timers_heap[child], pc)) break;
+    timers_place_lh(p, i, p->timers_heap[child]);
+    i = child;
+  }
+  timers_place_lh(p, i, pc);
+}
+
+// call with timers_mutex held
+static void timers_insert_lh(pn_proactor_t *p, pconnection_t *pc) {
+  if (p->timers_count == p->timers_capacity) {
+    size_t capacity = p->timers_capacity ? 2 * p->timers_capacity : 64;
+    pconnection_t **heap = (pconnection_t **) realloc(p->timers_heap, capacity * sizeof(pconnection_t *));
+    if (!heap) EPOLL_FATAL("timer heap allocation", ENOMEM);
+    p->timers_heap = heap;
+    p->timers_capacity = capacity;
+  }
+  pc->timer_key = pc->timer_expire;
+  timers_place_lh(p, p->timers_count++, pc);
+  timers_up_lh(p, pc->timer_index);
+}
+
+// call with timers_mutex held
+static void timers_remove_lh(pn_proactor_t *p, pconnection_t *pc) {
+  size_t i = pc->timer_index;
+  pc->timer_index = TIMER_NONE;
+  pconnection_t *last = p->timers_heap[--p->timers_count];
+  if (last == pc) return;
+  timers_place_lh(p, i, last);
+  timers_up_lh(p, i);
+  timers_down_lh(p, last->timer_index);
+}
+
+// call with timers_mutex held, set the timerfd if the earliest expiry is now earlier
+static void timers_update_lh(pn_proactor_t *p) {
+  if (!p->timers_count) return;
+  uint64_t deadline = p->timers_heap[0]->timer_key;
+  if (p->timers_deadline && p->timers_deadline <= deadline) return;
+  struct itimerspec newt;
+  memset(&newt, 0, sizeof(newt));
+  if (!deadline) deadline = 1;  // 0 would disarm
+  newt.it_value.tv_sec = deadline / 1000;
+  newt.it_value.tv_nsec = (deadline % 1000) * 1000000;
+  timerfd_settime(p->timersfd, TFD_TIMER_ABSTIME, &newt, NULL);
+  p->timers_deadline = deadline;
+}
+
+/* Set the connection timer to expire at monotonic time expire, 0 to cancel. */
+static void pconnection_timer_set(pconnection_t *pc, uint64_t expire) {
+  pn_proactor_t *p = pc->psocket.proactor;
+  lock(&p->timers_mutex);
+  if (!pc->timer_stopped) {
+    pc->timer_expire = expire;
+    if (expire) {
+      if (pc->timer_index == TIMER_NONE) {
+        timers_insert_lh(p, pc);
+      } else if (expire < pc->timer_key) {
+        pc->timer_key = expire;
+        timers_up_lh(p, pc->timer_index);
+      }
+      timers_update_lh(p);
+    }
+    // A cancelled or later expiry is dealt with when the heap entry expires
+  }
+  unlock(&p->timers_mutex);
+}
+
+/* No more timer events once closing, an event already queued still arrives. */
+static void pconnection_timer_stop(pconnection_t *pc) {
+  pn_proactor_t *p = pc->psocket.proactor;
+  lock(&p->timers_mutex);
+  pc->timer_stopped = true;
+  pc->timer_expire = 0;
+  if (pc->timer_index != TIMER_NONE)
+    timers_remove_lh(p, pc);
+  unlock(&p->timers_mutex);
+}
+
+static bool pconnection_timer_armed(pconnection_t *pc) {
+  pn_proactor_t *p = pc->psocket.proactor;
+  lock(&p->timers_mutex);
+  bool armed = pc->timer_armed;
+  unlock(&p->timers_mutex);
+  return armed;
+}
+
+/* Call with context lock held when processing a PCONNECTION_TIMER event */
+static void pconnection_timer_done(pconnection_t *pc) {
+  pn_proactor_t *p = pc->psocket.proactor;
+  lock(&p->timers_mutex);
+  pc->timer_armed = false;
+  unlock(&p->timers_mutex);
+}
+
 static void pconnection_tick(pconnection_t *pc);
+static void pconnection_disp_tick(pconnection_t *pc);
 
 static const char *pconnection_setup(pconnection_t *pc, pn_proactor_t *p, pn_connection_t *c, pn_transport_t *t, bool server, const char *addr)
 {
@@ -830,6 +999,9 @@ static const char *pconnection_setup(pconnection_t *pc, pn_proactor_t *p, pn_con
   pc->wake_count = 0;
   pc->tick_pending = false;
   pc->timer_armed = false;
+  pc->timer_stopped = false;
+  pc->timer_expire = 0;
+  pc->timer_index = TIMER_NONE;
   pc->queued_disconnect = false;
   pc->disconnect_condition = NULL;
 
@@ -846,13 +1018,16 @@ static const char *pconnection_setup(pconnection_t *pc, pn_proactor_t *p, pn_con
     pn_transport_set_server(pc->driver.transport);
   }
 
-  if (!ptimer_init(&pc->timer, &pc->psocket)) {
-    psocket_error(&pc->psocket, errno, "timer setup");
-    pc->disconnected = true;    /* Already failed */
-  }
   pmutex_init(&pc->rearm_mutex);
 
-  epoll_extended_t *ee = &pc->epoll_io_2;
+  epoll_extended_t *ee = &pc->timer_event;
+  ee->psocket = &pc->psocket;
+  ee->fd = -1;
+  ee->type = PCONNECTION_TIMER;
+  ee->wanted = 0;
+  ee->polling = false;
+
+  ee = &pc->epoll_io_2;
   ee->psocket = &pc->psocket;
   ee->fd = -1;
   ee->type = PCONNECTION_IO_2;
@@ -871,7 +1046,7 @@ static const char *pconnection_setup(pconnection_t *pc, pn_proactor_t *p, pn_con
 // Call with lock held and closing == true (i.e. pn_connection_driver_finished() == true), timer cancelled.
 // Return true when all possible outstanding epoll events associated with this pconnection have been processed.
 static inline bool pconnection_is_final(pconnection_t *pc) {
-  return !pc->current_arm && !pc->current_arm_2 && !pc->timer_armed && !pc->context.wake_ops;
+  return !pc->current_arm && !pc->current_arm_2 && !pconnection_timer_armed(pc) && !pc->context.wake_ops;
 }
 
 static void pconnection_final_free(pconnection_t *pc) {
@@ -896,8 +1071,7 @@ static void pconnection_cleanup(pconnection_t *pc) {
   stop_polling(&pc->psocket.epoll_io, pc->psocket.proactor->epollfd);
   if (pc->psocket.sockfd != -1)
     pclosefd(pc->psocket.proactor, pc->psocket.sockfd);
-  stop_polling(&pc->timer.epoll_io, pc->psocket.proactor->epollfd);
-  ptimer_finalize(&pc->timer);
+  pconnection_timer_stop(pc);
   lock(&pc->context.mutex);
   bool can_free = proactor_remove(&pc->context);
   unlock(&pc->context.mutex);
@@ -916,13 +1090,7 @@ static void pconnection_begin_close(pconnection_t *pc) {
     }
 
     pn_connection_driver_close(&pc->driver);
-    if (ptimer_shutdown(&pc->timer, pc->timer_armed))
-      pc->timer_armed = false;  // disarmed in the sense that the timer will never fire again
-    else if (!pc->timer_armed) {
-      // In doubt.  One last callback to collect
-      rearm(pc->psocket.proactor, &pc->timer.epoll_io);
-      pc->timer_armed = true;
-    }
+    pconnection_timer_stop(pc);
   }
 }
 
@@ -934,7 +1102,7 @@ static void pconnection_forced_shutdown(pconnection_t *pc) {
   pc->new_events_2 = 0;
   pconnection_begin_close(pc);
   // pconnection_process will never be called again.  Zero everything.
-  pc->timer_armed = false;
+  pc->timer_armed = false;    // Queued timer events are discarded with the proactor
   pc->context.wake_ops = 0;
   pn_connection_t *c = pc->driver.connection;
   pn_collector_release(pn_connection_collector(c));
@@ -967,6 +1135,12 @@ static inline bool pconnection_wclosed(pconnection_t  *pc) {
   return pn_connection_driver_write_closed(&pc->driver);
 }
 
+/* Check for output without copying it out of the transport */
+static inline bool pconnection_has_output(pconnection_t *pc) {
+  pn_bytes_t segment;
+  return pn_connection_driver_write_segments(&pc->driver, &segment, 1) > 0;
+}
+
 /* Call only from working context (no competitor for pc->current_arm or
    connection driver).  If true returned, caller must do
    pconnection_rearm().
@@ -983,13 +1157,8 @@ static bool pconnection_rearm_check(pconnection_t *pc) {
   }
   uint32_t wanted_now = (pc->read_blocked && !pconnection_rclosed(pc)) ? EPOLLIN : 0;
   if (!pconnection_wclosed(pc)) {
-    if (pc->write_blocked)
+    if (pc->write_blocked || pconnection_has_output(pc))
       wanted_now |= EPOLLOUT;
-    else {
-      pn_bytes_t wbuf = pn_connection_driver_write_buffer(&pc->driver);
-      if (wbuf.size > 0)
-        wanted_now |= EPOLLOUT;
-    }
   }
   if (!wanted_now) return false;
 
@@ -1026,12 +1195,12 @@ static inline bool pconnection_work_pending(pconnection_t *pc) {
     return true;
   if (!pc->read_blocked && !pconnection_rclosed(pc))
     return true;
-  pn_bytes_t wbuf = pn_connection_driver_write_buffer(&pc->driver);
-  return (wbuf.size > 0 && !pc->write_blocked);
+  return (!pc->write_blocked && pconnection_has_output(pc));
 }
 
 static void pconnection_done(pconnection_t *pc) {
   bool notify = false;
+  pconnection_disp_tick(pc);
   lock(&pc->context.mutex);
   pc->context.working = false;  // So we can wake() ourself if necessary.  We remain the de facto
                                 // working context while the lock is held.
@@ -1053,25 +1222,51 @@ static void pconnection_done(pconnection_t *pc) {
   return;
 }
 
-// Return true unless error
-static bool pconnection_write(pconnection_t *pc, pn_bytes_t wbuf) {
-  ssize_t n = send(pc->psocket.sockfd, wbuf.start, wbuf.size, MSG_NOSIGNAL);
-  if (n > 0) {
-    pn_connection_driver_write_done(&pc->driver, n);
-    if ((size_t) n < wbuf.size) pc->write_blocked = true;
-  } else if (errno == EWOULDBLOCK) {
-    pc->write_blocked = true;
-  } else if (!(errno == EAGAIN || errno == EINTR)) {
-    return false;
+#define PCONNECTION_WRITE_SEGMENTS 64
+
+// Write the output segments with gathering sends till they are all written
+// or the socket is full.  Return true unless error
+static bool pconnection_write(pconnection_t *pc, pn_bytes_t *segments, size_t count) {
+  struct iovec iov[PCONNECTION_WRITE_SEGMENTS];
+  while (count > 0) {
+    size_t size = 0;
+    for (size_t i = 0; i < count; ++i) {
+      iov[i].iov_base = (void *) segments[i].start;
+      iov[i].iov_len = segments[i].size;
+      size += segments[i].size;
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    ssize_t n = sendmsg(pc->psocket.sockfd, &msg, MSG_NOSIGNAL);
+    if (n > 0) {
+      pn_connection_driver_write_done(&pc->driver, n);
+      if ((size_t) n < size) {
+        pc->write_blocked = true;
+        break;
+      }
+    } else if (errno == EWOULDBLOCK) {
+      pc->write_blocked = true;
+      break;
+    } else if (!(errno == EAGAIN || errno == EINTR)) {
+      return false;
+    } else {
+      break;
+    }
+    // All written, there may be more than fitted in the segments
+    count = (count < PCONNECTION_WRITE_SEGMENTS) ? 0 :
+      pn_connection_driver_write_segments(&pc->driver, segments, PCONNECTION_WRITE_SEGMENTS);
   }
   return true;
 }
 
 static void write_flush(pconnection_t *pc) {
   if (!pc->write_blocked && !pconnection_wclosed(pc)) {
-    pn_bytes_t wbuf = pn_connection_driver_write_buffer(&pc->driver);
-    if (wbuf.size > 0) {
-      if (!pconnection_write(pc, wbuf)) {
+    pn_bytes_t segments[PCONNECTION_WRITE_SEGMENTS];
+    size_t count = pn_connection_driver_write_segments(&pc->driver, segments, PCONNECTION_WRITE_SEGMENTS);
+    if (count > 0) {
+      if (!pconnection_write(pc, segments, count)) {
         psocket_error(&pc->psocket, errno, pc->disconnected ? "disconnected" : "on write to");
       }
     }
@@ -1098,17 +1293,12 @@ static void pconnection_maybe_connect_lh(pconnection_t *pc);
  */
 static pn_event_batch_t *pconnection_process(pconnection_t *pc, uint32_t events, bool timeout, bool topup, bool is_io_2) {
   bool inbound_wake = !(events | timeout | topup);
-  bool rearm_timer = false;
-  bool timer_fired = false;
+  bool timer_fired = timeout;
   bool waking = false;
   bool tick_required = false;
 
   // Don't touch data exclusive to working thread (yet).
 
-  if (timeout) {
-    rearm_timer = true;
-    timer_fired = ptimer_callback(&pc->timer) != 0;
-  }
   lock(&pc->context.mutex);
 
   if (events) {
@@ -1127,8 +1317,8 @@ static pn_event_batch_t *pconnection_process(pconnection_t *pc, uint32_t events,
     inbound_wake = false;
   }
 
-  if (rearm_timer)
-    pc->timer_armed = false;
+  if (timeout)
+    pconnection_timer_done(pc);
 
   if (topup) {
     // Only called by the batch owner.  Does not loop, just "tops up"
@@ -1252,6 +1442,7 @@ static pn_event_batch_t *pconnection_process(pconnection_t *pc, uint32_t events,
   }
 
   write_flush(pc);
+  pconnection_disp_tick(pc);
 
   lock(&pc->context.mutex);
   if (pc->context.closing && pconnection_is_final(pc)) {
@@ -1275,10 +1466,6 @@ static pn_event_batch_t *pconnection_process(pconnection_t *pc, uint32_t events,
     }
   }
 
-  if (!pc->timer_armed && !pc->timer.shutting_down && pc->timer.timerfd >= 0) {
-    pc->timer_armed = true;
-    rearm(pc->psocket.proactor, &pc->timer.epoll_io);
-  }
   bool rearm_pc = pconnection_rearm_check(pc);  // holds rearm_mutex until pconnection_rearm() below
 
   unlock(&pc->context.mutex);
@@ -1312,8 +1499,6 @@ void pconnection_connected_lh(pconnection_t *pc) {
 /* multi-address connections may call pconnection_start multiple times with diffferent FDs  */
 static void pconnection_start(pconnection_t *pc) {
   int efd = pc->psocket.proactor->epollfd;
-  /* Start timer, a no-op if the timer has already started. */
-  start_polling(&pc->timer.epoll_io, efd);  // TODO: check for error
 
   /* Get the local socket name now, get the peer name in pconnection_connected */
   socklen_t len = sizeof(pc->local.ss);
@@ -1425,13 +1610,22 @@ void pn_proactor_connect2(pn_proactor_t *p, pn_connection_t *c, pn_transport_t *
 
 static void pconnection_tick(pconnection_t *pc) {
   pn_transport_t *t = pc->driver.transport;
-  if (pn_transport_get_idle_timeout(t) || pn_transport_get_remote_idle_timeout(t)) {
-    ptimer_set(&pc->timer, 0);
+  if (pn_transport_get_idle_timeout(t) || pn_transport_get_remote_idle_timeout(t) ||
+      pn_transport_get_disposition_delay(t)) {
     uint64_t now = pn_i_now2();
     uint64_t next = pn_transport_tick(t, now);
-    if (next) {
-      ptimer_set(&pc->timer, next - now);
-    }
+    pconnection_timer_set(pc, next ? monotonic_millis() + (next > now ? next - now : 0) : 0);
+  }
+}
+
+/* The transport collects dispositions as it produces output and, with a
+   disposition delay, holds them till a tick. Arm the timer for them even
+   if there is no more input, e.g. when the application settles from a
+   WAKE. Called by the working thread. */
+static void pconnection_disp_tick(pconnection_t *pc) {
+  if (pn_transport_get_disposition_delay(pc->driver.transport) && !pconnection_wclosed(pc)) {
+    pconnection_has_output(pc);
+    pconnection_tick(pc);
   }
 }
 
@@ -1536,9 +1730,10 @@ void pn_proactor_listen(pn_proactor_t *p, pn_listener_t *l, const char *addr, in
             (acceptor-1)->addr.next = &acceptor->addr;
           }
 
-          acceptor->accepted_fd = -1;
+          acceptor->accepted_count = 0;
           psocket_t *ps = &acceptor->psocket;
           psocket_init(ps, p, l, addr);
+          (void)fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK); /* accept() until EAGAIN */
           ps->sockfd = fd;
           ps->epoll_io.fd = fd;
           ps->epoll_io.wanted = EPOLLIN;
@@ -1564,7 +1759,7 @@ void pn_proactor_listen(pn_proactor_t *p, pn_listener_t *l, const char *addr, in
     l->acceptors_size = 1;
     memset(l->acceptors, 0, sizeof(acceptor_t));
     psocket_init(&l->acceptors[0].psocket, p, l, addr);
-    l->acceptors[0].accepted_fd = -1;
+    l->acceptors[0].accepted_count = 0;
     if (gai_err) {
       psocket_gai_error(&l->acceptors[0].psocket, gai_err, "listen on");
     } else {
@@ -1636,9 +1831,10 @@ static void listener_begin_close(pn_listener_t* l) {
     if (l->unclaimed) l->pending_count++;
     acceptor_t *a = listener_list_next(&l->pending_acceptors);
     while (a) {
-      close(a->accepted_fd);
-      a->accepted_fd = -1;
-      l->pending_count--;
+      while (a->accepted_count) {
+        close(acceptor_pop_fd(a));
+        l->pending_count--;
+      }
       a = listener_list_next(&l->pending_acceptors);
     }
     assert(!l->pending_count);
@@ -1675,31 +1871,55 @@ static void listener_forced_shutdown(pn_listener_t *l) {
   pn_listener_free(l);
 }
 
-/* Accept a connection as part of listener_process(). Called with listener context lock held. */
-static void listener_accept_lh(psocket_t *ps) {
+/*
+ * Accept connections as part of listener_process(). Called with listener context lock held.
+ * The listening socket is non-blocking: accept up to ACCEPT_BATCH connections, each is
+ * offered to the application with its own PN_LISTENER_ACCEPT.  The acceptor is rearmed
+ * once pn_listener_accept2() has taken them all, so the pending connections are bounded.
+ * Return true if nothing was accepted and the acceptor must be rearmed.
+ */
+static bool listener_accept_lh(psocket_t *ps) {
   pn_listener_t *l = psocket_listener(ps);
   acceptor_t *acceptor = psocket_acceptor(ps);
-  assert(acceptor->accepted_fd < 0); /* Shouldn't already have an accepted_fd */
-  acceptor->accepted_fd = accept(ps->sockfd, NULL, 0);
-  if (acceptor->accepted_fd >= 0) {
-    //    acceptor_t *acceptor = listener_list_next(pending_acceptors);
-    listener_list_append(&l->pending_acceptors, acceptor);
-    l->pending_count++;
-  } else {
-    int err = errno;
-    if (err == ENFILE || err == EMFILE) {
-      listener_set_overflow(acceptor);
+  assert(acceptor->accepted_count == 0); /* Shouldn't already have accepted fds */
+  while (acceptor->accepted_count < ACCEPT_BATCH) {
+    int fd = accept(ps->sockfd, NULL, 0);
+    if (fd >= 0) {
+      acceptor->accepted_fds[acceptor->accepted_count++] = fd;
+      l->pending_count++;
     } else {
-      psocket_error(ps, err, "accept");
+      int err = errno;
+      if (err == EINTR || err == ECONNABORTED) {
+        continue;
+      } else if (err == EAGAIN || err == EWOULDBLOCK) {
+        break;
+      } else if (err == ENFILE || err == EMFILE) {
+        if (!acceptor->accepted_count) {
+          listener_set_overflow(acceptor);
+          return false;
+        }
+        break;                  /* Overflow after the accepted connections are taken */
+      } else {
+        if (acceptor->accepted_count) {
+          listener_list_append(&l->pending_acceptors, acceptor);
+        }
+        psocket_error(ps, err, "accept");
+        return false;
+      }
     }
   }
+  if (acceptor->accepted_count) {
+    listener_list_append(&l->pending_acceptors, acceptor);
+    return false;
+  }
+  return true;
 }
 
 /* Process a listening socket */
 static pn_event_batch_t *listener_process(psocket_t *ps, uint32_t events) {
-  // TODO: some parallelization of the accept mechanism.
   pn_listener_t *l = psocket_listener(ps);
   acceptor_t *a = psocket_acceptor(ps);
+  bool rearming = false;
   lock(&l->context.mutex);
   if (events) {
     a->armed = false;
@@ -1716,7 +1936,12 @@ static pn_event_batch_t *listener_process(psocket_t *ps, uint32_t events) {
         /* Calls listener_begin_close which closes all the listener's sockets */
         psocket_error(ps, errno, "listener epoll");
       } else if (!l->context.closing && events & EPOLLIN) {
-        listener_accept_lh(ps);
+        if (listener_accept_lh(ps)) {
+          /* Nothing to accept after all */
+          lock(&l->rearm_mutex);
+          a->armed = true;
+          rearming = true;
+        }
       }
     }
   } else {
@@ -1737,6 +1962,10 @@ static pn_event_batch_t *listener_process(psocket_t *ps, uint32_t events) {
     }
   }
   unlock(&l->context.mutex);
+  if (rearming) {
+    rearm(ps->proactor, &ps->epoll_io);
+    unlock(&l->rearm_mutex);
+  }
   return lb;
 }
 
@@ -1811,14 +2040,17 @@ void pn_listener_accept2(pn_listener_t *l, pn_connection_t *c, pn_transport_t *t
     err2 = EBADF;
   else if (l->unclaimed) {
     l->unclaimed = false;
-    acceptor_t *a = listener_list_next(&l->pending_acceptors);
+    acceptor_t *a = l->pending_acceptors;
     assert(a);
     assert(!a->armed);
-    fd = a->accepted_fd;
-    a->accepted_fd = -1;
-    lock(&l->rearm_mutex);
-    rearming_ps = &a->psocket;
-    a->armed = true;
+    fd = acceptor_pop_fd(a);
+    if (!a->accepted_count) {
+      /* All taken, accept more */
+      listener_list_next(&l->pending_acceptors);
+      lock(&l->rearm_mutex);
+      rearming_ps = &a->psocket;
+      a->armed = true;
+    }
   }
   else err2 = EWOULDBLOCK;
 
@@ -1858,6 +2090,26 @@ static void epoll_wake_init(epoll_extended_t *ee, int eventfd, int epollfd) {
   start_polling(ee, epollfd);  // TODO: check for error
 }
 
+/* Set up the epoll_extended_t to be used for ready queue kicks */
+static void epoll_ready_init(epoll_extended_t *ee, int readyfd, int epollfd) {
+  ee->psocket = NULL;
+  ee->fd = readyfd;
+  ee->type = READY_KICK;
+  ee->wanted = EPOLLIN;
+  ee->polling = false;
+  start_polling(ee, epollfd);  // TODO: check for error
+}
+
+/* Set up the epoll_extended_t to be used for the shared connection timer */
+static void epoll_timers_init(epoll_extended_t *ee, int timersfd, int epollfd) {
+  ee->psocket = NULL;
+  ee->fd = timersfd;
+  ee->type = PCONNECTION_TIMERS;
+  ee->wanted = EPOLLIN;
+  ee->polling = false;
+  start_polling(ee, epollfd);  // TODO: check for error
+}
+
 /* Set up the epoll_extended_t to be used for secondary socket events */
 static void epoll_secondary_init(epoll_extended_t *ee, int epoll_fd_2, int epollfd) {
   ee->psocket = NULL;
@@ -1871,24 +2123,30 @@ static void epoll_secondary_init(epoll_extended_t *ee, int epoll_fd_2, int epoll
 pn_proactor_t *pn_proactor() {
   pn_proactor_t *p = (pn_proactor_t*)calloc(1, sizeof(*p));
   if (!p) return NULL;
-  p->epollfd = p->eventfd = p->timer.timerfd = -1;
+  p->epollfd = p->eventfd = p->timer.timerfd = p->readyfd = -1;
   pcontext_init(&p->context, PROACTOR, p, p);
-  pmutex_init(&p->eventfd_mutex);
-  ptimer_init(&p->timer, 0);
+  pmutex_init(&p->ready_mutex);
+  pmutex_init(&p->timers_mutex);
+  ptimer_init(&p->timer);
+  p->timersfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
 
   if ((p->epollfd = epoll_create(1)) >= 0 && (p->epollfd_2 = epoll_create(1)) >= 0) {
     if ((p->eventfd = eventfd(0, EFD_NONBLOCK)) >= 0) {
       if ((p->interruptfd = eventfd(0, EFD_NONBLOCK)) >= 0) {
-        if (p->timer.timerfd >= 0)
-          if ((p->collector = pn_collector()) != NULL) {
-            p->batch.next_event = &proactor_batch_next;
-            start_polling(&p->timer.epoll_io, p->epollfd);  // TODO: check for error
-            p->timer_armed = true;
-            epoll_wake_init(&p->epoll_wake, p->eventfd, p->epollfd);
-            epoll_wake_init(&p->epoll_interrupt, p->interruptfd, p->epollfd);
-            epoll_secondary_init(&p->epoll_secondary, p->epollfd_2, p->epollfd);
-            return p;
-          }
+        if ((p->readyfd = eventfd(0, EFD_NONBLOCK)) >= 0) {
+          if (p->timer.timerfd >= 0 && p->timersfd >= 0)
+            if ((p->collector = pn_collector()) != NULL) {
+              p->batch.next_event = &proactor_batch_next;
+              start_polling(&p->timer.epoll_io, p->epollfd);  // TODO: check for error
+              p->timer_armed = true;
+              epoll_wake_init(&p->epoll_wake, p->eventfd, p->epollfd);
+              epoll_wake_init(&p->epoll_interrupt, p->interruptfd, p->epollfd);
+              epoll_ready_init(&p->epoll_ready, p->readyfd, p->epollfd);
+              epoll_timers_init(&p->epoll_timers, p->timersfd, p->epollfd);
+              epoll_secondary_init(&p->epoll_secondary, p->epollfd_2, p->epollfd);
+              return p;
+            }
+        }
       }
     }
   }
@@ -1896,8 +2154,12 @@ pn_proactor_t *pn_proactor() {
   if (p->epollfd_2 >= 0) close(p->epollfd_2);
   if (p->eventfd >= 0) close(p->eventfd);
   if (p->interruptfd >= 0) close(p->interruptfd);
+  if (p->readyfd >= 0) close(p->readyfd);
+  if (p->timersfd >= 0) close(p->timersfd);
   ptimer_finalize(&p->timer);
   if (p->collector) pn_free(p->collector);
+  pmutex_finalize(&p->ready_mutex);
+  pmutex_finalize(&p->timers_mutex);
   free (p);
   return NULL;
 }
@@ -1913,6 +2175,10 @@ void pn_proactor_free(pn_proactor_t *p) {
   p->eventfd = -1;
   close(p->interruptfd);
   p->interruptfd = -1;
+  close(p->readyfd);
+  p->readyfd = -1;
+  close(p->timersfd);
+  p->timersfd = -1;
   ptimer_finalize(&p->timer);
   while (p->contexts) {
     pcontext_t *ctx = p->contexts;
@@ -1930,7 +2196,10 @@ void pn_proactor_free(pn_proactor_t *p) {
   }
 
   pn_collector_free(p->collector);
-  pmutex_finalize(&p->eventfd_mutex);
+  pmutex_finalize(&p->ready_mutex);
+  free(p->ready_events);
+  pmutex_finalize(&p->timers_mutex);
+  free(p->timers_heap);
   pcontext_finalize(&p->context);
   free(p);
 }
@@ -2100,36 +2369,171 @@ static pn_event_batch_t *process_inbound_wake(pn_proactor_t *p, epoll_extended_t
   return NULL;
 }
 
+/*
+ * **** ready queue ****
+ *
+ * A thread that is the only one blocked in epoll_wait() harvests up to
+ * PROACTOR_EPOLL_BATCH events with a single call, processes the first and
+ * leaves the rest on the proactor's ready queue.  Every thread takes work
+ * from the ready queue before calling epoll_wait() again, so a burst of
+ * activity costs one epoll_wait() per batch rather than one per event.
+ *
+ * While several threads are blocked in epoll_wait() the kernel already
+ * spreads the events among them, so they ask for one event at a time.
+ *
+ * All polled descriptors use EPOLLONESHOT, so a queued event stays pending
+ * exactly as if epoll_wait() had not returned it yet: nothing is rearmed
+ * until it is processed.  If threads are blocked in epoll_wait() while
+ * there are queued events, readyfd is written to "kick" one of them.
+ * A kicked thread passes the kick on if events remain, so a single write
+ * is outstanding at any time.
+ */
+#define PROACTOR_EPOLL_BATCH 16
+
+// call with ready_mutex held
+static bool ready_pop_lh(pn_proactor_t *p, struct epoll_event *ev) {
+  if (!p->ready_count) return false;
+  *ev = p->ready_events[p->ready_first];
+  p->ready_first = (p->ready_first + 1) % p->ready_capacity;
+  p->ready_count--;
+  return true;
+}
+
+// call with ready_mutex held
+static void ready_push_lh(pn_proactor_t *p, struct epoll_event *evs, size_t n) {
+  if (p->ready_count + n > p->ready_capacity) {
+    size_t capacity = p->ready_capacity ? p->ready_capacity : PROACTOR_EPOLL_BATCH;
+    while (capacity < p->ready_count + n) capacity *= 2;
+    struct epoll_event *events = (struct epoll_event *) malloc(capacity * sizeof(struct epoll_event));
+    if (!events) EPOLL_FATAL("ready queue allocation", ENOMEM);
+    for (size_t i = 0; i < p->ready_count; i++)
+      events[i] = p->ready_events[(p->ready_first + i) % p->ready_capacity];
+    free(p->ready_events);
+    p->ready_events = events;
+    p->ready_capacity = capacity;
+    p->ready_first = 0;
+  }
+  for (size_t i = 0; i < n; i++)
+    p->ready_events[(p->ready_first + p->ready_count + i) % p->ready_capacity] = evs[i];
+  p->ready_count += n;
+}
+
+// call with ready_mutex held, return true if caller must kick a blocked thread
+static bool ready_kick_lh(pn_proactor_t *p) {
+  if (p->ready_count && p->epoll_waiters && !p->ready_kicked) {
+    p->ready_kicked = true;
+    return true;
+  }
+  return false;
+}
+
+static void ready_kick(pn_proactor_t *p) {
+  uint64_t increment = 1;
+  if (write(p->readyfd, &increment, sizeof(uint64_t)) != sizeof(uint64_t))
+    EPOLL_FATAL("setting eventfd", errno);
+}
+
+// Take the kick, return true with an event from the ready queue if there is one.
+static bool ready_kicked(pn_proactor_t *p, struct epoll_event *ev) {
+  (void)read_uint64(p->readyfd);
+  lock(&p->ready_mutex);
+  p->ready_kicked = false;
+  bool found = ready_pop_lh(p, ev);
+  bool kick = ready_kick_lh(p);
+  unlock(&p->ready_mutex);
+  if (kick) ready_kick(p);
+  rearm(p, &p->epoll_ready);
+  return found;
+}
+
+// Queue timer events for expired connections, the timersfd has fired
+static void proactor_timers_fire(pn_proactor_t *p) {
+  (void)read_uint64(p->timersfd);
+  uint64_t now = monotonic_millis();
+  lock(&p->timers_mutex);
+  p->timers_deadline = 0;
+  lock(&p->ready_mutex);
+  while (p->timers_count && p->timers_heap[0]->timer_key <= now) {
+    pconnection_t *pc = p->timers_heap[0];
+    if (pc->timer_expire && pc->timer_expire > now) {
+      // Moved later since it was placed in the heap
+      pc->timer_key = pc->timer_expire;
+      timers_down_lh(p, 0);
+      continue;
+    }
+    timers_remove_lh(p, pc);
+    if (pc->timer_expire) {
+      pc->timer_expire = 0;
+      pc->timer_armed = true;
+      struct epoll_event ev = {0};
+      ev.data.ptr = &pc->timer_event;
+      ready_push_lh(p, &ev, 1);
+    }
+  }
+  bool kick = ready_kick_lh(p);
+  unlock(&p->ready_mutex);
+  timers_update_lh(p);
+  unlock(&p->timers_mutex);
+  if (kick) ready_kick(p);
+  rearm(p, &p->epoll_timers);
+}
+
 static pn_event_batch_t *proactor_do_epoll(struct pn_proactor_t* p, bool can_block) {
   int timeout = can_block ? -1 : 0;
   while(true) {
     pn_event_batch_t *batch = NULL;
     struct epoll_event ev = {0};
-    int n = epoll_wait(p->epollfd, &ev, 1, timeout);
 
-    if (n < 0) {
-      if (errno != EINTR)
-        perror("epoll_wait"); // TODO: proper log
-      if (!can_block)
-        return NULL;
-      else
-        continue;
-    } else if (n == 0) {
-      if (!can_block)
-        return NULL;
-      else {
-        perror("epoll_wait unexpected timeout"); // TODO: proper log
-        continue;
+    lock(&p->ready_mutex);
+    bool found = ready_pop_lh(p, &ev);
+    int maxevents = (p->epoll_waiters == 0) ? PROACTOR_EPOLL_BATCH : 1;
+    if (!found && can_block) p->epoll_waiters++;
+    unlock(&p->ready_mutex);
+
+    if (!found) {
+      struct epoll_event evs[PROACTOR_EPOLL_BATCH];
+      int n = epoll_wait(p->epollfd, evs, maxevents, timeout);
+
+      lock(&p->ready_mutex);
+      if (can_block) p->epoll_waiters--;
+      if (n > 1) ready_push_lh(p, evs + 1, n - 1);
+      bool kick = ready_kick_lh(p);
+      unlock(&p->ready_mutex);
+      if (kick) ready_kick(p);
+
+      if (n < 0) {
+        if (errno != EINTR)
+          perror("epoll_wait"); // TODO: proper log
+        if (!can_block)
+          return NULL;
+        else
+          continue;
+      } else if (n == 0) {
+        if (!can_block)
+          return NULL;
+        else {
+          perror("epoll_wait unexpected timeout"); // TODO: proper log
+          continue;
+        }
       }
+      ev = evs[0];
     }
-    assert(n == 1);
     epoll_extended_t *ee = (epoll_extended_t *) ev.data.ptr;
     memory_barrier(ee);
 
+    if (ee->type == READY_KICK) {
+      if (!ready_kicked(p, &ev))
+        continue;
+      ee = (epoll_extended_t *) ev.data.ptr;
+      memory_barrier(ee);
+    }
+
     if (ee->type == WAKE) {
       batch = process_inbound_wake(p, ee);
     } else if (ee->type == PROACTOR_TIMER) {
       batch = proactor_process(p, PN_PROACTOR_TIMEOUT);
+    } else if (ee->type == PCONNECTION_TIMERS) {
+      proactor_timers_fire(p);  // expired connections are now on the ready queue
     } else if (ee->type == CHAINED_EPOLL) {
       batch = proactor_chained_epoll_wait(p);  // expect a PCONNECTION_IO_2
     } else {
@@ -0,0 +1,1779 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/* Enable POSIX features beyond c99 for modern pthread and standard strerror_r() */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+/* syscall() and MAP_ANONYMOUS, there are no libc wrappers for the io_uring calls */
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+/* Avoid GNU extensions, in particular the incompatible alternative strerror_r() */
+#undef _GNU_SOURCE
+
+#include "../core/log_private.h"
+#include "./proactor-internal.h"
+
+#include <proton/condition.h>
+#include <proton/connection_driver.h>
+#include <proton/engine.h>
+#include <proton/listener.h>
+#include <proton/proactor.h>
+#include <proton/transport.h>
+
+/* All asserts are cheap and should remain in a release build for debuggability */
+#undef NDEBUG
+#include <assert.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./netaddr-internal.h" /* Include after socket/inet headers */
+
+/*
+  An io_uring proactor: sockets are driven by requests submitted to an io_uring
+  rather than by readiness notifications, so one io_uring_enter() call both
+  submits all the reads, writes and timers queued while processing and waits
+  for the completions of earlier requests.
+
+  The rings are not thread safe, so like the libuv proactor this uses a
+  "leader-worker-follower" model:
+
+  - At most one thread at a time is the "leader". Only the leader submits requests
+  and reaps completions. It processes connections and listeners that need attention
+  till there are events to process and then becomes a "worker"
+
+  - Concurrent "worker" threads process events for separate connections or listeners.
+  When they run out of work they become "followers"
+
+  - A "follower" is idle, waiting for work. When the leader becomes a worker, one follower
+  takes over as the new leader.
+
+  Any thread that calls pn_proactor_wait() or pn_proactor_get() can take on any of the
+  roles as required at run-time. Work is passed between threads on thread-safe queues,
+  an eventfd read request wakes the leader from io_uring_enter() when other threads
+  queue work for it.
+
+  Reads: each connection has a multishot recv request that takes buffers from a ring
+  of buffers provided to the kernel and stays armed while a worker owns the connection.
+  Received buffers queue on the connection until the leader copies them into the
+  transport, and go back to the kernel as soon as they have been read. The kernel only
+  hands out buffers for data that has arrived, so idle connections hold none.
+
+  Writes: a send request is made directly from the connection driver's write buffer.
+  A connection is not given to a worker while a send is outstanding.
+
+  Timers: transport ticks and the proactor timeout are absolute CLOCK_MONOTONIC timeout
+  requests. An armed timer is only updated if the new deadline is earlier, a timer that
+  fires early is simply armed again.
+
+  Function naming:
+  - on_*() - completion handlers, called in the leader thread
+  - leader_* - only called in the leader thread
+  - *_lh - called with the relevant lock held
+*/
+
+typedef char strerrorbuf[1024];      /* used for pstrerror message buffer */
+
+/* Like strerror_r but provide a default message if strerror_r fails */
+static void pstrerror(int err, strerrorbuf msg) {
+  int e = strerror_r(err, msg, sizeof(strerrorbuf));
+  if (e) snprintf(msg, sizeof(strerrorbuf), "unknown error %d", err);
+}
+
+/* Internal error, no recovery */
+#define URING_FATAL(EXPR, SYSERRNO)                                     \
+  do {                                                                  \
+    strerrorbuf msg;                                                    \
+    pstrerror((SYSERRNO), msg);                                         \
+    fprintf(stderr, "io_uring proactor failure in %s:%d: %s: %s\n",     \
+            __FILE__, __LINE__ , #EXPR, msg);                           \
+    abort();                                                            \
+  } while (0)
+
+#define URING_ENTRIES 256       /* Submission queue size, completion queue is twice this */
+#define URING_BUF_COUNT 256     /* Provided receive buffers, must be a power of 2 */
+#define URING_BUF_SIZE 16384
+#define URING_BUF_GROUP 0
+#define ACCEPT_BATCH 16         /* Accepted sockets held for pn_listener_accept2() */
+
+/* pn_proactor_t and pn_listener_t are plain C structs with normal memory management.
+   CLASSDEF is for identification when used as a pn_event_t context.
+*/
+PN_STRUCT_CLASSDEF(pn_proactor, CID_pn_proactor)
+PN_STRUCT_CLASSDEF(pn_listener, CID_pn_listener)
+
+static uint64_t now_millis(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec*1000 + t.tv_nsec/1000000;
+}
+
+/* ================ Queues ================ */
+static int unqueued;            /* Provide invalid address for _unqueued pointers */
+
+#define QUEUE_DECL(T)                                                   \
+  typedef struct T##_queue_t { T##_t *front, *back; } T##_queue_t;      \
+                                                                        \
+  static T##_t *T##_unqueued = (T##_t*)&unqueued;                       \
+                                                                        \
+  static void T##_push(T##_queue_t *q, T##_t *x) {                      \
+    assert(x->next == T##_unqueued);                                    \
+    x->next = NULL;                                                     \
+    if (!q->front) {                                                    \
+      q->front = q->back = x;                                           \
+    } else {                                                            \
+      q->back->next = x;                                                \
+      q->back =  x;                                                     \
+    }                                                                   \
+  }                                                                     \
+                                                                        \
+  static T##_t* T##_pop(T##_queue_t *q) {                               \
+    T##_t *x = q->front;                                                \
+    if (x) {                                                            \
+      q->front = x->next;                                               \
+      x->next = T##_unqueued;                                           \
+    }                                                                   \
+    return x;                                                           \
+  }                                                                     \
+                                                                        \
+  static void T##_remove(T##_queue_t *q, T##_t *x) {                    \
+    T##_t *prev = NULL;                                                 \
+    for (T##_t *i = q->front; i; prev = i, i = i->next) {               \
+      if (i == x) {                                                     \
+        if (prev) prev->next = x->next; else q->front = x->next;        \
+        if (q->back == x) q->back = prev;                               \
+        x->next = T##_unqueued;                                         \
+        return;                                                         \
+      }                                                                 \
+    }                                                                   \
+  }
+
+/* All work structs start with a struct_type member  */
+typedef enum { T_CONNECTION, T_LISTENER } struct_type;
+
+/* A stream of serialized work for the proactor */
+typedef struct work_t {
+  /* Immutable */
+  struct_type type;
+  pn_proactor_t *proactor;
+
+  /* Protected by proactor.lock */
+  struct work_t* next;
+  struct work_t *all_prev, *all_next; /* All connections and listeners of the proactor */
+  bool working;                      /* Owned by a worker thread */
+} work_t;
+
+QUEUE_DECL(work)
+
+static void work_init(work_t* w, pn_proactor_t* p, struct_type type) {
+  w->proactor = p;
+  w->next = work_unqueued;
+  w->type = type;
+  w->working = true;
+}
+
+/* ================ io_uring ================ */
+
+typedef enum { OP_NOTIFY, OP_TIMEOUT, OP_CONNECT, OP_RECV, OP_SEND, OP_TICK, OP_ACCEPT } op_type;
+
+/* A request, used as the user_data so a completion can find its owner.
+   Requests that need no completion handling (cancel and timer updates) have no op.
+*/
+typedef struct op_t {
+  op_type type;
+  bool pending;                 /* Submitted and can still complete */
+} op_t;
+
+/* An absolute CLOCK_MONOTONIC timer */
+typedef struct utimer_t {
+  op_t op;
+  uint64_t armed;               /* Deadline of the pending request */
+  struct __kernel_timespec ts;
+} utimer_t;
+
+/* A provided receive buffer that has been filled by the kernel */
+typedef struct rbuf_t {
+  uint32_t size;
+  uint32_t offset;              /* Bytes already read by the transport */
+  int next;                     /* Next buffer received on the connection or -1 */
+} rbuf_t;
+
+typedef struct uring_t {
+  int fd;
+  void *ring;
+  size_t ring_size;
+
+  /* Submission queue */
+  unsigned *sq_head, *sq_tail, *sq_flags;
+  unsigned sq_mask, sq_entries;
+  unsigned sqe_tail;            /* Local tail, includes requests not yet submitted */
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+
+  /* Completion queue */
+  unsigned *cq_head, *cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe *cqes;
+
+  /* Provided receive buffers */
+  struct io_uring_buf_ring *br;
+  uint16_t br_tail;
+  char *bufs;
+  rbuf_t rbufs[URING_BUF_COUNT];
+
+  size_t requests;              /* Requests that can still complete */
+} uring_t;
+
+static int uring_enter(uring_t *r, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  int n = (int)syscall(__NR_io_uring_enter, r->fd, to_submit, min_complete, flags, NULL, 0);
+  return n < 0 ? -errno : n;
+}
+
+static inline unsigned uring_unsubmitted(uring_t *r) {
+  return r->sqe_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+}
+
+static inline bool uring_has_completions(uring_t *r) {
+  return *r->cq_head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+}
+
+/* Queue a new request, it is submitted with the next uring_enter() */
+static struct io_uring_sqe *uring_sqe(uring_t *r, op_t *op, uint8_t opcode, int fd) {
+  while (uring_unsubmitted(r) >= r->sq_entries) { /* Full, submit without waiting */
+    int n = uring_enter(r, uring_unsubmitted(r), 0, 0);
+    if (n < 0 && n != -EINTR && n != -EAGAIN && n != -EBUSY) URING_FATAL("io_uring_enter", -n);
+  }
+  struct io_uring_sqe *sqe = &r->sqes[r->sqe_tail & r->sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->user_data = (uintptr_t)op;
+  if (op) {
+    assert(!op->pending);
+    op->pending = true;
+    ++r->requests;
+  }
+  __atomic_store_n(r->sq_tail, ++r->sqe_tail, __ATOMIC_RELEASE);
+  return sqe;
+}
+
+static void uring_cancel(uring_t *r, op_t *op) {
+  if (op->pending) {
+    struct io_uring_sqe *sqe = uring_sqe(r, NULL, IORING_OP_ASYNC_CANCEL, -1);
+    sqe->addr = (uintptr_t)op;
+  }
+}
+
+static void timer_ts(utimer_t *t, uint64_t deadline) {
+  t->armed = deadline;
+  t->ts.tv_sec = deadline / 1000;
+  t->ts.tv_nsec = (deadline % 1000) * 1000000;
+}
+
+/* Arm a timer for deadline, a pending request is only updated if it would fire too late */
+static void timer_arm(uring_t *r, utimer_t *t, uint64_t deadline) {
+  if (!t->op.pending) {
+    timer_ts(t, deadline);
+    struct io_uring_sqe *sqe = uring_sqe(r, &t->op, IORING_OP_TIMEOUT, -1);
+    sqe->addr = (uintptr_t)&t->ts;
+    sqe->len = 1;
+    sqe->timeout_flags = IORING_TIMEOUT_ABS;
+  } else if (deadline < t->armed) {
+    /* If the timer has already fired the update fails, and the owner re-arms it */
+    timer_ts(t, deadline);
+    struct io_uring_sqe *sqe = uring_sqe(r, NULL, IORING_OP_TIMEOUT_REMOVE, -1);
+    sqe->addr = (uintptr_t)&t->op;
+    sqe->off = (uintptr_t)&t->ts;
+    sqe->timeout_flags = IORING_TIMEOUT_UPDATE | IORING_TIMEOUT_ABS;
+  }
+}
+
+static inline char *uring_buf(uring_t *r, int bid) {
+  return r->bufs + (size_t)bid * URING_BUF_SIZE;
+}
+
+/* Give a receive buffer back to the kernel */
+static void uring_buf_return(uring_t *r, int bid) {
+  struct io_uring_buf *b = &r->br->bufs[r->br_tail & (URING_BUF_COUNT - 1)];
+  b->addr = (uintptr_t)uring_buf(r, bid);
+  b->len = URING_BUF_SIZE;
+  b->bid = bid;
+  __atomic_store_n(&r->br->tail, ++r->br_tail, __ATOMIC_RELEASE);
+}
+
+static void uring_free(uring_t *r) {
+  if (r->sqes) munmap(r->sqes, r->sqes_size);
+  if (r->ring) munmap(r->ring, r->ring_size);
+  if (r->fd >= 0) close(r->fd);
+  if (r->br) munmap(r->br, URING_BUF_COUNT * sizeof(struct io_uring_buf));
+  free(r->bufs);
+}
+
+/* Return 0 or an errno value */
+static int uring_init(uring_t *r) {
+  memset(r, 0, sizeof(*r));
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CLAMP;
+  r->fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+  if (r->fd < 0) return errno;
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+    return ENOSYS;              /* Kernel is too old */
+  }
+  size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  r->ring_size = sq_size > cq_size ? sq_size : cq_size;
+  r->ring = mmap(NULL, r->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, IORING_OFF_SQ_RING);
+  if (r->ring == MAP_FAILED) {
+    r->ring = NULL;
+    return errno;
+  }
+  r->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqes = (struct io_uring_sqe*)mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, IORING_OFF_SQES);
+  if (r->sqes == MAP_FAILED) {
+    r->sqes = NULL;
+    return errno;
+  }
+  char *ring = (char*)r->ring;
+  r->sq_head = (unsigned*)(ring + params.sq_off.head);
+  r->sq_tail = (unsigned*)(ring + params.sq_off.tail);
+  r->sq_flags = (unsigned*)(ring + params.sq_off.flags);
+  r->sq_mask = *(unsigned*)(ring + params.sq_off.ring_mask);
+  r->sq_entries = params.sq_entries;
+  r->sqe_tail = *r->sq_tail;
+  unsigned *array = (unsigned*)(ring + params.sq_off.array);
+  for (unsigned i = 0; i < r->sq_entries; ++i) {
+    array[i] = i;               /* Entries are always used in ring order */
+  }
+  r->cq_head = (unsigned*)(ring + params.cq_off.head);
+  r->cq_tail = (unsigned*)(ring + params.cq_off.tail);
+  r->cq_mask = *(unsigned*)(ring + params.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe*)(ring + params.cq_off.cqes);
+
+  /* Register the provided receive buffers */
+  r->br = (struct io_uring_buf_ring*)mmap(NULL, URING_BUF_COUNT * sizeof(struct io_uring_buf),
+                                          PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (r->br == MAP_FAILED) {
+    r->br = NULL;
+    return errno;
+  }
+  r->bufs = (char*)malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+  if (!r->bufs) return ENOMEM;
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uintptr_t)r->br;
+  reg.ring_entries = URING_BUF_COUNT;
+  reg.bgid = URING_BUF_GROUP;
+  if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return errno;
+  for (int bid = 0; bid < URING_BUF_COUNT; ++bid) {
+    uring_buf_return(r, bid);
+  }
+  return 0;
+}
+
+/* ================ Connections and listeners ================ */
+
+/* A single listening socket, a listener can have more than one */
+typedef struct lsocket_t {
+  pn_listener_t *parent;
+  struct lsocket_t *next;
+
+  /* Only used by leader */
+  int fd;
+  op_t accept;
+  bool overflow;                /* Out of file descriptors, waiting for a close */
+  struct lsocket_t *overflow_next;
+
+  /* Locked by the listener lock */
+  int accepted[ACCEPT_BATCH];   /* Sockets for PN_LISTENER_ACCEPT events */
+  size_t accepted_first, accepted_count;
+} lsocket_t;
+
+PN_STRUCT_CLASSDEF(lsocket, CID_pn_listener_socket)
+
+typedef enum { W_NONE, W_PENDING, W_CLOSED } wake_state;
+
+typedef enum { C_START, C_CONNECTING, C_DONE } connect_state;
+
+/* An incoming or outgoing connection. */
+typedef struct pconnection_t {
+  work_t work;                  /* Must be first to allow casting */
+
+  /* Only used by owner thread */
+  pn_connection_driver_t driver;
+
+  /* Only used by leader */
+  int fd;
+  char addr_buf[PN_MAX_ADDR];
+  const char *host, *port;
+  struct addrinfo *addrinfo;    /* Resolved addresses for connect */
+  struct addrinfo *ai;          /* Address being connected to */
+  int connect_err;              /* First error connecting, in case all addresses fail */
+  connect_state connect;
+
+  op_t connect_op;
+  op_t recv;
+  op_t send;
+  utimer_t tick;
+
+  int recv_first, recv_last;    /* Received buffers not yet read by the transport, -1 if none */
+  int recv_end;                 /* Recv ended: 1 at end of stream, -errno on error, else 0 */
+  bool starved;                 /* Recv stopped for lack of buffers */
+  struct pconnection_t *starved_next;
+  bool write_shutdown;
+  bool disconnect;              /* pn_proactor_disconnect() is closing the connection */
+  pn_condition_t *disconnect_cond;
+  bool closing;                 /* Finished, waiting for requests to complete */
+
+  struct pn_netaddr_t local, remote; /* Actual addresses */
+
+  /* Locked for thread-safe access */
+  pthread_mutex_t lock;
+  wake_state wake;
+} pconnection_t;
+
+typedef enum {
+  L_LISTENING,                  /**<< Listening */
+  L_CLOSE,                      /**<< Close requested  */
+  L_CLOSING,                    /**<< Cancelling accepts, wait for them to complete */
+  L_CLOSED                      /**<< User saw PN_LISTENER_CLOSED, all done  */
+} listener_state;
+
+/* A listener */
+struct pn_listener_t {
+  work_t work;                  /* Must be first to allow casting */
+
+  /* Only used by owner thread */
+  pn_event_batch_t batch;
+  pn_record_t *attachments;
+  void *context;
+  size_t backlog;
+
+  /* Only used by leader */
+  char addr_buf[PN_MAX_ADDR];
+  const char *host, *port;
+  lsocket_t *lsockets;
+  bool disconnect;
+  pn_condition_t *disconnect_cond;
+
+  /* Invariant listening addresses allocated during listener_listen_lh() */
+  struct pn_netaddr_t *addrs;
+  int addrs_len;
+
+  /* Locked for thread-safe access. Completions for the lsockets arrive while the
+     listener is owned by a worker.
+   */
+  pthread_mutex_t lock;
+  pn_condition_t *condition;
+  pn_collector_t *collector;
+  listener_state state;
+};
+
+typedef enum { TM_NONE, TM_REQUEST, TM_PENDING, TM_FIRED } timeout_state_t;
+
+struct pn_proactor_t {
+  /* Leader thread  */
+  uring_t uring;
+  op_t notify_op;               /* Read of notifyfd */
+  uint64_t notify_value;
+  utimer_t timer;
+  uint64_t timeout_deadline;
+  pconnection_t *starved;       /* Connections waiting for receive buffers */
+  lsocket_t *overflow;          /* Listening sockets waiting for file descriptors */
+  bool freeing;                 /* In pn_proactor_free(), ignore completions */
+
+  /* Owner thread: proactor collector and batch can belong to leader or a worker */
+  pn_collector_t *collector;
+  pn_event_batch_t batch;
+
+  /* Protected by lock */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  work_queue_t worker_q; /* ready for work, to be returned via pn_proactor_wait()  */
+  work_queue_t leader_q; /* waiting for attention by the leader thread */
+  work_t *all;           /* all connections and listeners */
+  timeout_state_t timeout_state;
+  pn_millis_t timeout;
+  size_t active;         /* connection/listener count for INACTIVE events */
+  pn_condition_t *disconnect_cond; /* disconnect condition */
+  int notifyfd;
+
+  bool has_leader;             /* A thread is working as leader */
+  bool notified;               /* notifyfd written, leader has not seen it yet */
+  bool disconnect;             /* disconnect requested */
+  bool batch_working;          /* batch is being processed in a worker thread */
+  bool need_interrupt;         /* Need a PN_PROACTOR_INTERRUPT event */
+  bool need_inactive;          /* need INACTIVE event */
+
+  /* Set by pn_proactor_interrupt() without a lock, must be async-signal-safe */
+  bool interrupt;
+};
+
+static inline pconnection_t *op_pconnection(op_t *op) {
+  switch (op->type) {
+   case OP_CONNECT: return (pconnection_t*)((char*)op - offsetof(pconnection_t, connect_op));
+   case OP_RECV: return (pconnection_t*)((char*)op - offsetof(pconnection_t, recv));
+   case OP_SEND: return (pconnection_t*)((char*)op - offsetof(pconnection_t, send));
+   case OP_TICK: return (pconnection_t*)((char*)op - offsetof(pconnection_t, tick));
+   default: return NULL;
+  }
+}
+
+static inline lsocket_t *op_lsocket(op_t *op) {
+  return (lsocket_t*)((char*)op - offsetof(lsocket_t, accept));
+}
+
+/* Wake the leader from io_uring_enter() */
+static void notify_lh(pn_proactor_t* p) {
+  if (!p->notified) {
+    p->notified = true;
+    uint64_t increment = 1;
+    if (write(p->notifyfd, &increment, sizeof(uint64_t)) != sizeof(uint64_t))
+      URING_FATAL("writing eventfd", errno);
+  }
+}
+
+static void work_notify_lh(work_t *w) {
+  /* If the socket is in use by a worker or is already queued then leave it where it is.
+     It will be processed in pn_proactor_done() or when the queue it is on is processed.
+  */
+  if (!w->working && w->next == work_unqueued) {
+    work_push(&w->proactor->leader_q, w);
+    notify_lh(w->proactor);
+  }
+}
+
+/* Notify that this work item needs attention from the leader at the next opportunity */
+static void work_notify(work_t *w) {
+  pthread_mutex_lock(&w->proactor->lock);
+  work_notify_lh(w);
+  pthread_mutex_unlock(&w->proactor->lock);
+}
+
+/* Like work_notify() but called by the leader, which will check leader_q before it waits */
+static void leader_notify(work_t *w) {
+  pthread_mutex_lock(&w->proactor->lock);
+  if (!w->working && w->next == work_unqueued) {
+    work_push(&w->proactor->leader_q, w);
+  }
+  pthread_mutex_unlock(&w->proactor->lock);
+}
+
+/* Notify the leader of a newly-created work item, it is active until it is freed */
+static void work_start(work_t *w) {
+  pn_proactor_t *p = w->proactor;
+  pthread_mutex_lock(&p->lock);
+  w->all_prev = NULL;
+  w->all_next = p->all;
+  if (p->all) p->all->all_prev = w;
+  p->all = w;
+  ++p->active;
+  w->working = false;
+  work_push(&p->leader_q, w);
+  notify_lh(p);
+  pthread_mutex_unlock(&p->lock);
+}
+
+static void remove_active_lh(pn_proactor_t *p) {
+  assert(p->active > 0);
+  if (--p->active == 0) {
+    p->need_inactive = true;
+  }
+}
+
+/* Forget a work item that is about to be freed, called by the leader */
+static void work_finish(work_t *w) {
+  pn_proactor_t *p = w->proactor;
+  pthread_mutex_lock(&p->lock);
+  if (w->next != work_unqueued) work_remove(&p->leader_q, w);
+  if (w->all_prev) w->all_prev->all_next = w->all_next; else p->all = w->all_next;
+  if (w->all_next) w->all_next->all_prev = w->all_prev;
+  remove_active_lh(p);
+  pthread_mutex_unlock(&p->lock);
+}
+
+/* Protect read/update of pn_connnection_t pointer to it's pconnection_t
+ *
+ * Global because pn_connection_wake()/pn_connection_proactor() navigate from
+ * the pn_connection_t before we know the proactor or driver. Critical sections
+ * are small: only get/set of the pn_connection_t driver pointer.
+ */
+static pthread_mutex_t driver_ptr_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pconnection_t *get_pconnection(pn_connection_t* c) {
+  if (!c) return NULL;
+  pthread_mutex_lock(&driver_ptr_mutex);
+  pn_connection_driver_t *d = *pn_connection_driver_ptr(c);
+  pthread_mutex_unlock(&driver_ptr_mutex);
+  if (!d) return NULL;
+  return (pconnection_t*)((char*)d-offsetof(pconnection_t, driver));
+}
+
+static void set_pconnection(pn_connection_t* c, pconnection_t *pc) {
+  pthread_mutex_lock(&driver_ptr_mutex);
+  *pn_connection_driver_ptr(c) = pc ? &pc->driver : NULL;
+  pthread_mutex_unlock(&driver_ptr_mutex);
+}
+
+static pconnection_t *pconnection(pn_proactor_t *p, pn_connection_t *c, pn_transport_t *t, bool server) {
+  pconnection_t *pc = (pconnection_t*)calloc(1, sizeof(*pc));
+  if (!pc || pn_connection_driver_init(&pc->driver, c, t) != 0) {
+    free(pc);
+    return NULL;
+  }
+  work_init(&pc->work, p,  T_CONNECTION);
+  pc->fd = -1;
+  pc->connect_op.type = OP_CONNECT;
+  pc->recv.type = OP_RECV;
+  pc->send.type = OP_SEND;
+  pc->tick.op.type = OP_TICK;
+  pc->recv_first = pc->recv_last = -1;
+  pthread_mutex_init(&pc->lock, NULL);
+  if (server) {
+    pn_transport_set_server(pc->driver.transport);
+  }
+  set_pconnection(pc->driver.connection, pc);
+  return pc;
+}
+
+static void pconnection_free(pconnection_t *pc) {
+  pn_connection_t *c = pc->driver.connection;
+  if (c) set_pconnection(c, NULL);
+  pn_connection_driver_destroy(&pc->driver);
+  if (pc->addrinfo) freeaddrinfo(pc->addrinfo);
+  if (pc->disconnect_cond) pn_condition_free(pc->disconnect_cond);
+  if (pc->fd >= 0) close(pc->fd);
+  pthread_mutex_destroy(&pc->lock);
+  free(pc);
+}
+
+static pn_event_t *listener_batch_next(pn_event_batch_t *batch);
+static pn_event_t *proactor_batch_next(pn_event_batch_t *batch);
+
+static inline pn_proactor_t *batch_proactor(pn_event_batch_t *batch) {
+  return (batch->next_event == proactor_batch_next) ?
+    (pn_proactor_t*)((char*)batch - offsetof(pn_proactor_t, batch)) : NULL;
+}
+
+static inline pn_listener_t *batch_listener(pn_event_batch_t *batch) {
+  return (batch->next_event == listener_batch_next) ?
+    (pn_listener_t*)((char*)batch - offsetof(pn_listener_t, batch)) : NULL;
+}
+
+static inline pconnection_t *batch_pconnection(pn_event_batch_t *batch) {
+  pn_connection_driver_t *d = pn_event_batch_connection_driver(batch);
+  return d ? (pconnection_t*)((char*)d - offsetof(pconnection_t, driver)) : NULL;
+}
+
+static inline work_t *batch_work(pn_event_batch_t *batch) {
+  pconnection_t *pc = batch_pconnection(batch);
+  if (pc) return &pc->work;
+  pn_listener_t *l = batch_listener(batch);
+  if (l) return &l->work;
+  return NULL;
+}
+
+static void configure_socket(int sock) {
+  int tcp_nodelay = 1;
+  (void)setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (void*) &tcp_nodelay, sizeof(tcp_nodelay));
+}
+
+static int pgetaddrinfo(const char *host, const char *port, int flags, struct addrinfo **res)
+{
+  struct addrinfo hints = { 0 };
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_V4MAPPED | AI_ADDRCONFIG | flags;
+  return getaddrinfo(host, port, &hints, res);
+}
+
+/* Set the error condition and close the driver. */
+static void pconnection_error_str(pconnection_t *pc, const char *msg, const char* what) {
+  pn_connection_driver_t *driver = &pc->driver;
+  pn_connection_driver_bind(driver); /* Make sure we are bound so errors will be reported */
+  pni_proactor_set_cond(pn_transport_condition(driver->transport), what, pc->host, pc->port, msg);
+  pn_connection_driver_close(driver);
+}
+
+static void pconnection_error(pconnection_t *pc, int err, const char* what) {
+  strerrorbuf msg;
+  pstrerror(err, msg);
+  pconnection_error_str(pc, msg, what);
+}
+
+static void pconnection_addresses(pconnection_t *pc) {
+  socklen_t len = sizeof(pc->local.ss);
+  (void)getsockname(pc->fd, (struct sockaddr*)&pc->local.ss, &len);
+  len = sizeof(pc->remote.ss);
+  (void)getpeername(pc->fd, (struct sockaddr*)&pc->remote.ss, &len);
+}
+
+static void leader_listeners_overflow_done(pn_proactor_t *p);
+
+static void pconnection_close_fd(pconnection_t *pc) {
+  if (pc->fd >= 0) {
+    close(pc->fd);
+    pc->fd = -1;
+    leader_listeners_overflow_done(pc->work.proactor);
+  }
+}
+
+/* Try the connect addresses in turn till a connect request can be made */
+static void leader_try_connect(pconnection_t *pc) {
+  uring_t *r = &pc->work.proactor->uring;
+  for (; pc->ai; pc->ai = pc->ai->ai_next) {
+    pc->fd = socket(pc->ai->ai_family, SOCK_STREAM, pc->ai->ai_protocol);
+    if (pc->fd < 0) {
+      if (!pc->connect_err) pc->connect_err = errno;
+      continue;
+    }
+    configure_socket(pc->fd);
+    struct io_uring_sqe *sqe = uring_sqe(r, &pc->connect_op, IORING_OP_CONNECT, pc->fd);
+    sqe->addr = (uintptr_t)pc->ai->ai_addr;
+    sqe->off = pc->ai->ai_addrlen;
+    pc->connect = C_CONNECTING;
+    return;
+  }
+  pc->connect = C_DONE;
+  pconnection_error(pc, pc->connect_err ? pc->connect_err : EHOSTUNREACH, "connecting to");
+}
+
+static void leader_connect(pconnection_t *pc) {
+  int gai_err = pgetaddrinfo(pc->host, pc->port, 0, &pc->addrinfo);
+  if (gai_err) {
+    pc->connect = C_DONE;
+    pconnection_error_str(pc, gai_strerror(gai_err), "connect to");
+  } else {
+    pc->ai = pc->addrinfo;
+    leader_try_connect(pc);
+  }
+}
+
+static void on_connect(pconnection_t *pc, int res) {
+  if (pc->closing || pc->connect != C_CONNECTING) return;
+  if (res == 0) {
+    pc->connect = C_DONE;
+    pconnection_addresses(pc);
+    freeaddrinfo(pc->addrinfo);
+    pc->addrinfo = pc->ai = NULL;
+  } else if (pc->disconnect) {
+    pc->connect = C_DONE;       /* Stopped by pn_proactor_disconnect() */
+  } else {
+    if (!pc->connect_err) pc->connect_err = -res;
+    pconnection_close_fd(pc);
+    pc->ai = pc->ai->ai_next;
+    leader_try_connect(pc);
+  }
+  if (pc->connect == C_DONE) leader_notify(&pc->work);
+}
+
+/* Add a received buffer to the connection, or return it if it can't be used */
+static void on_recv(pconnection_t *pc, struct io_uring_cqe *cqe) {
+  pn_proactor_t *p = pc->work.proactor;
+  uring_t *r = &p->uring;
+  if (cqe->flags & IORING_CQE_F_BUFFER) {
+    int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    if (cqe->res > 0 && !pc->closing) {
+      rbuf_t *b = &r->rbufs[bid];
+      b->size = cqe->res;
+      b->offset = 0;
+      b->next = -1;
+      if (pc->recv_last >= 0) r->rbufs[pc->recv_last].next = bid; else pc->recv_first = bid;
+      pc->recv_last = bid;
+    } else {
+      uring_buf_return(r, bid);
+    }
+  }
+  if (cqe->res == 0) {
+    pc->recv_end = 1;
+  } else if (cqe->res == -ENOBUFS) {
+    if (!pc->starved && !pc->closing) {
+      pc->starved = true;
+      pc->starved_next = p->starved;
+      p->starved = pc;
+    }
+  } else if (cqe->res < 0 && cqe->res != -ECANCELED) {
+    pc->recv_end = cqe->res;
+  }
+  if (!pc->closing) leader_notify(&pc->work);
+}
+
+static void on_send(pconnection_t *pc, int res) {
+  /* The driver belongs to the leader while a send is outstanding */
+  if (pc->closing) return;
+  if (res < 0) {
+    if (res != -ECANCELED) pconnection_error(pc, -res, "on write to");
+  } else if (!pn_connection_driver_write_closed(&pc->driver)) {
+    pn_connection_driver_write_done(&pc->driver, res);
+  }
+  leader_notify(&pc->work);
+}
+
+/* Give buffers back to the kernel, and restart connections that ran out */
+static void leader_recv_release(pconnection_t *pc) {
+  pn_proactor_t *p = pc->work.proactor;
+  uring_t *r = &p->uring;
+  while (pc->recv_first >= 0) {
+    int bid = pc->recv_first;
+    pc->recv_first = r->rbufs[bid].next;
+    uring_buf_return(r, bid);
+  }
+  pc->recv_last = -1;
+  while (p->starved) {
+    pconnection_t *s = p->starved;
+    p->starved = s->starved_next;
+    s->starved = false;
+    if (s != pc) leader_notify(&s->work);
+  }
+}
+
+/* Copy received data into the transport, and handle the end of the stream once it is all read */
+static void leader_read(pconnection_t *pc) {
+  uring_t *r = &pc->work.proactor->uring;
+  bool released = false;
+  while (pc->recv_first >= 0) {
+    pn_rwbytes_t rbuf = pn_connection_driver_read_buffer(&pc->driver);
+    if (rbuf.size == 0) break;
+    int bid = pc->recv_first;
+    rbuf_t *b = &r->rbufs[bid];
+    size_t n = b->size - b->offset;
+    if (n > rbuf.size) n = rbuf.size;
+    memcpy(rbuf.start, uring_buf(r, bid) + b->offset, n);
+    pn_connection_driver_read_done(&pc->driver, n);
+    b->offset += n;
+    if (b->offset == b->size) {
+      pc->recv_first = b->next;
+      if (pc->recv_first < 0) pc->recv_last = -1;
+      uring_buf_return(r, bid);
+      released = true;
+    }
+  }
+  if (pn_connection_driver_read_closed(&pc->driver)) {
+    leader_recv_release(pc);    /* Discard anything not read */
+  } else if (pc->recv_first < 0 && pc->recv_end) {
+    if (pc->recv_end < 0) {
+      pconnection_error(pc, -pc->recv_end, "on read from");
+    } else {
+      pn_connection_driver_read_close(&pc->driver);
+    }
+  } else if (released) {
+    leader_recv_release(pc);    /* Restart starved connections */
+  }
+}
+
+/* Generate tick events and arm the connection timer for the next tick */
+static void leader_tick(pconnection_t *pc) {
+  uint64_t now = now_millis();
+  uint64_t next = pn_transport_tick(pc->driver.transport, now);
+  if (next) timer_arm(&pc->work.proactor->uring, &pc->tick, next);
+}
+
+/* Check wake state and generate WAKE event if needed */
+static void check_wake(pconnection_t *pc) {
+  pthread_mutex_lock(&pc->lock);
+  if (pc->wake == W_PENDING) {
+    pn_connection_t *c = pc->driver.connection;
+    pn_collector_put(pn_connection_collector(c), PN_OBJECT, c, PN_CONNECTION_WAKE);
+    pc->wake = W_NONE;
+  }
+  pthread_mutex_unlock(&pc->lock);
+}
+
+static inline bool pconnection_is_final(pconnection_t *pc) {
+  return !pc->connect_op.pending && !pc->recv.pending && !pc->send.pending && !pc->tick.op.pending;
+}
+
+/* Free a closing connection once it has no outstanding requests */
+static void leader_check_final(pconnection_t *pc) {
+  if (pc->closing && pconnection_is_final(pc)) {
+    pn_proactor_t *p = pc->work.proactor;
+    if (pc->starved) {
+      pconnection_t **pp = &p->starved;
+      while (*pp != pc) pp = &(*pp)->starved_next;
+      *pp = pc->starved_next;
+    }
+    leader_recv_release(pc);
+    pconnection_close_fd(pc);
+    work_finish(&pc->work);
+    pconnection_free(pc);
+  }
+}
+
+/* The driver is finished, cancel outstanding requests. May free pc. */
+static void leader_close(pconnection_t *pc) {
+  uring_t *r = &pc->work.proactor->uring;
+  pthread_mutex_lock(&pc->lock);
+  pc->wake = W_CLOSED;          /* wake() is a no-op from now on */
+  pthread_mutex_unlock(&pc->lock);
+  pc->closing = true;
+  uring_cancel(r, &pc->connect_op);
+  uring_cancel(r, &pc->recv);
+  uring_cancel(r, &pc->send);
+  uring_cancel(r, &pc->tick.op);
+  leader_check_final(pc);
+}
+
+/* Process a pconnection, return true if it has events for a worker thread */
+static bool leader_process_pconnection(pconnection_t *pc) {
+  uring_t *r = &pc->work.proactor->uring;
+  if (pc->closing) {
+    return false;
+  }
+  if (pc->disconnect) {
+    /* Stop connecting or sending, the driver is closed when the request completes */
+    uring_cancel(r, &pc->connect_op);
+    uring_cancel(r, &pc->send);
+  }
+  if (pc->connect_op.pending || pc->send.pending) {
+    /* We can't do anything while a connect or send request is pending */
+    return false;
+  }
+  if (pc->disconnect) {
+    pc->disconnect = false;
+    pthread_mutex_lock(&pc->lock);
+    pc->wake = W_CLOSED;
+    pthread_mutex_unlock(&pc->lock);
+    if (pc->connect == C_START) pc->connect = C_DONE;
+    if (pc->disconnect_cond && pn_condition_is_set(pc->disconnect_cond)) {
+      pn_connection_driver_bind(&pc->driver);
+      pn_condition_copy(pn_transport_condition(pc->driver.transport), pc->disconnect_cond);
+    }
+    pn_connection_driver_close(&pc->driver);
+  }
+  if (pc->connect == C_START) {
+    leader_connect(pc);
+    if (pc->connect == C_CONNECTING) return false;
+  }
+  /* Must process INIT and BOUND events before we do any IO-related stuff  */
+  if (pn_connection_driver_has_event(&pc->driver)) {
+    return true;
+  }
+  if (pn_connection_driver_finished(&pc->driver)) {
+    leader_close(pc);           /* May free pc */
+    return false;
+  }
+  /* Check for events that can be generated without waiting for IO */
+  check_wake(pc);
+  leader_read(pc);
+  /* Produce output first, so the tick sees dispositions it holds back */
+  pn_connection_driver_write_buffer(&pc->driver);
+  leader_tick(pc);
+  /* If we still have no events, make IO requests */
+  if (!pn_connection_driver_has_event(&pc->driver)) {
+    pn_bytes_t wbuf = pn_connection_driver_write_buffer(&pc->driver);
+    if (wbuf.size > 0) {
+      struct io_uring_sqe *sqe = uring_sqe(r, &pc->send, IORING_OP_SEND, pc->fd);
+      sqe->addr = (uintptr_t)wbuf.start;
+      sqe->len = wbuf.size;
+      sqe->msg_flags = MSG_NOSIGNAL;
+    } else if (pn_connection_driver_write_closed(&pc->driver) && !pc->write_shutdown) {
+      shutdown(pc->fd, SHUT_WR);
+      pc->write_shutdown = true;
+    }
+    if (pn_connection_driver_read_closed(&pc->driver)) {
+      uring_cancel(r, &pc->recv);
+    } else if (!pc->recv.pending && !pc->recv_end && !pc->starved) {
+      struct io_uring_sqe *sqe = uring_sqe(r, &pc->recv, IORING_OP_RECV, pc->fd);
+      sqe->flags = IOSQE_BUFFER_SELECT;
+      sqe->buf_group = URING_BUF_GROUP;
+      sqe->ioprio = IORING_RECV_MULTISHOT;
+    }
+  }
+  return pn_connection_driver_has_event(&pc->driver);
+}
+
+/* ================ Listeners ================ */
+
+static void listener_close_lh(pn_listener_t* l) {
+  if (l->state < L_CLOSE) {
+    l->state = L_CLOSE;
+  }
+  work_notify(&l->work);
+}
+
+static void listener_error_lh(pn_listener_t *l, int err, const char* what) {
+  if (!pn_condition_is_set(l->condition)) {
+    strerrorbuf msg;
+    pstrerror(err, msg);
+    pni_proactor_set_cond(l->condition, what, l->host, l->port, msg);
+  }
+  listener_close_lh(l);
+}
+
+static void leader_accept(lsocket_t *ls) {
+  (void)uring_sqe(&ls->parent->work.proactor->uring, &ls->accept, IORING_OP_ACCEPT, ls->fd);
+}
+
+/* Accept requests can be made for sockets with room for more accepted connections */
+static inline bool lsocket_can_accept_lh(lsocket_t *ls) {
+  return !ls->accept.pending && !ls->overflow && ls->accepted_count < ACCEPT_BATCH;
+}
+
+static void on_accept(lsocket_t *ls, int res) {
+  pn_listener_t *l = ls->parent;
+  pn_proactor_t *p = l->work.proactor;
+  pthread_mutex_lock(&l->lock);
+  if (res >= 0) {
+    if (l->state == L_LISTENING) {
+      ls->accepted[(ls->accepted_first + ls->accepted_count++) % ACCEPT_BATCH] = res;
+      pn_collector_put(l->collector, lsocket__class(), ls, PN_LISTENER_ACCEPT);
+    } else {
+      close(res);
+    }
+  } else if (res == -EMFILE || res == -ENFILE) {
+    ls->overflow = true;        /* Accept again when a connection is closed */
+    ls->overflow_next = p->overflow;
+    p->overflow = ls;
+  } else if (res != -ECANCELED && res != -ECONNABORTED && res != -EINTR) {
+    listener_error_lh(l, -res, "accept");
+  }
+  if (l->state == L_LISTENING && lsocket_can_accept_lh(ls)) {
+    leader_accept(ls);
+  }
+  pthread_mutex_unlock(&l->lock);
+  leader_notify(&l->work);
+}
+
+/* A file descriptor was closed, let listeners that ran out accept again */
+static void leader_listeners_overflow_done(pn_proactor_t *p) {
+  while (p->overflow) {
+    lsocket_t *ls = p->overflow;
+    p->overflow = ls->overflow_next;
+    ls->overflow = false;
+    leader_notify(&ls->parent->work);
+  }
+}
+
+/* Listen on all available addresses, the leader makes the accept requests */
+static void listener_listen_lh(pn_listener_t *l) {
+  struct addrinfo *addrinfo = NULL;
+  int err = 0;
+  int gai_err = pgetaddrinfo(l->host, l->port, AI_PASSIVE | AI_ALL, &addrinfo);
+  if (!gai_err) {
+    /* Allocate enough space for the pn_netaddr_t addresses */
+    size_t len = 0;
+    for (struct addrinfo *ai = addrinfo; ai; ai = ai->ai_next) {
+      ++len;
+    }
+    l->addrs = (pn_netaddr_t*)calloc(len, sizeof(pn_netaddr_t));
+    uint16_t dynamic_port = 0;  /* Record dynamic port from first bind(0) */
+    /* Find the working addresses */
+    for (struct addrinfo *ai = addrinfo; ai; ai = ai->ai_next) {
+      if (dynamic_port) set_port(ai->ai_addr, dynamic_port);
+      int fd = socket(ai->ai_family, SOCK_STREAM, ai->ai_protocol);
+      static int on = 1;
+      if (fd >= 0 &&
+          !setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) &&
+          /* We listen to v4/v6 on separate sockets, don't let v6 listen for v4 */
+          (ai->ai_family != AF_INET6 ||
+           !setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on))) &&
+          !bind(fd, ai->ai_addr, ai->ai_addrlen) &&
+          !listen(fd, l->backlog))
+      {
+        /* Get actual listening address */
+        pn_netaddr_t *na = &l->addrs[l->addrs_len++];
+        socklen_t len = sizeof(na->ss);
+        (void)getsockname(fd, (struct sockaddr*)(&na->ss), &len);
+        if (na == l->addrs) {     /*  First socket, check for dynamic port bind */
+          dynamic_port = check_dynamic_port(ai->ai_addr, pn_netaddr_sockaddr(na));
+        } else {
+          (na-1)->next = na;      /* Link into list */
+        }
+        lsocket_t *ls = (lsocket_t*)calloc(1, sizeof(lsocket_t));
+        ls->parent = l;
+        ls->fd = fd;
+        ls->accept.type = OP_ACCEPT;
+        ls->next = l->lsockets;
+        l->lsockets = ls;
+      } else {
+        err = errno;
+        if (fd >= 0) close(fd);
+      }
+    }
+  }
+  if (addrinfo) {
+    freeaddrinfo(addrinfo);
+  }
+  if (gai_err) {
+    pni_proactor_set_cond(l->condition, "listen on", l->host, l->port, gai_strerror(gai_err));
+    listener_close_lh(l);
+  } else if (!l->lsockets) {  /* Ignore errors if we got at least one good listening socket */
+    listener_error_lh(l, err, "listen on");
+  } else {
+    pn_collector_put(l->collector, pn_listener__class(), l, PN_LISTENER_OPEN);
+  }
+}
+
+static void lsocket_close_accepted_lh(lsocket_t *ls) {
+  for (; ls->accepted_count; --ls->accepted_count) {
+    close(ls->accepted[ls->accepted_first]);
+    ls->accepted_first = (ls->accepted_first + 1) % ACCEPT_BATCH;
+  }
+}
+
+void pn_listener_free(pn_listener_t *l) {
+  if (l) {
+    if (l->addrs) free(l->addrs);
+    if (l->collector) pn_collector_free(l->collector);
+    if (l->condition) pn_condition_free(l->condition);
+    if (l->disconnect_cond) pn_condition_free(l->disconnect_cond);
+    if (l->attachments) pn_free(l->attachments);
+    while (l->lsockets) {
+      lsocket_t *ls = l->lsockets;
+      l->lsockets = ls->next;
+      lsocket_close_accepted_lh(ls);
+      if (ls->fd >= 0) close(ls->fd);
+      free(ls);
+    }
+    pthread_mutex_destroy(&l->lock);
+    free(l);
+  }
+}
+
+/* Process a listener, return true if it has events for a worker thread */
+static bool leader_process_listener(pn_listener_t *l) {
+  pn_proactor_t *p = l->work.proactor;
+  bool closed = false;
+  pthread_mutex_lock(&l->lock);
+
+  if (l->disconnect) {
+    l->disconnect = false;
+    if (l->disconnect_cond && pn_condition_is_set(l->disconnect_cond)) {
+      pn_condition_copy(l->condition, l->disconnect_cond);
+    }
+    listener_close_lh(l);
+  }
+
+  switch (l->state) {
+
+   case L_LISTENING:
+    for (lsocket_t *ls = l->lsockets; ls; ls = ls->next) {
+      if (lsocket_can_accept_lh(ls)) leader_accept(ls);
+    }
+    break;
+
+   case L_CLOSE:                /* Close requested, stop accepting */
+    l->state = L_CLOSING;
+    for (lsocket_t *ls = l->lsockets; ls; ls = ls->next) {
+      uring_cancel(&p->uring, &ls->accept);
+      lsocket_close_accepted_lh(ls);
+      if (ls->overflow) {
+        lsocket_t **pp = &p->overflow;
+        while (*pp != ls) pp = &(*pp)->overflow_next;
+        *pp = ls->overflow_next;
+        ls->overflow = false;
+      }
+    }
+    /* NOTE: Fall through in case we have 0 sockets - e.g. resolver error */
+
+   case L_CLOSING: {            /* Closing - can we send PN_LISTENER_CLOSE? */
+     bool pending = false;
+     for (lsocket_t *ls = l->lsockets; ls; ls = ls->next) {
+       pending = pending || ls->accept.pending;
+     }
+     if (!pending) {
+       for (lsocket_t *ls = l->lsockets; ls; ls = ls->next) {
+         if (ls->fd >= 0) {
+           close(ls->fd);
+           ls->fd = -1;
+         }
+       }
+       l->state = L_CLOSED;
+       pn_collector_put(l->collector, pn_listener__class(), l, PN_LISTENER_CLOSE);
+     }
+     break;
+   }
+
+   case L_CLOSED:              /* Closed, has LISTENER_CLOSE has been processed? */
+    if (!pn_collector_peek(l->collector)) {
+      closed = true;
+    }
+  }
+  bool has_work = !closed && pn_collector_peek(l->collector);
+  pthread_mutex_unlock(&l->lock);
+
+  if (closed) {
+    work_finish(&l->work);
+    pn_listener_free(l);
+  }
+  return has_work;
+}
+
+/* ================ Proactor ================ */
+
+static void on_timeout(pn_proactor_t *p) {
+  pthread_mutex_lock(&p->lock);
+  if (p->timeout_state == TM_PENDING) { /* Only fire if still pending */
+    if (now_millis() >= p->timeout_deadline) {
+      p->timeout_state = TM_FIRED;
+    } else {
+      timer_arm(&p->uring, &p->timer, p->timeout_deadline); /* Woken early */
+    }
+  }
+  pthread_mutex_unlock(&p->lock);
+}
+
+static void leader_notify_read(pn_proactor_t *p) {
+  struct io_uring_sqe *sqe = uring_sqe(&p->uring, &p->notify_op, IORING_OP_READ, p->notifyfd);
+  sqe->addr = (uintptr_t)&p->notify_value;
+  sqe->len = sizeof(p->notify_value);
+}
+
+static void on_notify(pn_proactor_t *p) {
+  pthread_mutex_lock(&p->lock);
+  p->notified = false;
+  pthread_mutex_unlock(&p->lock);
+  leader_notify_read(p);
+}
+
+/* Dispatch a completion to its owner */
+static void leader_complete(pn_proactor_t *p, struct io_uring_cqe *cqe) {
+  op_t *op = (op_t*)(uintptr_t)cqe->user_data;
+  if (!op) return;              /* Cancel or timer update */
+  if (!(cqe->flags & IORING_CQE_F_MORE)) {
+    op->pending = false;
+    --p->uring.requests;
+  }
+  if (p->freeing) {
+    if (op->type == OP_ACCEPT && cqe->res >= 0) close(cqe->res);
+    return;
+  }
+  pconnection_t *pc = op_pconnection(op);
+  switch (op->type) {
+   case OP_NOTIFY: on_notify(p); break;
+   case OP_TIMEOUT: on_timeout(p); break;
+   case OP_CONNECT: on_connect(pc, cqe->res); break;
+   case OP_RECV: on_recv(pc, cqe); break;
+   case OP_SEND: on_send(pc, cqe->res); break;
+   case OP_TICK: if (!pc->closing) leader_notify(&pc->work); break;
+   case OP_ACCEPT: on_accept(op_lsocket(op), cqe->res); break;
+  }
+  if (pc && pc->closing) leader_check_final(pc);
+}
+
+/* Submit queued requests, optionally wait for a completion, then handle all completions */
+static void leader_run(pn_proactor_t *p, bool wait) {
+  uring_t *r = &p->uring;
+  if (uring_has_completions(r)) wait = false;
+  unsigned to_submit = uring_unsubmitted(r);
+  bool overflow = __atomic_load_n(r->sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW;
+  if (to_submit || wait || overflow) {
+    int n = uring_enter(r, to_submit, wait ? 1 : 0, (wait || overflow) ? IORING_ENTER_GETEVENTS : 0);
+    if (n < 0 && n != -EINTR && n != -EAGAIN && n != -EBUSY) URING_FATAL("io_uring_enter", -n);
+  }
+  unsigned head = *r->cq_head;
+  while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+    struct io_uring_cqe cqe = r->cqes[head & r->cq_mask];
+    __atomic_store_n(r->cq_head, ++head, __ATOMIC_RELEASE);
+    leader_complete(p, &cqe);
+  }
+}
+
+/* Set the event in the proactor's batch  */
+static pn_event_batch_t *proactor_batch_lh(pn_proactor_t *p, pn_event_type_t t) {
+  pn_collector_put(p->collector, pn_proactor__class(), p, t);
+  p->batch_working = true;
+  return &p->batch;
+}
+
+static pn_event_t *log_event(void* p, pn_event_t *e) {
+  if (e) {
+    pn_logf("[%p]:(%s)", (void*)p, pn_event_type_name(pn_event_type(e)));
+  }
+  return e;
+}
+
+static pn_event_t *listener_batch_next(pn_event_batch_t *batch) {
+  pn_listener_t *l = batch_listener(batch);
+  pthread_mutex_lock(&l->lock);
+  pn_event_t *e = pn_collector_next(l->collector);
+  pthread_mutex_unlock(&l->lock);
+  return log_event(l, e);
+}
+
+static pn_event_t *proactor_batch_next(pn_event_batch_t *batch) {
+  pn_proactor_t *p = batch_proactor(batch);
+  assert(p->batch_working);
+  return log_event(p, pn_collector_next(p->collector));
+}
+
+/* Return the next event batch or NULL if no events are available */
+static pn_event_batch_t *get_batch_lh(pn_proactor_t *p) {
+  if (!p->batch_working) {       /* Can generate proactor events */
+    if (p->need_inactive) {
+      p->need_inactive = false;
+      return proactor_batch_lh(p, PN_PROACTOR_INACTIVE);
+    }
+    if (p->need_interrupt) {
+      p->need_interrupt = false;
+      return proactor_batch_lh(p, PN_PROACTOR_INTERRUPT);
+    }
+    if (p->timeout_state == TM_FIRED) {
+      p->timeout_state = TM_NONE;
+      remove_active_lh(p);
+      return proactor_batch_lh(p, PN_PROACTOR_TIMEOUT);
+    }
+  }
+  for (work_t *w = work_pop(&p->worker_q); w; w = work_pop(&p->worker_q)) {
+    assert(w->working);
+    switch (w->type) {
+     case T_CONNECTION:
+      return &((pconnection_t*)w)->driver.batch;
+     case T_LISTENER:
+      return &((pn_listener_t*)w)->batch;
+     default:
+      break;
+    }
+  }
+  return NULL;
+}
+
+/* Mark all connections and listeners for disconnect */
+static void leader_disconnect_lh(pn_proactor_t *p) {
+  for (work_t *w = p->all; w; w = w->all_next) {
+    pn_condition_t **cond = NULL;
+    switch (w->type) {
+     case T_CONNECTION: {
+       pconnection_t *pc = (pconnection_t*)w;
+       if (pc->closing) continue;
+       pc->disconnect = true;
+       cond = &pc->disconnect_cond;
+       break;
+     }
+     case T_LISTENER:
+      ((pn_listener_t*)w)->disconnect = true;
+      cond = &((pn_listener_t*)w)->disconnect_cond;
+      break;
+    }
+    if (!*cond) *cond = pn_condition();
+    pn_condition_copy(*cond, p->disconnect_cond);
+    work_notify_lh(w);
+  }
+}
+
+/* Process the leader_q, in the leader thread */
+static void leader_process_lh(pn_proactor_t *p) {
+  if (__atomic_exchange_n(&p->interrupt, false, __ATOMIC_ACQ_REL)) {
+    p->need_interrupt = true;
+  }
+  for (work_t *w = work_pop(&p->leader_q); w; w = work_pop(&p->leader_q)) {
+    assert(!w->working);
+
+    pthread_mutex_unlock(&p->lock);  /* Unlock to process each item, may add more items to leader_q */
+    bool has_work = false;
+    switch (w->type) {
+     case T_CONNECTION:
+      has_work = leader_process_pconnection((pconnection_t*)w);
+      break;
+     case T_LISTENER:
+      has_work = leader_process_listener((pn_listener_t*)w);
+      break;
+     default:
+      break;
+    }
+    pthread_mutex_lock(&p->lock);
+
+    if (has_work && !w->working && w->next == work_unqueued) {
+      w->working = true;
+      work_push(&p->worker_q, w);
+    }
+  }
+}
+
+/* Process the leader_q and the ring, in the leader thread */
+static pn_event_batch_t *leader_lead_lh(pn_proactor_t *p, bool wait) {
+  /* Set timeout timer if there was a request, let it count down while we process work */
+  if (p->timeout_state == TM_REQUEST) {
+    p->timeout_state = TM_PENDING;
+    p->timeout_deadline = now_millis() + p->timeout;
+    if (p->timeout == 0) {
+      p->timeout_state = TM_FIRED;
+    } else {
+      timer_arm(&p->uring, &p->timer, p->timeout_deadline);
+    }
+  } else if (p->timeout_state == TM_NONE) {
+    uring_cancel(&p->uring, &p->timer.op); /* Cancelled by the user */
+  }
+  /* If disconnect was requested, mark all connections and listeners */
+  if (p->disconnect) {
+    p->disconnect = false;
+    if (p->active) {
+      leader_disconnect_lh(p);
+    } else {
+      p->need_inactive = true;  /* Send INACTIVE right away, nothing to do. */
+    }
+  }
+  leader_process_lh(p);
+  pn_event_batch_t *batch = get_batch_lh(p);      /* Check for work */
+  if (!batch) {                 /* No work, submit requests and wait for completions */
+    pthread_mutex_unlock(&p->lock);
+    leader_run(p, wait);
+    pthread_mutex_lock(&p->lock);
+    leader_process_lh(p);
+    batch = get_batch_lh(p);
+  }
+  return batch;
+}
+
+/**** public API ****/
+
+pn_event_batch_t *pn_proactor_get(struct pn_proactor_t* p) {
+  pthread_mutex_lock(&p->lock);
+  pn_event_batch_t *batch = get_batch_lh(p);
+  if (batch == NULL && !p->has_leader) {
+    /* Try a non-blocking lead to generate some work */
+    p->has_leader = true;
+    batch = leader_lead_lh(p, false);
+    p->has_leader = false;
+    pthread_cond_broadcast(&p->cond);   /* Signal followers for possible work */
+  }
+  pthread_mutex_unlock(&p->lock);
+  return batch;
+}
+
+pn_event_batch_t *pn_proactor_wait(struct pn_proactor_t* p) {
+  pthread_mutex_lock(&p->lock);
+  pn_event_batch_t *batch = get_batch_lh(p);
+  while (!batch && p->has_leader) {
+    pthread_cond_wait(&p->cond, &p->lock); /* Follow the leader */
+    batch = get_batch_lh(p);
+  }
+  if (!batch) {                 /* Become leader */
+    p->has_leader = true;
+    do {
+      batch = leader_lead_lh(p, true);
+    } while (!batch);
+    p->has_leader = false;
+    pthread_cond_broadcast(&p->cond); /* Signal a followers. One takes over, many can work. */
+  }
+  pthread_mutex_unlock(&p->lock);
+  return batch;
+}
+
+void pn_proactor_done(pn_proactor_t *p, pn_event_batch_t *batch) {
+  if (!batch) return;
+  pthread_mutex_lock(&p->lock);
+  work_t *w = batch_work(batch);
+  if (w) {
+    assert(w->working);
+    assert(w->next == work_unqueued);
+    w->working = false;
+    work_push(&p->leader_q, w);
+  }
+  pn_proactor_t *bp = batch_proactor(batch); /* Proactor events */
+  if (bp == p) {
+    p->batch_working = false;
+  }
+  notify_lh(p);
+  pthread_mutex_unlock(&p->lock);
+}
+
+pn_listener_t *pn_event_listener(pn_event_t *e) {
+  if (pn_event_class(e) == pn_listener__class()) {
+    return (pn_listener_t*)pn_event_context(e);
+  } else if (pn_event_class(e) == lsocket__class()) {
+    return ((lsocket_t*)pn_event_context(e))->parent;
+  } else {
+    return NULL;
+  }
+}
+
+pn_proactor_t *pn_event_proactor(pn_event_t *e) {
+  if (pn_event_class(e) == pn_proactor__class()) {
+    return (pn_proactor_t*)pn_event_context(e);
+  }
+  pn_listener_t *l = pn_event_listener(e);
+  if (l) {
+    return l->work.proactor;
+  }
+  pn_connection_t *c = pn_event_connection(e);
+  if (c) {
+    return pn_connection_proactor(pn_event_connection(e));
+  }
+  return NULL;
+}
+
+void pn_proactor_interrupt(pn_proactor_t *p) {
+  /* NOTE: pn_proactor_interrupt must be async-signal-safe so we cannot use
+     locks to update shared proactor state here. The leader picks up the flag
+     when the eventfd read completes.
+   */
+  __atomic_store_n(&p->interrupt, true, __ATOMIC_RELEASE);
+  uint64_t increment = 1;
+  if (write(p->notifyfd, &increment, sizeof(uint64_t)) != sizeof(uint64_t))
+    URING_FATAL("writing eventfd", errno);
+}
+
+void pn_proactor_disconnect(pn_proactor_t *p, pn_condition_t *cond) {
+  pthread_mutex_lock(&p->lock);
+  if (!p->disconnect) {
+    p->disconnect = true;
+    if (cond) {
+      pn_condition_copy(p->disconnect_cond, cond);
+    } else {
+      pn_condition_clear(p->disconnect_cond);
+    }
+    notify_lh(p);
+  }
+  pthread_mutex_unlock(&p->lock);
+}
+
+void pn_proactor_set_timeout(pn_proactor_t *p, pn_millis_t t) {
+  pthread_mutex_lock(&p->lock);
+  p->timeout = t;
+  // This timeout *replaces* any existing timeout
+  if (p->timeout_state == TM_NONE) ++p->active;
+  p->timeout_state = TM_REQUEST;
+  notify_lh(p);
+  pthread_mutex_unlock(&p->lock);
+}
+
+void pn_proactor_cancel_timeout(pn_proactor_t *p) {
+  pthread_mutex_lock(&p->lock);
+  if (p->timeout_state != TM_NONE) {
+    p->timeout_state = TM_NONE;
+    remove_active_lh(p);
+    notify_lh(p);
+  }
+  pthread_mutex_unlock(&p->lock);
+}
+
+void pn_proactor_connect2(pn_proactor_t *p, pn_connection_t *c, pn_transport_t *t, const char *addr) {
+  pconnection_t *pc = pconnection(p, c, t, false);
+  /* Only fails out of memory, which the void API gives no way to report */
+  assert(pc);
+  pn_connection_open(pc->driver.connection);   /* Auto-open */
+  pni_parse_addr(addr, pc->addr_buf, sizeof(pc->addr_buf), &pc->host, &pc->port);
+  work_start(&pc->work);
+}
+
+void pn_proactor_listen(pn_proactor_t *p, pn_listener_t *l, const char *addr, int backlog) {
+  work_init(&l->work, p, T_LISTENER);
+  pni_parse_addr(addr, l->addr_buf, sizeof(l->addr_buf), &l->host, &l->port);
+  l->backlog = backlog;
+  /* Create the sockets now so the listening address is known when this returns */
+  pthread_mutex_lock(&l->lock);
+  listener_listen_lh(l);
+  pthread_mutex_unlock(&l->lock);
+  work_start(&l->work);
+}
+
+pn_proactor_t *pn_proactor() {
+  pn_proactor_t *p = (pn_proactor_t*)calloc(1, sizeof(pn_proactor_t));
+  if (!p) return NULL;
+  p->notifyfd = -1;
+  p->collector = pn_collector();
+  p->disconnect_cond = pn_condition();
+  if (p->collector && p->disconnect_cond && uring_init(&p->uring) == 0) {
+    p->notifyfd = eventfd(0, EFD_NONBLOCK);
+  }
+  if (p->notifyfd < 0) {
+    if (p->collector) pn_collector_free(p->collector);
+    if (p->disconnect_cond) pn_condition_free(p->disconnect_cond);
+    uring_free(&p->uring);
+    free(p);
+    return NULL;
+  }
+  p->batch.next_event = &proactor_batch_next;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->cond, NULL);
+  p->notify_op.type = OP_NOTIFY;
+  p->timer.op.type = OP_TIMEOUT;
+  leader_notify_read(p);
+  return p;
+}
+
+static void work_free(work_t *w) {
+  switch (w->type) {
+   case T_CONNECTION: pconnection_free((pconnection_t*)w); break;
+   case T_LISTENER: pn_listener_free((pn_listener_t*)w); break;
+   default: break;
+  }
+}
+
+void pn_proactor_free(pn_proactor_t *p) {
+  /* Cancel all requests, their buffers must not be freed till they complete */
+  uring_t *r = &p->uring;
+  p->freeing = true;
+  uring_cancel(r, &p->notify_op);
+  uring_cancel(r, &p->timer.op);
+  for (work_t *w = p->all; w; w = w->all_next) {
+    if (w->type == T_CONNECTION) {
+      pconnection_t *pc = (pconnection_t*)w;
+      uring_cancel(r, &pc->connect_op);
+      uring_cancel(r, &pc->recv);
+      uring_cancel(r, &pc->send);
+      uring_cancel(r, &pc->tick.op);
+    } else {
+      for (lsocket_t *ls = ((pn_listener_t*)w)->lsockets; ls; ls = ls->next) {
+        uring_cancel(r, &ls->accept);
+      }
+    }
+  }
+  while (r->requests) {
+    leader_run(p, true);
+  }
+  /* Free all connections and listeners */
+  while (p->all) {
+    work_t *w = p->all;
+    p->all = w->all_next;
+    work_free(w);
+  }
+  uring_free(r);
+  close(p->notifyfd);
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->cond);
+  pn_collector_free(p->collector);
+  pn_condition_free(p->disconnect_cond);
+  free(p);
+}
+
+pn_proactor_t *pn_connection_proactor(pn_connection_t* c) {
+  pconnection_t *pc = get_pconnection(c);
+  return pc ? pc->work.proactor : NULL;
+}
+
+void pn_connection_wake(pn_connection_t* c) {
+  /* May be called from any thread */
+  pconnection_t *pc = get_pconnection(c);
+  if (pc) {
+    pthread_mutex_lock(&pc->lock);
+    if (pc->wake == W_NONE) {
+      pc->wake = W_PENDING;
+      /* Notify with the lock held, the leader frees pc only after setting W_CLOSED */
+      work_notify(&pc->work);
+    }
+    pthread_mutex_unlock(&pc->lock);
+  }
+}
+
+void pn_proactor_release_connection(pn_connection_t *c) {
+  pconnection_t *pc = get_pconnection(c);
+  if (pc) {
+    set_pconnection(c, NULL);
+    pn_connection_driver_release_connection(&pc->driver);
+    work_notify(&pc->work);     /* Close the socket */
+  }
+}
+
+pn_listener_t *pn_listener(void) {
+  pn_listener_t *l = (pn_listener_t*)calloc(1, sizeof(pn_listener_t));
+  if (l) {
+    l->batch.next_event = listener_batch_next;
+    l->collector = pn_collector();
+    l->condition = pn_condition();
+    l->attachments = pn_record();
+    pthread_mutex_init(&l->lock, NULL);
+    if (!l->condition || !l->collector || !l->attachments) {
+      pn_listener_free(l);
+      return NULL;
+    }
+  }
+  return l;
+}
+
+void pn_listener_close(pn_listener_t* l) {
+  /* May be called from any thread */
+  pthread_mutex_lock(&l->lock);
+  listener_close_lh(l);
+  pthread_mutex_unlock(&l->lock);
+}
+
+pn_proactor_t *pn_listener_proactor(pn_listener_t* l) {
+  return l ? l->work.proactor : NULL;
+}
+
+pn_condition_t* pn_listener_condition(pn_listener_t* l) {
+  return l->condition;
+}
+
+void *pn_listener_get_context(pn_listener_t *l) {
+  return l->context;
+}
+
+void pn_listener_set_context(pn_listener_t *l, void *context) {
+  l->context = context;
+}
+
+pn_record_t *pn_listener_attachments(pn_listener_t *l) {
+  return l->attachments;
+}
+
+void pn_listener_accept2(pn_listener_t *l, pn_connection_t *c, pn_transport_t *t) {
+  pconnection_t *pc = pconnection(l->work.proactor, c, t, true);
+  assert(pc);
+  pthread_mutex_lock(&l->lock);
+  /* Get the socket from the accept event that we are processing */
+  pn_event_t *e = pn_collector_prev(l->collector);
+  assert(pn_event_type(e) == PN_LISTENER_ACCEPT);
+  assert(pn_event_listener(e) == l);
+  lsocket_t *ls = (lsocket_t*)pn_event_context(e);
+  if (ls->accepted_count) {
+    pc->fd = ls->accepted[ls->accepted_first];
+    ls->accepted_first = (ls->accepted_first + 1) % ACCEPT_BATCH;
+    --ls->accepted_count;
+  }
+  pthread_mutex_unlock(&l->lock);
+  pc->connect = C_DONE;         /* Don't need to connect() */
+  if (pc->fd >= 0) {
+    configure_socket(pc->fd);
+    pconnection_addresses(pc);
+  } else {
+    pconnection_error(pc, ECONNABORTED, "accept");
+  }
+  work_start(&pc->work);
+  work_notify(&l->work);        /* Accept more if the socket was full */
+}
+
+const pn_netaddr_t *pn_transport_local_addr(pn_transport_t *t) {
+  pconnection_t *pc = get_pconnection(pn_transport_connection(t));
+  return pc? &pc->local : NULL;
+}
+
+const pn_netaddr_t *pn_transport_remote_addr(pn_transport_t *t) {
+  pconnection_t *pc = get_pconnection(pn_transport_connection(t));
+  return pc ? &pc->remote : NULL;
+}
+
+const pn_netaddr_t *pn_listener_addr(pn_listener_t *l) {
+  return l->addrs_len ? &l->addrs[0] : NULL;
+}
+
+pn_millis_t pn_proactor_now(void) {
+  return (pn_millis_t)now_millis();
+}
@@ -904,6 +904,8 @@ static bool leader_process_pconnection(pconnection_t *pc) {
   } else {
     /* Check for events that can be generated without blocking for IO */
     check_wake(pc);
+    /* Produce output first, so the tick sees dispositions it holds back */
+    pn_connection_driver_write_buffer(&pc->driver);
     pn_millis_t next_tick = leader_tick(pc);
     pn_rwbytes_t rbuf = pn_connection_driver_read_buffer(&pc->driver);
     pn_bytes_t wbuf = pn_connection_driver_write_buffer(&pc->driver);
@@ -2142,7 +2142,8 @@ VOID CALLBACK tick_timer_cb(PVOID arg, BOOLEAN /* ignored*/ ) {
 // Call with no lock held or stop_timer and callback may deadlock
 static void pconnection_tick(pconnection_t *pc) {
   pn_transport_t *t = pc->driver.transport;
-  if (pn_transport_get_idle_timeout(t) || pn_transport_get_remote_idle_timeout(t)) {
+  if (pn_transport_get_idle_timeout(t) || pn_transport_get_remote_idle_timeout(t) ||
+      pn_transport_get_disposition_delay(t)) {
     if(!stop_timer(pc->context.proactor->timer_queue, &pc->tick_timer)) {
       // TODO: handle error
     }
@@ -2156,6 +2157,17 @@ static void pconnection_tick(pconnection_t *pc) {
   }
 }
 
+/* The transport collects dispositions as it produces output and, with a
+   disposition delay, holds them till a tick. Arm the timer for them even
+   if there is no more input, e.g. when the application settles from a
+   WAKE. Call with no lock held, from the working thread. */
+static void pconnection_disp_tick(pconnection_t *pc) {
+  if (pn_transport_get_disposition_delay(pc->driver.transport)) {
+    pn_connection_driver_write_buffer(&pc->driver);
+    pconnection_tick(pc);
+  }
+}
+
 static pconnection_t *get_pconnection(pn_connection_t* c) {
   if (!c) return NULL;
   pn_record_t *r = pn_connection_attachments(c);
@@ -2402,6 +2414,7 @@ static pn_event_batch_t *pconnection_process(pconnection_t *pc, iocp_result_t *r
         pconnection_tick(pc);         /* check for tick changes. */
         tick_required = false;
       }
+      pconnection_disp_tick(pc);
       wbuf = pn_connection_driver_write_buffer(&pc->driver);
       if (wbuf.size > 0 && (pc->psocket.iocpd->events & PN_WRITABLE)) {
         if (!pconnection_write(pc, wbuf))
@@ -2428,6 +2441,7 @@ static pn_event_t *pconnection_batch_next(pn_event_batch_t *batch) {
 }
 
 static void pconnection_done(pconnection_t *pc) {
+  pconnection_disp_tick(pc);
   {
     csguard g(&pc->context.cslock);
     pc->context.working = false;
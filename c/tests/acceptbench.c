@@ -0,0 +1,263 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/* Measure the rate a listener accepts a storm of connections.
+
+   For ROUNDS rounds, CONNECTIONS clients connect to one listener at once,
+   as after a broker restart, while WORKERS threads process proactor events
+   for both ends. A round is timed until every client has seen the remote
+   open, then all the connections are closed before the next round.
+
+   Each end of a connection uses a file descriptor, so CONNECTIONS is
+   limited by the open file limit.
+*/
+
+#include "thread.h"
+
+#include <proton/condition.h>
+#include <proton/connection.h>
+#include <proton/event.h>
+#include <proton/listener.h>
+#include <proton/netaddr.h>
+#include <proton/proactor.h>
+#include <proton/transport.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#undef NDEBUG                   /* Enable assert even in release builds */
+#include <assert.h>
+
+static const int default_connections = 500;
+static const int default_rounds = 20;
+static const int default_workers = 4;
+
+typedef struct bench {
+  pn_proactor_t *proactor;
+  pn_listener_t *listener;
+  int n_connections;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pn_connection_t **opened;     /* Client connections with remote open this round */
+  int n_opened;
+  int failed;                   /* Client connections closed before remote open */
+  int client_closed;
+  int server_closed;
+  long total_failed;
+} bench;
+
+static bool is_client(pn_connection_t *c) {
+  return pn_connection_get_context(c) != NULL;
+}
+
+static void *worker_thread(void *void_b) {
+  bench *b = (bench*)void_b;
+  bool finished = false;
+  while (!finished) {
+    pn_event_batch_t *batch = pn_proactor_wait(b->proactor);
+    pn_event_t *e;
+    while ((e = pn_event_batch_next(batch))) {
+      pn_connection_t *c = pn_event_connection(e);
+      switch (pn_event_type(e)) {
+
+       case PN_LISTENER_ACCEPT:
+        pn_listener_accept2(pn_event_listener(e), NULL, NULL);
+        break;
+
+       case PN_CONNECTION_REMOTE_OPEN:
+        if (is_client(c)) {
+          pthread_mutex_lock(&b->lock);
+          b->opened[b->n_opened++] = c;
+          pthread_cond_signal(&b->cond);
+          pthread_mutex_unlock(&b->lock);
+        } else {
+          pn_connection_open(c);
+        }
+        break;
+
+       case PN_CONNECTION_WAKE:
+        pn_connection_close(c);
+        break;
+
+       case PN_CONNECTION_REMOTE_CLOSE:
+        pn_connection_close(c);
+        break;
+
+       case PN_TRANSPORT_CLOSED:
+        pthread_mutex_lock(&b->lock);
+        if (c && is_client(c)) {
+          if (!(pn_connection_state(c) & (PN_REMOTE_ACTIVE | PN_REMOTE_CLOSED))) {
+            if (!b->total_failed++) {
+              fprintf(stderr, "connect failed: %s\n",
+                      pn_condition_get_description(pn_transport_condition(pn_event_transport(e))));
+            }
+            ++b->failed;
+          }
+          ++b->client_closed;
+        } else if (c) {
+          ++b->server_closed;
+        }
+        pthread_cond_signal(&b->cond);
+        pthread_mutex_unlock(&b->lock);
+        break;
+
+       case PN_PROACTOR_INTERRUPT:
+        finished = true;
+        pn_proactor_interrupt(b->proactor); /* Pass it on to the next worker */
+        break;
+
+       default:
+        break;
+      }
+    }
+    pn_proactor_done(b->proactor, batch);
+  }
+  return NULL;
+}
+
+static void usage(const char **argv, const char **arg) {
+  fprintf(stderr, "usage: %s [options]\n", argv[0]);
+  fprintf(stderr, "  -connections CONNECTIONS: clients connecting in each round (default %d)\n", default_connections);
+  fprintf(stderr, "  -rounds ROUNDS: connection storms (default %d)\n", default_rounds);
+  fprintf(stderr, "  -workers WORKERS: threads processing proactor events (default %d)\n", default_workers);
+  fprintf(stderr, "\nbad argument: %s\n", *arg);
+  exit(1);
+}
+
+int main(int argc, const char* argv[]) {
+  const char **arg = argv + 1;
+  const char **end = argv + argc;
+  int rounds = default_rounds;
+  int n_workers = default_workers;
+  bench b;
+  memset(&b, 0, sizeof(b));
+  b.n_connections = default_connections;
+
+  while (arg < end) {
+    if (!strcmp(*arg, "-connections") && ++arg < end) {
+      b.n_connections = atoi(*arg);
+      if (b.n_connections <= 0) usage(argv, arg);
+    }
+    else if (!strcmp(*arg, "-rounds") && ++arg < end) {
+      rounds = atoi(*arg);
+      if (rounds <= 0) usage(argv, arg);
+    }
+    else if (!strcmp(*arg, "-workers") && ++arg < end) {
+      n_workers = atoi(*arg);
+      if (n_workers <= 0) usage(argv, arg);
+    }
+    else {
+      usage(argv, arg);
+    }
+    ++arg;
+  }
+
+  pthread_mutex_init(&b.lock, NULL);
+  pthread_cond_init(&b.cond, NULL);
+  b.opened = (pn_connection_t**)calloc(b.n_connections, sizeof(pn_connection_t*));
+  b.proactor = pn_proactor();
+  assert(b.proactor);
+
+  /* Listen and wait for the address before connecting */
+  b.listener = pn_listener();
+  pn_proactor_listen(b.proactor, b.listener, "127.0.0.1:0", b.n_connections);
+  bool listening = false;
+  while (!listening) {
+    pn_event_batch_t *batch = pn_proactor_wait(b.proactor);
+    pn_event_t *e;
+    while ((e = pn_event_batch_next(batch))) {
+      if (pn_event_type(e) == PN_LISTENER_OPEN) {
+        listening = true;
+      } else if (pn_event_type(e) == PN_LISTENER_CLOSE) {
+        fprintf(stderr, "listen failed: %s\n",
+                pn_condition_get_description(pn_listener_condition(b.listener)));
+        exit(1);
+      }
+    }
+    pn_proactor_done(b.proactor, batch);
+  }
+  char host[PN_MAX_ADDR], port[PN_MAX_ADDR], addr[PN_MAX_ADDR];
+  pn_netaddr_host_port(pn_listener_addr(b.listener), host, sizeof(host), port, sizeof(port));
+  pn_proactor_addr(addr, sizeof(addr), host, port);
+
+  pthread_t *workers = (pthread_t*)calloc(n_workers, sizeof(pthread_t));
+  for (int i = 0; i < n_workers; ++i) {
+    pthread_create(&workers[i], NULL, worker_thread, &b);
+  }
+
+  long total_opened = 0;
+  pn_millis_t total_elapsed = 0;
+  double best = 0;
+  for (int r = 0; r < rounds; ++r) {
+    pthread_mutex_lock(&b.lock);
+    b.n_opened = b.failed = b.client_closed = b.server_closed = 0;
+    pthread_mutex_unlock(&b.lock);
+
+    /* Time the storm */
+    pn_millis_t start = pn_proactor_now();
+    for (int i = 0; i < b.n_connections; ++i) {
+      pn_connection_t *c = pn_connection();
+      pn_connection_set_context(c, &b);
+      pn_proactor_connect2(b.proactor, c, NULL, addr);
+    }
+    pthread_mutex_lock(&b.lock);
+    while (b.n_opened + b.failed < b.n_connections) pthread_cond_wait(&b.cond, &b.lock);
+    int n_opened = b.n_opened;
+    pthread_mutex_unlock(&b.lock);
+    pn_millis_t elapsed = pn_proactor_now() - start;
+
+    if (elapsed == 0) elapsed = 1;
+    double rate = n_opened * 1000.0 / elapsed;
+    if (rate > best) best = rate;
+    total_opened += n_opened;
+    total_elapsed += elapsed;
+
+    /* Close every connection before the next round */
+    for (int i = 0; i < n_opened; ++i) {
+      pn_connection_wake(b.opened[i]);
+    }
+    pthread_mutex_lock(&b.lock);
+    while (b.client_closed < b.n_connections || b.server_closed < n_opened) {
+      pthread_cond_wait(&b.cond, &b.lock);
+    }
+    pthread_mutex_unlock(&b.lock);
+  }
+
+  pn_proactor_interrupt(b.proactor);
+  for (int i = 0; i < n_workers; ++i) {
+    pthread_join(workers[i], NULL);
+  }
+
+  printf("connections=%d, workers=%d: %ld connections in %d rounds, %u ms, "
+         "%.0f connections/sec, best round %.0f connections/sec",
+         b.n_connections, n_workers, total_opened, rounds, (unsigned)total_elapsed,
+         total_opened * 1000.0 / total_elapsed, best);
+  if (b.total_failed) printf(", %ld failed", b.total_failed);
+  printf("\n");
+
+  free(workers);
+  free(b.opened);
+  pn_proactor_free(b.proactor);
+  pthread_cond_destroy(&b.cond);
+  pthread_mutex_destroy(&b.lock);
+  return b.total_failed ? 1 : 0;
+}
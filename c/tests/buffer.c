@@ -0,0 +1,110 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include "test_tools.h"
+#include "core/buffer.h"
+
+#include <string.h>
+
+/* Check the buffer holds exactly the first size bytes of want */
+static void check_contents(test_t *t, pn_buffer_t *buf, const char *want, size_t size) {
+  char got[256];
+  TEST_SIZE_EQUAL(t, size, pn_buffer_size(buf));
+  TEST_SIZE_EQUAL(t, size, pn_buffer_get(buf, 0, sizeof(got), got));
+  TEST_CHECK(t, !memcmp(want, got, size));
+}
+
+/* Reserve size bytes, fill them from src and extend the buffer over them */
+static void reserve_fill(test_t *t, pn_buffer_t *buf, const char *src, size_t size) {
+  pn_rwbytes_t space = pn_buffer_reserve(buf, size);
+  TEST_CHECK(t, space.start != NULL);
+  TEST_CHECK(t, space.size >= size);
+  memcpy(space.start, src, size);
+  pn_buffer_extend(buf, size);
+}
+
+static const char digits[] =
+  "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+  "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+  "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+static void test_reserve_inline(test_t *t) {
+  pn_buffer_t *buf = pn_buffer(0);
+  reserve_fill(t, buf, digits, 10);
+  reserve_fill(t, buf, digits + 10, 10);
+  check_contents(t, buf, digits, 20);
+  /* An empty reservation adds nothing */
+  reserve_fill(t, buf, digits + 20, 0);
+  check_contents(t, buf, digits, 20);
+  pn_buffer_free(buf);
+}
+
+static void test_reserve_spill(test_t *t) {
+  /* Reserving past the inline storage moves the contents to the heap */
+  pn_buffer_t *buf = pn_buffer(0);
+  TEST_CHECK(t, pn_buffer_append(buf, digits, 20) == 0);
+  reserve_fill(t, buf, digits + 20, 100);
+  TEST_CHECK(t, pn_buffer_capacity(buf) >= 120);
+  check_contents(t, buf, digits, 120);
+  pn_buffer_free(buf);
+}
+
+static void test_reserve_wrapped(test_t *t) {
+  /* Contents that wrap around the end of heap storage */
+  pn_buffer_t *buf = pn_buffer(64);
+  TEST_SIZE_EQUAL(t, 64, pn_buffer_capacity(buf));
+  TEST_CHECK(t, pn_buffer_append(buf, digits, 50) == 0);
+  TEST_CHECK(t, pn_buffer_trim(buf, 40, 0) == 0);
+  TEST_CHECK(t, pn_buffer_append(buf, digits + 50, 30) == 0); /* Wraps */
+  TEST_SIZE_EQUAL(t, 64, pn_buffer_capacity(buf));
+  /* Fits in the capacity but not after the tail, so it is defragmented */
+  reserve_fill(t, buf, digits + 80, 20);
+  TEST_SIZE_EQUAL(t, 64, pn_buffer_capacity(buf));
+  check_contents(t, buf, digits + 40, 60);
+  /* Grow a wrapped buffer */
+  pn_buffer_trim(buf, 30, 0);
+  TEST_CHECK(t, pn_buffer_append(buf, digits + 100, 30) == 0);
+  reserve_fill(t, buf, digits + 130, 50);
+  check_contents(t, buf, digits + 70, 110);
+  pn_buffer_free(buf);
+}
+
+static void test_reserve_wrapped_spill(test_t *t) {
+  /* Contents that wrap around the end of inline storage, then spill */
+  pn_buffer_t *buf = pn_buffer(0);
+  TEST_SIZE_EQUAL(t, 32, pn_buffer_capacity(buf));
+  TEST_CHECK(t, pn_buffer_append(buf, digits, 20) == 0);
+  TEST_CHECK(t, pn_buffer_trim(buf, 15, 0) == 0);
+  TEST_CHECK(t, pn_buffer_append(buf, digits + 20, 20) == 0); /* Wraps */
+  TEST_SIZE_EQUAL(t, 32, pn_buffer_capacity(buf));
+  reserve_fill(t, buf, digits + 40, 40);
+  TEST_CHECK(t, pn_buffer_capacity(buf) >= 65);
+  check_contents(t, buf, digits + 15, 65);
+  pn_buffer_free(buf);
+}
+
+int main(int argc, char **argv) {
+  int failed = 0;
+  RUN_ARGV_TEST(failed, t, test_reserve_inline(&t));
+  RUN_ARGV_TEST(failed, t, test_reserve_spill(&t));
+  RUN_ARGV_TEST(failed, t, test_reserve_wrapped(&t));
+  RUN_ARGV_TEST(failed, t, test_reserve_wrapped_spill(&t));
+  return failed;
+}
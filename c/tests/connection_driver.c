@@ -19,6 +19,7 @@
 
 
 #include "test_handler.h"
+#include "core/engine-internal.h"
 #include <proton/codec.h>
 #include <proton/connection_driver.h>
 #include <proton/connection.h>
@@ -130,6 +131,18 @@ static void test_message_transfer(test_t *t) {
   /* Receive and decode the message */
   pn_delivery_t *dlv = server.handler.delivery;
   TEST_ASSERT(dlv);
+
+  /* Decode in place from the delivery, the data is not consumed */
+  pn_bytes_t view = pn_delivery_bytes_view(dlv);
+  TEST_INT_EQUAL(t, pn_delivery_pending(dlv), view.size);
+  pn_message_t *m3 = pn_message();
+  TEST_INT_EQUAL(t, 0, pn_message_decode(m3, view.start, view.size));
+  pn_data_rewind(pn_message_body(m3));
+  TEST_CHECK(t, pn_data_next(pn_message_body(m3)));
+  TEST_STR_EQUAL(t, "abc", pn_data_get_string(pn_message_body(m3)).start);
+  pn_message_free(m3);
+  TEST_INT_EQUAL(t, view.size, pn_delivery_pending(dlv));
+
   pn_message_t *m2 = pn_message();
   pn_rwbytes_t buf2 = { 0 };
   message_decode(m2, dlv, &buf2);
@@ -221,6 +234,69 @@ static void test_message_stream(test_t *t) {
   test_connection_driver_destroy(&server);
 }
 
+/* Transfer at most max bytes from one driver to another */
+static size_t test_connection_drivers_trickle(test_connection_driver_t *dst, test_connection_driver_t *src, size_t max)
+{
+  pn_bytes_t wb = pn_connection_driver_write_buffer(&src->driver);
+  pn_rwbytes_t rb =  pn_connection_driver_read_buffer(&dst->driver);
+  size_t size = rb.size < wb.size ? rb.size : wb.size;
+  if (size > max) size = max;
+  if (size) {
+    memcpy(rb.start, wb.start, size);
+    pn_connection_driver_write_done(&src->driver, size);
+    pn_connection_driver_read_done(&dst->driver, size);
+  }
+  return size;
+}
+
+/* Send a message bigger than the transport buffers a few bytes at a time,
+   so output is popped and input is consumed part way through the buffers */
+static void test_message_trickle(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_driver_init(&client, t, send_client_handler, NULL);
+  test_connection_driver_init(&server, t, delivery_handler, NULL);
+  pn_transport_set_server(server.driver.transport);
+
+  pn_connection_open(client.driver.connection);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *rcv = server.handler.link;
+  pn_link_t *snd = client.handler.link;
+  pn_link_flow(rcv, 1);
+  test_connection_drivers_run(&client, &server);
+  TEST_HANDLER_EXPECT_LAST(&client.handler, PN_LINK_FLOW);
+
+  pn_message_t *m = pn_message();
+  static char body[100*1024];
+  for (size_t i = 0; i < sizeof(body); ++i) body[i] = (char)i;
+  pn_data_put_binary(pn_message_body(m), pn_bytes(sizeof(body), body));
+  pn_rwbytes_t buf = { 0 };
+  ssize_t size = message_encode(m, &buf);
+  pn_delivery(snd, PN_BYTES_LITERAL(x));
+  TEST_CHECK(t, size == pn_link_send(snd, buf.start, size));
+  TEST_CHECK(t, pn_link_advance(snd));
+
+  static const size_t CHUNK = 77;
+  size_t data;
+  do {
+    test_connection_driver_handle(&client);
+    test_connection_driver_handle(&server);
+    data = test_connection_drivers_trickle(&client, &server, CHUNK) +
+      test_connection_drivers_trickle(&server, &client, CHUNK);
+  } while (data || pn_connection_driver_has_event(&client.driver) || pn_connection_driver_has_event(&server.driver));
+
+  pn_delivery_t *dlv = server.handler.delivery;
+  TEST_ASSERT(dlv);
+  TEST_CHECK(t, !pn_delivery_partial(dlv));
+  TEST_INT_EQUAL(t, size, pn_delivery_pending(dlv));
+  pn_bytes_t view = pn_delivery_bytes_view(dlv);
+  TEST_CHECK(t, view.size == (size_t)size && !memcmp(buf.start, view.start, size));
+
+  pn_message_free(m);
+  free(buf.start);
+  test_connection_driver_destroy(&client);
+  test_connection_driver_destroy(&server);
+}
+
 // Test aborting a delivery
 static void test_message_abort(test_t *t) {
   /* Set up the link, give credit, start the delivery */
@@ -458,6 +534,65 @@ static void test_session_flow_control(test_t *t) {
   test_connection_drivers_destroy(&client, &server);
 }
 
+/* Receive everything available on the current delivery, return the bytes read */
+static size_t recv_all(pn_link_t *rcv) {
+  char buf[1024];
+  size_t total = 0;
+  ssize_t n;
+  while ((n = pn_link_recv(rcv, buf, sizeof(buf))) > 0) total += n;
+  return total;
+}
+
+/* The incoming window is refreshed at the low water mark, before it runs out */
+static void test_session_window_refresh(test_t *t) {
+  test_connection_driver_t client, server;
+  test_connection_drivers_init(t, &client, open_handler, &server, open_handler);
+  const size_t frame = 512, capacity = 8 * frame;
+  char data[9600];
+  memset(data, 'x', sizeof(data));
+
+  pn_transport_set_max_frame(client.driver.transport, frame);
+  pn_connection_open(client.driver.connection);
+  pn_session_t *ssn = pn_session(client.driver.connection);
+  pn_session_set_incoming_capacity(ssn, capacity);
+  TEST_INT_EQUAL(t, 0, pn_session_get_incoming_low_water(ssn));
+  pn_session_open(ssn);
+  pn_link_t *rcv = pn_receiver(ssn, "x");
+  pn_link_open(rcv);
+  pn_link_flow(rcv, 10);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *snd = server.handler.link;
+  TEST_CHECK(t, snd && pn_link_is_sender(snd));
+  TEST_INT_EQUAL(t, 10, pn_link_credit(snd));
+
+  /* Five frames leave three of the eight frame window, below the default low
+     water mark of four. Nothing is refreshed until they are consumed. */
+  pn_delivery(snd, PN_BYTES_LITERAL(a));
+  TEST_INT_EQUAL(t, 2200, pn_link_send(snd, data, 2200));
+  pn_link_advance(snd);
+  test_connection_drivers_run(&client, &server);
+  test_handler_clear(&server.handler, 0);
+  TEST_INT_EQUAL(t, 2200, pn_session_incoming_bytes(ssn));
+  TEST_INT_EQUAL(t, 2200, recv_all(rcv));
+  pn_link_advance(rcv);
+  test_connection_drivers_run(&client, &server);
+  TEST_HANDLER_EXPECT(&server.handler, PN_LINK_FLOW, 0);
+
+  /* A large message never buffers more than the capacity */
+  pn_delivery(snd, PN_BYTES_LITERAL(b));
+  TEST_INT_EQUAL(t, sizeof(data), pn_link_send(snd, data, sizeof(data)));
+  pn_link_advance(snd);
+  size_t received = 0;
+  for (int i = 0; i < 100 && received < sizeof(data); ++i) {
+    test_connection_drivers_run(&client, &server);
+    TEST_CHECK(t, pn_session_incoming_bytes(ssn) <= capacity);
+    received += recv_all(rcv);
+  }
+  TEST_INT_EQUAL(t, sizeof(data), received);
+
+  test_connection_drivers_destroy(&client, &server);
+}
+
 /* Regression test for https://issues.apache.org/jira/browse/PROTON-1832.
    Make sure we error on attempt to re-attach an already-attached link name.
    No crash or memory error.
@@ -577,15 +712,396 @@ static void test_settle_incomplete_receiver(test_t *t) {
   test_connection_driver_destroy(&server);
 }
 
+/* Settle deliveries out of order, so the session's unsettled delivery map
+   has gaps, grows and wraps around.
+*/
+static void test_settle_out_of_order(test_t *t) {
+  enum { N = 200 };
+  test_connection_driver_t client, server;
+  test_connection_drivers_init(t, &client, send_client_handler, &server, open_handler);
+  pn_connection_open(client.driver.connection);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *snd = client.handler.link;
+  pn_link_t *rcv = server.handler.link;
+  pn_delivery_t *sent[2*N], *received[2*N];
+  char data[10] = {0};
+
+  for (int round = 0; round < 2; ++round) {
+    pn_link_flow(rcv, N);
+    test_connection_drivers_run(&client, &server);
+    for (int i = round*N; i < (round+1)*N; ++i) {
+      sent[i] = pn_delivery(snd, pn_dtag((char*)&i, sizeof(i)));
+      pn_link_send(snd, data, sizeof(data));
+      pn_link_advance(snd);
+    }
+    test_connection_drivers_run(&client, &server);
+    for (int i = round*N; i < (round+1)*N; ++i) {
+      received[i] = pn_link_current(rcv);
+      TEST_CHECK(t, received[i]);
+      pn_link_advance(rcv);
+    }
+  }
+  /* Odd deliveries, then the first half of the even ones */
+  for (int i = 1; i < 2*N; i += 2) {
+    pn_delivery_update(received[i], PN_ACCEPTED);
+    pn_delivery_settle(received[i]);
+  }
+  for (int i = 0; i < N; i += 2) {
+    pn_delivery_update(received[i], PN_ACCEPTED);
+    pn_delivery_settle(received[i]);
+  }
+  test_connection_drivers_run(&client, &server);
+  for (int i = 0; i < 2*N; ++i) {
+    bool settled = (i % 2) || i < N;
+    TEST_CHECKF(t, pn_delivery_remote_state(sent[i]) == (settled ? PN_ACCEPTED : 0), "delivery %d", i);
+    TEST_CHECKF(t, pn_delivery_settled(sent[i]) == settled, "delivery %d", i);
+    if (settled) pn_delivery_settle(sent[i]);
+  }
+
+  /* More deliveries after the settled ones, then the rest in reverse order */
+  pn_delivery_t *more[N];
+  pn_link_flow(rcv, N);
+  test_connection_drivers_run(&client, &server);
+  for (int i = 0; i < N; ++i) {
+    more[i] = pn_delivery(snd, pn_dtag((char*)&i, sizeof(i)));
+    pn_link_send(snd, data, sizeof(data));
+    pn_link_advance(snd);
+  }
+  test_connection_drivers_run(&client, &server);
+  for (int i = 0; i < N; ++i) {
+    pn_delivery_t *d = pn_link_current(rcv);
+    TEST_CHECK(t, d);
+    pn_link_advance(rcv);
+    pn_delivery_update(d, PN_RELEASED);
+    pn_delivery_settle(d);
+  }
+  for (int i = 2*N - 2; i >= N; i -= 2) {
+    pn_delivery_update(received[i], PN_REJECTED);
+    pn_delivery_settle(received[i]);
+  }
+  test_connection_drivers_run(&client, &server);
+  for (int i = N; i < 2*N; i += 2) {
+    TEST_CHECKF(t, pn_delivery_remote_state(sent[i]) == PN_REJECTED, "delivery %d", i);
+    TEST_CHECKF(t, pn_delivery_settled(sent[i]), "delivery %d", i);
+  }
+  for (int i = 0; i < N; ++i) {
+    TEST_CHECKF(t, pn_delivery_remote_state(more[i]) == PN_RELEASED, "delivery %d", i);
+    TEST_CHECKF(t, pn_delivery_settled(more[i]), "delivery %d", i);
+  }
+  TEST_COND_EMPTY(t, pn_connection_remote_condition(client.driver.connection));
+  TEST_COND_EMPTY(t, pn_connection_remote_condition(server.driver.connection));
+  test_connection_drivers_destroy(&client, &server);
+}
+
+/* Leave the first deliveries unsettled while many more are settled, so the
+   delivery maps move them aside rather than growing to the whole span.
+*/
+static void test_settle_stragglers(test_t *t) {
+  enum { STRAGGLERS = 3, BATCH = 500, BATCHES = 20 };
+  test_connection_driver_t client, server;
+  test_connection_drivers_init(t, &client, send_client_handler, &server, open_handler);
+  pn_connection_open(client.driver.connection);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *snd = client.handler.link;
+  pn_link_t *rcv = server.handler.link;
+  pn_delivery_t *sent[STRAGGLERS], *received[STRAGGLERS];
+  char data[10] = {0};
+
+  pn_link_flow(rcv, STRAGGLERS);
+  test_connection_drivers_run(&client, &server);
+  for (int i = 0; i < STRAGGLERS; ++i) {
+    sent[i] = pn_delivery(snd, pn_dtag((char*)&i, sizeof(i)));
+    pn_link_send(snd, data, sizeof(data));
+    pn_link_advance(snd);
+  }
+  test_connection_drivers_run(&client, &server);
+  for (int i = 0; i < STRAGGLERS; ++i) {
+    received[i] = pn_link_current(rcv);
+    TEST_CHECK(t, received[i]);
+    pn_link_advance(rcv);
+  }
+
+  for (int b = 0; b < BATCHES; ++b) {
+    test_handler_clear(&client.handler, 0);
+    test_handler_clear(&server.handler, 0);
+    pn_link_flow(rcv, BATCH);
+    test_connection_drivers_run(&client, &server);
+    pn_delivery_t *batch[BATCH];
+    for (int i = 0; i < BATCH; ++i) {
+      batch[i] = pn_delivery(snd, pn_dtag((char*)&i, sizeof(i)));
+      pn_link_send(snd, data, sizeof(data));
+      pn_link_advance(snd);
+    }
+    test_connection_drivers_run(&client, &server);
+    for (int i = 0; i < BATCH; ++i) {
+      pn_delivery_t *d = pn_link_current(rcv);
+      TEST_CHECK(t, d);
+      pn_link_advance(rcv);
+      pn_delivery_update(d, PN_ACCEPTED);
+      pn_delivery_settle(d);
+    }
+    test_connection_drivers_run(&client, &server);
+    for (int i = 0; i < BATCH; ++i) {
+      TEST_CHECKF(t, pn_delivery_settled(batch[i]), "batch %d delivery %d", b, i);
+      pn_delivery_settle(batch[i]);
+    }
+  }
+
+  /* One disposition frame covers the last two stragglers */
+  pn_delivery_update(received[0], PN_RELEASED);
+  pn_delivery_settle(received[0]);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, pn_delivery_remote_state(sent[0]) == PN_RELEASED);
+  TEST_CHECK(t, pn_delivery_settled(sent[0]));
+  TEST_CHECK(t, !pn_delivery_settled(sent[1]));
+  for (int i = 1; i < STRAGGLERS; ++i) {
+    pn_delivery_update(received[i], PN_REJECTED);
+    pn_delivery_settle(received[i]);
+  }
+  test_connection_drivers_run(&client, &server);
+  for (int i = 1; i < STRAGGLERS; ++i) {
+    TEST_CHECKF(t, pn_delivery_remote_state(sent[i]) == PN_REJECTED, "delivery %d", i);
+    TEST_CHECKF(t, pn_delivery_settled(sent[i]), "delivery %d", i);
+  }
+  TEST_COND_EMPTY(t, pn_connection_remote_condition(client.driver.connection));
+  TEST_COND_EMPTY(t, pn_connection_remote_condition(server.driver.connection));
+  test_connection_drivers_destroy(&client, &server);
+}
+
+static bool in_input_buffer(pn_transport_t *transport, pn_bytes_t view) {
+  return view.start >= transport->input_buf &&
+    view.start + view.size <= transport->input_buf + transport->input_size;
+}
+
+/* Single-frame deliveries are read in place on a receiver that asks for it,
+   and copied out when the transport needs its input buffer space back.
+*/
+static void test_input_view(test_t *t) {
+  enum { N = 40, SIZE = 1024 };
+  test_connection_driver_t client, server;
+  test_connection_drivers_init(t, &client, send_client_handler, &server, open_handler);
+  pn_connection_open(client.driver.connection);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *snd = client.handler.link;
+  pn_link_t *rcv = server.handler.link;
+  pn_transport_t *transport = server.driver.transport;
+  char data[SIZE];
+
+  /* Off by default */
+  TEST_CHECK(t, !pn_link_get_input_view(rcv));
+  pn_link_flow(rcv, 1);
+  test_connection_drivers_run(&client, &server);
+  pn_delivery(snd, pn_dtag("a", 1));
+  pn_link_send(snd, "copied", 6);
+  pn_link_advance(snd);
+  test_connection_drivers_run(&client, &server);
+  pn_delivery_t *d = pn_link_current(rcv);
+  TEST_CHECK(t, d && !in_input_buffer(transport, pn_delivery_bytes_view(d)));
+  pn_link_advance(rcv);
+  pn_delivery_settle(d);
+
+  pn_link_set_input_view(rcv, true);
+  TEST_CHECK(t, pn_link_get_input_view(rcv));
+  pn_link_flow(rcv, N);
+  test_connection_drivers_run(&client, &server);
+  for (int i = 0; i < N; ++i) {
+    memset(data, 'a' + i % 26, SIZE);
+    pn_delivery(snd, pn_dtag((char*)&i, sizeof(i)));
+    pn_link_send(snd, data, SIZE);
+    pn_link_advance(snd);
+    if (i == 0) test_connection_drivers_run(&client, &server);
+  }
+
+  /* The first is read in place until the others need the space */
+  d = pn_link_current(rcv);
+  TEST_CHECK(t, d && in_input_buffer(transport, pn_delivery_bytes_view(d)));
+  TEST_SIZE_EQUAL(t, SIZE, pn_delivery_pending(d));
+  TEST_SIZE_EQUAL(t, SIZE, pn_session_incoming_bytes(server.handler.session));
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, !in_input_buffer(transport, pn_delivery_bytes_view(d)));
+
+  for (int i = 0; i < N; ++i) {
+    d = pn_link_current(rcv);
+    TEST_CHECKF(t, d, "delivery %d", i);
+    pn_bytes_t view = pn_delivery_bytes_view(d);
+    memset(data, 'a' + i % 26, SIZE);
+    TEST_CHECKF(t, view.size == SIZE && !memcmp(view.start, data, SIZE), "delivery %d", i);
+    if (i == N - 1) {
+      /* Receiving copies it out */
+      TEST_CHECK(t, in_input_buffer(transport, view));
+      char buf[SIZE];
+      TEST_INT_EQUAL(t, SIZE, pn_link_recv(rcv, buf, SIZE));
+      TEST_CHECK(t, !memcmp(buf, data, SIZE));
+    }
+    pn_link_advance(rcv);
+    pn_delivery_settle(d);
+  }
+  TEST_SIZE_EQUAL(t, 0, pn_session_incoming_bytes(server.handler.session));
+  TEST_COND_EMPTY(t, pn_connection_remote_condition(client.driver.connection));
+  TEST_COND_EMPTY(t, pn_connection_remote_condition(server.driver.connection));
+  test_connection_drivers_destroy(&client, &server);
+}
+
+/* Move up to max bytes of the src output segments to dst */
+static size_t xfer_segments(test_connection_driver_t *dst, test_connection_driver_t *src, size_t max) {
+  pn_bytes_t segments[4];
+  size_t count = pn_connection_driver_write_segments(&src->driver, segments, 4);
+  pn_rwbytes_t rb = pn_connection_driver_read_buffer(&dst->driver);
+  size_t size = 0;
+  for (size_t i = 0; i < count && size < max && size < rb.size; ++i) {
+    size_t n = segments[i].size;
+    if (n > max - size) n = max - size;
+    if (n > rb.size - size) n = rb.size - size;
+    memcpy(rb.start + size, segments[i].start, n);
+    size += n;
+  }
+  if (size) {
+    pn_connection_driver_write_done(&src->driver, size);
+    pn_connection_driver_read_done(&dst->driver, size);
+  }
+  return size;
+}
+
+/* Large payloads are written in place from the sender's buffer as output
+   segments, and copied in order by the copy-based write buffer */
+static void test_write_segments(test_t *t) {
+  enum { N = 4, SIZE = 3000 };
+  test_connection_driver_t client, server;
+  test_connection_drivers_init(t, &client, send_client_handler, &server, open_handler);
+  pn_transport_set_max_frame(server.driver.transport, 1024); /* Split payloads into frames */
+  pn_connection_open(client.driver.connection);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *snd = client.handler.link;
+  pn_link_t *rcv = server.handler.link;
+  char data[SIZE];
+
+  pn_link_flow(rcv, 2*N);
+  test_connection_drivers_run(&client, &server);
+  for (int i = 0; i < 2*N; ++i) {
+    memset(data, 'a' + i, SIZE);
+    pn_delivery(snd, pn_dtag((char*)&i, sizeof(i)));
+    pn_link_send(snd, data, SIZE);
+    pn_link_advance(snd);
+    if (i == N - 1) {
+      /* The first half goes through the copy-based write buffer */
+      test_connection_drivers_run(&client, &server);
+    }
+  }
+
+  /* The rest are segments, each frame body in place from its delivery */
+  pn_bytes_t segments[2];
+  TEST_SIZE_EQUAL(t, 2, pn_connection_driver_write_segments(&client.driver, segments, 2));
+  TEST_CHECK(t, segments[0].size < 100);
+  TEST_CHECK(t, segments[1].size > 900 && segments[1].size < 1024);
+  memset(data, 'a' + N, SIZE);
+  TEST_CHECK(t, !memcmp(segments[1].start, data, segments[1].size));
+
+  /* Written in pieces that do not line up with the segments */
+  while (xfer_segments(&server, &client, 700)) {
+    test_connection_driver_handle(&server);
+  }
+  test_connection_drivers_run(&client, &server);
+
+  for (int i = 0; i < 2*N; ++i) {
+    pn_delivery_t *d = pn_link_current(rcv);
+    TEST_CHECKF(t, d && !pn_delivery_partial(d), "delivery %d", i);
+    if (!d) break;
+    char buf[SIZE];
+    memset(data, 'a' + i, SIZE);
+    TEST_INT_EQUAL(t, SIZE, pn_link_recv(rcv, buf, SIZE));
+    TEST_CHECKF(t, !memcmp(buf, data, SIZE), "delivery %d", i);
+    pn_link_advance(rcv);
+    pn_delivery_settle(d);
+  }
+  TEST_COND_EMPTY(t, pn_connection_remote_condition(client.driver.connection));
+  TEST_COND_EMPTY(t, pn_connection_remote_condition(server.driver.connection));
+  test_connection_drivers_destroy(&client, &server);
+}
+
+/* Dispositions settled in any order are sent as one frame per range of ids */
+static void test_disposition_ranges(test_t *t) {
+  enum { N = 12 };
+  test_connection_driver_t client, server;
+  test_connection_drivers_init(t, &client, send_client_handler, &server, open_handler);
+  pn_connection_open(client.driver.connection);
+  test_connection_drivers_run(&client, &server);
+  pn_link_t *snd = client.handler.link;
+  pn_link_t *rcv = server.handler.link;
+  pn_transport_t *st = server.driver.transport;
+  pn_delivery_t *sent[N], *received[N];
+  char data[10] = {0};
+
+  pn_link_flow(rcv, N);
+  test_connection_drivers_run(&client, &server);
+  for (int i = 0; i < N; ++i) {
+    sent[i] = pn_delivery(snd, pn_dtag((char*)&i, sizeof(i)));
+    pn_link_send(snd, data, sizeof(data));
+    pn_link_advance(snd);
+  }
+  test_connection_drivers_run(&client, &server);
+  for (int i = 0; i < N; ++i) {
+    received[i] = pn_link_current(rcv);
+    pn_link_advance(rcv);
+  }
+
+  uint64_t frames = pn_transport_get_frames_output(st);
+  int order[] = { 3, 1, 0, 2, 9, 7, 6 };
+  for (size_t i = 0; i < sizeof(order)/sizeof(*order); ++i) {
+    pn_delivery_update(received[order[i]], PN_ACCEPTED);
+    pn_delivery_settle(received[order[i]]);
+  }
+  test_connection_drivers_run(&client, &server);
+  TEST_INT_EQUAL(t, 3, pn_transport_get_frames_output(st) - frames); /* 0-3, 6-7, 9 */
+  for (int i = 0; i < N; ++i) {
+    bool settled = i <= 3 || i == 6 || i == 7 || i == 9;
+    TEST_CHECKF(t, pn_delivery_settled(sent[i]) == settled, "delivery %d", i);
+  }
+
+  /* Held back till the transport is ticked after the delay */
+  pn_transport_set_disposition_delay(st, 100);
+  pn_delivery_settle(received[4]);
+  pn_delivery_settle(received[5]);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, !pn_delivery_settled(sent[4]));
+  TEST_INT_EQUAL(t, 1100, pn_transport_tick(st, 1000));
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, !pn_delivery_settled(sent[4]));
+  pn_transport_tick(st, 1100);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, pn_delivery_settled(sent[4]));
+  TEST_CHECK(t, pn_delivery_settled(sent[5]));
+
+  /* Sent without waiting when there are too many ranges */
+  pn_transport_set_max_disposition_ranges(st, 1);
+  pn_delivery_settle(received[8]);
+  pn_delivery_settle(received[10]);
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, pn_delivery_settled(sent[8]));
+  TEST_CHECK(t, !pn_delivery_settled(sent[10]));
+
+  /* Pending dispositions are sent when the session ends */
+  pn_session_close(pn_link_session(rcv));
+  test_connection_drivers_run(&client, &server);
+  TEST_CHECK(t, pn_delivery_settled(sent[10]));
+  test_connection_drivers_destroy(&client, &server);
+}
+
 int main(int argc, char **argv) {
   int failed = 0;
   RUN_ARGV_TEST(failed, t, test_message_transfer(&t));
   RUN_ARGV_TEST(failed, t, test_message_stream(&t));
+  RUN_ARGV_TEST(failed, t, test_message_trickle(&t));
   RUN_ARGV_TEST(failed, t, test_message_abort(&t));
   RUN_ARGV_TEST(failed, t, test_message_abort_mixed(&t));
   RUN_ARGV_TEST(failed, t, test_session_flow_control(&t));
+  RUN_ARGV_TEST(failed, t, test_session_window_refresh(&t));
   RUN_ARGV_TEST(failed, t, test_duplicate_link_server(&t));
   RUN_ARGV_TEST(failed, t, test_duplicate_link_client(&t));
   RUN_ARGV_TEST(failed, t, test_settle_incomplete_receiver(&t));
+  RUN_ARGV_TEST(failed, t, test_settle_out_of_order(&t));
+  RUN_ARGV_TEST(failed, t, test_settle_stragglers(&t));
+  RUN_ARGV_TEST(failed, t, test_input_view(&t));
+  RUN_ARGV_TEST(failed, t, test_write_segments(&t));
+  RUN_ARGV_TEST(failed, t, test_disposition_ranges(&t));
   return failed;
 }
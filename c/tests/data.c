@@ -27,6 +27,7 @@
 #include <proton/codec.h>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
 // Make sure we can grow the capacity of a pn_data_t all the way to the max and we stop there.
 static void test_grow(void)
@@ -96,9 +97,96 @@ static void test_multiple(test_t *t) {
   pn_data_free(src);
 }
 
+// Interned strings must keep their address as more are added, and clearing
+// the data must reuse the same storage rather than allocate more.
+static void test_intern(test_t *t) {
+  pn_data_t *data = pn_data(0);
+  char big[1000];
+  memset(big, 'x', sizeof(big));
+  pn_data_put_list(data);
+  pn_data_enter(data);
+  pn_data_put_string(data, PN_BYTES_LITERAL(first));
+  pn_data_rewind(data);
+  pn_data_next(data);
+  pn_data_enter(data);
+  pn_data_next(data);
+  const char *first = pn_data_get_string(data).start;
+  pn_data_exit(data);
+  pn_data_enter(data);
+  pn_data_next(data);
+  for (int i = 0; i < 1000; ++i) {
+    pn_data_put_binary(data, pn_bytes(i % sizeof(big), big));
+  }
+  pn_data_rewind(data);
+  pn_data_next(data);
+  pn_data_enter(data);
+  pn_data_next(data);
+  pn_bytes_t s = pn_data_get_string(data);
+  TEST_CHECK(t, s.start == first);
+  TEST_CHECK(t, s.size == 5 && !strcmp(s.start, "first"));
+  for (int i = 0; i < 1000; ++i) {
+    TEST_CHECK(t, pn_data_next(data));
+    TEST_CHECK(t, pn_data_get_binary(data).size == i % sizeof(big));
+  }
+
+  pn_data_clear(data);
+  pn_data_put_string(data, PN_BYTES_LITERAL(again));
+  pn_data_rewind(data);
+  pn_data_next(data);
+  TEST_CHECK(t, pn_data_get_string(data).start == first);
+  TEST_INSPECT(t, "\"again\"", data);
+  pn_data_free(data);
+}
+
+// Lists, maps and arrays use their smallest encoding, and the size is known
+// before encoding.
+static void test_encode_small(test_t *t) {
+  pn_data_t *data = pn_data(0);
+  char buf[2048];
+  pn_data_fill(data, "DL[Is]", 0x70, 1, "x");
+  ssize_t size = pn_data_encoded_size(data);
+  TEST_CHECK(t, size == 11);
+  TEST_CHECK(t, pn_data_encoded_size(data) == size);
+  TEST_CHECK(t, pn_data_encode(data, buf, size - 1) == PN_OVERFLOW);
+  TEST_CHECK(t, pn_data_encode(data, buf, sizeof(buf)) == size);
+  const char expect[] = {0x00, 0x53, 0x70, (char)0xc0, 0x06, 0x02, 0x52, 0x01, (char)0xa3, 0x01, 'x'};
+  TEST_CHECK(t, !memcmp(buf, expect, sizeof(expect)));
+
+  // Trailing nulls in a described list are dropped, leaving list0
+  pn_data_clear(data);
+  pn_data_fill(data, "DL[nn]", 0x70);
+  TEST_CHECK(t, pn_data_encode(data, buf, sizeof(buf)) == 4);
+  TEST_CHECK(t, buf[3] == 0x45);
+
+  // Too big for list8, and an array of lists keeps the 32 bit encoding
+  pn_data_clear(data);
+  pn_data_put_list(data);
+  pn_data_enter(data);
+  char big[300] = {0};
+  pn_data_put_binary(data, pn_bytes(sizeof(big), big));
+  pn_data_put_array(data, false, PN_LIST);
+  pn_data_enter(data);
+  pn_data_put_list(data);
+  pn_data_exit(data);
+  pn_data_exit(data);
+  size = pn_data_encoded_size(data);
+  TEST_CHECK(t, size == 9 + 5 + 300 + 3 + 1 + 8);
+  TEST_CHECK(t, pn_data_encode(data, buf, sizeof(buf)) == size);
+  TEST_CHECK(t, (uint8_t)buf[0] == 0xd0);
+  TEST_CHECK(t, (uint8_t)buf[9 + 5 + 300] == 0xe0);
+
+  pn_data_t *copy = pn_data(0);
+  TEST_CHECK(t, pn_data_decode(copy, buf, size) == size);
+  TEST_CHECK(t, pn_data_encoded_size(copy) == size);
+  pn_data_free(copy);
+  pn_data_free(data);
+}
+
 int main(int argc, char **argv) {
   int failed = 0;
   test_grow();
   RUN_ARGV_TEST(failed, t, test_multiple(&t));
+  RUN_ARGV_TEST(failed, t, test_intern(&t));
+  RUN_ARGV_TEST(failed, t, test_encode_small(&t));
   return failed;
 }
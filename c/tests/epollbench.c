@@ -0,0 +1,317 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/* Measure the epoll_wait() calls the epoll proactor makes per event batch.
+
+   CONNECTIONS connections are opened and left idle. Then for ROUNDS rounds
+   a burst of ACTIVE of them, in turn, each open and close a session while
+   WORKERS threads process proactor events. Every round waits for all of
+   its sessions to close, so each round is a burst of socket activity
+   between idle periods.
+
+   epoll_wait() is counted by interposing on the libc function, so this is
+   only built with the epoll proactor.
+*/
+
+#define _GNU_SOURCE
+
+#include "thread.h"
+
+#include <proton/connection.h>
+#include <proton/event.h>
+#include <proton/import_export.h>
+#include <proton/listener.h>
+#include <proton/netaddr.h>
+#include <proton/proactor.h>
+#include <proton/session.h>
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+
+#undef NDEBUG                   /* Enable assert even in release builds */
+#include <assert.h>
+
+static const int default_connections = 1000;
+static const int default_active = 100;
+static const int default_rounds = 1000;
+static const int default_workers = 4;
+
+typedef int epoll_wait_fn(int, struct epoll_event *, int, int);
+static epoll_wait_fn *real_epoll_wait;
+static long epoll_calls;
+static long epoll_events;
+
+/* Exported so the proactor library calls this instead of the libc function */
+PN_EXPORT int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout) {
+  int n = real_epoll_wait(epfd, events, maxevents, timeout);
+  __atomic_fetch_add(&epoll_calls, 1, __ATOMIC_RELAXED);
+  if (n > 0) __atomic_fetch_add(&epoll_events, n, __ATOMIC_RELAXED);
+  return n;
+}
+
+typedef struct bench {
+  pn_proactor_t *proactor;
+  pn_listener_t *listener;
+  pn_connection_t **connections; /* Client side of each connection */
+  int n_connections;
+  int active;
+  long batches;                 /* Batches returned by pn_proactor_wait() */
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int opened;                   /* Client connections with remote open */
+  int closed;                   /* Client transports closed */
+  int finished;                 /* Client sessions closed in this round */
+  bool done;                    /* Rounds have finished, close on next wake */
+} bench;
+
+static bool is_client(pn_connection_t *c) {
+  return pn_connection_get_context(c) != NULL;
+}
+
+static void signal_count(bench *b, int *count, int target) {
+  pthread_mutex_lock(&b->lock);
+  if (++*count == target) pthread_cond_signal(&b->cond);
+  pthread_mutex_unlock(&b->lock);
+}
+
+static void wait_count(bench *b, int *count, int target) {
+  pthread_mutex_lock(&b->lock);
+  while (*count < target) pthread_cond_wait(&b->cond, &b->lock);
+  pthread_mutex_unlock(&b->lock);
+}
+
+static void *worker_thread(void *void_b) {
+  bench *b = (bench*)void_b;
+  bool finished = false;
+  while (!finished) {
+    pn_event_batch_t *batch = pn_proactor_wait(b->proactor);
+    __atomic_fetch_add(&b->batches, 1, __ATOMIC_RELAXED);
+    pn_event_t *e;
+    while ((e = pn_event_batch_next(batch))) {
+      pn_connection_t *c = pn_event_connection(e);
+      pn_session_t *s = pn_event_session(e);
+      switch (pn_event_type(e)) {
+
+       case PN_LISTENER_ACCEPT:
+        pn_listener_accept2(pn_event_listener(e), NULL, NULL);
+        break;
+
+       case PN_CONNECTION_REMOTE_OPEN:
+        if (is_client(c)) {
+          signal_count(b, &b->opened, b->n_connections);
+        } else {
+          pn_connection_open(c);
+        }
+        break;
+
+       case PN_CONNECTION_WAKE: {
+         pthread_mutex_lock(&b->lock);
+         bool done = b->done;
+         pthread_mutex_unlock(&b->lock);
+         if (done) {
+           pn_connection_close(c);
+         } else {
+           pn_session_open(pn_session(c));
+         }
+         break;
+       }
+
+       case PN_SESSION_REMOTE_OPEN:
+        if (is_client(pn_session_connection(s))) {
+          pn_session_close(s);
+        } else {
+          pn_session_open(s);
+        }
+        break;
+
+       case PN_SESSION_REMOTE_CLOSE:
+        if (is_client(pn_session_connection(s))) {
+          pn_session_free(s);
+          signal_count(b, &b->finished, b->active);
+        } else {
+          pn_session_close(s);
+          pn_session_free(s);
+        }
+        break;
+
+       case PN_CONNECTION_REMOTE_CLOSE:
+        pn_connection_close(c);
+        break;
+
+       case PN_TRANSPORT_CLOSED:
+        if (c && is_client(c)) {
+          pthread_mutex_lock(&b->lock);
+          if (++b->closed == b->n_connections) pn_listener_close(b->listener);
+          pthread_mutex_unlock(&b->lock);
+        }
+        break;
+
+       case PN_PROACTOR_INACTIVE:
+       case PN_PROACTOR_INTERRUPT:
+        finished = true;
+        pn_proactor_interrupt(b->proactor); /* Pass it on to the next worker */
+        break;
+
+       default:
+        break;
+      }
+    }
+    pn_proactor_done(b->proactor, batch);
+  }
+  return NULL;
+}
+
+static void usage(const char **argv, const char **arg) {
+  fprintf(stderr, "usage: %s [options]\n", argv[0]);
+  fprintf(stderr, "  -connections CONNECTIONS: open connections (default %d)\n", default_connections);
+  fprintf(stderr, "  -active ACTIVE: connections active in each round (default %d)\n", default_active);
+  fprintf(stderr, "  -rounds ROUNDS: bursts of activity (default %d)\n", default_rounds);
+  fprintf(stderr, "  -workers WORKERS: threads processing proactor events (default %d)\n", default_workers);
+  fprintf(stderr, "\nbad argument: %s\n", *arg);
+  exit(1);
+}
+
+int main(int argc, const char* argv[]) {
+  const char **arg = argv + 1;
+  const char **end = argv + argc;
+  int rounds = default_rounds;
+  int n_workers = default_workers;
+  bench b;
+  memset(&b, 0, sizeof(b));
+  b.n_connections = default_connections;
+  b.active = default_active;
+
+  while (arg < end) {
+    if (!strcmp(*arg, "-connections") && ++arg < end) {
+      b.n_connections = atoi(*arg);
+      if (b.n_connections <= 0) usage(argv, arg);
+    }
+    else if (!strcmp(*arg, "-active") && ++arg < end) {
+      b.active = atoi(*arg);
+      if (b.active <= 0) usage(argv, arg);
+    }
+    else if (!strcmp(*arg, "-rounds") && ++arg < end) {
+      rounds = atoi(*arg);
+      if (rounds <= 0) usage(argv, arg);
+    }
+    else if (!strcmp(*arg, "-workers") && ++arg < end) {
+      n_workers = atoi(*arg);
+      if (n_workers <= 0) usage(argv, arg);
+    }
+    else {
+      usage(argv, arg);
+    }
+    ++arg;
+  }
+  if (b.active > b.n_connections) b.active = b.n_connections;
+
+  *(void**)&real_epoll_wait = dlsym(RTLD_NEXT, "epoll_wait"); /* As POSIX suggests for function pointers */
+  assert(real_epoll_wait);
+  pthread_mutex_init(&b.lock, NULL);
+  pthread_cond_init(&b.cond, NULL);
+  b.proactor = pn_proactor();
+  assert(b.proactor);
+
+  /* Listen and wait for the address before connecting */
+  b.listener = pn_listener();
+  pn_proactor_listen(b.proactor, b.listener, "127.0.0.1:0", b.n_connections);
+  bool listening = false;
+  while (!listening) {
+    pn_event_batch_t *batch = pn_proactor_wait(b.proactor);
+    pn_event_t *e;
+    while ((e = pn_event_batch_next(batch))) {
+      if (pn_event_type(e) == PN_LISTENER_OPEN) {
+        listening = true;
+      } else if (pn_event_type(e) == PN_LISTENER_CLOSE) {
+        fprintf(stderr, "listen failed: %s\n",
+                pn_condition_get_description(pn_listener_condition(b.listener)));
+        exit(1);
+      }
+    }
+    pn_proactor_done(b.proactor, batch);
+  }
+  char host[PN_MAX_ADDR], port[PN_MAX_ADDR], addr[PN_MAX_ADDR];
+  pn_netaddr_host_port(pn_listener_addr(b.listener), host, sizeof(host), port, sizeof(port));
+  pn_proactor_addr(addr, sizeof(addr), host, port);
+
+  pthread_t *workers = (pthread_t*)calloc(n_workers, sizeof(pthread_t));
+  for (int i = 0; i < n_workers; ++i) {
+    pthread_create(&workers[i], NULL, worker_thread, &b);
+  }
+
+  b.connections = (pn_connection_t**)calloc(b.n_connections, sizeof(pn_connection_t*));
+  for (int i = 0; i < b.n_connections; ++i) {
+    b.connections[i] = pn_connection();
+    pn_connection_set_context(b.connections[i], &b);
+    pn_proactor_connect2(b.proactor, b.connections[i], NULL, addr);
+  }
+  wait_count(&b, &b.opened, b.n_connections);
+
+  /* Time the rounds */
+  __atomic_store_n(&epoll_calls, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&epoll_events, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&b.batches, 0, __ATOMIC_RELAXED);
+  pn_millis_t start = pn_proactor_now();
+  int next = 0;
+  for (int r = 0; r < rounds; ++r) {
+    pthread_mutex_lock(&b.lock);
+    b.finished = 0;
+    pthread_mutex_unlock(&b.lock);
+    for (int i = 0; i < b.active; ++i) {
+      pn_connection_wake(b.connections[next]);
+      next = (next + 1) % b.n_connections;
+    }
+    wait_count(&b, &b.finished, b.active);
+  }
+  pn_millis_t elapsed = pn_proactor_now() - start;
+  long calls = __atomic_load_n(&epoll_calls, __ATOMIC_RELAXED);
+  long events = __atomic_load_n(&epoll_events, __ATOMIC_RELAXED);
+  long batches = __atomic_load_n(&b.batches, __ATOMIC_RELAXED);
+
+  /* Close the connections with a final wake, then stop the workers */
+  pthread_mutex_lock(&b.lock);
+  b.done = true;
+  pthread_mutex_unlock(&b.lock);
+  for (int i = 0; i < b.n_connections; ++i) {
+    pn_connection_wake(b.connections[i]);
+  }
+  for (int i = 0; i < n_workers; ++i) {
+    pthread_join(workers[i], NULL);
+  }
+
+  if (elapsed == 0) elapsed = 1;
+  if (batches == 0) batches = 1;
+  if (calls == 0) calls = 1;
+  printf("connections=%d, active=%d, workers=%d: %d rounds in %u ms, %ld batches, "
+         "%ld epoll_wait calls, %.2f calls/batch, %.2f events/call\n",
+         b.n_connections, b.active, n_workers, rounds, (unsigned)elapsed, batches,
+         calls, (double)calls / batches, (double)events / calls);
+
+  free(workers);
+  free(b.connections);
+  pn_proactor_free(b.proactor);
+  pthread_cond_destroy(&b.cond);
+  pthread_mutex_destroy(&b.lock);
+  return 0;
+}
@@ -96,6 +96,25 @@ static void test_event_incref(bool eventfirst) {
   }
 }
 
+PN_HANDLE(TEST_KEY)
+
+static void test_event_attachments(void) {
+  SETUP_COLLECTOR;
+  pn_record_t *record = pn_event_attachments(event);
+  assert(record);
+  assert(pn_event_attachments(event) == record);
+  pn_record_def(record, TEST_KEY, PN_VOID);
+  pn_record_set(record, TEST_KEY, collector);
+  assert(pn_record_get(record, TEST_KEY) == collector);
+  pn_collector_pop(collector);
+  void *obj2 = pn_class_new(PN_OBJECT, 0);
+  pn_event_t *event2 = pn_collector_put(collector, PN_OBJECT, obj2, (pn_event_type_t) 0);
+  pn_decref(obj2);
+  assert(event2 == event);
+  assert(!pn_record_has(pn_event_attachments(event2), TEST_KEY));
+  pn_free(collector);
+}
+
 int main(int argc, char **argv)
 {
   test_collector();
@@ -105,5 +124,6 @@ int main(int argc, char **argv)
   test_collector_pool();
   test_event_incref(true);
   test_event_incref(false);
+  test_event_attachments();
   return 0;
 }
@@ -21,6 +21,8 @@
 
 #include "test_tools.h"
 
+#include "core/message-internal.h"
+
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -87,10 +89,146 @@ static void test_inferred(test_t *t) {
   pn_message_free(dst);
 }
 
+static void test_decode_lazy(test_t *t) {
+  pn_message_t *src = pn_message();
+  pn_message_t *dst = pn_message();
+  pn_message_t *check = pn_message();
+
+  pn_message_set_address(src, "queue");
+  pn_message_set_ttl(src, 1000);
+  pn_data_put_map(pn_message_properties(src));
+  pn_data_enter(pn_message_properties(src));
+  pn_data_put_string(pn_message_properties(src), PN_BYTES_LITERAL(key));
+  pn_data_put_int(pn_message_properties(src), 42);
+  pn_data_put_binary(pn_message_body(src), PN_BYTES_LITERAL(body));
+  pn_message_set_inferred(src, true);
+
+  pn_rwbytes_t buf = { 0 };
+  ssize_t size = pn_message_encode2(src, &buf);
+  TEST_CHECK(t, size > 0);
+  TEST_INT_EQUAL(t, 0, pn_message_decode_lazy(dst, buf.start, size));
+  memset(buf.start, 0, size);   /* The message has its own copy */
+
+  /* Untouched, the message is encoded as it was decoded */
+  pn_rwbytes_t out = { 0 };
+  TEST_INT_EQUAL(t, size, pn_message_encode2(dst, &out));
+
+  /* Sections are decoded on access */
+  TEST_STR_EQUAL(t, "queue", pn_message_get_address(dst));
+  TEST_INT_EQUAL(t, 1000, pn_message_get_ttl(dst));
+  pn_message_set_durable(dst, true);
+  pn_message_set_address(dst, "other");
+
+  ssize_t size2 = pn_message_encode2(dst, &out);
+  TEST_CHECK(t, size2 > 0);
+  TEST_INT_EQUAL(t, 0, pn_message_decode(check, out.start, size2));
+  TEST_STR_EQUAL(t, "other", pn_message_get_address(check));
+  TEST_CHECK(t, pn_message_is_durable(check));
+  TEST_INT_EQUAL(t, 1000, pn_message_get_ttl(check));
+  TEST_CHECK(t, pn_message_is_inferred(check));
+  TEST_INSPECT(t, "{\"key\"=42}", pn_message_properties(check));
+  TEST_INSPECT(t, "b\"body\"", pn_message_body(check));
+
+  /* Malformed sections fall back to eager decoding */
+  TEST_CHECK(t, pn_message_decode_lazy(dst, "\x00\x53", 2) != 0);
+
+  free(buf.start);
+  free(out.start);
+  pn_message_free(src);
+  pn_message_free(dst);
+  pn_message_free(check);
+}
+
+static void test_pass_through(test_t *t) {
+  /* A body that pn_message_encode would encode as str8 */
+  static const char body[] = "\x00\x53\x77\xb1\x00\x00\x00\x05hello";
+  const size_t body_size = sizeof(body) - 1;
+  pn_message_t *msg = pn_message();
+  char buf[256];
+  size_t size = sizeof(buf);
+
+  TEST_INT_EQUAL(t, 0, pn_message_decode(msg, body, body_size));
+  TEST_INSPECT(t, "\"hello\"", pn_message_body(msg));
+  pn_message_set_ttl(msg, 1000);
+
+  /* Reading the body does not change it, so its bytes are copied */
+  TEST_INT_EQUAL(t, 0, pn_message_encode(msg, buf, &size));
+  TEST_CHECK(t, size > body_size);
+  TEST_CHECK(t, !memcmp(buf + size - body_size, body, body_size));
+
+  /* Changing it means encoding it again */
+  pn_data_t *data = pn_message_body(msg);
+  pn_data_clear(data);
+  pn_data_put_string(data, PN_BYTES_LITERAL(hello));
+  size = sizeof(buf);
+  TEST_INT_EQUAL(t, 0, pn_message_encode(msg, buf, &size));
+  TEST_CHECK(t, !memcmp(buf + size - 10, "\x00\x53\x77\xa1\x05hello", 10));
+  TEST_INT_EQUAL(t, 0, pn_message_decode(msg, buf, size));
+  TEST_INT_EQUAL(t, 1000, pn_message_get_ttl(msg));
+
+  pn_message_free(msg);
+}
+
+/* A freed message may be reused, it must come back empty */
+static void test_reuse(test_t *t) {
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, "queue");
+  pn_message_set_durable(msg, true);
+  pn_data_put_int(pn_message_properties(msg), 1);
+  pn_data_put_string(pn_message_body(msg), PN_BYTES_LITERAL(hello));
+  TEST_CHECK(t, pn_message_decode(msg, "\x00\x53", 2) != 0);
+  pn_message_free(msg);
+
+  msg = pn_message();
+  TEST_CHECK(t, pn_message_get_address(msg) == NULL);
+  TEST_CHECK(t, !pn_message_is_durable(msg));
+  TEST_INT_EQUAL(t, 0, pn_data_size(pn_message_properties(msg)));
+  TEST_INT_EQUAL(t, 0, pn_data_size(pn_message_body(msg)));
+  TEST_INT_EQUAL(t, 0, pn_message_errno(msg));
+  pn_message_free(msg);
+}
+
+/* A message reused to receive doesn't keep a large message's copy */
+static void test_trim(test_t *t) {
+  pn_message_t *msg = pn_message();
+  pn_rwbytes_t buf = { 0 };
+  pn_data_put_string(pn_message_body(msg), PN_BYTES_LITERAL(hello));
+  ssize_t size = pn_message_encode2(msg, &buf);
+  TEST_CHECK(t, size > 0);
+  TEST_INT_EQUAL(t, 0, pn_message_decode_lazy(msg, buf.start, size));
+  TEST_CHECK(t, !pni_message_trim(msg));
+  TEST_INSPECT(t, "\"hello\"", pn_message_body(msg));
+
+  const size_t big = 100*1024;
+  char *body = (char*)calloc(big, 1);
+  pn_data_clear(pn_message_body(msg));
+  pn_data_put_binary(pn_message_body(msg), pn_bytes(big, body));
+  size = pn_message_encode2(msg, &buf);
+  TEST_CHECK(t, size > (ssize_t)big);
+  TEST_INT_EQUAL(t, 0, pn_message_decode_lazy(msg, buf.start, size));
+  TEST_CHECK(t, pni_message_trim(msg));
+  TEST_INT_EQUAL(t, 0, pn_data_size(pn_message_body(msg)));
+
+  /* Still usable */
+  TEST_INT_EQUAL(t, 0, pn_message_decode_lazy(msg, buf.start, size));
+  pn_data_t *data = pn_message_body(msg);
+  pn_data_rewind(data);
+  TEST_CHECK(t, pn_data_next(data));
+  TEST_SIZE_EQUAL(t, big, pn_data_get_binary(data).size);
+
+  free(body);
+  free(buf.start);
+  pn_message_free(msg);
+}
+
 int main(int argc, char **argv)
 {
   int failed = 0;
   RUN_ARGV_TEST(failed, t, test_overflow_error(&t));
   RUN_ARGV_TEST(failed, t, test_inferred(&t));
-  return 0;
+  RUN_ARGV_TEST(failed, t, test_decode_lazy(&t));
+  RUN_ARGV_TEST(failed, t, test_pass_through(&t));
+  RUN_ARGV_TEST(failed, t, test_reuse(&t));
+  RUN_ARGV_TEST(failed, t, test_trim(&t));
+  return failed;
 }
@@ -689,6 +689,39 @@ static void test_string_addf(void)
   pn_free(str);
 }
 
+static void test_string_grow(void)
+{
+  char expected[128];
+  pn_string_t *str = pn_string("");
+  for (int i = 0; i < 100; i++) {
+    expected[i] = 'a' + i % 26;
+    expected[i + 1] = '\0';
+    int err = pn_string_addf(str, "%c", expected[i]);
+    assert(err == 0);
+    assert(pn_string_size(str) == (size_t) i + 1);
+    assert(equals(pn_string_get(str), expected));
+  }
+  pn_string_t *copy = pn_string(NULL);
+  pn_string_copy(copy, str);
+  assert(!pn_compare(str, copy));
+  pn_string_set(str, "short");
+  assert(equals(pn_string_get(str), "short"));
+  pn_free(str);
+  pn_free(copy);
+}
+
+static void test_object_cache(void)
+{
+  pn_object_cache_flush();
+  pn_string_t *str = pn_string("cached");
+  void *first = str;
+  pn_free(str);
+  str = pn_string("cached");
+  assert((void *) str == first);
+  pn_free(str);
+  pn_object_cache_flush();
+}
+
 static void test_map_iteration(int n)
 {
   pn_list_t *pairs = pn_list(PN_OBJECT, 2*n);
@@ -1088,6 +1121,8 @@ int main(int argc, char **argv)
 
   test_string_format();
   test_string_addf();
+  test_string_grow();
+  test_object_cache();
 
   test_build_list();
   test_build_map();
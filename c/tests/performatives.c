@@ -0,0 +1,425 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+/*
+ * The TRANSFER, FLOW and DISPOSITION emitters and consumers must agree with
+ * the pn_data_t path they replace: emitters byte for byte with pn_data_fill()
+ * and pn_data_encode(), consumers field for field with pn_data_decode() and
+ * pn_data_scan() on every list encoding.
+ */
+
+#include "test_tools.h"
+#include "core/consumers.h"
+#include "core/emitters.h"
+
+#include <proton/codec.h>
+
+#include <string.h>
+
+#define FRAME_MAX 1024
+
+typedef struct frame_t {
+  size_t size;
+  char bytes[FRAME_MAX];
+} frame_t;
+
+static void check_same_bytes(test_t *t, pni_emitter_t *emitter, pn_data_t *data) {
+  char expect[FRAME_MAX];
+  ssize_t size = pn_data_encode(data, expect, sizeof(expect));
+  TEST_CHECK(t, size > 0);
+  TEST_CHECK(t, !pni_emitter_overflow(emitter));
+  TEST_SIZE_EQUAL(t, (size_t)size, emitter->position);
+  if (size > 0 && (size_t)size == emitter->position) {
+    TEST_CHECKF(t, !memcmp(expect, emitter->output_start, size), "emitted bytes differ");
+  }
+}
+
+/* The emitter must report the space it needs when the buffer is too small */
+static void check_overflow(test_t *t, const frame_t *f, void (*emit)(pni_emitter_t *, const void *), const void *arg) {
+  char small[FRAME_MAX];
+  pni_emitter_t emitter = pni_emitter(pn_rwbytes(f->size - 1, small));
+  emit(&emitter, arg);
+  TEST_CHECK(t, pni_emitter_overflow(&emitter));
+  TEST_SIZE_EQUAL(t, f->size, emitter.position);
+}
+
+/* Re-encode the field list of a performative as list8 or list32, with extra trailing nulls.
+   The result is empty if the fields do not fit a list8. */
+static frame_t relist(const frame_t *in, uint8_t list_type, unsigned extra_nulls) {
+  frame_t out = {0};
+  pni_consumer_t consumer = pni_consumer(pn_bytes(in->size, in->bytes));
+  pni_consumer_t fields;
+  uint64_t code;
+  if (!pni_consume_descriptor(&consumer, &code) || !pni_consume_list(&consumer, &fields)) {
+    return out;
+  }
+  uint32_t count = fields.count + extra_nulls;
+  uint32_t size = fields.size + extra_nulls;
+  if (list_type == PNE_LIST8 && (size + 1 > 255 || count > 255)) {
+    return out;
+  }
+  pni_emitter_t emitter = pni_emitter(pn_rwbytes(sizeof(out.bytes), out.bytes));
+  pni_emit_descriptor(&emitter, code);
+  pni_emitter_writef8(&emitter, list_type);
+  if (list_type == PNE_LIST8) {
+    pni_emitter_writef8(&emitter, size + 1);
+    pni_emitter_writef8(&emitter, count);
+  } else {
+    pni_emitter_writef32(&emitter, size + 4);
+    pni_emitter_writef32(&emitter, count);
+  }
+  if (emitter.position + fields.size <= emitter.size) {
+    memcpy(out.bytes + emitter.position, fields.input_start, fields.size);
+  }
+  emitter.position += fields.size;
+  for (unsigned i = 0; i < extra_nulls; ++i) pni_emitter_writef8(&emitter, PNE_NULL);
+  out.size = emitter.position;
+  return out;
+}
+
+/* A performative with an empty field list */
+static frame_t list0_frame(uint64_t code) {
+  frame_t out = {0};
+  pni_emitter_t emitter = pni_emitter(pn_rwbytes(sizeof(out.bytes), out.bytes));
+  pni_emit_descriptor(&emitter, code);
+  pni_emitter_writef8(&emitter, PNE_LIST0);
+  out.size = emitter.position;
+  return out;
+}
+
+/* Consume the descriptor and field list of f */
+static bool consume_fields(test_t *t, const frame_t *f, uint64_t expect_code, pni_consumer_t *fields) {
+  pni_consumer_t consumer = pni_consumer(pn_bytes(f->size, f->bytes));
+  uint64_t code = 0;
+  bool ok = pni_consume_descriptor(&consumer, &code) && pni_consume_list(&consumer, fields);
+  TEST_CHECK(t, ok);
+  TEST_CHECK(t, code == expect_code);
+  TEST_SIZE_EQUAL(t, 0, pni_consumer_remaining(&consumer).size);
+  return ok;
+}
+
+static void decode(test_t *t, pn_data_t *data, const frame_t *f) {
+  pn_data_clear(data);
+  ssize_t size = pn_data_decode(data, f->bytes, f->size);
+  TEST_CHECK(t, size == (ssize_t)f->size);
+}
+
+/* TRANSFER */
+
+typedef struct transfer_args_t {
+  uint32_t handle;
+  pn_sequence_t id;
+  pn_bytes_t tag;
+  uint32_t message_format;
+  bool settled, more, resume, aborted, batchable;
+} transfer_args_t;
+
+static void emit_transfer(pni_emitter_t *emitter, const void *arg) {
+  const transfer_args_t *a = (const transfer_args_t *)arg;
+  pni_emit_transfer(emitter, a->handle, a->id, a->tag, a->message_format,
+                    a->settled, a->more, a->resume, a->aborted, a->batchable);
+}
+
+static void check_transfer_fields(test_t *t, pn_data_t *data, const frame_t *f) {
+  pni_transfer_t got, want;
+  memset(&got, 0, sizeof(got));
+  memset(&want, 0, sizeof(want));
+  pni_consumer_t fields;
+  if (!consume_fields(t, f, TRANSFER, &fields)) return;
+  TEST_CHECK(t, pni_consume_transfer_fields(&fields, &got));
+
+  pn_data_t *state = pn_data(0);
+  decode(t, data, f);
+  TEST_CHECK(t, 0 == pn_data_scan(data, "D.[I?Iz.?oo.D?LCooo]", &want.handle, &want.id_present, &want.id,
+                                  &want.tag, &want.settled_set, &want.settled, &want.more,
+                                  &want.has_type, &want.type, state,
+                                  &want.resume, &want.aborted, &want.batchable));
+  pn_data_free(state);
+
+  TEST_CHECK(t, got.handle == want.handle);
+  TEST_CHECK(t, got.id_present == want.id_present);
+  TEST_CHECK(t, got.id == want.id);
+  TEST_SIZE_EQUAL(t, want.tag.size, got.tag.size);
+  TEST_CHECK(t, (got.tag.start == NULL) == (want.tag.start == NULL));
+  if (got.tag.size == want.tag.size && want.tag.size) {
+    TEST_CHECK(t, !memcmp(got.tag.start, want.tag.start, want.tag.size));
+  }
+  TEST_CHECK(t, got.settled_set == want.settled_set);
+  TEST_CHECK(t, got.settled == want.settled);
+  TEST_CHECK(t, got.more == want.more);
+  TEST_CHECK(t, got.has_type == want.has_type);
+  TEST_CHECK(t, got.type == want.type);
+  TEST_CHECK(t, got.resume == want.resume);
+  TEST_CHECK(t, got.aborted == want.aborted);
+  TEST_CHECK(t, got.batchable == want.batchable);
+}
+
+static void check_transfer(test_t *t, const transfer_args_t *a) {
+  pn_data_t *data = pn_data(0);
+  pn_data_fill(data, "DL[IIzI?o?on?DLC?o?o?o]", TRANSFER,
+               a->handle, a->id, a->tag.size, a->tag.start, a->message_format,
+               a->settled, a->settled, a->more, a->more,
+               false, (uint64_t)0, (pn_data_t *)NULL,
+               a->resume, a->resume, a->aborted, a->aborted, a->batchable, a->batchable);
+  frame_t f;
+  pni_emitter_t emitter = pni_emitter(pn_rwbytes(sizeof(f.bytes), f.bytes));
+  emit_transfer(&emitter, a);
+  f.size = emitter.position;
+  check_same_bytes(t, &emitter, data);
+  check_overflow(t, &f, emit_transfer, a);
+
+  check_transfer_fields(t, data, &f);
+  frame_t list8 = relist(&f, PNE_LIST8, 2);
+  if (list8.size) check_transfer_fields(t, data, &list8);
+  frame_t list32 = relist(&f, PNE_LIST32, 0);
+  check_transfer_fields(t, data, &list32);
+  pn_data_free(data);
+}
+
+static void test_transfer(test_t *t) {
+  static const char tag[300] = "tag";
+  transfer_args_t a;
+  memset(&a, 0, sizeof(a));
+  a.tag = pn_bytes(1, tag);
+  check_transfer(t, &a);
+  /* Every field present, using the uint and vbin32 encodings */
+  a.handle = 0x12345;
+  a.id = 0xFFFFFFFF;
+  a.tag = pn_bytes(sizeof(tag), tag);
+  a.message_format = 255;
+  a.settled = a.more = a.resume = a.aborted = a.batchable = true;
+  check_transfer(t, &a);
+  /* Null and empty tags, trailing booleans omitted */
+  a.handle = 1;
+  a.id = 256;
+  a.tag = pn_bytes(0, NULL);
+  a.resume = a.aborted = a.batchable = false;
+  check_transfer(t, &a);
+  a.tag = pn_bytes(0, tag);
+  a.settled = false;
+  check_transfer(t, &a);
+
+  pn_data_t *data = pn_data(0);
+  frame_t empty = list0_frame(TRANSFER);
+  check_transfer_fields(t, data, &empty);
+  /* A delivery state is read as its descriptor */
+  static const char with_state[] = {
+    0x00, 0x53, 0x14, (char)0xc0, 0x0d, 0x08,
+    0x43, 0x43, (char)0xa0, 0x00, 0x43, 0x41, 0x40, 0x40, 0x00, 0x53, 0x24, 0x45};
+  frame_t f;
+  f.size = sizeof(with_state);
+  memcpy(f.bytes, with_state, sizeof(with_state));
+  check_transfer_fields(t, data, &f);
+  pn_data_free(data);
+}
+
+/* FLOW */
+
+typedef struct flow_args_t {
+  bool inext_init;
+  pn_sequence_t inext;
+  uint32_t iwin;
+  pn_sequence_t onext;
+  uint32_t owin;
+  bool linkq;
+  uint32_t handle;
+  pn_sequence_t delivery_count;
+  uint32_t link_credit;
+  bool drain;
+} flow_args_t;
+
+static void emit_flow(pni_emitter_t *emitter, const void *arg) {
+  const flow_args_t *a = (const flow_args_t *)arg;
+  pni_emit_flow(emitter, a->inext_init, a->inext, a->iwin, a->onext, a->owin,
+                a->linkq, a->handle, a->delivery_count, a->link_credit, a->drain);
+}
+
+static void check_flow_fields(test_t *t, pn_data_t *data, const frame_t *f) {
+  pni_flow_t got, want;
+  memset(&got, 0, sizeof(got));
+  memset(&want, 0, sizeof(want));
+  pni_consumer_t fields;
+  if (!consume_fields(t, f, FLOW, &fields)) return;
+  TEST_CHECK(t, pni_consume_flow_fields(&fields, &got));
+
+  decode(t, data, f);
+  TEST_CHECK(t, 0 == pn_data_scan(data, "D.[?IIII?I?II.o]", &want.inext_init, &want.inext, &want.iwin,
+                                  &want.onext, &want.owin, &want.handle_init, &want.handle,
+                                  &want.dcount_init, &want.delivery_count, &want.link_credit,
+                                  &want.drain));
+
+  TEST_CHECK(t, got.inext_init == want.inext_init);
+  TEST_CHECK(t, got.inext == want.inext);
+  TEST_CHECK(t, got.iwin == want.iwin);
+  TEST_CHECK(t, got.onext == want.onext);
+  TEST_CHECK(t, got.owin == want.owin);
+  TEST_CHECK(t, got.handle_init == want.handle_init);
+  TEST_CHECK(t, got.handle == want.handle);
+  TEST_CHECK(t, got.dcount_init == want.dcount_init);
+  TEST_CHECK(t, got.delivery_count == want.delivery_count);
+  TEST_CHECK(t, got.link_credit == want.link_credit);
+  TEST_CHECK(t, got.drain == want.drain);
+}
+
+static void check_flow(test_t *t, const flow_args_t *a) {
+  pn_data_t *data = pn_data(0);
+  pn_data_fill(data, "DL[?IIII?I?I?In?o]", FLOW,
+               a->inext_init, a->inext, a->iwin, a->onext, a->owin,
+               a->linkq, a->handle, a->linkq, a->delivery_count,
+               a->linkq, a->link_credit, a->linkq, a->drain);
+  frame_t f;
+  pni_emitter_t emitter = pni_emitter(pn_rwbytes(sizeof(f.bytes), f.bytes));
+  emit_flow(&emitter, a);
+  f.size = emitter.position;
+  check_same_bytes(t, &emitter, data);
+  check_overflow(t, &f, emit_flow, a);
+
+  check_flow_fields(t, data, &f);
+  frame_t list8 = relist(&f, PNE_LIST8, 3);
+  if (list8.size) check_flow_fields(t, data, &list8);
+  frame_t list32 = relist(&f, PNE_LIST32, 1);
+  check_flow_fields(t, data, &list32);
+  pn_data_free(data);
+}
+
+static void test_flow(test_t *t) {
+  flow_args_t a;
+  memset(&a, 0, sizeof(a));
+  /* Session flow before the remote begin: only the windows are present */
+  a.iwin = 2147483647;
+  check_flow(t, &a);
+  a.inext_init = true;
+  a.inext = 7;
+  a.onext = 300;
+  a.owin = 0;
+  check_flow(t, &a);
+  /* Link flow */
+  a.linkq = true;
+  a.handle = 0;
+  a.delivery_count = 0xFFFFFFF0;
+  a.link_credit = 10;
+  check_flow(t, &a);
+  a.drain = true;
+  a.link_credit = 0;
+  check_flow(t, &a);
+
+  pn_data_t *data = pn_data(0);
+  frame_t empty = list0_frame(FLOW);
+  check_flow_fields(t, data, &empty);
+  pn_data_free(data);
+}
+
+/* DISPOSITION */
+
+typedef struct disposition_args_t {
+  bool role;
+  pn_sequence_t first, last;
+  bool settled;
+  uint64_t code;
+} disposition_args_t;
+
+static void emit_disposition(pni_emitter_t *emitter, const void *arg) {
+  const disposition_args_t *a = (const disposition_args_t *)arg;
+  pni_emit_disposition(emitter, a->role, a->first, a->last, a->settled, a->code);
+}
+
+static void check_disposition_fields(test_t *t, pn_data_t *data, const frame_t *f) {
+  pni_disposition_t got, want;
+  memset(&got, 0, sizeof(got));
+  memset(&want, 0, sizeof(want));
+  pni_consumer_t fields;
+  if (!consume_fields(t, f, DISPOSITION, &fields)) return;
+  TEST_CHECK(t, pni_consume_disposition_fields(&fields, &got));
+
+  pn_data_t *state = pn_data(0);
+  decode(t, data, f);
+  TEST_CHECK(t, 0 == pn_data_scan(data, "D.[oI?IoD?LC]", &want.role, &want.first, &want.last_init,
+                                  &want.last, &want.settled, &want.type_init, &want.type, state));
+  pn_data_free(state);
+
+  TEST_CHECK(t, got.role == want.role);
+  TEST_CHECK(t, got.first == want.first);
+  TEST_CHECK(t, got.last_init == want.last_init);
+  TEST_CHECK(t, got.last == want.last);
+  TEST_CHECK(t, got.settled == want.settled);
+  TEST_CHECK(t, got.type_init == want.type_init);
+  TEST_CHECK(t, got.type == want.type);
+}
+
+static void check_disposition(test_t *t, const disposition_args_t *a) {
+  pn_data_t *data = pn_data(0);
+  pn_data_fill(data, "DL[oI?I?o?DL[]]", DISPOSITION,
+               a->role, a->first, a->last != a->first, a->last,
+               a->settled, a->settled, (bool)a->code, a->code);
+  frame_t f;
+  pni_emitter_t emitter = pni_emitter(pn_rwbytes(sizeof(f.bytes), f.bytes));
+  emit_disposition(&emitter, a);
+  f.size = emitter.position;
+  check_same_bytes(t, &emitter, data);
+  check_overflow(t, &f, emit_disposition, a);
+
+  check_disposition_fields(t, data, &f);
+  frame_t list8 = relist(&f, PNE_LIST8, 1);
+  if (list8.size) check_disposition_fields(t, data, &list8);
+  frame_t list32 = relist(&f, PNE_LIST32, 2);
+  check_disposition_fields(t, data, &list32);
+  pn_data_free(data);
+}
+
+static void test_disposition(test_t *t) {
+  disposition_args_t a;
+  memset(&a, 0, sizeof(a));
+  check_disposition(t, &a);
+  /* A range, settled with each outcome that has no fields */
+  a.role = true;
+  a.first = 10;
+  a.last = 1000;
+  a.settled = true;
+  const uint64_t codes[] = {ACCEPTED, RELEASED, 0};
+  for (size_t i = 0; i < sizeof(codes)/sizeof(*codes); ++i) {
+    a.code = codes[i];
+    check_disposition(t, &a);
+  }
+  /* Unsettled with an outcome, so the null settled field is not trailing */
+  a.first = a.last = 0xFFFFFFFF;
+  a.settled = false;
+  a.code = ACCEPTED;
+  check_disposition(t, &a);
+
+  pn_data_t *data = pn_data(0);
+  frame_t empty = list0_frame(DISPOSITION);
+  check_disposition_fields(t, data, &empty);
+  /* An explicitly null state */
+  static const char null_state[] = {
+    0x00, 0x53, 0x15, (char)0xc0, 0x07, 0x05, 0x41, 0x52, 0x05, 0x40, 0x41, 0x40};
+  frame_t f;
+  f.size = sizeof(null_state);
+  memcpy(f.bytes, null_state, sizeof(null_state));
+  check_disposition_fields(t, data, &f);
+  pn_data_free(data);
+}
+
+int main(int argc, char **argv) {
+  int failed = 0;
+  RUN_ARGV_TEST(failed, t, test_transfer(&t));
+  RUN_ARGV_TEST(failed, t, test_flow(&t));
+  RUN_ARGV_TEST(failed, t, test_disposition(&t));
+  return failed;
+}
@@ -513,6 +513,63 @@ static void test_inactive(test_t *t) {
   TEST_PROACTORS_DESTROY(tps);
 }
 
+/* Test that the idle timeout expires when the peer stops sending, using the connection timer */
+static void test_idle_timeout(test_t *t) {
+  test_proactor_t tps[] =  { test_proactor(t, open_wake_handler), test_proactor(t, listen_handler) };
+  pn_proactor_t *client = tps[0].proactor;
+  pn_listener_t *l = test_listen(&tps[1], "");
+
+  pn_transport_t *tr = pn_transport();
+  pn_transport_set_idle_timeout(tr, 100);
+  pn_proactor_connect2(client, NULL, tr, listener_info(l).connect);
+  TEST_ETYPE_EQUAL(t, PN_CONNECTION_REMOTE_OPEN, TEST_PROACTORS_RUN(tps));
+
+  /* Only run the client: the server sends no heartbeats */
+  TEST_ETYPE_EQUAL(t, PN_TRANSPORT_ERROR, test_proactors_run(&tps[0], 1));
+  TEST_COND_NAME(t, "amqp:resource-limit-exceeded", last_condition);
+  TEST_ETYPE_EQUAL(t, PN_TRANSPORT_CLOSED, test_proactors_run(&tps[0], 1));
+
+  pn_listener_close(l);
+  TEST_PROACTORS_DESTROY(tps);
+}
+
+#define STORM_CONNECTIONS 200
+
+/* Count client connections that are open, return when all are */
+static pn_event_type_t storm_handler(test_handler_t *th, pn_event_t *e) {
+  switch (pn_event_type(e)) {
+   case PN_CONNECTION_REMOTE_OPEN:
+    if (++*(size_t*)th->context == STORM_CONNECTIONS)
+      return PN_CONNECTION_REMOTE_OPEN;
+    return PN_EVENT_NONE;
+   default:
+    return listen_handler(th, e);
+  }
+}
+
+/* Test many connections arriving at a listener at once */
+static void test_accept_storm(test_t *t) {
+  test_proactor_t tps[] =  { test_proactor(t, storm_handler), test_proactor(t, listen_handler) };
+  size_t opened = 0;
+  tps[0].handler.context = &opened;
+  pn_proactor_t *client = tps[0].proactor, *server = tps[1].proactor;
+
+  char addr[1024];
+  pn_listener_t *l = pn_listener();
+  (void)pn_proactor_addr(addr, sizeof(addr), "", "0");
+  pn_proactor_listen(server, l, addr, STORM_CONNECTIONS);
+  TEST_ETYPE_EQUAL(t, PN_LISTENER_OPEN, test_proactors_run(&tps[1], 1));
+
+  for (size_t i = 0; i < STORM_CONNECTIONS; ++i) {
+    pn_proactor_connect2(client, NULL, NULL, listener_info(l).connect);
+  }
+  TEST_ETYPE_EQUAL(t, PN_CONNECTION_REMOTE_OPEN, TEST_PROACTORS_RUN(tps));
+  TEST_INT_EQUAL(t, STORM_CONNECTIONS, opened);
+
+  pn_listener_close(l);
+  TEST_PROACTORS_DESTROY(tps);
+}
+
 /* Tests for error handling */
 static void test_errors(test_t *t) {
   test_proactor_t tps[] =  { test_proactor(t, open_wake_handler), test_proactor(t, listen_handler) };
@@ -1081,10 +1138,90 @@ static void test_message_stream(test_t *t) {
   TEST_PROACTORS_DESTROY(tps);
 }
 
+#define DISP_DELAY 10            /* Milliseconds */
+
+/* Receiver holds its delivery till a WAKE, then accepts it with a delayed
+   disposition. The sender returns when it sees the outcome. */
+static pn_event_type_t disp_delay_handler(test_handler_t *th, pn_event_t *e) {
+  switch (pn_event_type(e)) {
+   case PN_CONNECTION_BOUND:
+    pn_transport_set_disposition_delay(pn_event_transport(e), DISP_DELAY);
+    return PN_EVENT_NONE;
+
+   case PN_LINK_REMOTE_OPEN:
+    common_handler(th, e);
+    if (pn_link_is_receiver(pn_event_link(e))) pn_link_flow(pn_event_link(e), 1);
+    return PN_EVENT_NONE;
+
+   case PN_LINK_FLOW: {         /* Send one delivery */
+     pn_link_t *l = pn_event_link(e);
+     if (pn_link_is_sender(l) && !th->delivery && pn_link_credit(l) > 0) {
+       th->delivery = pn_delivery(l, pn_dtag("x", 1));
+       TEST_CHECK(th->t, 1 == pn_link_send(l, "x", 1));
+       TEST_CHECK(th->t, pn_link_advance(l));
+     }
+     return PN_EVENT_NONE;
+   }
+
+   case PN_DELIVERY: {
+     pn_delivery_t *dlv = pn_event_delivery(e);
+     if (pn_link_is_receiver(pn_delivery_link(dlv))) {
+       if (pn_delivery_partial(dlv)) return PN_EVENT_NONE;
+       char buf[16];
+       pn_link_recv(pn_delivery_link(dlv), buf, sizeof(buf));
+       th->delivery = dlv;
+       th->connection = pn_event_connection(e);
+       return PN_DELIVERY;      /* Not accepted yet */
+     }
+     return pn_delivery_remote_state(dlv) ? PN_DELIVERY : PN_EVENT_NONE;
+   }
+
+   case PN_CONNECTION_WAKE:     /* Accept with no more input to follow */
+    pn_delivery_update(th->delivery, PN_ACCEPTED);
+    pn_delivery_settle(th->delivery);
+    th->delivery = NULL;
+    return PN_CONNECTION_WAKE;
+
+   default:
+    return common_handler(th, e);
+  }
+}
+
+/* Test that a delayed disposition is sent when nothing else is happening */
+static void test_disposition_delay(test_t *t) {
+  test_proactor_t tps[] ={ test_proactor(t, disp_delay_handler), test_proactor(t, disp_delay_handler) };
+  pn_proactor_t *client = tps[0].proactor;
+  pn_listener_t *l = test_listen(&tps[1], "");
+
+  pn_connection_t *c = pn_connection();
+  pn_proactor_connect2(client, c, NULL, listener_info(l).connect);
+  pn_session_t *ssn = pn_session(c);
+  pn_session_open(ssn);
+  pn_link_open(pn_sender(ssn, "x"));
+  TEST_PROACTORS_RUN_UNTIL(tps, PN_DELIVERY);
+  TEST_ASSERT(tps[1].handler.delivery);
+  pn_delivery_t *dlv = tps[0].handler.delivery;
+  TEST_PROACTORS_DRAIN(tps);    /* Idle, so only a timer can send the outcome */
+
+  pn_connection_wake(tps[1].handler.connection);
+  TEST_ETYPE_EQUAL(t, PN_CONNECTION_WAKE, TEST_PROACTORS_RUN(tps));
+  pn_proactor_set_timeout(client, 2000); /* Fail rather than hang */
+  TEST_ETYPE_EQUAL(t, PN_DELIVERY, TEST_PROACTORS_RUN(tps));
+  TEST_CHECK(t, pn_delivery_remote_state(dlv) == PN_ACCEPTED);
+  TEST_CHECK(t, pn_delivery_settled(dlv));
+  pn_proactor_cancel_timeout(client);
+
+  pn_proactor_disconnect(client, NULL);
+  TEST_PROACTORS_DRAIN(tps);
+  TEST_PROACTORS_DESTROY(tps);
+}
+
 int main(int argc, char **argv) {
   int failed = 0;
   last_condition = pn_condition();
   RUN_ARGV_TEST(failed, t, test_inactive(&t));
+  RUN_ARGV_TEST(failed, t, test_idle_timeout(&t));
+  RUN_ARGV_TEST(failed, t, test_accept_storm(&t));
   RUN_ARGV_TEST(failed, t, test_interrupt_timeout(&t));
   RUN_ARGV_TEST(failed, t, test_errors(&t));
   RUN_ARGV_TEST(failed, t, test_proton_1586(&t));
@@ -1102,6 +1239,7 @@ int main(int argc, char **argv) {
   RUN_ARGV_TEST(failed, t, test_abort(&t));
   RUN_ARGV_TEST(failed, t, test_refuse(&t));
   RUN_ARGV_TEST(failed, t, test_message_stream(&t));
+  RUN_ARGV_TEST(failed, t, test_disposition_delay(&t));
   pn_condition_free(last_condition);
   return failed;
 }
@@ -0,0 +1,272 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/* Measure the cost of waking connections from threads outside the proactor.
+
+   WAKERS threads call pn_connection_wake() WAKES times each, spread over
+   CONNECTIONS open connections, while WORKERS threads process proactor
+   events. This is what the C++ connection work queues do for every
+   function they are given.
+
+   Wakes on a connection that already has a wake pending coalesce into a
+   single PN_CONNECTION_WAKE, so the number of events is also reported.
+*/
+
+#include "thread.h"
+
+#include <proton/connection.h>
+#include <proton/event.h>
+#include <proton/listener.h>
+#include <proton/netaddr.h>
+#include <proton/proactor.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#undef NDEBUG                   /* Enable assert even in release builds */
+#include <assert.h>
+
+static const int default_wakers = 4;
+static const int default_workers = 4;
+static const int default_connections = 16;
+static const long default_wakes = 1000000;
+
+typedef struct bench {
+  pn_proactor_t *proactor;
+  pn_listener_t *listener;
+  pn_connection_t **connections; /* Client side of each connection */
+  int n_connections;
+  long wakes;
+
+  pthread_mutex_t lock;
+  int opened;                   /* Client connections with remote open */
+  int closed;                   /* Client transports closed */
+  long wake_events;
+  bool done;                    /* Wakers have finished, close on next wake */
+} bench;
+
+typedef struct waker {
+  bench *b;
+  int id;
+  pthread_t thread;
+} waker;
+
+static void *waker_thread(void *void_w) {
+  waker *w = (waker*)void_w;
+  bench *b = w->b;
+  for (long i = 0; i < b->wakes; ++i) {
+    pn_connection_wake(b->connections[(i + w->id) % b->n_connections]);
+  }
+  return NULL;
+}
+
+static bool is_client(pn_connection_t *c) {
+  return pn_connection_get_context(c) != NULL;
+}
+
+static void *worker_thread(void *void_b) {
+  bench *b = (bench*)void_b;
+  long wake_events = 0;
+  bool finished = false;
+  while (!finished) {
+    pn_event_batch_t *batch = pn_proactor_wait(b->proactor);
+    pn_event_t *e;
+    while ((e = pn_event_batch_next(batch))) {
+      pn_connection_t *c = pn_event_connection(e);
+      switch (pn_event_type(e)) {
+
+       case PN_LISTENER_ACCEPT:
+        pn_listener_accept2(pn_event_listener(e), NULL, NULL);
+        break;
+
+       case PN_CONNECTION_REMOTE_OPEN:
+        if (is_client(c)) {
+          pthread_mutex_lock(&b->lock);
+          ++b->opened;
+          pthread_mutex_unlock(&b->lock);
+        } else {
+          pn_connection_open(c);
+        }
+        break;
+
+       case PN_CONNECTION_WAKE: {
+         ++wake_events;
+         /* done is set before the final wakes, the proactor orders them */
+         pthread_mutex_lock(&b->lock);
+         bool done = b->done;
+         pthread_mutex_unlock(&b->lock);
+         if (done) pn_connection_close(c);
+         break;
+       }
+
+       case PN_CONNECTION_REMOTE_CLOSE:
+        pn_connection_close(c);
+        break;
+
+       case PN_TRANSPORT_CLOSED:
+        if (c && is_client(c)) {
+          pthread_mutex_lock(&b->lock);
+          if (++b->closed == b->n_connections) pn_listener_close(b->listener);
+          pthread_mutex_unlock(&b->lock);
+        }
+        break;
+
+       case PN_PROACTOR_INACTIVE:
+       case PN_PROACTOR_INTERRUPT:
+        finished = true;
+        pn_proactor_interrupt(b->proactor); /* Pass it on to the next worker */
+        break;
+
+       default:
+        break;
+      }
+    }
+    pn_proactor_done(b->proactor, batch);
+  }
+  pthread_mutex_lock(&b->lock);
+  b->wake_events += wake_events;
+  pthread_mutex_unlock(&b->lock);
+  return NULL;
+}
+
+static void usage(const char **argv, const char **arg) {
+  fprintf(stderr, "usage: %s [options]\n", argv[0]);
+  fprintf(stderr, "  -wakers WAKERS: threads calling pn_connection_wake() (default %d)\n", default_wakers);
+  fprintf(stderr, "  -workers WORKERS: threads processing proactor events (default %d)\n", default_workers);
+  fprintf(stderr, "  -connections CONNECTIONS: connections to wake (default %d)\n", default_connections);
+  fprintf(stderr, "  -wakes WAKES: wakes made by each waker thread (default %ld)\n", default_wakes);
+  fprintf(stderr, "\nbad argument: %s\n", *arg);
+  exit(1);
+}
+
+int main(int argc, const char* argv[]) {
+  const char **arg = argv + 1;
+  const char **end = argv + argc;
+  int n_wakers = default_wakers;
+  int n_workers = default_workers;
+  bench b;
+  memset(&b, 0, sizeof(b));
+  b.n_connections = default_connections;
+  b.wakes = default_wakes;
+
+  while (arg < end) {
+    if (!strcmp(*arg, "-wakers") && ++arg < end) {
+      n_wakers = atoi(*arg);
+      if (n_wakers <= 0) usage(argv, arg);
+    }
+    else if (!strcmp(*arg, "-workers") && ++arg < end) {
+      n_workers = atoi(*arg);
+      if (n_workers <= 0) usage(argv, arg);
+    }
+    else if (!strcmp(*arg, "-connections") && ++arg < end) {
+      b.n_connections = atoi(*arg);
+      if (b.n_connections <= 0) usage(argv, arg);
+    }
+    else if (!strcmp(*arg, "-wakes") && ++arg < end) {
+      b.wakes = atol(*arg);
+      if (b.wakes <= 0) usage(argv, arg);
+    }
+    else {
+      usage(argv, arg);
+    }
+    ++arg;
+  }
+
+  pthread_mutex_init(&b.lock, NULL);
+  b.proactor = pn_proactor();
+  assert(b.proactor);
+
+  /* Listen and wait for the address before connecting */
+  b.listener = pn_listener();
+  pn_proactor_listen(b.proactor, b.listener, "127.0.0.1:0", 16);
+  bool listening = false;
+  while (!listening) {
+    pn_event_batch_t *batch = pn_proactor_wait(b.proactor);
+    pn_event_t *e;
+    while ((e = pn_event_batch_next(batch))) {
+      if (pn_event_type(e) == PN_LISTENER_OPEN) {
+        listening = true;
+      } else if (pn_event_type(e) == PN_LISTENER_CLOSE) {
+        fprintf(stderr, "listen failed: %s\n",
+                pn_condition_get_description(pn_listener_condition(b.listener)));
+        exit(1);
+      }
+    }
+    pn_proactor_done(b.proactor, batch);
+  }
+  char host[PN_MAX_ADDR], port[PN_MAX_ADDR], addr[PN_MAX_ADDR];
+  pn_netaddr_host_port(pn_listener_addr(b.listener), host, sizeof(host), port, sizeof(port));
+  pn_proactor_addr(addr, sizeof(addr), host, port);
+
+  pthread_t *workers = (pthread_t*)calloc(n_workers, sizeof(pthread_t));
+  for (int i = 0; i < n_workers; ++i) {
+    pthread_create(&workers[i], NULL, worker_thread, &b);
+  }
+
+  b.connections = (pn_connection_t**)calloc(b.n_connections, sizeof(pn_connection_t*));
+  for (int i = 0; i < b.n_connections; ++i) {
+    b.connections[i] = pn_connection();
+    pn_connection_set_context(b.connections[i], &b);
+    pn_proactor_connect2(b.proactor, b.connections[i], NULL, addr);
+  }
+  for (bool ready = false; !ready; ) {
+    millisleep(10);
+    pthread_mutex_lock(&b.lock);
+    ready = (b.opened == b.n_connections);
+    pthread_mutex_unlock(&b.lock);
+  }
+
+  /* Time the wakes */
+  waker *wakers = (waker*)calloc(n_wakers, sizeof(waker));
+  pn_millis_t start = pn_proactor_now();
+  for (int i = 0; i < n_wakers; ++i) {
+    wakers[i].b = &b;
+    wakers[i].id = i;
+    pthread_create(&wakers[i].thread, NULL, waker_thread, &wakers[i]);
+  }
+  for (int i = 0; i < n_wakers; ++i) {
+    pthread_join(wakers[i].thread, NULL);
+  }
+  pn_millis_t elapsed = pn_proactor_now() - start;
+
+  /* Close the connections with a final wake, then stop the workers */
+  pthread_mutex_lock(&b.lock);
+  b.done = true;
+  pthread_mutex_unlock(&b.lock);
+  for (int i = 0; i < b.n_connections; ++i) {
+    pn_connection_wake(b.connections[i]);
+  }
+  for (int i = 0; i < n_workers; ++i) {
+    pthread_join(workers[i], NULL);
+  }
+
+  long total = b.wakes * n_wakers;
+  if (elapsed == 0) elapsed = 1;
+  printf("wakers=%d, workers=%d, connections=%d: %ld wakes in %u ms, %.0f wakes/sec, %ld PN_CONNECTION_WAKE events\n",
+         n_wakers, n_workers, b.n_connections, total, (unsigned)elapsed, total * 1000.0 / elapsed,
+         b.wake_events);
+
+  free(wakers);
+  free(workers);
+  free(b.connections);
+  pn_proactor_free(b.proactor);
+  pthread_mutex_destroy(&b.lock);
+  return 0;
+}
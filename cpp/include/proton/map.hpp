@@ -130,6 +130,7 @@ class PN_CPP_CLASS_EXTERN map {
     /// @cond INTERNAL
     explicit map(pn_data_t*);
     void reset(pn_data_t*);
+    void flush_changes() const;
     /// @endcond
 
   private:
@@ -43,6 +43,10 @@ struct pn_message_t;
 
 namespace proton {
 
+namespace internal {
+template <class T> class factory;
+}
+
 /// An AMQP message.
 ///
 /// Value semantics: A message can be copied or assigned to make a new
@@ -107,6 +111,9 @@ class message {
     PN_CPP_EXTERN std::vector<char> encode() const;
 
     /// Decode from string data into the message.
+    ///
+    /// Sections of the message are decoded when first used, so an
+    /// accessor throws proton::error if its section is malformed.
     PN_CPP_EXTERN void decode(const std::vector<char>&);
 
     /// @}
@@ -328,6 +335,8 @@ class message {
 
     mutable pn_message_t* pn_msg_;
 
+  friend class internal::factory<message>;
+
   PN_CPP_EXTERN friend void swap(message&, message&);
     /// @endcond
 };
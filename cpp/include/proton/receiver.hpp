@@ -78,6 +78,11 @@ PN_CPP_CLASS_EXTERN receiver : public link {
     /// outstanding drained credit reaches zero.
     PN_CPP_EXTERN void drain();
 
+    /// **Unsettled API** - The credit window currently in use.  This
+    /// is the fixed receiver_options::credit_window unless a
+    /// receiver_options::max_credit_window lets it adapt.
+    PN_CPP_EXTERN int credit_window() const;
+
     /// @cond INTERNAL
   friend class internal::factory<receiver>;
   friend class receiver_iterator;
@@ -97,6 +97,17 @@ class receiver_options {
     /// automatic replenishment.
     PN_CPP_EXTERN receiver_options& credit_window(int count);
 
+    /// **Unsettled API** - Adapt the credit window to the link.  The
+    /// window starts at the credit_window and grows up to `count`
+    /// messages while the sender is kept waiting for credit, shrinking
+    /// again when the handler cannot keep up.  Credit is then
+    /// replenished once half the window is used rather than after
+    /// every message.  The default is zero, a fixed window; so is any
+    /// `count` no greater than the credit_window.
+    ///
+    /// @see receiver::credit_window
+    PN_CPP_EXTERN receiver_options& max_credit_window(int count);
+
     /// Set the link name. If not set a unique name is generated.
     PN_CPP_EXTERN receiver_options& name(const std::string& name);
 
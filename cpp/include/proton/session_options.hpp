@@ -26,6 +26,8 @@
 #include "./internal/export.hpp"
 #include "./internal/pn_unique_ptr.hpp"
 
+#include <cstddef>
+
 /// @file
 /// @copybrief proton::session_options
 
@@ -53,6 +55,16 @@ class session_options {
     /// Set a messaging_handler for the session.
     PN_CPP_EXTERN session_options& handler(class messaging_handler &);
 
+    /// **Unsettled API** - Limit the incoming message data the session
+    /// buffers to `bytes`, which must be at least the connection's
+    /// max frame size.  The default is no limit.
+    PN_CPP_EXTERN session_options& incoming_capacity(size_t bytes);
+
+    /// **Unsettled API** - Refresh the incoming window granted to the
+    /// peer once what is left of it falls to `bytes`.  Only used with
+    /// an incoming_capacity.  The default is half the capacity.
+    PN_CPP_EXTERN session_options& incoming_low_water(size_t bytes);
+
     // Other useful session configuration TBD.
 
     /// @cond INTERNAL
@@ -490,6 +490,102 @@ void test_message() {
     ASSERT_EQUAL(value("b"), m2.message_annotations().get("a"));
 }
 
+/// A record_handler that opens incoming receivers with options
+struct receiver_options_handler : public record_handler {
+    receiver_options options;
+
+    receiver_options_handler(const receiver_options& o) : options(o) {}
+
+    void on_receiver_open(receiver &l) PN_CPP_OVERRIDE {
+        l.open(options);
+        receivers.push_back(l);
+    }
+};
+
+void test_credit_window() {
+    // Verify a fixed window stays put and an adaptive one grows while the
+    // sender is waiting for credit.
+    record_handler ha;
+    receiver_options_handler hb(receiver_options().credit_window(2).max_credit_window(64));
+    driver_pair d(ha, hb);
+
+    proton::sender s = d.a.connection().open_sender("x");
+    for (int i = 0; i < 500; ++i)
+        s.send(proton::message(i));
+    while (hb.messages.size() < 500)
+        d.process();
+
+    ASSERT_EQUAL(500u, hb.messages.size());
+    ASSERT_EQUAL(value(499), hb.messages.back().body());
+    receiver r = quick_pop(hb.receivers);
+    ASSERT(r.credit_window() > 2);
+    ASSERT(r.credit_window() <= 64);
+    ASSERT(r.credit() <= 64);
+
+    record_handler hc, hd;
+    driver_pair d2(hc, hd);
+    d2.a.connection().open_sender("y");
+    while (hd.receivers.empty())
+        d2.process();
+    ASSERT_EQUAL(10, hd.receivers.front().credit_window());
+
+    // A maximum no greater than the window leaves the window fixed, topped
+    // up after every message
+    int maxes[] = { 0, 5, 10 };
+    for (size_t i = 0; i < sizeof(maxes)/sizeof(maxes[0]); ++i) {
+        record_handler he;
+        receiver_options_handler hf(receiver_options().credit_window(10).max_credit_window(maxes[i]));
+        driver_pair d3(he, hf);
+        proton::sender s3 = d3.a.connection().open_sender("z");
+        while (hf.receivers.empty())
+            d3.process();
+        s3.send(proton::message("x"));
+        while (hf.messages.empty())
+            d3.process();
+        receiver r3 = hf.receivers.front();
+        ASSERT_EQUAL(10, r3.credit_window());
+        ASSERT_EQUAL(10, r3.credit());
+    }
+}
+
+/// A receiver_options_handler that can be made slow to handle messages
+struct slow_handler : public receiver_options_handler {
+    int delay_ms;
+
+    slow_handler(const receiver_options& o) : receiver_options_handler(o), delay_ms(0) {}
+
+    void on_message(proton::delivery& d, proton::message& m) PN_CPP_OVERRIDE {
+        timestamp end = timestamp::now() + duration(delay_ms);
+        while (timestamp::now() < end)
+            ;
+        record_handler::on_message(d, m);
+    }
+};
+
+void test_credit_window_shrink() {
+    // Verify an adaptive window shrinks when the handler is the bottleneck
+    record_handler ha;
+    slow_handler hb(receiver_options().credit_window(2).max_credit_window(64));
+    driver_pair d(ha, hb);
+
+    proton::sender s = d.a.connection().open_sender("x");
+    for (int i = 0; i < 500; ++i)
+        s.send(proton::message(i));
+    while (hb.messages.size() < 500)
+        d.process();
+    receiver r = hb.receivers.front();
+    int grown = r.credit_window();
+    ASSERT(grown > 2);
+
+    hb.delay_ms = 2;
+    for (int i = 0; i < 300; ++i)
+        s.send(proton::message(i));
+    while (hb.messages.size() < 800)
+        d.process();
+    ASSERT(r.credit_window() < grown);
+    ASSERT(r.credit_window() >= 2);
+}
+
 void test_message_timeout_succeed() {
     // Verify a message arrives intact
     record_handler ha, hb;
@@ -549,6 +645,8 @@ int main(int argc, char** argv) {
     RUN_ARGV_TEST(failed, test_link_anonymous_dynamic());
     RUN_ARGV_TEST(failed, test_link_capability_filter());
     RUN_ARGV_TEST(failed, test_message());
+    RUN_ARGV_TEST(failed, test_credit_window());
+    RUN_ARGV_TEST(failed, test_credit_window_shrink());
     RUN_ARGV_TEST(failed, test_message_timeout_succeed());
     RUN_ARGV_TEST(failed, test_message_timeout_fail());
     return failed;
@@ -38,6 +38,7 @@
 # include <thread>
 # include <mutex>
 # include <condition_variable>
+# include <chrono>
 #endif
 
 namespace {
@@ -406,6 +407,42 @@ void test_container_mt_stop() {
     }
 }
 
+// Jobs on one work queue wait for a job on another, which can only run
+// if the container runs different queues on different threads.
+class work_queues_tester {
+  public:
+    proton::container& c_;
+    proton::work_queue a_, b_;
+    std::mutex lock_;
+    std::condition_variable cond_;
+    bool b_ran_;
+    bool met_;
+
+    work_queues_tester(proton::container& c) : c_(c), a_(c), b_(c), b_ran_(false), met_(false) {}
+
+    void wait_for_b() {
+        std::unique_lock<std::mutex> l(lock_);
+        met_ = cond_.wait_for(l, std::chrono::seconds(10), [this]{ return b_ran_; });
+        c_.stop();
+    }
+
+    void signal_b() {
+        std::lock_guard<std::mutex> l(lock_);
+        b_ran_ = true;
+        cond_.notify_all();
+    }
+};
+
+void test_container_mt_work_queues() {
+    proton::container c;
+    c.auto_stop(false);
+    work_queues_tester wt(c);
+    wt.a_.add(proton::make_work(&work_queues_tester::wait_for_b, &wt));
+    wt.b_.add(proton::make_work(&work_queues_tester::signal_b, &wt));
+    c.run(2);
+    ASSERT(wt.met_);
+}
+
 #endif
 
 } // namespace
@@ -426,6 +463,7 @@ int main(int argc, char** argv) {
 #if PN_CPP_SUPPORTS_THREADS
     RUN_ARGV_TEST(failed, test_container_mt_stop_empty());
     RUN_ARGV_TEST(failed, test_container_mt_stop());
+    RUN_ARGV_TEST(failed, test_container_mt_work_queues());
 #endif
     return failed;
 }
@@ -35,6 +35,7 @@
 #include <proton/message.h>
 #include <proton/session.h>
 
+#include <algorithm>
 #include <typeinfo>
 
 namespace proton {
@@ -89,6 +90,60 @@ link_context& link_context::get(pn_link_t* l) {
     return ref<link_context>(id(pn_link_attachments(l), LINK_CONTEXT));
 }
 
+credit_controller::credit_controller() :
+    min_window_(0), max_window_(0), window_(0), received_(0), probe_limit_(0),
+    probe_time_(0), probing_(false), rtt_(-1), round_start_(-1), round_handling_(0),
+    round_received_(0)
+{}
+
+void credit_controller::enable(int min_window, int max_window) {
+    min_window_ = std::max(min_window, 1);
+    max_window_ = std::max(max_window, min_window_);
+    window_ = min_window_;
+}
+
+int credit_controller::flow(int credit, int64_t now) {
+    // Batch credit into one flow per half window rather than one per delivery
+    if (credit * 2 > window_) return 0;
+    if (!probing_) {
+        // The first delivery beyond the current credit times the round trip
+        probing_ = true;
+        probe_limit_ = received_ + credit;
+        probe_time_ = now;
+    }
+    return window_ - credit;
+}
+
+void credit_controller::delivered(int64_t now) {
+    ++received_;
+    if (probing_ && received_ > probe_limit_) {
+        probing_ = false;
+        int64_t sample = std::max(now - probe_time_, int64_t(0));
+        // Follow a falling round trip at once, a rising one slowly: samples
+        // are stretched when the sender had nothing to send.
+        rtt_ = (rtt_ < 0 || sample < rtt_) ? sample : rtt_ + (sample - rtt_) / 8;
+    }
+    if (round_start_ < 0) round_start_ = now;
+    if (++round_received_ >= window_) end_round(now);
+}
+
+void credit_controller::end_round(int64_t now) {
+    int64_t elapsed = std::max(now - round_start_, int64_t(0));
+    if (round_handling_ > 0 && round_handling_ * 2 >= elapsed) {
+        // Handler bound: keep enough credit to cover a round trip at the
+        // handler's rate, shedding a quarter of the window per round.
+        int64_t needed = 2 * (std::max(rtt_, int64_t(0)) * round_received_ / round_handling_ + 1);
+        if (needed < window_) window_ = std::max(int64_t(window_ - window_ / 4), needed);
+    } else if (rtt_ >= 0 && elapsed <= 2 * rtt_ + 1) {
+        // Credit bound: the window was used up within a round trip or so
+        window_ = std::min(window_ * 2, max_window_);
+    }
+    window_ = std::max(std::min(window_, max_window_), min_window_);
+    round_start_ = -1;
+    round_handling_ = 0;
+    round_received_ = 0;
+}
+
 session_context& session_context::get(pn_session_t* s) {
     return ref<session_context>(id(pn_session_attachments(s), SESSION_CONTEXT));
 }
@@ -118,6 +118,47 @@ class listener_context : public context {
     internal::pn_unique_ptr<const connection_options> connection_options_;
 };
 
+// Adaptive credit window for a receiver, see receiver_options::max_credit_window.
+//
+// The window is resized once per round, a round being a window's worth of
+// deliveries. A round that takes no longer than a couple of round trips
+// means the sender is waiting on credit, so the window doubles. A round
+// that is mostly spent in the handler means the application is the
+// bottleneck, so the window shrinks towards the credit needed to cover one
+// round trip at the handler's rate. Times are in milliseconds.
+class credit_controller {
+  public:
+    credit_controller();
+
+    void enable(int min_window, int max_window);
+    bool enabled() const { return max_window_ > 0; }
+    int window() const { return window_; }
+    int64_t round_trip() const { return rtt_; }
+
+    // Credit to add with credit outstanding, 0 if it is not yet low enough
+    // to be worth a flow.
+    int flow(int credit, int64_t now);
+    // Count a delivery that has arrived.
+    void delivered(int64_t now);
+    // Count time spent handling a delivery.
+    void handled(int64_t start, int64_t end) { round_handling_ += end - start; }
+
+  private:
+    void end_round(int64_t now);
+
+    int min_window_;
+    int max_window_;
+    int window_;
+    uint64_t received_;
+    uint64_t probe_limit_;      // Deliveries beyond this were sent after probe_time_
+    int64_t probe_time_;
+    bool probing_;
+    int64_t rtt_;               // -1 until measured
+    int64_t round_start_;
+    int64_t round_handling_;
+    int round_received_;
+};
+
 class link_context : public context {
   public:
     link_context() : handler(0), credit_window(10), pending_credit(0), auto_accept(true), auto_settle(true), draining(false) {}
@@ -125,6 +166,7 @@ class link_context : public context {
 
     messaging_handler* handler;
     int credit_window;
+    credit_controller credit;
     uint32_t pending_credit;
     bool auto_accept;
     bool auto_settle;
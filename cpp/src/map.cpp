@@ -191,6 +191,14 @@ void map<K,T>::reset(pn_data_t *d) {
     // would forcibly decode message maps immediately, we want to decode on-demand.
 }
 
+// Write back entries that were read or changed through the cache. A map that
+// was never cached is left alone, so its pn_data_t (and any encoded copy the
+// message keeps of it) is not touched.
+template <class K, class T>
+void map<K,T>::flush_changes() const {
+    if (map_.get() && !map_->empty()) flush();
+}
+
 template <class K, class T>
 PN_CPP_EXTERN proton::codec::decoder& operator>>(proton::codec::decoder& d, map<K,T>& m)
 {
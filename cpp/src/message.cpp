@@ -37,7 +37,6 @@
 
 #include <string>
 #include <algorithm>
-#include <assert.h>
 
 namespace proton {
 
@@ -60,11 +59,13 @@ struct message::impl {
         instructions.clear();
     }
 
-    // Encode cached maps to the pn_data_t, always used an empty() value for an empty map
+    // Encode cached maps to the pn_data_t, always used an empty() value for an empty map.
+    // Maps that were not used keep their pn_data_t, so the message can copy
+    // their sections as they were decoded.
     void flush() {
-        if (!properties.empty()) properties.value();
-        if (!annotations.empty()) annotations.value();
-        if (!instructions.empty()) instructions.value();
+        properties.flush_changes();
+        annotations.flush_changes();
+        instructions.flush_changes();
     }
 };
 
@@ -126,12 +127,18 @@ namespace {
 void check(int err) {
     if (err) throw error(error_str(err));
 }
+
+// Decode a section that decode() left for later, throw if it is malformed
+pn_message_t* loaded(pn_message_t* m, pni_section_t section) {
+    check(pni_message_check_sections(m, PNI_SECTION_BIT(section)));
+    return m;
+}
 } // namespace
 
 void message::id(const message_id& id) { pn_message_set_id(pn_msg(), id.atom_); }
 
 message_id message::id() const {
-    return pn_message_get_id(pn_msg());
+    return pn_message_get_id(loaded(pn_msg(), PNI_SECTION_PROPERTIES));
 }
 
 void message::user(const std::string &id) {
@@ -139,7 +146,7 @@ void message::user(const std::string &id) {
 }
 
 std::string message::user() const {
-    return str(pn_message_get_user_id(pn_msg()));
+    return str(pn_message_get_user_id(loaded(pn_msg(), PNI_SECTION_PROPERTIES)));
 }
 
 void message::to(const std::string &addr) {
@@ -147,7 +154,7 @@ void message::to(const std::string &addr) {
 }
 
 std::string message::to() const {
-    const char* addr = pn_message_get_address(pn_msg());
+    const char* addr = pn_message_get_address(loaded(pn_msg(), PNI_SECTION_PROPERTIES));
     return addr ? std::string(addr) : std::string();
 }
 
@@ -156,7 +163,7 @@ void message::address(const std::string &addr) {
 }
 
 std::string message::address() const {
-  const char* addr = pn_message_get_address(pn_msg());
+  const char* addr = pn_message_get_address(loaded(pn_msg(), PNI_SECTION_PROPERTIES));
   return addr ? std::string(addr) : std::string();
 }
 
@@ -165,7 +172,7 @@ void message::subject(const std::string &s) {
 }
 
 std::string message::subject() const {
-    const char* s = pn_message_get_subject(pn_msg());
+    const char* s = pn_message_get_subject(loaded(pn_msg(), PNI_SECTION_PROPERTIES));
     return s ? std::string(s) : std::string();
 }
 
@@ -174,7 +181,7 @@ void message::reply_to(const std::string &s) {
 }
 
 std::string message::reply_to() const {
-    const char* s = pn_message_get_reply_to(pn_msg());
+    const char* s = pn_message_get_reply_to(loaded(pn_msg(), PNI_SECTION_PROPERTIES));
     return s ? std::string(s) : std::string();
 }
 
@@ -183,7 +190,7 @@ void message::correlation_id(const message_id& id) {
 }
 
 message_id message::correlation_id() const {
-    return pn_message_get_correlation_id(pn_msg());
+    return pn_message_get_correlation_id(loaded(pn_msg(), PNI_SECTION_PROPERTIES));
 }
 
 void message::content_type(const std::string &s) {
@@ -191,7 +198,7 @@ void message::content_type(const std::string &s) {
 }
 
 std::string message::content_type() const {
-    const char* s = pn_message_get_content_type(pn_msg());
+    const char* s = pn_message_get_content_type(loaded(pn_msg(), PNI_SECTION_PROPERTIES));
     return s ? std::string(s) : std::string();
 }
 
@@ -200,7 +207,7 @@ void message::content_encoding(const std::string &s) {
 }
 
 std::string message::content_encoding() const {
-    const char* s = pn_message_get_content_encoding(pn_msg());
+    const char* s = pn_message_get_content_encoding(loaded(pn_msg(), PNI_SECTION_PROPERTIES));
     return s ? std::string(s) : std::string();
 }
 
@@ -208,14 +215,14 @@ void message::expiry_time(timestamp t) {
     pn_message_set_expiry_time(pn_msg(), t.milliseconds());
 }
 timestamp message::expiry_time() const {
-    return timestamp(pn_message_get_expiry_time(pn_msg()));
+    return timestamp(pn_message_get_expiry_time(loaded(pn_msg(), PNI_SECTION_PROPERTIES)));
 }
 
 void message::creation_time(timestamp t) {
     pn_message_set_creation_time(pn_msg(), t.milliseconds());
 }
 timestamp message::creation_time() const {
-    return timestamp(pn_message_get_creation_time(pn_msg()));
+    return timestamp(pn_message_get_creation_time(loaded(pn_msg(), PNI_SECTION_PROPERTIES)));
 }
 
 void message::group_id(const std::string &s) {
@@ -223,7 +230,7 @@ void message::group_id(const std::string &s) {
 }
 
 std::string message::group_id() const {
-    const char* s = pn_message_get_group_id(pn_msg());
+    const char* s = pn_message_get_group_id(loaded(pn_msg(), PNI_SECTION_PROPERTIES));
     return s ? std::string(s) : std::string();
 }
 
@@ -232,59 +239,59 @@ void message::reply_to_group_id(const std::string &s) {
 }
 
 std::string message::reply_to_group_id() const {
-    const char* s = pn_message_get_reply_to_group_id(pn_msg());
+    const char* s = pn_message_get_reply_to_group_id(loaded(pn_msg(), PNI_SECTION_PROPERTIES));
     return s ? std::string(s) : std::string();
 }
 
-bool message::inferred() const { return pn_message_is_inferred(pn_msg()); }
+bool message::inferred() const { return pn_message_is_inferred(loaded(pn_msg(), PNI_SECTION_BODY)); }
 
 void message::inferred(bool b) { pn_message_set_inferred(pn_msg(), b); }
 
 void message::body(const value& x) { body() = x; }
 
-const value& message::body() const { return impl().body; }
-value& message::body() { return impl().body; }
+// Sections are decoded when first used, see decode()
+
+const value& message::body() const { loaded(pn_msg(), PNI_SECTION_BODY); return impl().body; }
+value& message::body() { loaded(pn_msg(), PNI_SECTION_BODY); return impl().body; }
 
 message::property_map& message::properties() {
+    loaded(pn_msg(), PNI_SECTION_APPLICATION_PROPERTIES);
     return impl().properties;
 }
 
 const message::property_map& message::properties() const {
+    loaded(pn_msg(), PNI_SECTION_APPLICATION_PROPERTIES);
     return impl().properties;
 }
 
 message::annotation_map& message::message_annotations() {
+    loaded(pn_msg(), PNI_SECTION_MESSAGE_ANNOTATIONS);
     return impl().annotations;
 }
 
 const message::annotation_map& message::message_annotations() const {
+    loaded(pn_msg(), PNI_SECTION_MESSAGE_ANNOTATIONS);
     return impl().annotations;
 }
 
 message::annotation_map& message::delivery_annotations() {
+    loaded(pn_msg(), PNI_SECTION_DELIVERY_ANNOTATIONS);
     return impl().instructions;
 }
 
 const message::annotation_map& message::delivery_annotations() const {
+    loaded(pn_msg(), PNI_SECTION_DELIVERY_ANNOTATIONS);
     return impl().instructions;
 }
 
 void message::encode(std::vector<char> &s) const {
     impl().flush();
-    size_t sz = std::max(s.capacity(), size_t(512));
-    while (true) {
-        s.resize(sz);
-        assert(!s.empty());
-        int err = pn_message_encode(pn_msg(), const_cast<char*>(&s[0]), &sz);
-        if (err) {
-            if (err != PN_OVERFLOW)
-                check(err);
-        } else {
-            s.resize(sz);
-            return;
-        }
-        sz *= 2;
-    }
+    ssize_t sz = pni_message_encoded_size(pn_msg());
+    if (sz < 0) check(int(sz));
+    s.resize(std::max(size_t(sz), size_t(1)));
+    sz = pni_message_encode_prepared(pn_msg(), &s[0], s.size());
+    if (sz < 0) check(int(sz));
+    s.resize(sz);
 }
 
 std::vector<char> message::encode() const {
@@ -297,25 +304,48 @@ void message::decode(const std::vector<char> &s) {
     if (s.empty())
         throw error("message decode: no data");
     impl().clear();
-    check(pn_message_decode(pn_msg(), &s[0], s.size()));
+    check(pn_message_decode_lazy(pn_msg(), &s[0], s.size()));
+}
+
+namespace internal {
+
+void factory<message>::send(const message& msg, pn_link_t *sender) {
+    msg.impl().flush();
+    ssize_t sz = pni_message_send_direct(msg.pn_msg(), sender);
+    if (sz < 0) check(int(sz));
+}
+
+// Decodes without copying the data out of the delivery first
+void factory<message>::decode(message& msg, pn_delivery_t *dlv) {
+    pn_bytes_t bytes = pn_delivery_bytes_view(dlv);
+    if (!bytes.size)
+        throw error("message decode: no delivery pending on link");
+    msg.impl().clear();
+    check(pn_message_decode_lazy(msg.pn_msg(), bytes.start, bytes.size));
+}
+
+void factory<message>::trim(message& msg) {
+    if (msg.pn_msg_ && pni_message_trim(msg.pn_msg_)) msg.impl().clear();
+}
+
 }
 
-bool message::durable() const { return pn_message_is_durable(pn_msg()); }
+bool message::durable() const { return pn_message_is_durable(loaded(pn_msg(), PNI_SECTION_HEADER)); }
 void message::durable(bool b) { pn_message_set_durable(pn_msg(), b); }
 
-duration message::ttl() const { return duration(pn_message_get_ttl(pn_msg())); }
+duration message::ttl() const { return duration(pn_message_get_ttl(loaded(pn_msg(), PNI_SECTION_HEADER))); }
 void message::ttl(duration d) { pn_message_set_ttl(pn_msg(), d.milliseconds()); }
 
-uint8_t message::priority() const { return pn_message_get_priority(pn_msg()); }
+uint8_t message::priority() const { return pn_message_get_priority(loaded(pn_msg(), PNI_SECTION_HEADER)); }
 void message::priority(uint8_t d) { pn_message_set_priority(pn_msg(), d); }
 
-bool message::first_acquirer() const { return pn_message_is_first_acquirer(pn_msg()); }
+bool message::first_acquirer() const { return pn_message_is_first_acquirer(loaded(pn_msg(), PNI_SECTION_HEADER)); }
 void message::first_acquirer(bool b) { pn_message_set_first_acquirer(pn_msg(), b); }
 
-uint32_t message::delivery_count() const { return pn_message_get_delivery_count(pn_msg()); }
+uint32_t message::delivery_count() const { return pn_message_get_delivery_count(loaded(pn_msg(), PNI_SECTION_HEADER)); }
 void message::delivery_count(uint32_t d) { pn_message_set_delivery_count(pn_msg(), d); }
 
-int32_t message::group_sequence() const { return pn_message_get_group_sequence(pn_msg()); }
+int32_t message::group_sequence() const { return pn_message_get_group_sequence(loaded(pn_msg(), PNI_SECTION_PROPERTIES)); }
 void message::group_sequence(int32_t d) { pn_message_set_group_sequence(pn_msg(), d); }
 
 const uint8_t message::default_priority = PN_DEFAULT_PRIORITY;
@@ -24,6 +24,8 @@
 #include <fstream>
 #include <streambuf>
 #include <iosfwd>
+#include <algorithm>
+#include <vector>
 
 namespace {
 
@@ -194,6 +196,42 @@ void test_message_reuse() {
     ASSERT_EQUAL(value("b"), m1.properties().get("a"));
 }
 
+void test_message_pass_through() {
+    // A body that message::encode would encode as str8
+    const char body[] = "\x00\x53\x77\xb1\x00\x00\x00\x05hello";
+    const size_t body_size = sizeof(body) - 1;
+    message m;
+    m.decode(std::vector<char>(body, body + body_size));
+    ASSERT_EQUAL(value("hello"), m.body());
+    m.ttl(duration(1000));
+
+    // Copies and unchanged sections keep the received encoding
+    message m2 = m;
+    std::vector<char> bytes = m2.encode();
+    ASSERT(bytes.size() > body_size);
+    ASSERT(std::equal(body, body + body_size, bytes.end() - body_size));
+    ASSERT_EQUAL(duration(1000), m2.ttl());
+
+    m2.body("hello");
+    bytes = m2.encode();
+    ASSERT_EQUAL('\xa1', bytes[bytes.size() - 7]);
+}
+
+void test_message_malformed() {
+    // An array8 body with an invalid element constructor
+    const char body[] = "\x00\x53\x77\xe0\x03\x01\xff\x00";
+    const size_t body_size = sizeof(body) - 1;
+    message m;
+    m.decode(std::vector<char>(body, body + body_size));
+    ASSERT_EQUAL(std::string(), m.to()); // Other sections are still usable
+    ASSERT_THROWS(proton::error, m.body());
+    ASSERT_THROWS(proton::error, m.body()); // Not only the first time
+    ASSERT_THROWS(proton::error, m.inferred());
+
+    m.clear();
+    ASSERT(m.body().empty());
+}
+
 void test_message_print() {
   message m("hello");
   m.to("to");
@@ -216,6 +254,8 @@ int main(int, char**) {
     RUN_TEST(failed, test_message_body());
     RUN_TEST(failed, test_message_maps());
     RUN_TEST(failed, test_message_reuse());
+    RUN_TEST(failed, test_message_pass_through());
+    RUN_TEST(failed, test_message_malformed());
     RUN_TEST(failed, test_message_print());
     return failed;
 }
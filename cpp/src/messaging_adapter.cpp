@@ -31,11 +31,11 @@
 #include "proton/sender.hpp"
 #include "proton/sender_options.hpp"
 #include "proton/session.hpp"
+#include "proton/timestamp.hpp"
 #include "proton/tracker.hpp"
 #include "proton/transport.hpp"
 
 #include "contexts.hpp"
-#include "msg.hpp"
 #include "proton_bits.hpp"
 
 #include <proton/connection.h>
@@ -54,7 +54,13 @@ namespace {
 // This must only be called for receiver links
 void credit_topup(pn_link_t *link) {
     assert(pn_link_is_receiver(link));
-    int window = link_context::get(link).credit_window;
+    link_context& lctx = link_context::get(link);
+    if (lctx.credit.enabled()) {
+        int delta = lctx.credit.flow(pn_link_credit(link), timestamp::now().milliseconds());
+        if (delta > 0) pn_link_flow(link, delta);
+        return;
+    }
+    int window = lctx.credit_window;
     if (window) {
         int delta = window - pn_link_credit(link);
         pn_link_flow(link, delta);
@@ -92,21 +98,6 @@ void on_link_flow(messaging_handler& handler, pn_event_t* event) {
     }
 }
 
-// Decode the message corresponding to a delivery from a link.
-void message_decode(message& msg, proton::delivery delivery) {
-    std::vector<char> buf;
-    buf.resize(pn_delivery_pending(unwrap(delivery)));
-    if (buf.empty())
-        throw error("message decode: no delivery pending on link");
-    proton::receiver link = delivery.receiver();
-    assert(!buf.empty());
-    ssize_t n = pn_link_recv(unwrap(link), const_cast<char *>(&buf[0]), buf.size());
-    if (n != ssize_t(buf.size())) throw error(MSG("receiver read failure"));
-    msg.clear();
-    msg.decode(buf);
-    pn_link_advance(unwrap(link));
-}
-
 void on_delivery(messaging_handler& handler, pn_event_t* event) {
     pn_link_t *lnk = pn_event_link(event);
     pn_delivery_t *dlv = pn_event_delivery(event);
@@ -122,12 +113,17 @@ void on_delivery(messaging_handler& handler, pn_event_t* event) {
             // Avoid expensive heap malloc/free overhead.
             // See PROTON-998
             class message &msg(ctx.event_message);
-            message_decode(msg, d);
+            internal::factory<message>::decode(msg, dlv);
+            pn_link_advance(lnk);
             if (pn_link_state(lnk) & PN_LOCAL_CLOSED) {
                 if (lctx.auto_accept)
                     d.release();
             } else {
+                bool adaptive = lctx.credit.enabled();
+                int64_t start = adaptive ? timestamp::now().milliseconds() : 0;
+                if (adaptive) lctx.credit.delivered(start);
                 handler.on_message(d, msg);
+                if (adaptive) lctx.credit.handled(start, timestamp::now().milliseconds());
                 if (lctx.auto_accept && pn_delivery_local_state(dlv) == 0) // Not set by handler
                     d.accept();
                 if (lctx.draining && !pn_link_credit(lnk)) {
@@ -136,6 +132,8 @@ void on_delivery(messaging_handler& handler, pn_event_t* event) {
                     handler.on_receiver_drain_finish(r);
                 }
             }
+            // Don't keep a large message's memory for the rest of the connection
+            internal::factory<message>::trim(msg);
         }
         else if (pn_delivery_updated(dlv) && d.settled()) {
             handler.on_delivery_settle(d);
@@ -248,6 +246,8 @@ void on_session_remote_open(messaging_handler& handler, pn_event_t* event) {
 void on_link_local_open(messaging_handler& handler, pn_event_t* event) {
     pn_link_t* lnk = pn_event_link(event);
     if ( pn_link_is_receiver(lnk) ) {
+        // on_delivery decodes each message and advances, so it can be read in place
+        pn_link_set_input_view(lnk, true);
         credit_topup(lnk);
     // We know local is active so don't check for it
     } else if ( pn_link_state(lnk)&PN_REMOTE_ACTIVE && pn_link_credit(lnk) > 0) {
@@ -122,22 +122,45 @@ bool container::impl::connection_work_queue::add(work f) {
 
 class container::impl::container_work_queue : public common_work_queue {
   public:
-    container_work_queue(container::impl& c): common_work_queue(c) {}
+    container_work_queue(container::impl& c): common_work_queue(c), ready_(false), busy_(false) {}
     ~container_work_queue() { container_.remove_work_queue(this); }
 
     bool add(work f);
+    bool run_ready();
+
+    bool ready_; // On the container's ready list or running
+    bool busy_;  // Taken off the ready list to run, guarded by the container's work_queues_lock_
 };
 
 bool container::impl::container_work_queue::add(work f) {
     // Note this is an unbounded work queue.
     // A resource-safe implementation should be bounded.
-    GUARD(lock_);
-    if (finished_) return false;
-    jobs_.push_back(f);
-    pn_proactor_set_timeout(container_.proactor_, 0);
+    {
+        GUARD(lock_);
+        if (finished_) return false;
+        jobs_.push_back(f);
+        if (ready_) return true;
+        ready_ = true;
+    }
+    container_.work_queue_ready(this);
     return true;
 }
 
+// Run the queued jobs, return true if more were added in the meantime
+bool container::impl::container_work_queue::run_ready() {
+    try {
+        run_all_jobs();
+    } catch (...) {
+        // Not on the ready list, so let the next add() put it back
+        GUARD(lock_);
+        ready_ = false;
+        throw;
+    }
+    GUARD(lock_);
+    ready_ = !jobs_.empty();
+    return ready_;
+}
+
 class work_queue::impl* container::impl::make_work_queue(container& c) {
     return c.impl_->add_work_queue();
 }
@@ -158,9 +181,90 @@ container::impl::container_work_queue* container::impl::add_work_queue() {
     return c;
 }
 
+// Don't return while another thread is running the queue's jobs, it still
+// uses the queue afterwards. So a queue can't be destroyed by its own jobs.
 void container::impl::remove_work_queue(container::impl::container_work_queue* l) {
-    GUARD(work_queues_lock_);
+#if PN_CPP_SUPPORTS_THREADS
+    std::unique_lock<std::mutex> g(work_queues_lock_);
+    while (l->busy_) work_queue_idle_.wait(g);
+#endif
     work_queues_.erase(l);
+    ready_work_queues_.erase(
+        std::remove(ready_work_queues_.begin(), ready_work_queues_.end(), l),
+        ready_work_queues_.end());
+}
+
+// Container work queues are not tied to a connection, so the proactor timeout
+// wakes a thread to run them. Each queue is on the ready list at most once
+// and only the thread that takes it off runs it, so a queue's jobs are
+// serialised while different queues run on different threads at once.
+void container::impl::work_queue_ready(container_work_queue* q) {
+    bool wake;
+    {
+        GUARD(work_queues_lock_);
+        wake = ready_work_queues_.empty();
+        ready_work_queues_.push_back(q);
+    }
+    if (wake) wake_work_queues();
+}
+
+bool container::impl::work_queues_ready() {
+    GUARD(work_queues_lock_);
+    return !ready_work_queues_.empty();
+}
+
+void container::impl::wake_work_queues() {
+    GUARD(deferred_lock_);
+    pn_proactor_set_timeout(proactor_, 0);
+}
+
+void container::impl::run_work_queues() {
+    // Run the queues that are ready now, each once, so this thread gets back
+    // to the proactor even if the queues stay busy.
+    size_t n;
+    {
+        GUARD(work_queues_lock_);
+        n = ready_work_queues_.size();
+    }
+    for (size_t i = 0; i < n; ++i) {
+        container_work_queue* q;
+        bool more;
+        {
+            GUARD(work_queues_lock_);
+            if (ready_work_queues_.empty()) return;
+            q = ready_work_queues_.front();
+            ready_work_queues_.pop_front();
+            more = !ready_work_queues_.empty();
+            q->busy_ = true;
+        }
+        // Wake another thread to share the rest
+        if (i == 0 && more) wake_work_queues();
+        run_work_queue(q);
+    }
+    // Don't strand queues that became ready while we were running
+    if (work_queues_ready()) wake_work_queues();
+}
+
+// The queue stays busy, so it can't be removed, until it is back on the
+// ready list or finished with.
+void container::impl::run_work_queue(container_work_queue* q) {
+    bool more = false;
+    try {
+        more = q->run_ready();
+    } catch (...) {
+        GUARD(work_queues_lock_);
+        q->busy_ = false;
+#if PN_CPP_SUPPORTS_THREADS
+        work_queue_idle_.notify_all();
+#endif
+        throw;
+    }
+    GUARD(work_queues_lock_);
+    q->busy_ = false;
+    if (more) ready_work_queues_.push_back(q);
+#if PN_CPP_SUPPORTS_THREADS
+    work_queue_idle_.notify_all();
+#endif
 }
 
 void container::impl::setup_connection_lh(const url& url, pn_connection_t *pnc) {
@@ -438,9 +542,11 @@ void container::impl::schedule(duration delay, work f) {
     deferred_.push_back(s);
     std::push_heap(deferred_.begin(), deferred_.end());
 
-    // Set timeout for current head of timeout queue
+    // Set timeout for current head of timeout queue, unless it would delay
+    // the wake for ready work queues
     scheduled* next = &deferred_.front();
     pn_millis_t timeout_ms = (now < next->time) ? (next->time-now).milliseconds() : 0;
+    if (timeout_ms && work_queues_ready()) timeout_ms = 0;
     pn_proactor_set_timeout(proactor_, timeout_ms);
 }
 
@@ -483,7 +589,7 @@ void container::impl::run_timer_jobs() {
             // Is the next task in the future?
             timestamp next_time = deferred_.front().time;
             if ( next_time>now ) {
-                pn_proactor_set_timeout(proactor_, (next_time-now).milliseconds());
+                pn_proactor_set_timeout(proactor_, work_queues_ready() ? 0 : (next_time-now).milliseconds());
                 break;
             }
 
@@ -542,18 +648,9 @@ container::impl::dispatch_result container::impl::dispatch(pn_event_t* event) {
         // Can get an immediate timeout, if we have a container event loop inject
         run_timer_jobs();
 
-        // Run every container event loop job
-        // This is not at all efficient and single threads all these jobs, but it does correctly
-        // serialise them
-        work_queues queues;
-        {
-            GUARD(work_queues_lock_);
-            queues = work_queues_;
-        }
-        for (work_queues::iterator queue = queues.begin(); queue!=queues.end(); ++queue) {
-            (*queue)->run_all_jobs();
-        }
-        return EndBatch;
+        // Run the ready container work queues once the batch is done, so the
+        // next timeout can wake another thread to run more of them
+        return RunWorkQueues;
     }
     case PN_LISTENER_OPEN: {
         pn_listener_t* l = pn_event_listener(event);
@@ -704,19 +801,26 @@ void container::impl::thread() {
         pn_event_batch_t *events = pn_proactor_wait(proactor_);
         pn_event_t *e;
         error_condition error;
+        bool run_work = false;
         try {
             while ((e = pn_event_batch_next(events))) {
                 dispatch_result r = dispatch(e);
                 finished = r==EndLoop;
+                run_work = r==RunWorkQueues;
                 if (r!=ContinueLoop) break;
             }
+            if (run_work) {
+                pn_proactor_done(proactor_, events);
+                events = 0;
+                run_work_queues();
+            }
         } catch (const std::exception& e) {
             // If we caught an exception then shutdown the (other threads of the) container
             error = error_condition("exception", e.what());
         } catch (...) {
             error = error_condition("exception", "container shut-down by unknown exception");
         }
-        pn_proactor_done(proactor_, events);
+        if (events) pn_proactor_done(proactor_, events);
         if (!error.empty()) {
             finished = true;
             {
@@ -37,6 +37,7 @@
 
 #include "proton_bits.hpp"
 
+#include <deque>
 #include <list>
 #include <map>
 #include <set>
@@ -44,6 +45,7 @@
 #include <vector>
 
 #if PN_CPP_SUPPORTS_THREADS
+#include <condition_variable>
 #include <mutex>
 # define MUTEX(x) std::mutex x;
 # define GUARD(x) std::lock_guard<std::mutex> g(x)
@@ -111,7 +113,7 @@ class container::impl {
 
     // Event loop to run in each container thread
     void thread();
-    enum dispatch_result {ContinueLoop, EndBatch, EndLoop};
+    enum dispatch_result {ContinueLoop, EndBatch, EndLoop, RunWorkQueues};
     dispatch_result dispatch(pn_event_t*);
     void run_timer_jobs();
 
@@ -126,9 +128,18 @@ class container::impl {
 
     typedef std::set<container_work_queue*> work_queues;
     work_queues work_queues_;
+    std::deque<container_work_queue*> ready_work_queues_; // Queues with jobs, each listed once
     MUTEX(work_queues_lock_)
+#if PN_CPP_SUPPORTS_THREADS
+    std::condition_variable work_queue_idle_; // A queue's jobs have stopped running
+#endif
     container_work_queue* add_work_queue();
     void remove_work_queue(container_work_queue*);
+    void work_queue_ready(container_work_queue*);
+    bool work_queues_ready();
+    void wake_work_queues();
+    void run_work_queues();
+    void run_work_queue(container_work_queue*);
 
     struct scheduled {
         timestamp time; // duration from epoch for task
@@ -122,6 +122,18 @@ public:
     static typename wrapped<T>::type* unwrap(const T& t) { return t.pn_object(); }
 };
 
+// message is not a wrapper, this gives the library its no-copy send and receive
+template <>
+class factory<message> {
+public:
+    // Encode straight into the current delivery of a sender link
+    static void send(const message&, pn_link_t*);
+    // Decode the complete message held by a delivery, without consuming it
+    static void decode(message&, pn_delivery_t*);
+    // Clear a message that is reused to receive if it holds a large one
+    static void trim(message&);
+};
+
 template <class T> struct context {};
 template <> struct context<link> {typedef link_context type; };
 template <> struct context<receiver> {typedef link_context type; };
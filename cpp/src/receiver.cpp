@@ -83,6 +83,11 @@ void receiver::drain() {
     }
 }
 
+int receiver::credit_window() const {
+    link_context &ctx = link_context::get(pn_object());
+    return ctx.credit.enabled() ? ctx.credit.window() : ctx.credit_window;
+}
+
 receiver_iterator receiver_iterator::operator++() {
     if (!!obj_) {
         pn_link_t *lnk = pn_link_next(obj_.pn_object(), 0);
@@ -67,6 +67,7 @@ class receiver_options::impl {
     option<bool> auto_accept;
     option<bool> auto_settle;
     option<int> credit_window;
+    option<int> max_credit_window;
     option<bool> dynamic_address;
     option<source_options> source;
     option<target_options> target;
@@ -80,6 +81,9 @@ class receiver_options::impl {
             if (auto_settle.set) get_context(r).auto_settle = auto_settle.value;
             if (auto_accept.set) get_context(r).auto_accept = auto_accept.value;
             if (credit_window.set) get_context(r).credit_window = credit_window.value;
+            int window = get_context(r).credit_window;
+            if (max_credit_window.set && window > 0 && max_credit_window.value > window)
+                get_context(r).credit.enable(window, max_credit_window.value);
 
             if (source.set) {
                 proton::source local_s(make_wrapper<proton::source>(pn_link_source(unwrap(r))));
@@ -98,6 +102,7 @@ class receiver_options::impl {
         auto_accept.update(x.auto_accept);
         auto_settle.update(x.auto_settle);
         credit_window.update(x.credit_window);
+        max_credit_window.update(x.max_credit_window);
         dynamic_address.update(x.dynamic_address);
         source.update(x.source);
         target.update(x.target);
@@ -123,6 +128,7 @@ receiver_options& receiver_options::handler(class messaging_handler &h) { impl_-
 receiver_options& receiver_options::delivery_mode(proton::delivery_mode m) {impl_->delivery_mode = m; return *this; }
 receiver_options& receiver_options::auto_accept(bool b) {impl_->auto_accept = b; return *this; }
 receiver_options& receiver_options::credit_window(int w) {impl_->credit_window = w; return *this; }
+receiver_options& receiver_options::max_credit_window(int w) {impl_->max_credit_window = w; return *this; }
 receiver_options& receiver_options::source(source_options &s) {impl_->source = s; return *this; }
 receiver_options& receiver_options::target(target_options &s) {impl_->target = s; return *this; }
 receiver_options& receiver_options::name(const std::string &s) {impl_->name = s; return *this; }
@@ -0,0 +1,187 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Measure the cost of proton::sender::send.
+//
+// A sender and a receiver are connected in memory by a pair of
+// connection_drivers. The sender sends pre-settled messages as fast as
+// its credit allows, and the time spent inside sender::send is reported
+// separately from the total time, which includes transferring and
+// receiving the messages.
+
+#include "proton/connection.hpp"
+#include "proton/connection_options.hpp"
+#include "proton/delivery_mode.hpp"
+#include "proton/io/connection_driver.hpp"
+#include "proton/message.hpp"
+#include "proton/message_id.hpp"
+#include "proton/messaging_handler.hpp"
+#include "proton/receiver_options.hpp"
+#include "proton/sender.hpp"
+#include "proton/sender_options.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+
+#include <time.h>
+
+namespace {
+
+using namespace proton;
+using proton::io::connection_driver;
+
+typedef std::deque<char> byte_stream;
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct in_memory_driver : public connection_driver {
+    byte_stream& reads;
+    byte_stream& writes;
+
+    in_memory_driver(byte_stream& rd, byte_stream& wr) : reads(rd), writes(wr) {}
+
+    void process() {
+        dispatch();
+        io::mutable_buffer rbuf = read_buffer();
+        size_t size = std::min(reads.size(), rbuf.size);
+        if (size) {
+            std::copy(reads.begin(), reads.begin()+size, static_cast<char*>(rbuf.data));
+            read_done(size);
+            reads.erase(reads.begin(), reads.begin()+size);
+        }
+        io::const_buffer wbuf = write_buffer();
+        if (wbuf.size) {
+            writes.insert(writes.end(),
+                          static_cast<const char*>(wbuf.data),
+                          static_cast<const char*>(wbuf.data) + wbuf.size);
+            write_done(wbuf.size);
+        }
+        dispatch();
+    }
+};
+
+struct send_handler : public messaging_handler {
+    long total;
+    long sent;
+    message msg;
+    double sending;
+
+    send_handler(long n, size_t body_size) : total(n), sent(0), sending(0) {
+        msg.address("examples");
+        msg.subject("sendbench");
+        msg.body(binary(std::string(body_size, 'x')));
+    }
+
+    void on_connection_open(connection& c) {
+        c.open_sender("examples", sender_options().delivery_mode(delivery_mode::AT_MOST_ONCE));
+    }
+
+    void on_sendable(sender& s) {
+        double start = now();
+        while (s.credit() > 0 && sent < total) {
+            msg.id(message_id(uint64_t(sent)));
+            s.send(msg);
+            ++sent;
+        }
+        sending += now() - start;
+    }
+};
+
+struct receive_handler : public messaging_handler {
+    long received;
+    int credit;
+
+    receive_handler(int credit_window) : received(0), credit(credit_window) {}
+
+    void on_receiver_open(receiver& r) {
+        r.open(receiver_options().credit_window(credit));
+    }
+
+    void on_message(delivery&, message&) { ++received; }
+};
+
+const long default_messages = 1000000;
+const size_t default_body = 64;
+const int default_credit = 1000;
+
+void usage(const char **argv, const char **arg) {
+    std::cerr << "usage: " << argv[0] << " [options]\n"
+              << "  -messages MESSAGES: messages to send (default " << default_messages << ")\n"
+              << "  -body SIZE: size of the binary body (default " << default_body << ")\n"
+              << "  -credit CREDIT: receiver credit window (default " << default_credit << ")\n"
+              << "\nbad argument: " << *arg << std::endl;
+    exit(1);
+}
+
+}
+
+int main(int argc, const char* argv[]) {
+    const char **arg = argv + 1;
+    const char **end = argv + argc;
+    long messages = default_messages;
+    size_t body_size = default_body;
+    int credit = default_credit;
+
+    while (arg < end) {
+        if (!strcmp(*arg, "-messages") && ++arg < end) {
+            messages = atol(*arg);
+            if (messages <= 0) usage(argv, arg);
+        }
+        else if (!strcmp(*arg, "-body") && ++arg < end) {
+            body_size = size_t(atol(*arg));
+        }
+        else if (!strcmp(*arg, "-credit") && ++arg < end) {
+            credit = atoi(*arg);
+            if (credit <= 0) usage(argv, arg);
+        }
+        else {
+            usage(argv, arg);
+        }
+        ++arg;
+    }
+
+    send_handler sh(messages, body_size);
+    receive_handler rh(credit);
+    byte_stream ab, ba;
+    in_memory_driver a(ba, ab), b(ab, ba);
+    a.connect(connection_options().handler(sh));
+    b.accept(connection_options().handler(rh));
+
+    double start = now();
+    while (rh.received < messages) {
+        a.process();
+        b.process();
+    }
+    double elapsed = now() - start;
+    double sending = sh.sending;
+
+    std::cout << messages << " messages with " << body_size << " byte bodies: "
+              << long(sending * 1000) << " ms in sender::send, "
+              << long(messages / sending) << " sends/sec; "
+              << long(elapsed * 1000) << " ms in total, "
+              << long(messages / elapsed) << " messages/sec" << std::endl;
+    return 0;
+}
@@ -22,6 +22,7 @@
 #include "proton/sender.hpp"
 
 #include "proton/link.hpp"
+#include "proton/message.hpp"
 #include "proton/sender_options.hpp"
 #include "proton/source.hpp"
 #include "proton/target.hpp"
@@ -34,8 +35,6 @@
 #include "proton_bits.hpp"
 #include "contexts.hpp"
 
-#include <assert.h>
-
 namespace proton {
 
 sender::sender(pn_link_t *l): link(make_wrapper(l)) {}
@@ -68,10 +67,7 @@ tracker sender::send(const message &message) {
     uint64_t id = ++tag_counter;
     pn_delivery_t *dlv =
         pn_delivery(pn_object(), pn_dtag(reinterpret_cast<const char*>(&id), sizeof(id)));
-    std::vector<char> buf;
-    message.encode(buf);
-    assert(!buf.empty());
-    pn_link_send(pn_object(), &buf[0], buf.size());
+    internal::factory<class message>::send(message, pn_object());
     pn_link_advance(pn_object());
     if (pn_link_snd_settle_mode(pn_object()) == PN_SND_SETTLED)
         pn_delivery_settle(dlv);
@@ -44,10 +44,14 @@ template <class T> struct option {
 class session_options::impl {
   public:
     option<messaging_handler *> handler;
+    option<size_t> incoming_capacity;
+    option<size_t> incoming_low_water;
 
     void apply(session& s) {
         if (s.uninitialized()) {
             if (handler.set && handler.value) container::impl::set_handler(s, handler.value);
+            if (incoming_capacity.set) pn_session_set_incoming_capacity(unwrap(s), incoming_capacity.value);
+            if (incoming_low_water.set) pn_session_set_incoming_low_water(unwrap(s), incoming_low_water.value);
         }
     }
 
@@ -65,6 +69,8 @@ session_options& session_options::operator=(const session_options& x) {
 }
 
 session_options& session_options::handler(class messaging_handler &h) { impl_->handler = &h; return *this; }
+session_options& session_options::incoming_capacity(size_t n) { impl_->incoming_capacity = n; return *this; }
+session_options& session_options::incoming_low_water(size_t n) { impl_->incoming_low_water = n; return *this; }
 
 void session_options::apply(session& s) const { impl_->apply(s); }
 
@@ -0,0 +1,164 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+// Measure container work_queue throughput.
+//
+// QUEUES work queues, not tied to any connection, are kept busy: each job
+// does WORK iterations of busy work and adds the next job to its own
+// queue until JOBS have run on it. Jobs on different queues may run
+// concurrently, so the rate should scale with the container threads.
+
+#include "proton/container.hpp"
+#include "proton/work_queue.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if PN_CPP_SUPPORTS_THREADS
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <time.h>
+
+namespace {
+
+using namespace proton;
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct bench;
+
+struct busy_queue {
+    bench& b;
+    work_queue queue;
+    long remaining;
+    std::atomic<bool> running;  // Detect jobs of one queue running concurrently
+
+    busy_queue(bench& b_, container& c, long jobs) : b(b_), queue(c), remaining(jobs), running(false) {}
+
+    void job();
+};
+
+struct bench {
+    container& cont;
+    long work;
+    std::atomic<int> finished;
+    std::atomic<bool> overlapped;
+    std::vector<std::unique_ptr<busy_queue> > queues;
+
+    bench(container& c, long w) : cont(c), work(w), finished(0), overlapped(false) {}
+};
+
+void busy_queue::job() {
+    if (running.exchange(true)) b.overlapped = true;
+    volatile long spin = 0;
+    for (long i = 0; i < b.work; ++i) spin = spin + i;
+    running = false;
+    if (--remaining > 0)
+        queue.add(make_work(&busy_queue::job, this));
+    else if (++b.finished == int(b.queues.size()))
+        b.cont.stop();
+}
+
+const int default_queues = 1000;
+const long default_jobs = 1000;
+const long default_work = 1000;
+const int default_threads = 1;
+
+void usage(const char **argv, const char **arg) {
+    std::cerr << "usage: " << argv[0] << " [options]\n"
+              << "  -queues QUEUES: busy work queues (default " << default_queues << ")\n"
+              << "  -jobs JOBS: jobs run on each queue (default " << default_jobs << ")\n"
+              << "  -work WORK: busy loop iterations per job (default " << default_work << ")\n"
+              << "  -threads THREADS: container threads (default " << default_threads << ")\n"
+              << "\nbad argument: " << *arg << std::endl;
+    exit(1);
+}
+
+}
+
+int main(int argc, const char* argv[]) {
+    const char **arg = argv + 1;
+    const char **end = argv + argc;
+    int n_queues = default_queues;
+    long jobs = default_jobs;
+    long work = default_work;
+    int threads = default_threads;
+
+    while (arg < end) {
+        if (!strcmp(*arg, "-queues") && ++arg < end) {
+            n_queues = atoi(*arg);
+            if (n_queues <= 0) usage(argv, arg);
+        }
+        else if (!strcmp(*arg, "-jobs") && ++arg < end) {
+            jobs = atol(*arg);
+            if (jobs <= 0) usage(argv, arg);
+        }
+        else if (!strcmp(*arg, "-work") && ++arg < end) {
+            work = atol(*arg);
+            if (work < 0) usage(argv, arg);
+        }
+        else if (!strcmp(*arg, "-threads") && ++arg < end) {
+            threads = atoi(*arg);
+            if (threads <= 0) usage(argv, arg);
+        }
+        else {
+            usage(argv, arg);
+        }
+        ++arg;
+    }
+
+    container c("workbench");
+    c.auto_stop(false);
+    bench b(c, work);
+    for (int i = 0; i < n_queues; ++i)
+        b.queues.push_back(std::unique_ptr<busy_queue>(new busy_queue(b, c, jobs)));
+    for (int i = 0; i < n_queues; ++i)
+        b.queues[i]->queue.add(make_work(&busy_queue::job, b.queues[i].get()));
+
+    double start = now();
+    c.run(threads);
+    double elapsed = now() - start;
+
+    long total = jobs * n_queues;
+    std::cout << "threads=" << threads << ", queues=" << n_queues << ": "
+              << total << " jobs in " << long(elapsed * 1000) << " ms, "
+              << long(total / elapsed) << " jobs/sec" << std::endl;
+    if (b.overlapped) {
+        std::cerr << "jobs on one queue ran concurrently" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+#else
+
+int main(int, const char**) {
+    std::cerr << "workbench needs a C++ library built with thread support" << std::endl;
+    return 1;
+}
+
+#endif